@@ -0,0 +1,118 @@
+# CMake script to test 16-bit activation storage (--activations fp16/bf16)
+# Trains with fp16 caches, then compares fp16 and bf16 storage
+# against fp32 inference with --verify; the u8 input matrix
+# (--dataset-format u8) must train the same network as fp32
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+set(MODEL_FILE "${WORK_DIR}/test_activation_storage_model.json")
+set(U8_MODEL_FILE "${WORK_DIR}/test_activation_storage_u8_model.json")
+set(CONFIG_FILE "${CONFIG_DIR}/simple.json")
+
+message(STATUS "=== Testing Activation Storage Formats ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+# Step 1: Training with fp16 caches must classify correctly
+message(STATUS "Step 1: Training with fp16 activation storage...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${MODEL_FILE}" -t --activations fp16
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE TRAIN_RESULT
+    OUTPUT_VARIABLE TRAIN_OUTPUT
+    ERROR_VARIABLE TRAIN_ERROR
+    TIMEOUT 120
+)
+
+if(NOT TRAIN_RESULT EQUAL 0)
+    message(FATAL_ERROR "Training with fp16 storage failed with code ${TRAIN_RESULT}:\nOutput: ${TRAIN_OUTPUT}\nError: ${TRAIN_ERROR}")
+endif()
+
+if(NOT TRAIN_OUTPUT MATCHES "fp16 storage")
+    message(FATAL_ERROR "fp16 storage was not applied:\n${TRAIN_OUTPUT}")
+endif()
+message(STATUS "Training with fp16 storage passed")
+
+# Step 2: --verify compares each 16-bit format against fp32
+foreach(FORMAT fp16 bf16)
+    message(STATUS "Step 2: Verifying with ${FORMAT} storage...")
+    execute_process(
+        COMMAND "${NNETS_EXE}" -l "${MODEL_FILE}" -c "${CONFIG_FILE}" --verify --activations ${FORMAT}
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE VERIFY_RESULT
+        OUTPUT_VARIABLE VERIFY_OUTPUT
+        ERROR_VARIABLE VERIFY_ERROR
+        TIMEOUT 60
+    )
+
+    if(NOT VERIFY_RESULT EQUAL 0)
+        message(FATAL_ERROR "Verification with ${FORMAT} storage failed with code ${VERIFY_RESULT}:\nOutput: ${VERIFY_OUTPUT}\nError: ${VERIFY_ERROR}")
+    endif()
+
+    string(REGEX MATCH "Accuracy: [0-9.]+% \\(${FORMAT}\\), [0-9.]+% \\(fp32\\)" COMPARE_LINE "${VERIFY_OUTPUT}")
+    if(COMPARE_LINE STREQUAL "")
+        message(FATAL_ERROR "Verification output missing ${FORMAT} vs fp32 comparison:\n${VERIFY_OUTPUT}")
+    endif()
+
+    string(FIND "${VERIFY_OUTPUT}" "Max output difference:" DIFF_FOUND)
+    if(DIFF_FOUND EQUAL -1)
+        message(FATAL_ERROR "Verification output missing output difference:\n${VERIFY_OUTPUT}")
+    endif()
+    message(STATUS "${COMPARE_LINE}")
+endforeach()
+
+# Step 3: u8 input matrix holds the same values, so the network is identical
+message(STATUS "Step 3: Training with the u8 input matrix...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${U8_MODEL_FILE}" -t --activations fp16 --dataset-format u8
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE U8_RESULT
+    OUTPUT_VARIABLE U8_OUTPUT
+    ERROR_VARIABLE U8_ERROR
+    TIMEOUT 120
+)
+
+if(NOT U8_RESULT EQUAL 0)
+    message(FATAL_ERROR "Training with the u8 input matrix failed with code ${U8_RESULT}:\nOutput: ${U8_OUTPUT}\nError: ${U8_ERROR}")
+endif()
+
+if(NOT U8_OUTPUT MATCHES "Dataset: [0-9]+ receptors x [0-9]+ images, u8")
+    message(FATAL_ERROR "u8 input matrix was not applied:\n${U8_OUTPUT}")
+endif()
+
+file(READ "${MODEL_FILE}" FP32_MODEL)
+file(READ "${U8_MODEL_FILE}" U8_MODEL)
+if(NOT FP32_MODEL STREQUAL U8_MODEL)
+    message(FATAL_ERROR "Network trained with the u8 input matrix differs from fp32")
+endif()
+message(STATUS "u8 input matrix trained the same network")
+
+# Step 4: Unknown formats must be rejected
+foreach(BAD_OPTION "--activations;fp8" "--dataset-format;fp16")
+    execute_process(
+        COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -t ${BAD_OPTION}
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE BAD_RESULT
+        OUTPUT_VARIABLE BAD_OUTPUT
+        ERROR_VARIABLE BAD_ERROR
+        TIMEOUT 30
+    )
+
+    if(BAD_RESULT EQUAL 0)
+        message(FATAL_ERROR "Unknown format (${BAD_OPTION}) was accepted:\n${BAD_OUTPUT}")
+    endif()
+endforeach()
+
+# Cleanup
+file(REMOVE "${MODEL_FILE}" "${U8_MODEL_FILE}")
+message(STATUS "=== Activation Storage Test PASSED ===")
@@ -0,0 +1,99 @@
+# CMake script to test batch inference (--classify-batch)
+# Trains a simple model, classifies a file of inputs in one batch
+# and compares the results with per-input classification
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+set(MODEL_FILE "${WORK_DIR}/test_batch_inference_model.json")
+set(INPUT_FILE "${WORK_DIR}/test_batch_inference_inputs.txt")
+set(CONFIG_FILE "${CONFIG_DIR}/simple.json")
+
+message(STATUS "=== Testing Batch Inference ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+# Step 1: Train and save model
+message(STATUS "Step 1: Training model...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${MODEL_FILE}" -t
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE TRAIN_RESULT
+    OUTPUT_VARIABLE TRAIN_OUTPUT
+    ERROR_VARIABLE TRAIN_ERROR
+    TIMEOUT 120
+)
+
+if(NOT TRAIN_RESULT EQUAL 0)
+    message(FATAL_ERROR "Training failed with code ${TRAIN_RESULT}:\nOutput: ${TRAIN_OUTPUT}\nError: ${TRAIN_ERROR}")
+endif()
+
+# Step 2: Input file larger than one batch tile (256 inputs)
+set(INPUTS "")
+foreach(INDEX RANGE 1 200)
+    string(APPEND INPUTS "yes\nno\nmaybe\n")
+endforeach()
+file(WRITE "${INPUT_FILE}" "${INPUTS}")
+
+# Step 3: Batch classification must match per-input classification (also concurrent)
+message(STATUS "Step 3: Classifying 600 inputs in one batch...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -l "${MODEL_FILE}" --classify-batch "${INPUT_FILE}" -b -j 4
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE BATCH_RESULT
+    OUTPUT_VARIABLE BATCH_OUTPUT
+    ERROR_VARIABLE BATCH_ERROR
+    TIMEOUT 60
+)
+
+if(NOT BATCH_RESULT EQUAL 0)
+    message(FATAL_ERROR "Batch classification failed with code ${BATCH_RESULT}:\nOutput: ${BATCH_OUTPUT}\nError: ${BATCH_ERROR}")
+endif()
+
+if(NOT BATCH_OUTPUT MATCHES "Inputs: 600")
+    message(FATAL_ERROR "Batch classification did not process all inputs:\n${BATCH_OUTPUT}")
+endif()
+
+if(NOT BATCH_OUTPUT MATCHES "Mismatches vs per-input: 0")
+    message(FATAL_ERROR "Batch results differ from per-input classification:\n${BATCH_OUTPUT}")
+endif()
+
+# Per-input classification in several threads shares one plan
+if(NOT BATCH_OUTPUT MATCHES "Parallel mismatches vs batch: 0")
+    message(FATAL_ERROR "Concurrent per-input results differ from batch results:\n${BATCH_OUTPUT}")
+endif()
+
+# Training words must be classified into their own classes
+foreach(WORD yes no)
+    if(NOT BATCH_OUTPUT MATCHES "\n${WORD}\t${WORD}\t")
+        message(FATAL_ERROR "Input '${WORD}' was not classified as '${WORD}':\n${BATCH_OUTPUT}")
+    endif()
+endforeach()
+message(STATUS "Batch classification matches per-input classification")
+
+# Step 4: Missing input file must be reported
+execute_process(
+    COMMAND "${NNETS_EXE}" -l "${MODEL_FILE}" --classify-batch "${WORK_DIR}/nonexistent_inputs.txt"
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE MISSING_RESULT
+    OUTPUT_VARIABLE MISSING_OUTPUT
+    ERROR_VARIABLE MISSING_ERROR
+    TIMEOUT 30
+)
+
+if(MISSING_RESULT EQUAL 0)
+    message(FATAL_ERROR "Missing input file was not reported:\n${MISSING_OUTPUT}")
+endif()
+
+# Cleanup
+file(REMOVE "${MODEL_FILE}" "${INPUT_FILE}")
+message(STATUS "=== Batch Inference Test PASSED ===")
@@ -0,0 +1,67 @@
+# CMake script to test the memory-budgeted neuron cache (--cache-budget)
+# Trains with a budget far below the network size so that cold neuron
+# vectors are evicted and recomputed, and checks accuracy and counters
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+message(STATUS "=== Testing Cache Budget ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+# Step 1: Multithreaded training with a tiny budget must still classify correctly
+message(STATUS "Step 1: Training with 10 KB cache budget (4 threads)...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_DIR}/simple.json" -t -j 4 --cache-budget 0.01
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE TRAIN_RESULT
+    OUTPUT_VARIABLE TRAIN_OUTPUT
+    ERROR_VARIABLE TRAIN_ERROR
+    TIMEOUT 120
+)
+
+if(NOT TRAIN_RESULT EQUAL 0)
+    message(FATAL_ERROR "Training with cache budget failed with code ${TRAIN_RESULT}:\nOutput: ${TRAIN_OUTPUT}\nError: ${TRAIN_ERROR}")
+endif()
+
+if(NOT TRAIN_OUTPUT MATCHES "KB budget")
+    message(FATAL_ERROR "Cache budget was not applied:\n${TRAIN_OUTPUT}")
+endif()
+message(STATUS "Training with cache budget passed")
+
+# Step 2: Deterministic benchmark (fixed seed) grows the network beyond
+# the slot count, so evictions must be reported
+message(STATUS "Step 2: Benchmark with 10 KB cache budget...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_DIR}/simple.json" -t -b --single-thread --cache-budget 0.01
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE BENCH_RESULT
+    OUTPUT_VARIABLE BENCH_OUTPUT
+    ERROR_VARIABLE BENCH_ERROR
+    TIMEOUT 120
+)
+
+if(NOT BENCH_RESULT EQUAL 0)
+    message(FATAL_ERROR "Benchmark with cache budget failed with code ${BENCH_RESULT}:\nOutput: ${BENCH_OUTPUT}\nError: ${BENCH_ERROR}")
+endif()
+
+string(REGEX MATCH "Cache hits: [0-9]+, misses: [0-9]+, evictions: [0-9]+" CACHE_LINE "${BENCH_OUTPUT}")
+if(CACHE_LINE STREQUAL "")
+    message(FATAL_ERROR "Cache counters not reported in benchmark output:\n${BENCH_OUTPUT}")
+endif()
+message(STATUS "${CACHE_LINE}")
+
+if(CACHE_LINE MATCHES "evictions: 0$")
+    message(FATAL_ERROR "No evictions happened with a 10 KB budget")
+endif()
+
+message(STATUS "=== Cache Budget Test PASSED ===")
@@ -0,0 +1,146 @@
+# CMake script to test model code generation (--emit-cpp, --emit-so, --compiled)
+# Generates C++ code for a trained model, builds it into a shared library
+# and checks that the library classifies exactly like the interpreter
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+set(MODEL_FILE "${WORK_DIR}/test_compiled_model.json")
+set(SOURCE_FILE "${WORK_DIR}/test_compiled_model.cpp")
+set(LIBRARY_FILE "${WORK_DIR}/test_compiled_model.so")
+set(INPUT_FILE "${WORK_DIR}/test_compiled_model_inputs.txt")
+set(CONFIG_FILE "${CONFIG_DIR}/simple.json")
+
+message(STATUS "=== Testing Compiled Model ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+# Step 1: Train and save model
+message(STATUS "Step 1: Training model...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${MODEL_FILE}" -t
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE TRAIN_RESULT
+    OUTPUT_VARIABLE TRAIN_OUTPUT
+    ERROR_VARIABLE TRAIN_ERROR
+    TIMEOUT 120
+)
+
+if(NOT TRAIN_RESULT EQUAL 0)
+    message(FATAL_ERROR "Training failed with code ${TRAIN_RESULT}:\nOutput: ${TRAIN_OUTPUT}\nError: ${TRAIN_ERROR}")
+endif()
+
+# Step 2: Generate C++ code
+message(STATUS "Step 2: Generating C++ code...")
+execute_process(
+    COMMAND "${NNETS_EXE}" --emit-cpp "${MODEL_FILE}" "${SOURCE_FILE}"
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE EMIT_RESULT
+    OUTPUT_VARIABLE EMIT_OUTPUT
+    ERROR_VARIABLE EMIT_ERROR
+    TIMEOUT 60
+)
+
+if(NOT EMIT_RESULT EQUAL 0)
+    message(FATAL_ERROR "Code generation failed with code ${EMIT_RESULT}:\nOutput: ${EMIT_OUTPUT}\nError: ${EMIT_ERROR}")
+endif()
+
+file(READ "${SOURCE_FILE}" SOURCE_CONTENT)
+foreach(SYMBOL nnets_abi_version nnets_classify nnets_classify_batch nnets_class_name)
+    string(FIND "${SOURCE_CONTENT}" "${SYMBOL}(" SYMBOL_FOUND)
+    if(SYMBOL_FOUND EQUAL -1)
+        message(FATAL_ERROR "Generated code is missing ${SYMBOL}:\n${SOURCE_CONTENT}")
+    endif()
+endforeach()
+message(STATUS "Code generation passed")
+
+# Building the library needs a compiler command line (not available on Windows)
+if(WIN32 OR NOT DEFINED CXX_COMPILER)
+    file(REMOVE "${MODEL_FILE}" "${SOURCE_FILE}")
+    message(STATUS "Skipping library build on this platform")
+    message(STATUS "=== Compiled Model Test PASSED ===")
+    return()
+endif()
+
+# Step 3: Build the library and benchmark it against the interpreter
+message(STATUS "Step 3: Building and benchmarking library...")
+execute_process(
+    COMMAND ${CMAKE_COMMAND} -E env "CXX=${CXX_COMPILER}"
+        "${NNETS_EXE}" --emit-cpp "${MODEL_FILE}" "${SOURCE_FILE}" --emit-so "${LIBRARY_FILE}" -b
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE BUILD_RESULT
+    OUTPUT_VARIABLE BUILD_OUTPUT
+    ERROR_VARIABLE BUILD_ERROR
+    TIMEOUT 180
+)
+
+if(NOT BUILD_RESULT EQUAL 0)
+    message(FATAL_ERROR "Library build failed with code ${BUILD_RESULT}:\nOutput: ${BUILD_OUTPUT}\nError: ${BUILD_ERROR}")
+endif()
+
+if(NOT BUILD_OUTPUT MATCHES "Mismatches vs interpreter: 0")
+    message(FATAL_ERROR "Compiled model differs from the interpreter:\n${BUILD_OUTPUT}")
+endif()
+message(STATUS "Library matches the interpreter")
+
+# Step 4: Single input through the library must match the interpreter
+foreach(WORD yes no)
+    execute_process(
+        COMMAND "${NNETS_EXE}" -l "${MODEL_FILE}" -i "${WORD}"
+        WORKING_DIRECTORY "${WORK_DIR}"
+        OUTPUT_VARIABLE PLAN_OUTPUT
+        TIMEOUT 30
+    )
+    execute_process(
+        COMMAND "${NNETS_EXE}" -l "${MODEL_FILE}" --compiled "${LIBRARY_FILE}" -i "${WORD}"
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE COMPILED_RESULT
+        OUTPUT_VARIABLE COMPILED_OUTPUT
+        ERROR_VARIABLE COMPILED_ERROR
+        TIMEOUT 30
+    )
+
+    if(NOT COMPILED_RESULT EQUAL 0)
+        message(FATAL_ERROR "Compiled classification failed with code ${COMPILED_RESULT}:\nOutput: ${COMPILED_OUTPUT}\nError: ${COMPILED_ERROR}")
+    endif()
+
+    string(REGEX MATCH "Classifying:.*$" PLAN_RESULTS "${PLAN_OUTPUT}")
+    string(REGEX MATCH "Classifying:.*$" COMPILED_RESULTS "${COMPILED_OUTPUT}")
+    if(NOT PLAN_RESULTS STREQUAL COMPILED_RESULTS)
+        message(FATAL_ERROR "Compiled result for '${WORD}' differs:\nInterpreter: ${PLAN_RESULTS}\nCompiled: ${COMPILED_RESULTS}")
+    endif()
+endforeach()
+
+# Step 5: Batch classification through the library
+set(INPUTS "")
+foreach(INDEX RANGE 1 100)
+    string(APPEND INPUTS "yes\nno\nmaybe\n")
+endforeach()
+file(WRITE "${INPUT_FILE}" "${INPUTS}")
+
+execute_process(
+    COMMAND "${NNETS_EXE}" -l "${MODEL_FILE}" --compiled "${LIBRARY_FILE}" --classify-batch "${INPUT_FILE}" -b
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE BATCH_RESULT
+    OUTPUT_VARIABLE BATCH_OUTPUT
+    ERROR_VARIABLE BATCH_ERROR
+    TIMEOUT 60
+)
+
+if(NOT BATCH_RESULT EQUAL 0 OR NOT BATCH_OUTPUT MATCHES "Batch engine: compiled model")
+    message(FATAL_ERROR "Compiled batch classification failed:\nOutput: ${BATCH_OUTPUT}\nError: ${BATCH_ERROR}")
+endif()
+message(STATUS "Compiled classification passed")
+
+# Cleanup
+file(REMOVE "${MODEL_FILE}" "${SOURCE_FILE}" "${LIBRARY_FILE}" "${INPUT_FILE}")
+message(STATUS "=== Compiled Model Test PASSED ===")
@@ -0,0 +1,109 @@
+# CMake script to test the streaming config loader
+# A config is parsed without a JSON tree, so its keys may come in any order
+# (receptors and generate_shifts after the images); images listed in an
+# images_file ("word<TAB>class" lines) must train the same network as the
+# same images in JSON, and a changed list must invalidate the dataset cache
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+set(REFERENCE_MODEL_FILE "${WORK_DIR}/test_config_stream_reference.json")
+set(MODEL_FILE "${WORK_DIR}/test_config_stream_model.json")
+set(REORDERED_CONFIG_FILE "${WORK_DIR}/test_config_stream_reordered.json")
+set(LIST_CONFIG_FILE "${WORK_DIR}/test_config_stream_list.json")
+set(LIST_FILE "${WORK_DIR}/test_config_stream_images.tsv")
+set(CACHE_FILE "${WORK_DIR}/test_config_stream_cache.bin")
+
+message(STATUS "=== Testing Streaming Config Loader ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+# Train on CONFIG, save the model to MODEL and check that the output mentions EXPECTED
+function(train_config STEP CONFIG MODEL EXPECTED)
+    execute_process(
+        COMMAND "${NNETS_EXE}" -c "${CONFIG}" -s "${MODEL}" -t ${ARGN}
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE TRAIN_RESULT
+        OUTPUT_VARIABLE TRAIN_OUTPUT
+        ERROR_VARIABLE TRAIN_ERROR
+        TIMEOUT 120
+    )
+
+    if(NOT TRAIN_RESULT EQUAL 0)
+        message(FATAL_ERROR "${STEP} failed with code ${TRAIN_RESULT}:\nOutput: ${TRAIN_OUTPUT}\nError: ${TRAIN_ERROR}")
+    endif()
+
+    if(NOT "${TRAIN_OUTPUT}${TRAIN_ERROR}" MATCHES "${EXPECTED}")
+        message(FATAL_ERROR "${STEP}: expected '${EXPECTED}' in output:\n${TRAIN_OUTPUT}\n${TRAIN_ERROR}")
+    endif()
+    message(STATUS "${STEP} passed")
+endfunction()
+
+# Compare MODEL with the reference network
+function(check_same_model STEP MODEL)
+    file(READ "${REFERENCE_MODEL_FILE}" REFERENCE_MODEL)
+    file(READ "${MODEL}" TRAINED_MODEL)
+    if(NOT REFERENCE_MODEL STREQUAL TRAINED_MODEL)
+        message(FATAL_ERROR "${STEP}: trained network differs from the reference one")
+    endif()
+endfunction()
+
+# Step 1: Keys after the images (generate_shifts and receptors last)
+train_config("Step 1: Reference shifted config" "${CONFIG_DIR}/simple.json" "${REFERENCE_MODEL_FILE}" "Images: 22")
+file(WRITE "${REORDERED_CONFIG_FILE}" [=[
+{
+    "classes": [
+        { "word": "", "id": 0 },
+        { "id": 1, "word": "yes" },
+        { "word": "no", "ignored": { "nested": [1, 2] }, "id": 2 }
+    ],
+    "description": "simple.json with the keys in another order",
+    "generate_shifts": true,
+    "receptors": 12
+}
+]=])
+train_config("Step 1: Reordered config" "${REORDERED_CONFIG_FILE}" "${MODEL_FILE}" "Images: 22")
+check_same_model("Step 1" "${MODEL_FILE}")
+
+# Step 2: Images of custom_images.json as a word<TAB>class list (with CRLF and blank lines)
+train_config("Step 2: Reference image config" "${CONFIG_DIR}/custom_images.json" "${REFERENCE_MODEL_FILE}" "Images: 8")
+file(WRITE "${LIST_FILE}" "\t0\ntime\t1\r\nhour\t2\n\nmain\t3\n time\t1\n  time\t1\n   time\t1\n    time\t1\n")
+file(WRITE "${LIST_CONFIG_FILE}" "{ \"images_file\": \"test_config_stream_images.tsv\", \"receptors\": 16 }\n")
+train_config("Step 2: Image list" "${LIST_CONFIG_FILE}" "${MODEL_FILE}" "Images: 8")
+check_same_model("Step 2" "${MODEL_FILE}")
+
+# Step 3: The dataset cache follows changes of the image list
+file(REMOVE "${CACHE_FILE}")
+train_config("Step 3: Building the cache" "${LIST_CONFIG_FILE}" "${MODEL_FILE}" "Saved dataset cache" --dataset-cache "${CACHE_FILE}")
+train_config("Step 3: Loading the cache" "${LIST_CONFIG_FILE}" "${MODEL_FILE}" "Loaded dataset cache" --dataset-cache "${CACHE_FILE}")
+file(APPEND "${LIST_FILE}" "     time\t1\n")
+train_config("Step 3: Changed image list" "${LIST_CONFIG_FILE}" "${MODEL_FILE}" "is stale, rebuilding.*Images: 9" --dataset-cache "${CACHE_FILE}")
+
+# Step 4: A malformed line is reported with its number
+file(APPEND "${LIST_FILE}" "time 1\n")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${LIST_CONFIG_FILE}" -t
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE BAD_RESULT
+    OUTPUT_VARIABLE BAD_OUTPUT
+    ERROR_VARIABLE BAD_ERROR
+    TIMEOUT 60
+)
+if(BAD_RESULT EQUAL 0 OR NOT BAD_ERROR MATCHES "test_config_stream_images.tsv:11: expected word<TAB>class")
+    message(FATAL_ERROR "Malformed image list was not reported (code ${BAD_RESULT}):\n${BAD_OUTPUT}\n${BAD_ERROR}")
+endif()
+message(STATUS "Step 4: Malformed image list passed")
+
+# Cleanup
+file(REMOVE "${REFERENCE_MODEL_FILE}" "${MODEL_FILE}" "${REORDERED_CONFIG_FILE}" "${LIST_CONFIG_FILE}"
+            "${LIST_FILE}" "${CACHE_FILE}")
+message(STATUS "=== Streaming Config Loader Test PASSED ===")
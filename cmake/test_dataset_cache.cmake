@@ -0,0 +1,98 @@
+# CMake script to test the binary dataset cache (--dataset-cache)
+# The first run encodes the config and saves the cache, the second one
+# loads it instead of the JSON and must train the same network; a changed
+# config or a damaged cache file must be rebuilt
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+# The config is copied so that it can be modified
+set(CONFIG_FILE "${WORK_DIR}/test_dataset_cache_config.json")
+set(CACHE_FILE "${WORK_DIR}/test_dataset_cache.bin")
+set(PLAIN_MODEL_FILE "${WORK_DIR}/test_dataset_cache_plain_model.json")
+set(CACHED_MODEL_FILE "${WORK_DIR}/test_dataset_cache_model.json")
+
+file(READ "${CONFIG_DIR}/simple.json" CONFIG_CONTENT)
+file(WRITE "${CONFIG_FILE}" "${CONFIG_CONTENT}")
+file(REMOVE "${CACHE_FILE}")
+
+message(STATUS "=== Testing Dataset Cache ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+# Run training with the cache and check that the output mentions EXPECTED
+function(run_cached STEP MODEL EXPECTED)
+    execute_process(
+        COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${MODEL}" -t --dataset-cache "${CACHE_FILE}"
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE RUN_RESULT
+        OUTPUT_VARIABLE RUN_OUTPUT
+        ERROR_VARIABLE RUN_ERROR
+        TIMEOUT 120
+    )
+
+    if(NOT RUN_RESULT EQUAL 0)
+        message(FATAL_ERROR "${STEP} failed with code ${RUN_RESULT}:\nOutput: ${RUN_OUTPUT}\nError: ${RUN_ERROR}")
+    endif()
+
+    if(NOT "${RUN_OUTPUT}${RUN_ERROR}" MATCHES "${EXPECTED}")
+        message(FATAL_ERROR "${STEP}: expected '${EXPECTED}' in output:\n${RUN_OUTPUT}\n${RUN_ERROR}")
+    endif()
+    message(STATUS "${STEP} passed")
+endfunction()
+
+# Step 1: Reference network without the cache
+message(STATUS "Step 1: Training without the cache...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${PLAIN_MODEL_FILE}" -t
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE PLAIN_RESULT
+    OUTPUT_VARIABLE PLAIN_OUTPUT
+    ERROR_VARIABLE PLAIN_ERROR
+    TIMEOUT 120
+)
+
+if(NOT PLAIN_RESULT EQUAL 0)
+    message(FATAL_ERROR "Training without the cache failed with code ${PLAIN_RESULT}:\nOutput: ${PLAIN_OUTPUT}\nError: ${PLAIN_ERROR}")
+endif()
+file(READ "${PLAIN_MODEL_FILE}" PLAIN_MODEL)
+
+# Step 2: The first run writes the cache
+run_cached("Step 2: Building the cache" "${CACHED_MODEL_FILE}" "Saved dataset cache")
+if(NOT EXISTS "${CACHE_FILE}")
+    message(FATAL_ERROR "Dataset cache file was not created")
+endif()
+
+# Step 3: The second run reads it and trains the same network
+run_cached("Step 3: Loading the cache" "${CACHED_MODEL_FILE}" "Loaded dataset cache")
+file(READ "${CACHED_MODEL_FILE}" CACHED_MODEL)
+if(NOT PLAIN_MODEL STREQUAL CACHED_MODEL)
+    message(FATAL_ERROR "Network trained from the dataset cache differs from the JSON one")
+endif()
+
+# Step 4: A changed config makes the cache stale
+file(WRITE "${CONFIG_FILE}" "${CONFIG_CONTENT}\n")
+run_cached("Step 4: Rebuilding a stale cache" "${CACHED_MODEL_FILE}" "is stale, rebuilding")
+
+# Step 5: A damaged cache is ignored and rewritten
+file(WRITE "${CACHE_FILE}" "NNDSET damaged")
+run_cached("Step 5: Replacing a damaged cache" "${CACHED_MODEL_FILE}" "Ignoring dataset cache")
+run_cached("Step 5: Loading the rewritten cache" "${CACHED_MODEL_FILE}" "Loaded dataset cache")
+
+file(READ "${CACHED_MODEL_FILE}" CACHED_MODEL)
+if(NOT PLAIN_MODEL STREQUAL CACHED_MODEL)
+    message(FATAL_ERROR "Network trained from the rebuilt cache differs from the JSON one")
+endif()
+
+# Cleanup
+file(REMOVE "${CONFIG_FILE}" "${CACHE_FILE}" "${PLAIN_MODEL_FILE}" "${CACHED_MODEL_FILE}")
+message(STATUS "=== Dataset Cache Test PASSED ===")
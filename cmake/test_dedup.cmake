@@ -0,0 +1,100 @@
+# CMake script to test weighted deduplication of training images
+# Repeated images must be merged into weighted unique images that train a
+# working network (the same with Gram scoring and direct search); inputs
+# shared by several classes must be reported as conflicts
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+set(CONFIG_FILE "${CONFIG_DIR}/test_dedup.json")
+set(MODEL_FILE "${WORK_DIR}/test_dedup_model.json")
+set(NO_GRAM_MODEL_FILE "${WORK_DIR}/test_dedup_no_gram_model.json")
+set(CONFLICT_CONFIG_FILE "${WORK_DIR}/test_dedup_conflict.json")
+
+message(STATUS "=== Testing Image Deduplication ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+# Train on the config and check that all images are classified
+function(train_dedup STEP MODEL)
+    execute_process(
+        COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${MODEL}" -t ${ARGN}
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE TRAIN_RESULT
+        OUTPUT_VARIABLE TRAIN_OUTPUT
+        ERROR_VARIABLE TRAIN_ERROR
+        TIMEOUT 120
+    )
+
+    if(NOT TRAIN_RESULT EQUAL 0)
+        message(FATAL_ERROR "${STEP} failed with code ${TRAIN_RESULT}:\nOutput: ${TRAIN_OUTPUT}\nError: ${TRAIN_ERROR}")
+    endif()
+
+    if(NOT TRAIN_OUTPUT MATCHES "All tests PASSED")
+        message(FATAL_ERROR "${STEP}: trained network does not classify all images:\n${TRAIN_OUTPUT}")
+    endif()
+    set(TRAIN_OUTPUT "${TRAIN_OUTPUT}" PARENT_SCOPE)
+    message(STATUS "${STEP} passed")
+endfunction()
+
+# Step 1: 39 images, 8 of them repeat earlier ones
+train_dedup("Step 1: Training on weighted unique images" "${MODEL_FILE}")
+if(NOT TRAIN_OUTPUT MATCHES "Deduplicated images: 39 -> 31 unique")
+    message(FATAL_ERROR "Duplicate images were not merged:\n${TRAIN_OUTPUT}")
+endif()
+# -t counts every original image, not every unique one
+if(NOT TRAIN_OUTPUT MATCHES "Total images: 39\n")
+    message(FATAL_ERROR "Test mode did not count repeated images:\n${TRAIN_OUTPUT}")
+endif()
+
+# Step 2: Weighted Gram scoring must pick the same neurons as weighted direct search
+train_dedup("Step 2: Training with --no-gram" "${NO_GRAM_MODEL_FILE}" --no-gram)
+file(READ "${MODEL_FILE}" GRAM_MODEL)
+file(READ "${NO_GRAM_MODEL_FILE}" NO_GRAM_MODEL)
+if(NOT GRAM_MODEL STREQUAL NO_GRAM_MODEL)
+    message(FATAL_ERROR "Weighted Gram scoring and direct search trained different networks")
+endif()
+
+# Step 3: --no-dedup trains on every listed image
+train_dedup("Step 3: Training with --no-dedup" "${NO_GRAM_MODEL_FILE}" --no-dedup)
+if(TRAIN_OUTPUT MATCHES "Deduplicated images")
+    message(FATAL_ERROR "Images were merged despite --no-dedup:\n${TRAIN_OUTPUT}")
+endif()
+
+# Step 4: Conflicting images are reported before training. Such a network
+# never reaches the target error, so the run is stopped by the timeout.
+file(WRITE "${CONFLICT_CONFIG_FILE}" [=[
+{
+    "receptors": 8,
+    "images": [
+        { "word": "", "id": 0 },
+        { "word": "time", "id": 1 },
+        { "word": "time  ", "id": 2 },
+        { "word": "hour", "id": 2 }
+    ]
+}
+]=])
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFLICT_CONFIG_FILE}" --single-thread
+    WORKING_DIRECTORY "${WORK_DIR}"
+    OUTPUT_VARIABLE CONFLICT_OUTPUT
+    ERROR_VARIABLE CONFLICT_ERROR
+    TIMEOUT 5
+)
+if(NOT CONFLICT_OUTPUT MATCHES "1 input\\(s\\) belong to several classes:[\r\n]+  \"time\": classes 1, 2")
+    message(FATAL_ERROR "Conflicting images were not reported:\n${CONFLICT_OUTPUT}\n${CONFLICT_ERROR}")
+endif()
+message(STATUS "Step 4: Conflict report passed")
+
+# Cleanup
+file(REMOVE "${MODEL_FILE}" "${NO_GRAM_MODEL_FILE}" "${CONFLICT_CONFIG_FILE}")
+message(STATUS "=== Image Deduplication Test PASSED ===")
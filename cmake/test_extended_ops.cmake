@@ -0,0 +1,136 @@
+# CMake script to test the extended operation set (op_5..op_11)
+# Trains with all operations enabled by the "ops" config key, checks that
+# Gram scoring picks the same neurons as the direct search, that the model
+# uses the extended operations and that the inference plan and the compiled
+# model classify it; unknown operation names must be rejected
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+set(CONFIG_FILE "${CONFIG_DIR}/test_funcs_extended_ops.json")
+set(GRAM_MODEL "${WORK_DIR}/test_extended_ops_gram.json")
+set(DIRECT_MODEL "${WORK_DIR}/test_extended_ops_direct.json")
+set(SOURCE_FILE "${WORK_DIR}/test_extended_ops.cpp")
+set(LIBRARY_FILE "${WORK_DIR}/test_extended_ops.so")
+set(BAD_CONFIG "${WORK_DIR}/test_extended_ops_bad.json")
+
+message(STATUS "=== Testing Extended Operations ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+# Step 1: Train with matrix scoring
+message(STATUS "Step 1: Training with the extended operation set...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${GRAM_MODEL}" -t
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE GRAM_RESULT
+    OUTPUT_VARIABLE GRAM_OUTPUT
+    ERROR_VARIABLE GRAM_ERROR
+    TIMEOUT 120
+)
+
+if(NOT GRAM_RESULT EQUAL 0)
+    message(FATAL_ERROR "Training failed with code ${GRAM_RESULT}:\nOutput: ${GRAM_OUTPUT}\nError: ${GRAM_ERROR}")
+endif()
+
+if(NOT GRAM_OUTPUT MATCHES "Operations: [a-z0-9_, ]*parallel")
+    message(FATAL_ERROR "Config operation set was not reported:\n${GRAM_OUTPUT}")
+endif()
+
+if(NOT GRAM_OUTPUT MATCHES "All tests PASSED")
+    message(FATAL_ERROR "Network trained with extended operations failed its tests:\n${GRAM_OUTPUT}")
+endif()
+
+# Step 2: Direct search must pick the same neurons
+message(STATUS "Step 2: Training with direct scoring (--no-gram)...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${DIRECT_MODEL}" -t --no-gram
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE DIRECT_RESULT
+    OUTPUT_VARIABLE DIRECT_OUTPUT
+    ERROR_VARIABLE DIRECT_ERROR
+    TIMEOUT 120
+)
+
+if(NOT DIRECT_RESULT EQUAL 0)
+    message(FATAL_ERROR "Training with --no-gram failed with code ${DIRECT_RESULT}:\nOutput: ${DIRECT_OUTPUT}\nError: ${DIRECT_ERROR}")
+endif()
+
+file(READ "${GRAM_MODEL}" GRAM_CONTENT)
+file(READ "${DIRECT_MODEL}" DIRECT_CONTENT)
+if(NOT GRAM_CONTENT STREQUAL DIRECT_CONTENT)
+    message(FATAL_ERROR "Gram scoring trained a different network than direct scoring")
+endif()
+
+# Operations op_5..op_11 are stored as 4..10
+if(NOT GRAM_CONTENT MATCHES "\"op\": *([4-9]|10)[,}\n ]")
+    message(FATAL_ERROR "Trained network does not use extended operations")
+endif()
+message(STATUS "Networks are identical and use extended operations")
+
+# Step 3: Verify through the inference plan
+message(STATUS "Step 3: Verifying the model...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -l "${GRAM_MODEL}" -c "${CONFIG_FILE}" --verify
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE VERIFY_RESULT
+    OUTPUT_VARIABLE VERIFY_OUTPUT
+    ERROR_VARIABLE VERIFY_ERROR
+    TIMEOUT 60
+)
+
+if(NOT VERIFY_RESULT EQUAL 0 OR NOT VERIFY_OUTPUT MATCHES "Inference plan: [0-9]+ operations"
+   OR NOT VERIFY_OUTPUT MATCHES "Accuracy: 100%")
+    message(FATAL_ERROR "Verification failed with code ${VERIFY_RESULT}:\nOutput: ${VERIFY_OUTPUT}\nError: ${VERIFY_ERROR}")
+endif()
+
+# Step 4: The compiled model must match the interpreter
+if(NOT WIN32 AND DEFINED CXX_COMPILER)
+    message(STATUS "Step 4: Building the compiled model...")
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -E env "CXX=${CXX_COMPILER}"
+            "${NNETS_EXE}" --emit-cpp "${GRAM_MODEL}" "${SOURCE_FILE}" --emit-so "${LIBRARY_FILE}" -b
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE BUILD_RESULT
+        OUTPUT_VARIABLE BUILD_OUTPUT
+        ERROR_VARIABLE BUILD_ERROR
+        TIMEOUT 180
+    )
+
+    if(NOT BUILD_RESULT EQUAL 0)
+        message(FATAL_ERROR "Library build failed with code ${BUILD_RESULT}:\nOutput: ${BUILD_OUTPUT}\nError: ${BUILD_ERROR}")
+    endif()
+
+    if(NOT BUILD_OUTPUT MATCHES "Mismatches vs interpreter: 0")
+        message(FATAL_ERROR "Compiled model differs from the interpreter:\n${BUILD_OUTPUT}")
+    endif()
+    message(STATUS "Compiled model matches the interpreter")
+endif()
+
+# Step 5: Unknown operation names are rejected
+file(WRITE "${BAD_CONFIG}" "{ \"receptors\": 8, \"classes\": [ { \"id\": 0, \"word\": \"a\" } ], \"ops\": [\"add\", \"pow\"] }\n")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${BAD_CONFIG}" -t
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE BAD_RESULT
+    OUTPUT_VARIABLE BAD_OUTPUT
+    ERROR_VARIABLE BAD_ERROR
+    TIMEOUT 30
+)
+
+if(BAD_RESULT EQUAL 0 OR NOT BAD_ERROR MATCHES "Unknown operation 'pow'")
+    message(FATAL_ERROR "Unknown operation was not rejected:\nOutput: ${BAD_OUTPUT}\nError: ${BAD_ERROR}")
+endif()
+
+# Cleanup
+file(REMOVE "${GRAM_MODEL}" "${DIRECT_MODEL}" "${SOURCE_FILE}" "${LIBRARY_FILE}" "${BAD_CONFIG}")
+message(STATUS "=== Extended Operations Test PASSED ===")
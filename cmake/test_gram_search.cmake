@@ -0,0 +1,65 @@
+# CMake script to test Gram-matrix scoring of exhaustive search
+# Trains the same config with matrix scoring (default) and with direct
+# scoring (--no-gram) and checks that the saved networks are identical
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+set(GRAM_MODEL "${WORK_DIR}/test_gram_search_gram.json")
+set(DIRECT_MODEL "${WORK_DIR}/test_gram_search_direct.json")
+set(CONFIG_FILE "${CONFIG_DIR}/test_funcs_gram.json")
+
+message(STATUS "=== Testing Gram-Matrix Exhaustive Search ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+# Step 1: Train with matrix scoring
+message(STATUS "Step 1: Training with Gram scoring...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${GRAM_MODEL}" -t
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE GRAM_RESULT
+    OUTPUT_VARIABLE GRAM_OUTPUT
+    ERROR_VARIABLE GRAM_ERROR
+    TIMEOUT 120
+)
+
+if(NOT GRAM_RESULT EQUAL 0)
+    message(FATAL_ERROR "Training with Gram scoring failed with code ${GRAM_RESULT}:\nOutput: ${GRAM_OUTPUT}\nError: ${GRAM_ERROR}")
+endif()
+
+# Step 2: Train with direct scoring
+message(STATUS "Step 2: Training with direct scoring (--no-gram)...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${DIRECT_MODEL}" -t --no-gram
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE DIRECT_RESULT
+    OUTPUT_VARIABLE DIRECT_OUTPUT
+    ERROR_VARIABLE DIRECT_ERROR
+    TIMEOUT 120
+)
+
+if(NOT DIRECT_RESULT EQUAL 0)
+    message(FATAL_ERROR "Training with direct scoring failed with code ${DIRECT_RESULT}:\nOutput: ${DIRECT_OUTPUT}\nError: ${DIRECT_ERROR}")
+endif()
+
+# Step 3: Both searches must pick the same neurons
+file(READ "${GRAM_MODEL}" GRAM_CONTENT)
+file(READ "${DIRECT_MODEL}" DIRECT_CONTENT)
+if(NOT GRAM_CONTENT STREQUAL DIRECT_CONTENT)
+    message(FATAL_ERROR "Gram scoring trained a different network than direct scoring")
+endif()
+message(STATUS "Networks are identical")
+
+# Cleanup
+file(REMOVE "${GRAM_MODEL}" "${DIRECT_MODEL}")
+message(STATUS "=== Gram-Matrix Exhaustive Search Test PASSED ===")
@@ -0,0 +1,128 @@
+# CMake script to test the binary model format (--model-format, --convert-model)
+# A network saved as binary must equal the converted JSON model, convert back
+# to the same JSON, classify like the JSON model and be usable for retraining;
+# a damaged file must be rejected
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+set(CONFIG_FILE "${CONFIG_DIR}/simple.json")
+set(JSON_MODEL_FILE "${WORK_DIR}/test_model_binary.json")
+set(BINARY_MODEL_FILE "${WORK_DIR}/test_model_binary.nnm")
+set(CONVERTED_MODEL_FILE "${WORK_DIR}/test_model_binary_converted.nnm")
+set(ROUND_TRIP_MODEL_FILE "${WORK_DIR}/test_model_binary_round_trip.json")
+set(DAMAGED_MODEL_FILE "${WORK_DIR}/test_model_binary_damaged.nnm")
+
+message(STATUS "=== Testing Binary Model Format ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+# Run NNets with ARGN and check that it succeeds and the output mentions EXPECTED
+function(run_nnets STEP EXPECTED)
+    execute_process(
+        COMMAND "${NNETS_EXE}" ${ARGN}
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE RUN_RESULT
+        OUTPUT_VARIABLE RUN_OUTPUT
+        ERROR_VARIABLE RUN_ERROR
+        TIMEOUT 120
+    )
+
+    if(NOT RUN_RESULT EQUAL 0)
+        message(FATAL_ERROR "${STEP} failed with code ${RUN_RESULT}:\nOutput: ${RUN_OUTPUT}\nError: ${RUN_ERROR}")
+    endif()
+
+    if(NOT RUN_OUTPUT MATCHES "${EXPECTED}")
+        message(FATAL_ERROR "${STEP}: expected '${EXPECTED}' in output:\n${RUN_OUTPUT}")
+    endif()
+    set(RUN_OUTPUT "${RUN_OUTPUT}" PARENT_SCOPE)
+    message(STATUS "${STEP} passed")
+endfunction()
+
+# Check that two files are identical
+function(check_same_files STEP FIRST SECOND)
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -E compare_files "${FIRST}" "${SECOND}"
+        RESULT_VARIABLE COMPARE_RESULT
+    )
+    if(NOT COMPARE_RESULT EQUAL 0)
+        message(FATAL_ERROR "${STEP}: ${FIRST} and ${SECOND} differ")
+    endif()
+endfunction()
+
+# Step 1: The same network saved in both formats
+run_nnets("Step 1: Saving JSON" "Network saved to" -c "${CONFIG_FILE}" -s "${JSON_MODEL_FILE}" -t)
+run_nnets("Step 1: Saving binary" "Network saved to: .*\\(binary\\)"
+          -c "${CONFIG_FILE}" -s "${BINARY_MODEL_FILE}" --model-format binary -t)
+
+# Step 2: JSON -> binary gives the saved binary file, binary -> JSON the saved JSON
+run_nnets("Step 2: Converting to binary" "Model converted: .* \\(binary, "
+          --convert-model "${JSON_MODEL_FILE}" "${CONVERTED_MODEL_FILE}")
+check_same_files("Step 2" "${BINARY_MODEL_FILE}" "${CONVERTED_MODEL_FILE}")
+run_nnets("Step 2: Converting to JSON" "Model converted: .* \\(json, "
+          --convert-model "${BINARY_MODEL_FILE}" "${ROUND_TRIP_MODEL_FILE}")
+check_same_files("Step 2" "${JSON_MODEL_FILE}" "${ROUND_TRIP_MODEL_FILE}")
+
+# Step 3: Both models classify alike
+foreach(WORD "yes" "no" " yes" "maybe")
+    run_nnets("Step 3: JSON model on '${WORD}'" "Classifying" -l "${JSON_MODEL_FILE}" -i "${WORD}")
+    string(REGEX MATCH "Classifying.*" JSON_RESULT "${RUN_OUTPUT}")
+    run_nnets("Step 3: Binary model on '${WORD}'" "Network loaded from: .*\\(binary\\)" -l "${BINARY_MODEL_FILE}" -i "${WORD}")
+    string(REGEX MATCH "Classifying.*" BINARY_RESULT "${RUN_OUTPUT}")
+    if(NOT JSON_RESULT STREQUAL BINARY_RESULT)
+        message(FATAL_ERROR "Binary model classifies '${WORD}' differently:\n${JSON_RESULT}\n${BINARY_RESULT}")
+    endif()
+endforeach()
+
+# Step 4: A binary model can be retrained (all its classes are trained)
+run_nnets("Step 4: Retraining from binary" "All classes are already trained" -r "${BINARY_MODEL_FILE}" -c "${CONFIG_FILE}")
+
+# Step 5: A damaged file is rejected
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy "${BINARY_MODEL_FILE}" "${DAMAGED_MODEL_FILE}")
+file(APPEND "${DAMAGED_MODEL_FILE}" "x")
+execute_process(
+    COMMAND "${NNETS_EXE}" -l "${DAMAGED_MODEL_FILE}" -i "yes"
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE DAMAGED_RESULT
+    OUTPUT_VARIABLE DAMAGED_OUTPUT
+    ERROR_VARIABLE DAMAGED_ERROR
+    TIMEOUT 60
+)
+if(DAMAGED_RESULT EQUAL 0 OR NOT DAMAGED_ERROR MATCHES "Model file size mismatch")
+    message(FATAL_ERROR "Damaged model was not rejected (code ${DAMAGED_RESULT}):\n${DAMAGED_OUTPUT}\n${DAMAGED_ERROR}")
+endif()
+message(STATUS "Step 5: Damaged model passed")
+
+# Step 6: Saving goes through a temporary file that replaces the model atomically
+if(EXISTS "${JSON_MODEL_FILE}.tmp" OR EXISTS "${BINARY_MODEL_FILE}.tmp")
+    message(FATAL_ERROR "Temporary model file left after saving")
+endif()
+file(MAKE_DIRECTORY "${WORK_DIR}/occupied_model.json")
+execute_process(
+    COMMAND "${NNETS_EXE}" --convert-model "${BINARY_MODEL_FILE}" "${WORK_DIR}/occupied_model.json" --model-format json
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE REPLACE_RESULT
+    OUTPUT_VARIABLE REPLACE_OUTPUT
+    ERROR_VARIABLE REPLACE_ERROR
+    TIMEOUT 60
+)
+if(REPLACE_RESULT EQUAL 0 OR NOT REPLACE_ERROR MATCHES "Cannot replace"
+   OR EXISTS "${WORK_DIR}/occupied_model.json.tmp")
+    message(FATAL_ERROR "Failed replace was not reported or left a temporary file (code ${REPLACE_RESULT}):\n${REPLACE_OUTPUT}\n${REPLACE_ERROR}")
+endif()
+file(REMOVE_RECURSE "${WORK_DIR}/occupied_model.json")
+message(STATUS "Step 6: Atomic save passed")
+
+# Cleanup
+file(REMOVE "${JSON_MODEL_FILE}" "${BINARY_MODEL_FILE}" "${CONVERTED_MODEL_FILE}" "${ROUND_TRIP_MODEL_FILE}"
+            "${DAMAGED_MODEL_FILE}")
+message(STATUS "=== Binary Model Format Test PASSED ===")
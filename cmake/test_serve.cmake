@@ -0,0 +1,105 @@
+# CMake script to test the classification server (--serve)
+# Trains a simple model, starts the server with built-in load test clients
+# (-b) and checks that every response matches direct classification while
+# the model is reloaded (#!reload) under load
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+set(MODEL_FILE "${WORK_DIR}/test_serve_model.json")
+set(SOCKET_FILE "${WORK_DIR}/test_serve.sock")
+set(CONFIG_FILE "${CONFIG_DIR}/simple.json")
+
+message(STATUS "=== Testing Classification Server ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+# Unix domain sockets are not available on Windows
+if(WIN32)
+    message(STATUS "Skipping server test on this platform")
+    message(STATUS "=== Classification Server Test PASSED ===")
+    return()
+endif()
+
+# Socket paths are limited to ~100 characters: fall back to /tmp
+string(LENGTH "${SOCKET_FILE}" SOCKET_PATH_LENGTH)
+if(SOCKET_PATH_LENGTH GREATER 100)
+    string(RANDOM LENGTH 8 SOCKET_SUFFIX)
+    set(SOCKET_FILE "/tmp/nnets_test_serve_${SOCKET_SUFFIX}.sock")
+endif()
+
+# Step 1: Train and save model
+message(STATUS "Step 1: Training model...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${MODEL_FILE}" -t
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE TRAIN_RESULT
+    OUTPUT_VARIABLE TRAIN_OUTPUT
+    ERROR_VARIABLE TRAIN_ERROR
+    TIMEOUT 120
+)
+
+if(NOT TRAIN_RESULT EQUAL 0)
+    message(FATAL_ERROR "Training failed with code ${TRAIN_RESULT}:\nOutput: ${TRAIN_OUTPUT}\nError: ${TRAIN_ERROR}")
+endif()
+
+# Step 2: Load test in TSV and JSONL with different batch limits
+foreach(SERVE_ARGS "--serve-batch;8;--serve-wait;0.5" "--serve-batch;64;--stream-format;jsonl")
+    message(STATUS "Step 2: Serving with ${SERVE_ARGS}...")
+    execute_process(
+        COMMAND "${NNETS_EXE}" -l "${MODEL_FILE}" --serve "${SOCKET_FILE}" ${SERVE_ARGS} -j 4 -b
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE SERVE_RESULT
+        OUTPUT_VARIABLE SERVE_OUTPUT
+        ERROR_VARIABLE SERVE_ERROR
+        TIMEOUT 120
+    )
+
+    if(NOT SERVE_RESULT EQUAL 0)
+        message(FATAL_ERROR "Server load test failed with code ${SERVE_RESULT}:\nOutput: ${SERVE_OUTPUT}\nError: ${SERVE_ERROR}")
+    endif()
+
+    if(NOT SERVE_OUTPUT MATCHES "Failed clients: 0" OR NOT SERVE_OUTPUT MATCHES "Mismatched responses: 0")
+        message(FATAL_ERROR "Server responses do not match direct classification:\n${SERVE_OUTPUT}")
+    endif()
+
+    if(NOT SERVE_OUTPUT MATCHES "Server stats: model_version=6 requests=32000 ")
+        message(FATAL_ERROR "Server did not count all requests:\n${SERVE_OUTPUT}")
+    endif()
+
+    if(NOT SERVE_OUTPUT MATCHES "Model reloads: 5 of 5")
+        message(FATAL_ERROR "Model reloads under load failed:\n${SERVE_OUTPUT}\n${SERVE_ERROR}")
+    endif()
+
+    if(EXISTS "${SOCKET_FILE}")
+        message(FATAL_ERROR "Socket file was not removed after shutdown")
+    endif()
+endforeach()
+message(STATUS "Server load test passed")
+
+# Step 3: Invalid batch size must be rejected
+execute_process(
+    COMMAND "${NNETS_EXE}" -l "${MODEL_FILE}" --serve "${SOCKET_FILE}" --serve-batch 0
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE BAD_RESULT
+    OUTPUT_VARIABLE BAD_OUTPUT
+    ERROR_VARIABLE BAD_ERROR
+    TIMEOUT 30
+)
+
+if(BAD_RESULT EQUAL 0)
+    message(FATAL_ERROR "Invalid --serve-batch was accepted:\n${BAD_OUTPUT}")
+endif()
+
+# Cleanup
+file(REMOVE "${MODEL_FILE}" "${SOCKET_FILE}")
+message(STATUS "=== Classification Server Test PASSED ===")
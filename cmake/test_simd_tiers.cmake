@@ -0,0 +1,85 @@
+# CMake script to test run-time SIMD tier selection
+# Trains the same config on every kernel tier supported by the CPU (--simd)
+# with 16-bit activations, so that the op, fused-error, triplet and
+# conversion kernels of each tier are exercised; unsupported tiers and
+# unknown tier names must be rejected
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+set(CONFIG_FILE "${CONFIG_DIR}/test_funcs_gram.json")
+set(TIER_MODEL "${WORK_DIR}/test_simd_tiers.json")
+
+message(STATUS "=== Testing SIMD Tier Selection ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+set(TIERS "scalar" "sse4.1" "avx2" "avx512")
+set(TIER_INFO "None" "SSE4.1" "AVX2\\+FMA" "AVX-512")
+set(TESTED_TIERS 0)
+
+foreach(INDEX RANGE 3)
+    list(GET TIERS ${INDEX} TIER)
+    list(GET TIER_INFO ${INDEX} INFO)
+    message(STATUS "Training with --simd ${TIER}...")
+    execute_process(
+        COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${TIER_MODEL}" -t --simd ${TIER} --activations fp16
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE TIER_RESULT
+        OUTPUT_VARIABLE TIER_OUTPUT
+        ERROR_VARIABLE TIER_ERROR
+        TIMEOUT 120
+    )
+
+    if(TIER_ERROR MATCHES "not supported by this CPU")
+        message(STATUS "  ${TIER} is not supported by this CPU, skipped")
+        continue()
+    endif()
+
+    if(NOT TIER_RESULT EQUAL 0)
+        message(FATAL_ERROR "Training with --simd ${TIER} failed with code ${TIER_RESULT}:\nOutput: ${TIER_OUTPUT}\nError: ${TIER_ERROR}")
+    endif()
+
+    if(NOT TIER_OUTPUT MATCHES "SIMD: ${INFO}")
+        message(FATAL_ERROR "--simd ${TIER} did not select the ${TIER} kernels:\n${TIER_OUTPUT}")
+    endif()
+
+    if(NOT TIER_OUTPUT MATCHES "All tests PASSED")
+        message(FATAL_ERROR "Network trained with --simd ${TIER} failed its tests:\n${TIER_OUTPUT}")
+    endif()
+
+    math(EXPR TESTED_TIERS "${TESTED_TIERS} + 1")
+    message(STATUS "  ${TIER} passed")
+endforeach()
+
+# The scalar tier is always available
+if(TESTED_TIERS LESS 1)
+    message(FATAL_ERROR "No SIMD tier was tested")
+endif()
+
+# Unknown tier names are rejected
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -t --simd sse9
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE UNKNOWN_RESULT
+    OUTPUT_VARIABLE UNKNOWN_OUTPUT
+    ERROR_VARIABLE UNKNOWN_ERROR
+    TIMEOUT 30
+)
+
+if(UNKNOWN_RESULT EQUAL 0 OR NOT UNKNOWN_ERROR MATCHES "Unknown SIMD tier")
+    message(FATAL_ERROR "Unknown SIMD tier was not rejected:\nOutput: ${UNKNOWN_OUTPUT}\nError: ${UNKNOWN_ERROR}")
+endif()
+
+# Cleanup
+file(REMOVE "${TIER_MODEL}")
+message(STATUS "=== SIMD Tier Selection Test PASSED (${TESTED_TIERS} tiers) ===")
@@ -0,0 +1,120 @@
+# CMake script to test streaming classification (--classify-stream)
+# Trains a simple model, then classifies a file and stdin in TSV and JSONL
+# formats with several threads
+
+# Check required variables
+if(NOT DEFINED NNETS_EXE)
+    message(FATAL_ERROR "NNETS_EXE not defined")
+endif()
+
+if(NOT DEFINED CONFIG_DIR)
+    message(FATAL_ERROR "CONFIG_DIR not defined")
+endif()
+
+if(NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "WORK_DIR not defined")
+endif()
+
+set(MODEL_FILE "${WORK_DIR}/test_stream_classify_model.json")
+set(INPUT_FILE "${WORK_DIR}/test_stream_classify_inputs.txt")
+set(CONFIG_FILE "${CONFIG_DIR}/simple.json")
+
+message(STATUS "=== Testing Stream Classification ===")
+message(STATUS "Executable: ${NNETS_EXE}")
+
+# Step 1: Train and save model
+message(STATUS "Step 1: Training model...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -c "${CONFIG_FILE}" -s "${MODEL_FILE}" -t
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE TRAIN_RESULT
+    OUTPUT_VARIABLE TRAIN_OUTPUT
+    ERROR_VARIABLE TRAIN_ERROR
+    TIMEOUT 120
+)
+
+if(NOT TRAIN_RESULT EQUAL 0)
+    message(FATAL_ERROR "Training failed with code ${TRAIN_RESULT}:\nOutput: ${TRAIN_OUTPUT}\nError: ${TRAIN_ERROR}")
+endif()
+
+# Step 2: 1500 inputs (several batch tiles per thread), last line without newline
+set(INPUTS "")
+foreach(INDEX RANGE 1 500)
+    string(APPEND INPUTS "yes\nno\r\nmaybe\n")
+endforeach()
+string(APPEND INPUTS "yes")
+file(WRITE "${INPUT_FILE}" "${INPUTS}")
+
+# Step 3: TSV output from file, several threads
+message(STATUS "Step 3: Streaming file to TSV...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -l "${MODEL_FILE}" --classify-stream "${INPUT_FILE}" -j 4
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE TSV_RESULT
+    OUTPUT_VARIABLE TSV_OUTPUT
+    ERROR_VARIABLE TSV_ERROR
+    TIMEOUT 60
+)
+
+if(NOT TSV_RESULT EQUAL 0)
+    message(FATAL_ERROR "Stream classification failed with code ${TSV_RESULT}:\nOutput: ${TSV_OUTPUT}\nError: ${TSV_ERROR}")
+endif()
+
+if(NOT TSV_ERROR MATCHES "Classified 1501 inputs")
+    message(FATAL_ERROR "Not all inputs were classified:\n${TSV_ERROR}")
+endif()
+
+# stdout must contain only results: one line per input, in input order
+string(REGEX MATCHALL "\n" TSV_LINES "${TSV_OUTPUT}")
+list(LENGTH TSV_LINES TSV_LINE_COUNT)
+if(NOT TSV_LINE_COUNT EQUAL 1501)
+    message(FATAL_ERROR "Expected 1501 result lines, got ${TSV_LINE_COUNT}:\n${TSV_OUTPUT}")
+endif()
+
+if(NOT TSV_OUTPUT MATCHES "^yes\tyes\t[^\n]*\nno\tno\t[^\n]*\nmaybe\t")
+    message(FATAL_ERROR "Unexpected TSV results:\n${TSV_OUTPUT}")
+endif()
+message(STATUS "TSV stream classification passed")
+
+# Step 4: JSONL output from stdin
+message(STATUS "Step 4: Streaming stdin to JSONL...")
+execute_process(
+    COMMAND "${NNETS_EXE}" -l "${MODEL_FILE}" --classify-stream - --stream-format jsonl -j 2
+    INPUT_FILE "${INPUT_FILE}"
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE JSONL_RESULT
+    OUTPUT_VARIABLE JSONL_OUTPUT
+    ERROR_VARIABLE JSONL_ERROR
+    TIMEOUT 60
+)
+
+if(NOT JSONL_RESULT EQUAL 0)
+    message(FATAL_ERROR "Stream classification from stdin failed with code ${JSONL_RESULT}:\nOutput: ${JSONL_OUTPUT}\nError: ${JSONL_ERROR}")
+endif()
+
+if(NOT JSONL_OUTPUT MATCHES "^{\"input\":\"yes\",\"class\":\"yes\",\"class_id\":1,\"scores\":\\[")
+    message(FATAL_ERROR "Unexpected JSONL results:\n${JSONL_OUTPUT}")
+endif()
+
+if(NOT JSONL_ERROR MATCHES "Classified 1501 inputs")
+    message(FATAL_ERROR "Not all stdin inputs were classified:\n${JSONL_ERROR}")
+endif()
+message(STATUS "JSONL stream classification passed")
+
+# Step 5: Unknown output format must be rejected
+execute_process(
+    COMMAND "${NNETS_EXE}" -l "${MODEL_FILE}" --classify-stream "${INPUT_FILE}" --stream-format csv
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE BAD_RESULT
+    OUTPUT_VARIABLE BAD_OUTPUT
+    ERROR_VARIABLE BAD_ERROR
+    TIMEOUT 30
+)
+
+if(BAD_RESULT EQUAL 0)
+    message(FATAL_ERROR "Unknown stream format was accepted:\n${BAD_OUTPUT}")
+endif()
+
+# Cleanup
+file(REMOVE "${MODEL_FILE}" "${INPUT_FILE}")
+message(STATUS "=== Stream Classification Test PASSED ===")
@@ -74,6 +74,12 @@ if(PASSED_FOUND EQUAL -1)
     message(FATAL_ERROR "Verification output missing passed count:\n${VERIFY_OUTPUT}")
 endif()
 
+# Classification runs through the compiled inference plan
+string(REGEX MATCH "Inference plan: [0-9]+ operations" PLAN_LINE "${VERIFY_OUTPUT}")
+if(PLAN_LINE STREQUAL "")
+    message(FATAL_ERROR "Verification output missing inference plan summary:\n${VERIFY_OUTPUT}")
+endif()
+
 message(STATUS "Verification output:\n${VERIFY_OUTPUT}")
 message(STATUS "Verification mode test passed")
 
@@ -0,0 +1,372 @@
+/*
+ * activation_arena.h - Единая выровненная область памяти для кэшей нейронов
+ *
+ * Этот модуль содержит:
+ * - Класс ActivationArena - один непрерывный блок памяти, в котором
+ *   хранятся векторы значений всех нейронов (по строке на нейрон)
+ * - AlignedAllocator - аллокатор для временных буферов поиска
+ *
+ * Раскладка памяти (neuron-major):
+ *   [нейрон 0: Images значений + выравнивание][нейрон 1: ...]...
+ * Значения хранятся в формате кэша (fp32 или 16-битные fp16/bf16,
+ * см. activation_format.h); область знает только размер значения.
+ *
+ * Адресное пространство резервируется под все строки сразу, а физическая
+ * память выделяется блоками только для реально используемых нейронов.
+ *
+ * Каждая строка начинается с границы 64 байт (размер кэш-линии и
+ * регистра AVX-512), поэтому SIMD-ядра из simd_ops.h получают
+ * выровненные данные, а шаг между строками постоянен, что позволяет
+ * предвыбирать (prefetch) следующий нейрон в циклах поиска.
+ *
+ * Смещение строки вычисляется из номера строки (n * rowBytes), поэтому
+ * структура Neiron не хранит собственный буфер и может свободно
+ * копироваться функциями обучения.
+ */
+
+#ifndef ACTIVATION_ARENA_H
+#define ACTIVATION_ARENA_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+#if defined(_WIN32)
+    #include <malloc.h>
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+    #include <sys/mman.h>
+    #define NNETS_HAS_MMAP 1
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <xmmintrin.h>
+#endif
+
+// Выравнивание строк кэша (кэш-линия / регистр AVX-512)
+const size_t ACTIVATION_ALIGNMENT = 64;
+
+// Выравнивание области при использовании больших страниц (2 МБ)
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// ============================================================================
+// Низкоуровневое выделение выровненной памяти
+// ============================================================================
+
+/**
+ * Выделение выровненного блока памяти
+ *
+ * @param bytes - размер блока в байтах
+ * @param alignment - выравнивание (степень двойки, кратная sizeof(void*))
+ * @return указатель на блок или nullptr при ошибке
+ */
+inline void* alignedAlloc(size_t bytes, size_t alignment) {
+    if (bytes == 0) bytes = alignment;
+#if defined(_WIN32)
+    return _aligned_malloc(bytes, alignment);
+#else
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, bytes) != 0) return nullptr;
+    return ptr;
+#endif
+}
+
+/**
+ * Освобождение блока, выделенного alignedAlloc()
+ */
+inline void alignedFree(void* ptr) {
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+/**
+ * Предвыборка начала области памяти в кэш процессора
+ *
+ * @param ptr - адрес начала области
+ * @param lines - количество кэш-линий для предвыборки
+ */
+inline void prefetchLines(const void* ptr, int lines) {
+    const char* p = static_cast<const char*>(ptr);
+    for (int l = 0; l < lines; l++, p += ACTIVATION_ALIGNMENT) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(p, 0, 3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_prefetch(p, _MM_HINT_T0);
+#else
+        (void)p;
+#endif
+    }
+}
+
+// ============================================================================
+// Аллокатор для выровненных временных буферов
+// ============================================================================
+
+/**
+ * STL-аллокатор с выравниванием ACTIVATION_ALIGNMENT
+ *
+ * Используется для рабочих векторов функций обучения, чтобы они
+ * имели то же выравнивание, что и строки ActivationArena.
+ */
+template <class T>
+struct AlignedAllocator {
+    typedef T value_type;
+
+    AlignedAllocator() {}
+    template <class U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        void* ptr = alignedAlloc(n * sizeof(T), ACTIVATION_ALIGNMENT);
+        if (ptr == nullptr) throw std::bad_alloc();
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_t) { alignedFree(ptr); }
+
+    template <class U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <class U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+// Выровненный вектор значений (замена std::vector<float> в циклах поиска)
+typedef std::vector<float, AlignedAllocator<float>> AlignedFloatVector;
+
+// ============================================================================
+// Резервирование адресного пространства и постраничная фиксация памяти
+// ============================================================================
+
+/**
+ * Резервирование адресного пространства без выделения физической памяти
+ *
+ * На платформах без виртуальной памяти с резервированием (не Windows и
+ * не POSIX) возвращает nullptr, и ActivationArena выделяет область целиком.
+ *
+ * @param bytes - размер резервируемой области
+ * @return адрес начала области (выровнен по странице) или nullptr
+ */
+inline void* reserveAddressSpace(size_t bytes) {
+#if defined(_WIN32)
+    return VirtualAlloc(nullptr, bytes, MEM_RESERVE, PAGE_NOACCESS);
+#elif defined(NNETS_HAS_MMAP)
+    void* ptr = mmap(nullptr, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return (ptr == MAP_FAILED) ? nullptr : ptr;
+#else
+    (void)bytes;
+    return nullptr;
+#endif
+}
+
+/**
+ * Фиксация (выделение физической памяти) части зарезервированной области
+ */
+inline bool commitAddressSpace(void* ptr, size_t bytes) {
+#if defined(_WIN32)
+    return VirtualAlloc(ptr, bytes, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#elif defined(NNETS_HAS_MMAP)
+    return mprotect(ptr, bytes, PROT_READ | PROT_WRITE) == 0;
+#else
+    (void)ptr; (void)bytes;
+    return false;
+#endif
+}
+
+/**
+ * Освобождение зарезервированной области
+ */
+inline void releaseAddressSpace(void* ptr, size_t bytes) {
+#if defined(_WIN32)
+    (void)bytes;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#elif defined(NNETS_HAS_MMAP)
+    munmap(ptr, bytes);
+#else
+    (void)ptr; (void)bytes;
+#endif
+}
+
+// ============================================================================
+// Класс области кэшей нейронов
+// ============================================================================
+
+/**
+ * Область кэшей нейронов с ленивой фиксацией памяти
+ *
+ * init() только резервирует адресное пространство под все строки
+ * (MAX_NEURONS нейронов), а физическая память фиксируется блоками
+ * по мере обращения к строкам через acquire(). Поэтому потребление
+ * памяти следует за реальным размером сети, а адреса уже выданных
+ * строк никогда не меняются (важно для потоков поиска).
+ */
+class ActivationArena
+{
+public:
+    ActivationArena()
+        : data_(nullptr), reservedBase_(nullptr), rows_(0), cols_(0), rowBytes_(0),
+          chunkBytes_(COMMIT_CHUNK_SIZE), reservedBytes_(0), committedBytes_(0),
+          committedRows_(0), reserved_(false), hugePages_(false) {}
+    ~ActivationArena() { release(); }
+
+    ActivationArena(const ActivationArena&) = delete;
+    ActivationArena& operator=(const ActivationArena&) = delete;
+
+    /**
+     * Резервирование области под rows строк по cols значений
+     *
+     * Повторный вызов освобождает предыдущую область.
+     * Содержимое строк не инициализируется: валидность данных
+     * отслеживается флагом Neiron::cached.
+     *
+     * @param rows - максимальное количество строк (нейронов)
+     * @param cols - количество значений в строке (образов)
+     * @param hugePages - запросить у ОС большие страницы (только Linux)
+     * @param valueSize - размер одного значения в байтах (4 для fp32, 2 для fp16/bf16)
+     * @return true при успешном резервировании
+     */
+    bool init(size_t rows, size_t cols, bool hugePages = false, size_t valueSize = sizeof(float)) {
+        release();
+
+        rowBytes_ = rowBytesFor(cols, valueSize);
+
+        // Блок фиксации кратен странице (большой странице при hugePages)
+        chunkBytes_ = hugePages ? HUGE_PAGE_SIZE : COMMIT_CHUNK_SIZE;
+        reservedBytes_ = roundUp(rows * rowBytes_, chunkBytes_);
+        hugePages_ = hugePages;
+
+        data_ = static_cast<char*>(reserveAddressSpace(reservedBytes_ + (hugePages ? HUGE_PAGE_SIZE : 0)));
+        if (data_ != nullptr) {
+            reserved_ = true;
+            reservedBase_ = data_;
+            // Выравниваем начало по большой странице, чтобы ОС могла её использовать
+            if (hugePages) {
+                uintptr_t addr = reinterpret_cast<uintptr_t>(data_);
+                data_ = reinterpret_cast<char*>(roundUp(addr, HUGE_PAGE_SIZE));
+            }
+        } else {
+            // Резервирование недоступно: выделяем всю область сразу
+            data_ = static_cast<char*>(alignedAlloc(reservedBytes_, hugePages ? HUGE_PAGE_SIZE : ACTIVATION_ALIGNMENT));
+            if (data_ == nullptr) {
+                release();
+                return false;
+            }
+            reservedBase_ = data_;
+            committedBytes_ = reservedBytes_;
+            committedRows_ = rows;
+            adviseHugePages(data_, reservedBytes_);
+        }
+
+        rows_ = rows;
+        cols_ = cols;
+        return true;
+    }
+
+    /**
+     * Освобождение области
+     */
+    void release() {
+        if (reservedBase_ != nullptr) {
+            if (reserved_) {
+                releaseAddressSpace(reservedBase_, reservedBytes_ + (hugePages_ ? HUGE_PAGE_SIZE : 0));
+            } else {
+                alignedFree(reservedBase_);
+            }
+        }
+        data_ = nullptr;
+        reservedBase_ = nullptr;
+        rows_ = cols_ = rowBytes_ = 0;
+        reservedBytes_ = committedBytes_ = 0;
+        committedRows_.store(0);
+        reserved_ = false;
+        hugePages_ = false;
+    }
+
+    /**
+     * Получение строки n-го нейрона с фиксацией памяти при первом обращении
+     *
+     * Быстрый путь - одно атомарное чтение; фиксация нового блока
+     * выполняется под мьютексом, поэтому метод можно вызывать из потоков.
+     *
+     * @param n - номер строки (нейрона)
+     * @return указатель на строку или nullptr, если память не выделена
+     */
+    void* acquire(size_t n) {
+        if (n < committedRows_.load(std::memory_order_acquire)) return row(n);
+        if (n >= rows_) return nullptr;
+
+        std::lock_guard<std::mutex> lock(commitMutex_);
+        if (n >= committedRows_.load(std::memory_order_relaxed)) {
+            size_t target = std::min(reservedBytes_, roundUp((n + 1) * rowBytes_, chunkBytes_));
+            char* begin = data_ + committedBytes_;
+            if (!commitAddressSpace(begin, target - committedBytes_)) return nullptr;
+            adviseHugePages(begin, target - committedBytes_);
+            committedBytes_ = target;
+            committedRows_.store(std::min(rows_, committedBytes_ / rowBytes_), std::memory_order_release);
+        }
+        return row(n);
+    }
+
+    // Указатель на строку значений n-го нейрона (строка должна быть получена через acquire)
+    void* row(size_t n) { return data_ + n * rowBytes_; }
+    const void* row(size_t n) const { return data_ + n * rowBytes_; }
+
+    // Предвыборка первых кэш-линий строки n-го нейрона
+    void prefetch(size_t n) const {
+        if (n < committedRows_.load(std::memory_order_relaxed)) prefetchLines(row(n), 4);
+    }
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    size_t rowBytes() const { return rowBytes_; }
+    size_t committedRows() const { return committedRows_.load(); }
+    size_t committedBytes() const { return committedBytes_; }
+    size_t reservedBytes() const { return reservedBytes_; }
+    bool usesHugePages() const { return hugePages_; }
+
+    // Размер строки из cols значений по valueSize байт, выровненный по кэш-линии
+    static size_t rowBytesFor(size_t cols, size_t valueSize) {
+        return std::max<size_t>(1, (cols * valueSize + ACTIVATION_ALIGNMENT - 1) / ACTIVATION_ALIGNMENT) * ACTIVATION_ALIGNMENT;
+    }
+
+private:
+    // Размер блока фиксации памяти без больших страниц
+    static constexpr size_t COMMIT_CHUNK_SIZE = 256 * 1024;
+
+    static size_t roundUp(size_t value, size_t step) {
+        return (value + step - 1) / step * step;
+    }
+
+    void adviseHugePages(void* ptr, size_t bytes) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (hugePages_) madvise(ptr, bytes, MADV_HUGEPAGE);
+#else
+        (void)ptr; (void)bytes;
+#endif
+    }
+
+    char* data_;                        // Начало строк (выровнено по ACTIVATION_ALIGNMENT)
+    void* reservedBase_;                // Начало зарезервированной/выделенной области
+    size_t rows_;                       // Максимальное количество строк
+    size_t cols_;                       // Полезное количество значений в строке
+    size_t rowBytes_;                   // Шаг между строками в байтах (кратен ACTIVATION_ALIGNMENT)
+    size_t chunkBytes_;                 // Размер блока фиксации
+    size_t reservedBytes_;              // Размер зарезервированной области
+    size_t committedBytes_;             // Размер зафиксированной части
+    std::atomic<size_t> committedRows_; // Количество строк в зафиксированной части
+    std::mutex commitMutex_;            // Защита фиксации новых блоков
+    bool reserved_;                     // Память получена резервированием (а не alignedAlloc)
+    bool hugePages_;                    // Запрошены большие страницы
+};
+
+#endif // ACTIVATION_ARENA_H
@@ -0,0 +1,302 @@
+/*
+ * activation_cache.h - Кэш векторов значений нейронов с ограничением памяти
+ *
+ * Этот модуль содержит:
+ * - Класс ActivationCache - отображение "нейрон -> слот" поверх ActivationArena
+ *   с вытеснением холодных векторов при исчерпании бюджета памяти
+ * - Функцию определения лимита памяти контейнера (cgroup v1/v2)
+ *
+ * Без ограничения бюджета каждому нейрону достаётся собственный слот и
+ * вытеснение не происходит. При ограниченном бюджете слотов меньше, чем
+ * нейронов: вытесняемый слот выбирается алгоритмом CLOCK, в котором
+ * каждое обращение к нейрону даёт ему "кредит" тем больший, чем больше
+ * нейронов используют его как вход (LRU, взвешенный по fan-out).
+ * Вытесненный вектор пересчитывается из входов i/j при следующем промахе.
+ * Потоки поиска кэш не изменяют, а только считают промахи по нейронам
+ * (addMisses); основной поток между шагами возвращает в кэш векторы
+ * с наибольшим числом промахов (takeMissed).
+ *
+ * Векторы хранятся в формате кэша (ActivationFormat): при fp16/bf16
+ * в тот же бюджет помещается вдвое больше нейронов.
+ *
+ * Изменять кэш (allocate, touch, pin) можно только из основного потока.
+ * Потоки поиска используют lookup() только для чтения: во время
+ * параллельного поиска основной поток кэш не изменяет.
+ */
+
+#ifndef ACTIVATION_CACHE_H
+#define ACTIVATION_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "activation_arena.h"
+#include "activation_format.h"
+
+// ============================================================================
+// Определение лимита памяти
+// ============================================================================
+
+/**
+ * Лимит памяти cgroup текущего процесса
+ *
+ * Проверяет cgroup v2 (memory.max) и cgroup v1 (memory.limit_in_bytes).
+ *
+ * @return лимит в байтах или 0, если лимит не задан или не определён
+ */
+inline size_t detectCgroupMemoryLimit() {
+    const char* paths[] = {
+        "/sys/fs/cgroup/memory.max",
+        "/sys/fs/cgroup/memory/memory.limit_in_bytes",
+    };
+    for (const char* path : paths) {
+        std::ifstream file(path);
+        if (!file.is_open()) continue;
+        std::string value;
+        file >> value;
+        if (value.empty() || value == "max") return 0;
+        unsigned long long limit = strtoull(value.c_str(), nullptr, 10);
+        // cgroup v1 сообщает о "безлимите" огромным числом
+        if (limit == 0 || limit >= (1ULL << 60)) return 0;
+        return (size_t)limit;
+    }
+    return 0;
+}
+
+// ============================================================================
+// Класс кэша векторов нейронов
+// ============================================================================
+
+class ActivationCache
+{
+public:
+    // Счётчики обращений к кэшу (копируемый снимок)
+    struct Stats {
+        unsigned long long hits;       // Вектор существующего нейрона найден в кэше
+        unsigned long long misses;     // Вектор существующего нейрона пришлось вычислять
+        unsigned long long evictions;  // Вытеснено векторов
+    };
+
+    ActivationCache() : format_(ACTIVATION_FP32), slots_(0), bounded_(false), hand_(0), nextFree_(0), evictions_(0) {
+        resetStats();
+    }
+
+    ActivationCache(const ActivationCache&) = delete;
+    ActivationCache& operator=(const ActivationCache&) = delete;
+
+    /**
+     * Инициализация кэша
+     *
+     * @param neurons - максимальное количество нейронов
+     * @param cols - количество значений в векторе (образов)
+     * @param format - формат хранения значений
+     * @param budgetBytes - бюджет памяти под векторы (0 = без ограничения)
+     * @param minSlots - минимальное количество слотов (не меньше числа одновременно закреплённых)
+     * @param hugePages - запросить большие страницы
+     * @return true при успешном резервировании памяти
+     */
+    bool init(size_t neurons, size_t cols, ActivationFormat format, size_t budgetBytes,
+              size_t minSlots, bool hugePages = false) {
+        const size_t valueSize = activationValueSize(format);
+        size_t rowBytes = ActivationArena::rowBytesFor(cols, valueSize);
+        format_ = format;
+
+        slots_ = neurons;
+        if (budgetBytes > 0) {
+            slots_ = std::min(neurons, std::max(minSlots, budgetBytes / rowBytes));
+        }
+        bounded_ = (slots_ < neurons);
+
+        slotOf_.assign(neurons, -1);
+        fanout_.assign(neurons, 0);
+        owner_.assign(slots_, -1);
+        credit_.assign(slots_, 0);
+        pins_.assign(slots_, 0);
+        missed_.assign(neurons, 0);
+        hand_ = 0;
+        nextFree_ = 0;
+        evictions_ = 0;
+        resetStats();
+
+        return arena_.init(slots_, cols, hugePages, valueSize);
+    }
+
+    /**
+     * Вектор нейрона n, если он находится в кэше (только чтение, потокобезопасно)
+     *
+     * @return ссылка на вектор (data == nullptr, если вектора нет в кэше)
+     */
+    ActivationRef lookup(int n) const {
+        int slot = slotOf_[n];
+        return ActivationRef((slot < 0) ? nullptr : arena_.row(slot), format_);
+    }
+
+    /**
+     * Получение слота под вектор нейрона n (только основной поток)
+     *
+     * Если у нейрона уже есть слот - возвращает его. Иначе занимает
+     * свободный слот, а при их отсутствии вытесняет холодный вектор.
+     *
+     * @param n - номер нейрона
+     * @param evicted - выходной параметр: номер вытесненного нейрона или -1
+     * @return указатель на строку (в формате format()) или nullptr при ошибке
+     */
+    void* allocate(int n, int& evicted) {
+        evicted = -1;
+        int slot = slotOf_[n];
+        if (slot < 0) {
+            if (!bounded_) {
+                // Без ограничения слот совпадает с номером нейрона
+                slot = n;
+            } else if (nextFree_ < slots_) {
+                slot = (int)nextFree_++;
+            } else {
+                slot = findVictim();
+                if (slot < 0) return nullptr;
+                evicted = owner_[slot];
+                slotOf_[evicted] = -1;
+                evictions_++;
+            }
+            owner_[slot] = n;
+            slotOf_[n] = slot;
+        }
+        touch(n);
+        return arena_.acquire((size_t)slot);
+    }
+
+    /**
+     * Отметка обращения к вектору нейрона (только основной поток)
+     */
+    void touch(int n) {
+        if (!bounded_) return;
+        int slot = slotOf_[n];
+        if (slot >= 0) credit_[slot] = (uint8_t)(1 + std::min(fanout_[n], MAX_CREDIT - 1));
+    }
+
+    // Защита вектора от вытеснения на время вычисления зависящего от него нейрона
+    // (без ограничения бюджета вытеснения нет и закрепление не требуется)
+    void pin(int n) { if (!bounded_) return; int slot = slotOf_[n]; if (slot >= 0) pins_[slot]++; }
+    void unpin(int n) { if (!bounded_) return; int slot = slotOf_[n]; if (slot >= 0 && pins_[slot] > 0) pins_[slot]--; }
+
+    // Учёт нового потребителя вектора нейрона n
+    void addFanout(int n) { fanout_[n]++; }
+
+    /**
+     * Учёт промахов по нейронам (можно вызывать из потоков)
+     *
+     * @param counts - количество пересчётов вектора нейрона по номеру нейрона
+     */
+    void addMisses(const std::vector<uint32_t>& counts) {
+        if (!bounded_ || counts.empty()) return;
+        std::lock_guard<std::mutex> lock(missedMutex_);
+        const size_t count = std::min(counts.size(), missed_.size());
+        for (size_t n = 0; n < count; n++) missed_[n] += counts[n];
+    }
+
+    /**
+     * Нейроны вне кэша с наибольшим числом промахов (только основной поток)
+     *
+     * Счётчики промахов обнуляются.
+     *
+     * @param neurons - выход: номера нейронов по возрастанию
+     * @param limit - наибольшее количество нейронов
+     * @param minimum - наименьшее число промахов
+     */
+    void takeMissed(std::vector<int>& neurons, size_t limit, uint32_t minimum) {
+        neurons.clear();
+        if (!bounded_) return;
+        std::lock_guard<std::mutex> lock(missedMutex_);
+        for (size_t n = 0; n < missed_.size(); n++) {
+            if (missed_[n] >= minimum && slotOf_[n] < 0) neurons.push_back((int)n);
+        }
+        if (neurons.size() > limit) {
+            std::nth_element(neurons.begin(), neurons.begin() + limit, neurons.end(),
+                             [this](int a, int b) { return missed_[a] > missed_[b]; });
+            neurons.resize(limit);
+        }
+        std::sort(neurons.begin(), neurons.end());
+        std::fill(missed_.begin(), missed_.end(), 0);
+    }
+
+    // Предвыборка вектора нейрона n, если он в кэше
+    void prefetch(int n) const {
+        if (n >= 0 && n < (int)slotOf_.size() && slotOf_[n] >= 0) arena_.prefetch(slotOf_[n]);
+    }
+
+    // Учёт попаданий и промахов основного потока (без атомарных операций)
+    void hit() { mainHits_++; }
+    void miss() { mainMisses_++; }
+
+    // Учёт попаданий и промахов (атомарно, можно вызывать из потоков)
+    void countHits(unsigned long long count) { hits_.fetch_add(count, std::memory_order_relaxed); }
+    void countMisses(unsigned long long count) { misses_.fetch_add(count, std::memory_order_relaxed); }
+
+    void resetStats() {
+        mainHits_ = 0;
+        mainMisses_ = 0;
+        hits_.store(0);
+        misses_.store(0);
+    }
+
+    Stats stats() const {
+        Stats s;
+        s.hits = mainHits_ + hits_.load();
+        s.misses = mainMisses_ + misses_.load();
+        s.evictions = evictions_;
+        return s;
+    }
+
+    size_t slots() const { return slots_; }
+    ActivationFormat format() const { return format_; }
+    bool isBounded() const { return bounded_; }
+    const ActivationArena& arena() const { return arena_; }
+
+private:
+    // Максимальный кредит слота (количество проходов CLOCK до вытеснения)
+    static constexpr int MAX_CREDIT = 8;
+
+    /**
+     * Поиск вытесняемого слота (CLOCK со взвешенными кредитами)
+     *
+     * @return номер слота или -1, если все слоты закреплены
+     */
+    int findVictim() {
+        for (size_t step = 0; step < slots_ * (MAX_CREDIT + 1); step++) {
+            size_t slot = hand_;
+            hand_ = (hand_ + 1 == slots_) ? 0 : hand_ + 1;
+            if (pins_[slot] > 0) continue;
+            if (credit_[slot] > 0) {
+                credit_[slot]--;
+                continue;
+            }
+            return (int)slot;
+        }
+        return -1;
+    }
+
+    ActivationArena arena_;                 // Память слотов
+    ActivationFormat format_;               // Формат хранения значений
+    std::vector<int> slotOf_;               // Слот нейрона (-1 = не в кэше)
+    std::vector<int> fanout_;               // Количество нейронов, использующих нейрон как вход
+    std::vector<int> owner_;                // Нейрон, занимающий слот (-1 = свободен)
+    std::vector<uint8_t> credit_;           // Кредит слота для алгоритма CLOCK
+    std::vector<int> pins_;                 // Счётчик закреплений слота
+    std::vector<uint32_t> missed_;          // Промахи по нейрону с последнего takeMissed()
+    std::mutex missedMutex_;                // Защищает missed_
+    size_t slots_;                          // Количество слотов
+    bool bounded_;                          // Слотов меньше, чем нейронов
+    size_t hand_;                           // Стрелка CLOCK
+    size_t nextFree_;                       // Первый ещё не использованный слот
+    unsigned long long evictions_;          // Количество вытеснений
+    unsigned long long mainHits_;           // Попадания основного потока
+    unsigned long long mainMisses_;         // Промахи основного потока
+    std::atomic<unsigned long long> hits_;  // Попадания
+    std::atomic<unsigned long long> misses_;// Промахи
+};
+
+#endif // ACTIVATION_CACHE_H
@@ -0,0 +1,480 @@
+/*
+ * activation_format.h - Формат хранения векторов значений нейронов
+ *
+ * Этот модуль содержит:
+ * - Перечисление ActivationFormat (fp32, fp16, bf16; для ссылок также
+ *   скаляр и коды u8)
+ * - Преобразования fp32 <-> fp16/bf16 (скалярные и SIMD: F16C, AVX2;
+ *   выбираются по уровню SIMD процессора)
+ * - ActivationRef - ссылку на вектор значений в любом формате
+ * - roundValues() - округление fp32 до точности формата хранения
+ * - applyOpMixed()/storeOpMixed() - применение операции нейрона
+ *   к векторам в разных форматах
+ * - errorOpMixed() - ошибка кандидата по слитному ядру для векторов
+ *   в разных форматах
+ * - errorOpBroadcast() и перегрузка applyOpMixed() для OpKernel - ядра
+ *   с операндом-скаляром (базисный нейрон) без вектора одинаковых значений
+ *
+ * Векторы значений - промежуточные данные, поэтому в кэше их можно
+ * хранить в 16-битном формате: это вдвое сокращает и объём кэша, и
+ * трафик памяти в циклах поиска. Вычисления всегда выполняются в fp32:
+ * операнды расширяются блоками по ACTIVATION_BLOCK значений, которые
+ * остаются в L1, и только затем передаются в SIMD-операции из simd_ops.h.
+ *
+ * fp16 (IEEE 754 half): 10 бит мантиссы, диапазон до 65504.
+ * bf16 (bfloat16): 7 бит мантиссы, диапазон как у fp32.
+ */
+
+#ifndef ACTIVATION_FORMAT_H
+#define ACTIVATION_FORMAT_H
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <algorithm>
+
+// Уровень SIMD (activeSIMDTier) и атрибуты target
+#include "simd_ops.h"
+
+// ============================================================================
+// Формат хранения
+// ============================================================================
+
+enum ActivationFormat {
+    ACTIVATION_FP32 = 0,    // 32-битные float (без потерь)
+    ACTIVATION_FP16 = 1,    // IEEE 754 half precision
+    ACTIVATION_BF16 = 2,    // bfloat16 (старшие 16 бит float)
+    ACTIVATION_SCALAR = 3,  // Одно значение fp32 для всех образов (базисный нейрон;
+                            // только для ActivationRef, не формат кэша)
+    ACTIVATION_U8 = 4,      // Коды 0..255, значение - ActivationU8Table[код]
+                            // (матрица входов, см. receptor_matrix.h; не формат кэша)
+};
+
+// Таблица расширения ACTIVATION_U8 (заполняет владелец кодов - ReceptorMatrix)
+inline float ActivationU8Table[256] = {};
+
+// Размер одного значения в байтах (у скаляра все значения - одно и то же)
+inline size_t activationValueSize(ActivationFormat format) {
+    switch (format) {
+        case ACTIVATION_FP32:   return sizeof(float);
+        case ACTIVATION_SCALAR: return 0;
+        case ACTIVATION_U8:     return sizeof(uint8_t);
+        default:                return sizeof(uint16_t);
+    }
+}
+
+// Имя формата для вывода
+inline const char* activationFormatName(ActivationFormat format) {
+    switch (format) {
+        case ACTIVATION_FP16:   return "fp16";
+        case ACTIVATION_BF16:   return "bf16";
+        case ACTIVATION_SCALAR: return "scalar";
+        case ACTIVATION_U8:     return "u8";
+        default:                return "fp32";
+    }
+}
+
+/**
+ * Разбор имени формата ("fp32", "fp16", "bf16")
+ *
+ * @param name - имя формата
+ * @param format - выходной параметр
+ * @return true, если имя распознано
+ */
+inline bool parseActivationFormat(const std::string& name, ActivationFormat& format) {
+    if (name == "fp32") { format = ACTIVATION_FP32; return true; }
+    if (name == "fp16") { format = ACTIVATION_FP16; return true; }
+    if (name == "bf16") { format = ACTIVATION_BF16; return true; }
+    return false;
+}
+
+// ============================================================================
+// Скалярные преобразования
+// ============================================================================
+
+inline uint32_t floatBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float bitsToFloat(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * fp32 -> fp16 с округлением к ближайшему чётному
+ */
+inline uint16_t floatToHalf(float value) {
+    uint32_t x = floatBits(value);
+    uint16_t sign = (uint16_t)((x >> 16) & 0x8000);
+    x &= 0x7FFFFFFF;
+
+    if (x >= 0x7F800000) {
+        // Бесконечность или NaN (NaN становится "тихим", старшие биты сохраняются, как в F16C)
+        return sign | ((x > 0x7F800000) ? (uint16_t)(0x7E00 | ((x >> 13) & 0x03FF)) : 0x7C00);
+    }
+    if (x >= 0x477FF000) {
+        // |value| >= 65520 округляется до бесконечности
+        return sign | 0x7C00;
+    }
+    if (x < 0x38800000) {
+        // Денормализованные числа fp16: шаг 2^-24
+        float scaled = bitsToFloat(x) * 16777216.0f;
+        return sign | (uint16_t)lrintf(scaled);
+    }
+    uint32_t rounded = x + 0x0FFF + ((x >> 13) & 1);
+    return sign | (uint16_t)((rounded >> 13) - (112 << 10));
+}
+
+/**
+ * fp16 -> fp32 (без потерь)
+ */
+inline float halfToFloat(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x03FF;
+
+    if (exponent == 0) {
+        float value = (float)mantissa * 5.9604644775390625e-8f;  // 2^-24
+        return sign ? -value : value;
+    }
+    if (exponent == 31) {
+        return bitsToFloat(sign | 0x7F800000 | (mantissa << 13));
+    }
+    return bitsToFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+/**
+ * fp32 -> bf16 с округлением к ближайшему чётному
+ */
+inline uint16_t floatToBF16(float value) {
+    uint32_t x = floatBits(value);
+    if ((x & 0x7FFFFFFF) > 0x7F800000) {
+        return (uint16_t)((x >> 16) | 0x0040);
+    }
+    return (uint16_t)((x + 0x7FFF + ((x >> 16) & 1)) >> 16);
+}
+
+/**
+ * bf16 -> fp32 (без потерь)
+ */
+inline float bf16ToFloat(uint16_t value) {
+    return bitsToFloat((uint32_t)value << 16);
+}
+
+// ============================================================================
+// Векторные преобразования
+// ============================================================================
+
+#ifdef SIMD_X86
+
+// F16C: fp16 -> fp32 по 8 значений; возвращает количество обработанных
+SIMD_TARGET_AVX2 inline int widenHalfAvx2(float* dst, const uint16_t* s, int count) {
+    int i = 0;
+    for (; i <= count - 8; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+    return i;
+}
+
+// AVX2: bf16 -> fp32 по 8 значений
+SIMD_TARGET_AVX2 inline int widenBF16Avx2(float* dst, const uint16_t* s, int count) {
+    int i = 0;
+    for (; i <= count - 8; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        __m256i w = _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16);
+        _mm256_storeu_ps(dst + i, _mm256_castsi256_ps(w));
+    }
+    return i;
+}
+
+// F16C: fp32 -> fp16 по 8 значений
+SIMD_TARGET_AVX2 inline int narrowHalfAvx2(uint16_t* d, const float* src, int count) {
+    int i = 0;
+    for (; i <= count - 8; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), h);
+    }
+    return i;
+}
+
+// AVX2: fp32 -> bf16 по 8 значений
+SIMD_TARGET_AVX2 inline int narrowBF16Avx2(uint16_t* d, const float* src, int count) {
+    const __m256i roundBias = _mm256_set1_epi32(0x7FFF);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i quietBit = _mm256_set1_epi32(0x0040);
+    int i = 0;
+    for (; i <= count - 8; i += 8) {
+        __m256 v = _mm256_loadu_ps(src + i);
+        __m256i x = _mm256_castps_si256(v);
+        // Округление к ближайшему чётному, NaN остаётся NaN
+        __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(x, 16), one);
+        __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(x, roundBias), lsb), 16);
+        __m256i nan = _mm256_or_si256(_mm256_srli_epi32(x, 16), quietBit);
+        __m256 isNan = _mm256_cmp_ps(v, v, _CMP_UNORD_Q);
+        __m256i bits = _mm256_castps_si256(_mm256_blendv_ps(
+            _mm256_castsi256_ps(rounded), _mm256_castsi256_ps(nan), isNan));
+        // Упаковка 8 x 32 бит -> 8 x 16 бит (packus работает по 128-битным половинам)
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(bits, bits), 0xD8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), _mm256_castsi256_si128(packed));
+    }
+    return i;
+}
+
+#endif // SIMD_X86
+
+/**
+ * Расширение count значений из формата format в fp32
+ */
+inline void widenValues(float* dst, const void* src, ActivationFormat format, int count) {
+    int i = 0;
+    if (format == ACTIVATION_FP32) {
+        memcpy(dst, src, count * sizeof(float));
+        return;
+    }
+    if (format == ACTIVATION_SCALAR) {
+        std::fill(dst, dst + count, *static_cast<const float*>(src));
+        return;
+    }
+    if (format == ACTIVATION_U8) {
+        const uint8_t* codes = static_cast<const uint8_t*>(src);
+        for (; i < count; i++) dst[i] = ActivationU8Table[codes[i]];
+        return;
+    }
+    const uint16_t* s = static_cast<const uint16_t*>(src);
+#ifdef SIMD_X86
+    const bool vector = activeSIMDTier() >= SIMD_TIER_AVX2;
+#endif
+
+    if (format == ACTIVATION_FP16) {
+#ifdef SIMD_X86
+        if (vector) i = widenHalfAvx2(dst, s, count);
+#endif
+        for (; i < count; i++) dst[i] = halfToFloat(s[i]);
+    } else {
+#ifdef SIMD_X86
+        if (vector) i = widenBF16Avx2(dst, s, count);
+#endif
+        for (; i < count; i++) dst[i] = bf16ToFloat(s[i]);
+    }
+}
+
+/**
+ * Сужение count значений из fp32 в формат format
+ */
+inline void narrowValues(void* dst, ActivationFormat format, const float* src, int count) {
+    int i = 0;
+    if (format == ACTIVATION_FP32) {
+        memcpy(dst, src, count * sizeof(float));
+        return;
+    }
+    uint16_t* d = static_cast<uint16_t*>(dst);
+#ifdef SIMD_X86
+    const bool vector = activeSIMDTier() >= SIMD_TIER_AVX2;
+#endif
+
+    if (format == ACTIVATION_FP16) {
+#ifdef SIMD_X86
+        if (vector) i = narrowHalfAvx2(d, src, count);
+#endif
+        for (; i < count; i++) d[i] = floatToHalf(src[i]);
+    } else {
+#ifdef SIMD_X86
+        if (vector) i = narrowBF16Avx2(d, src, count);
+#endif
+        for (; i < count; i++) d[i] = floatToBF16(src[i]);
+    }
+}
+
+// ============================================================================
+// Ссылка на вектор значений
+// ============================================================================
+
+// Размер блока расширения операндов (значений; 1 КБ на операнд в fp32)
+const int ACTIVATION_BLOCK = 256;
+
+/**
+ * Округление count значений fp32 до точности формата format (на месте)
+ *
+ * Пересчитанный во временный вектор нейрон совпадает с его строкой
+ * в кэше 16-битного формата.
+ */
+inline void roundValues(float* values, ActivationFormat format, int count) {
+    if (format == ACTIVATION_FP32) return;
+    alignas(64) uint16_t narrow[ACTIVATION_BLOCK];
+    for (int offset = 0; offset < count; offset += ACTIVATION_BLOCK) {
+        int block = std::min(ACTIVATION_BLOCK, count - offset);
+        narrowValues(narrow, format, values + offset, block);
+        widenValues(values + offset, narrow, format, block);
+    }
+}
+
+/**
+ * Ссылка на вектор значений нейрона в формате хранения
+ *
+ * Строки кэша хранятся в формате кэша, а временные векторы потоков
+ * поиска - всегда в fp32; ActivationRef позволяет передавать и те,
+ * и другие в одни и те же функции. Базисные нейроны передаются
+ * скаляром (ACTIVATION_SCALAR): data указывает на одно значение,
+ * widen() размножает его.
+ */
+struct ActivationRef {
+    const void* data;
+    ActivationFormat format;
+
+    ActivationRef() : data(nullptr), format(ACTIVATION_FP32) {}
+    ActivationRef(const float* values) : data(values), format(ACTIVATION_FP32) {}
+    ActivationRef(const void* values, ActivationFormat fmt) : data(values), format(fmt) {}
+
+    bool isFloat() const { return format == ACTIVATION_FP32; }
+    bool isScalar() const { return format == ACTIVATION_SCALAR; }
+    const float* floats() const { return static_cast<const float*>(data); }
+
+    // Ссылка на значения, начиная с offset
+    ActivationRef at(int offset) const {
+        return ActivationRef(static_cast<const char*>(data) + offset * activationValueSize(format), format);
+    }
+
+    /**
+     * Первые count значений в fp32
+     *
+     * @param buf - буфер на count значений (используется, если формат не fp32)
+     * @return указатель на значения (data или buf)
+     */
+    const float* widen(float* buf, int count) const {
+        if (isFloat()) return floats();
+        widenValues(buf, data, format, count);
+        return buf;
+    }
+};
+
+// ============================================================================
+// Операции над векторами в разных форматах
+// ============================================================================
+
+/**
+ * r = f(a, b) для векторов в любом формате, результат в fp32
+ *
+ * Если оба операнда в fp32, операция вызывается напрямую. Иначе операнды
+ * расширяются блоками по ACTIVATION_BLOCK значений (блоки остаются в L1),
+ * поэтому из памяти читается только 16-битное представление.
+ *
+ * @param f - операция нейрона (oper или функтор с той же сигнатурой)
+ */
+template <typename Op>
+inline void applyOpMixed(Op f, float* r, const ActivationRef& a, const ActivationRef& b, const int size) {
+    if (a.isFloat() && b.isFloat()) {
+        f(r, a.floats(), b.floats(), size);
+        return;
+    }
+    alignas(64) float abuf[ACTIVATION_BLOCK];
+    alignas(64) float bbuf[ACTIVATION_BLOCK];
+    for (int offset = 0; offset < size; offset += ACTIVATION_BLOCK) {
+        int count = std::min(ACTIVATION_BLOCK, size - offset);
+        f(r + offset, a.at(offset).widen(abuf, count), b.at(offset).widen(bbuf, count), count);
+    }
+}
+
+/**
+ * То же для операции OpKernel: операнды-скаляры передаются в ядро одним
+ * значением (OpKernel::broadcast), и из памяти читается только векторный
+ * операнд (16-битный расширяется блоками)
+ */
+template <int Kind>
+inline void applyOpMixed(OpKernel<Kind> f, float* r, const ActivationRef& a, const ActivationRef& b, const int size) {
+    if (!a.isScalar() && !b.isScalar()) {
+        applyOpMixed<OpKernel<Kind>>(f, r, a, b, size);
+        return;
+    }
+    const ActivationRef& v = a.isScalar() ? b : a;
+    if (v.isFloat() || v.isScalar()) {
+        f.broadcast(r, a.floats(), a.isScalar(), b.floats(), b.isScalar(), size);
+        return;
+    }
+    alignas(64) float vbuf[ACTIVATION_BLOCK];
+    for (int offset = 0; offset < size; offset += ACTIVATION_BLOCK) {
+        int count = std::min(ACTIVATION_BLOCK, size - offset);
+        const float* z = v.at(offset).widen(vbuf, count);
+        f.broadcast(r + offset, a.isScalar() ? a.floats() : z, a.isScalar(),
+                    b.isScalar() ? b.floats() : z, b.isScalar(), count);
+    }
+}
+
+/**
+ * out = f(a, b) с сохранением результата в формате format
+ */
+template <typename Op>
+inline void storeOpMixed(Op f, void* out, ActivationFormat format,
+                         const ActivationRef& a, const ActivationRef& b, const int size) {
+    if (format == ACTIVATION_FP32) {
+        applyOpMixed(f, static_cast<float*>(out), a, b, size);
+        return;
+    }
+    alignas(64) float rbuf[ACTIVATION_BLOCK];
+    const size_t valueSize = activationValueSize(format);
+    for (int offset = 0; offset < size; offset += ACTIVATION_BLOCK) {
+        int count = std::min(ACTIVATION_BLOCK, size - offset);
+        applyOpMixed(f, rbuf, a.at(offset), b.at(offset), count);
+        narrowValues(static_cast<char*>(out) + offset * valueSize, format, rbuf, count);
+    }
+}
+
+/**
+ * Квадратичная ошибка кандидата по слитному ядру для векторов в любом формате
+ *
+ * 16-битные операнды расширяются блоками по ACTIVATION_BLOCK значений;
+ * сумма переносится между блоками, граница проверяется после каждого.
+ *
+ * @param kernel - ядро (z1, z2, t, w, count, sum, bound) -> sum + ошибка
+ * @param t - ожидаемые выходы (fp32)
+ * @param w - веса образов или nullptr
+ * @param bound - граница ошибки (см. op_error_simd)
+ */
+template <typename Kernel>
+inline float errorOpMixed(Kernel kernel, const ActivationRef& a, const ActivationRef& b,
+                          const float* t, const float* w, const int size, const float bound) {
+    if (a.isFloat() && b.isFloat()) {
+        return kernel(a.floats(), b.floats(), t, w, size, 0.0f, bound);
+    }
+    alignas(64) float abuf[ACTIVATION_BLOCK];
+    alignas(64) float bbuf[ACTIVATION_BLOCK];
+    float sum = 0.0f;
+    for (int offset = 0; offset < size && sum < bound; offset += ACTIVATION_BLOCK) {
+        int count = std::min(ACTIVATION_BLOCK, size - offset);
+        sum = kernel(a.at(offset).widen(abuf, count), b.at(offset).widen(bbuf, count), t + offset,
+                     w ? w + offset : nullptr, count, sum, bound);
+    }
+    return sum;
+}
+
+/**
+ * Квадратичная ошибка op(a, b), где хотя бы один операнд - скаляр
+ *
+ * Скаляры передаются в слитное ядро одним значением (op_error_broadcast_simd);
+ * 16-битный векторный операнд расширяется блоками, как в errorOpMixed.
+ */
+inline float errorOpBroadcast(FusedOp kind, const ActivationRef& a, const ActivationRef& b,
+                              const float* t, const float* w, const int size, const float bound) {
+    const ActivationRef& v = a.isScalar() ? b : a;
+    if (v.isFloat() || v.isScalar()) {
+        return op_error_broadcast_simd(kind, a.floats(), a.isScalar(), b.floats(), b.isScalar(),
+                                       t, w, size, 0.0f, bound);
+    }
+    alignas(64) float vbuf[ACTIVATION_BLOCK];
+    float sum = 0.0f;
+    for (int offset = 0; offset < size && sum < bound; offset += ACTIVATION_BLOCK) {
+        int count = std::min(ACTIVATION_BLOCK, size - offset);
+        const float* z = v.at(offset).widen(vbuf, count);
+        sum = op_error_broadcast_simd(kind, a.isScalar() ? a.floats() : z, a.isScalar(),
+                                      b.isScalar() ? b.floats() : z, b.isScalar(),
+                                      t + offset, w ? w + offset : nullptr, count, sum, bound);
+    }
+    return sum;
+}
+
+#endif // ACTIVATION_FORMAT_H
@@ -0,0 +1,426 @@
+/*
+ * batch_inference.h - Пакетная и потоковая классификация
+ *
+ * Этот модуль содержит:
+ * - Кодирование текста во входы сети (encodeReceptorCode, encodeReceptor)
+ *   и выбор класса
+ * - Пакетную классификацию (classifyBatch) поверх InferencePlan::evaluateBatch
+ * - Класс LineChunkReader - чтение строк файла или stdin большими блоками
+ * - Потоковую классификацию (classifyStream) с выводом в TSV или JSONL
+ *
+ * Потоковый режим читает входы блоками по STREAM_CHUNK_BYTES, делит
+ * строки блока между NumThreads потоками (каждый со своим контекстом
+ * InferenceContext; план только читается) и выводит результаты
+ * в исходном порядке строк.
+ *
+ * Примечание: Этот файл предназначен для включения в main.cpp после
+ * объявления плана инференса (g_inferencePlan), контекста основного
+ * потока (g_inferenceContext) и скомпилированной модели (g_compiledModel).
+ */
+
+#ifndef BATCH_INFERENCE_H
+#define BATCH_INFERENCE_H
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <chrono>
+
+// ============================================================================
+// Кодирование входов
+// ============================================================================
+
+/**
+ * Код d-го рецептора для входного текста: код символа, позиции после
+ * конца текста заполняются пробелами
+ */
+inline unsigned char encodeReceptorCode(std::string_view text, int d) {
+    if (d < (int)text.length() && text[d] != 0) {
+        return (unsigned char)text[d];
+    }
+    return (unsigned char)' ';
+}
+
+/**
+ * Значение d-го рецептора для входного текста (код / max_num)
+ */
+inline float encodeReceptor(std::string_view text, int d) {
+    return float(encodeReceptorCode(text, d)) / float(max_num);
+}
+
+/**
+ * Номер класса с максимальным выходом
+ *
+ * @param outputs - выходы всех классов
+ * @param classCount - количество классов
+ */
+int predictClass(const float* outputs, int classCount = Classes) {
+    int predictedClass = -1;
+    float maxOutput = -big;
+    for (int c = 0; c < classCount; c++) {
+        if (outputs[c] > maxOutput) {
+            maxOutput = outputs[c];
+            predictedClass = c;
+        }
+    }
+    return predictedClass;
+}
+
+/**
+ * Случайные тексты из строчных букв для бенчмарков (воспроизводимо)
+ *
+ * @param count - количество текстов
+ * @param seed - начальное значение генератора
+ * @return тексты длиной от 1 до Receptors символов
+ */
+std::vector<std::string> randomInputs(int count, unsigned int seed) {
+    std::vector<std::string> inputs(count);
+    for (std::string& text : inputs) {
+        seed = seed * 1103515245u + 12345u;
+        int length = 1 + (int)((seed >> 16) % (unsigned)Receptors);
+        for (int d = 0; d < length; d++) {
+            seed = seed * 1103515245u + 12345u;
+            text += (char)('a' + (seed >> 16) % 26);
+        }
+    }
+    return inputs;
+}
+
+// ============================================================================
+// Пакетная классификация
+// ============================================================================
+
+/**
+ * Пакетная классификация входных текстов
+ *
+ * Тексты кодируются в матрицу "рецептор x образ", после чего каждая
+ * операция плана вычисляется сразу для всего пакета векторными
+ * операциями op[] (как при обучении по Images образам).
+ * Если загружена скомпилированная модель (g_compiledModel) - пакет
+ * считается ею.
+ * Не изменяет глобальное состояние, кроме контекста.
+ *
+ * @param inputs - входные тексты
+ * @param count - количество текстов
+ * @param scores - выход: count x классов плана выходов (по строке на текст)
+ * @param context - контекст инференса вызывающего потока
+ * @param useCompiled - считать скомпилированной моделью, если она загружена
+ *                      (false для плана, подменённого после её загрузки)
+ */
+void classifyBatch(const std::string_view* inputs, int count, std::vector<float>& scores,
+                   InferenceContext& context, bool useCompiled = true) {
+    const int receptorCount = context.plan().receptorCount();
+    scores.resize((size_t)count * context.plan().classCount());
+    std::vector<float>& receptors = context.batchInput();
+    receptors.resize((size_t)receptorCount * count);
+
+    // Скомпилированная модель принимает входы по образам ("образ x рецептор")
+    if (useCompiled && g_compiledModel.isLoaded()) {
+        for (int s = 0; s < count; s++) {
+            float* row = receptors.data() + (size_t)s * receptorCount;
+            for (int d = 0; d < receptorCount; d++) {
+                row[d] = encodeReceptor(inputs[s], d);
+            }
+        }
+        g_compiledModel.classifyBatch(receptors.data(), count, scores.data());
+        return;
+    }
+
+    for (int d = 0; d < receptorCount; d++) {
+        float* row = receptors.data() + (size_t)d * count;
+        for (int s = 0; s < count; s++) {
+            row[s] = encodeReceptor(inputs[s], d);
+        }
+    }
+    context.evaluateBatch(receptors.data(), count, scores.data());
+}
+
+/**
+ * Пакетная классификация входных текстов (основной поток)
+ *
+ * @param inputs - входные тексты
+ * @param scores - выход: inputs.size() x Classes выходов (по строке на текст)
+ */
+void classifyBatch(const std::vector<std::string>& inputs, std::vector<float>& scores) {
+    std::vector<std::string_view> views(inputs.begin(), inputs.end());
+    classifyBatch(views.data(), (int)views.size(), scores, g_inferenceContext);
+}
+
+/**
+ * Количество потоков классификации
+ *
+ * NumThreads (0 = по числу ядер) или 1 при --single-thread.
+ */
+int inferenceThreadCount() {
+    if (!UseMultithreading) return 1;
+    int threadCount = (NumThreads > 0) ? NumThreads : (int)std::thread::hardware_concurrency();
+    return (threadCount > 0) ? threadCount : 4;
+}
+
+// ============================================================================
+// Чтение строк блоками
+// ============================================================================
+
+// Размер блока чтения потокового режима
+const size_t STREAM_CHUNK_BYTES = 4 << 20;
+
+/**
+ * Чтение строк из файла большими блоками
+ *
+ * Строки блока возвращаются как string_view во внутренний буфер и
+ * действительны до следующего вызова next(). Незавершённая строка в
+ * конце блока переносится в начало следующего; строка длиннее блока
+ * увеличивает буфер. Завершающий '\r' (CRLF) отбрасывается.
+ */
+class LineChunkReader
+{
+public:
+    explicit LineChunkReader(FILE* file) : file_(file), buffer_(STREAM_CHUNK_BYTES), size_(0), eof_(false) {}
+
+    /**
+     * Чтение следующего блока строк
+     *
+     * @param lines - выход: строки блока
+     * @return false, если входные данные закончились
+     */
+    bool next(std::vector<std::string_view>& lines) {
+        lines.clear();
+        while (lines.empty()) {
+            if (eof_ && size_ == 0) return false;
+
+            if (!eof_) {
+                if (size_ == buffer_.size()) buffer_.resize(buffer_.size() * 2);
+                size_t read = fread(buffer_.data() + size_, 1, buffer_.size() - size_, file_);
+                size_ += read;
+                if (read == 0) eof_ = true;
+            }
+
+            // Разбиваем на полные строки (при конце файла - и последнюю неполную)
+            size_t begin = 0;
+            for (size_t pos = 0; pos < size_; pos++) {
+                if (buffer_[pos] == '\n') {
+                    addLine(lines, begin, pos);
+                    begin = pos + 1;
+                }
+            }
+            if (eof_ && begin < size_) {
+                addLine(lines, begin, size_);
+                begin = size_;
+            }
+
+            // Остаток переносим в начало: строки блока уже не нужны после next()
+            if (!lines.empty()) {
+                pending_.assign(buffer_.data() + begin, buffer_.data() + size_);
+                std::swap(current_, buffer_);
+                buffer_.resize(std::max(current_.size(), pending_.size() + STREAM_CHUNK_BYTES));
+                std::copy(pending_.begin(), pending_.end(), buffer_.begin());
+                size_ = pending_.size();
+            }
+        }
+        return true;
+    }
+
+private:
+    void addLine(std::vector<std::string_view>& lines, size_t begin, size_t end) {
+        if (end > begin && buffer_[end - 1] == '\r') end--;
+        lines.emplace_back(buffer_.data() + begin, end - begin);
+    }
+
+    FILE* file_;
+    std::vector<char> buffer_;   // Читаемый блок
+    std::vector<char> current_;  // Блок, на который ссылаются строки последнего next()
+    std::vector<char> pending_;  // Незавершённая строка
+    size_t size_;                // Заполнено байт в buffer_
+    bool eof_;
+};
+
+// ============================================================================
+// Потоковая классификация
+// ============================================================================
+
+// Формат вывода потоковой классификации
+enum StreamFormat {
+    STREAM_TSV,    // текст<TAB>класс<TAB>выход_0<TAB>...<TAB>выход_N
+    STREAM_JSONL   // {"input": ..., "class": ..., "class_id": ..., "scores": [...]}
+};
+
+/**
+ * Разбор имени формата вывода (tsv, jsonl)
+ *
+ * @return true, если имя распознано
+ */
+inline bool parseStreamFormat(const std::string& name, StreamFormat& format) {
+    if (name == "tsv") { format = STREAM_TSV; return true; }
+    if (name == "jsonl") { format = STREAM_JSONL; return true; }
+    return false;
+}
+
+// Добавление строки в JSON-виде (кавычки и экранирование)
+inline void appendJsonString(std::string& out, std::string_view text) {
+    out += '"';
+    for (char ch : text) {
+        switch (ch) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char)ch < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)ch);
+                    out += escaped;
+                } else {
+                    out += ch;
+                }
+        }
+    }
+    out += '"';
+}
+
+// Добавление значения выхода (в JSON нечисловые значения записываются как null)
+inline void appendScore(std::string& out, float value, bool json) {
+    if (json && !std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%.6g", value);
+    out.append(text, length);
+}
+
+/**
+ * Форматирование результата классификации одного входа
+ *
+ * @param out - строка, к которой добавляется результат (с переводом строки)
+ * @param text - входной текст
+ * @param outputs - выходы всех классов
+ * @param classNames - имена классов модели
+ * @param format - формат вывода
+ */
+void appendClassification(std::string& out, std::string_view text, const float* outputs,
+                          const std::vector<std::string>& classNames, StreamFormat format) {
+    static const std::string unknownClass;
+    const int classCount = (int)classNames.size();
+    const int predictedClass = predictClass(outputs, classCount);
+    const std::string& className = (predictedClass >= 0) ? classNames[predictedClass] : unknownClass;
+
+    if (format == STREAM_JSONL) {
+        out += "{\"input\":";
+        appendJsonString(out, text);
+        out += ",\"class\":";
+        appendJsonString(out, className);
+        out += ",\"class_id\":";
+        out += std::to_string(predictedClass);
+        out += ",\"scores\":[";
+        for (int c = 0; c < classCount; c++) {
+            if (c > 0) out += ',';
+            appendScore(out, outputs[c], true);
+        }
+        out += "]}\n";
+    } else {
+        out.append(text.data(), text.size());
+        out += '\t';
+        out += className;
+        for (int c = 0; c < classCount; c++) {
+            out += '\t';
+            appendScore(out, outputs[c], false);
+        }
+        out += '\n';
+    }
+}
+
+/**
+ * Классификация части блока и форматирование результатов
+ *
+ * @param lines - строки части блока
+ * @param count - количество строк
+ * @param format - формат вывода
+ * @param context - контекст инференса потока
+ * @param scores - буфер выходов потока
+ * @param out - выход: отформатированные результаты
+ */
+void classifyStreamPart(const std::string_view* lines, int count, StreamFormat format,
+                        InferenceContext& context, std::vector<float>& scores, std::string& out) {
+    out.clear();
+    if (count == 0) return;
+    classifyBatch(lines, count, scores, context);
+    for (int s = 0; s < count; s++) {
+        appendClassification(out, lines[s], scores.data() + (size_t)s * Classes, classes, format);
+    }
+}
+
+/**
+ * Потоковая классификация строк файла или stdin
+ *
+ * Результаты пишутся в stdout, итоговая статистика - в stderr
+ * (stdout остаётся пригодным для разбора).
+ *
+ * @param path - путь к файлу или "-" для stdin
+ * @param format - формат вывода
+ * @return код возврата программы
+ */
+int classifyStream(const std::string& path, StreamFormat format) {
+    FILE* file = (path == "-") ? stdin : fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        std::cerr << "Error: Cannot open input file " << path << std::endl;
+        return 1;
+    }
+
+    const int threadCount = inferenceThreadCount();
+
+    std::vector<InferenceContext> contexts(threadCount, InferenceContext(g_inferencePlan));
+    std::vector<std::vector<float>> scores(threadCount);
+    std::vector<std::string> outputs(threadCount);
+
+    LineChunkReader reader(file);
+    std::vector<std::string_view> lines;
+    unsigned long long total = 0;
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    while (reader.next(lines)) {
+        const int count = (int)lines.size();
+
+        // Не меньше одного блока плана на поток
+        int parts = std::min(threadCount, (count + PLAN_BATCH_TILE - 1) / PLAN_BATCH_TILE);
+        if (parts < 1) parts = 1;
+        const int perPart = (count + parts - 1) / parts;
+
+        auto runPart = [&](int t) {
+            int first = std::min(count, t * perPart);
+            int last = std::min(count, first + perPart);
+            classifyStreamPart(lines.data() + first, last - first, format,
+                               contexts[t], scores[t], outputs[t]);
+        };
+
+        if (parts == 1) {
+            runPart(0);
+        } else {
+            std::vector<std::thread> threads;
+            threads.reserve(parts);
+            for (int t = 0; t < parts; t++) threads.emplace_back(runPart, t);
+            for (auto& t : threads) t.join();
+        }
+
+        for (int t = 0; t < parts; t++) {
+            fwrite(outputs[t].data(), 1, outputs[t].size(), stdout);
+        }
+        total += count;
+    }
+
+    bool readError = ferror(file) != 0;
+    if (file != stdin) fclose(file);
+    fflush(stdout);
+    if (readError) {
+        std::cerr << "Error: Cannot read input file " << path << std::endl;
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+    std::cerr << "Classified " << total << " inputs in " << (seconds * 1000.0) << " ms (";
+    if (seconds > 0.0) std::cerr << (total / seconds) << " inputs/sec, ";
+    std::cerr << threadCount << " threads)" << std::endl;
+    return 0;
+}
+
+#endif // BATCH_INFERENCE_H
@@ -0,0 +1,400 @@
+/*
+ * compiled_model.h - Генерация C++ кода модели и загрузка скомпилированной модели
+ *
+ * Этот модуль содержит:
+ * - Функцию emitModelCpp() - генерацию линейного C++ кода из плана инференса
+ * - Функцию buildModelLibrary() - сборку сгенерированного кода в разделяемую библиотеку
+ * - Класс CompiledModel - загрузку библиотеки (dlopen/LoadLibrary) для инференса
+ *
+ * Обученная модель - статический граф операций, поэтому её можно
+ * скомпилировать: генератор выписывает только достижимые из выходов
+ * операции (InferencePlan) в виде последовательности присваиваний.
+ * Базисные входы подставляются как константы, операции над одними
+ * константами вычисляются при генерации. Пакетная функция считает
+ * блоки по COMPILED_MODEL_LANES входов, переиспользуя строки рабочей
+ * памяти так же, как пакетный план. Код вычисляет те же значения,
+ * что и интерпретатор (библиотека собирается с -ffp-contract=off).
+ *
+ * Интерфейс библиотеки (extern "C", версия NNETS_MODEL_ABI):
+ *   int nnets_abi_version();
+ *   int nnets_receptors();
+ *   int nnets_classes();
+ *   const char* nnets_class_name(int c);
+ *   void nnets_classify(const float* receptors, float* scores);
+ *   void nnets_classify_batch(const float* receptors, int count, float* scores);
+ * Во входах пакета рецепторы образа s - receptors[s * nnets_receptors() + d].
+ *
+ * Примечание: Этот файл предназначен для включения в main.cpp после
+ * объявления плана инференса (g_inferencePlan).
+ */
+
+#ifndef COMPILED_MODEL_H
+#define COMPILED_MODEL_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <dlfcn.h>
+#endif
+
+// Версия интерфейса сгенерированной библиотеки
+const int NNETS_MODEL_ABI = 1;
+
+// Количество входов в блоке пакетной функции сгенерированного кода
+const int COMPILED_MODEL_LANES = 16;
+
+// ============================================================================
+// Генерация кода
+// ============================================================================
+
+/**
+ * Запись значения float в виде литерала C++, читаемого без потери точности
+ */
+inline std::string floatLiteral(float value) {
+    if (std::isnan(value)) return "std::numeric_limits<float>::quiet_NaN()";
+    if (std::isinf(value)) {
+        return (value < 0) ? "-std::numeric_limits<float>::infinity()" : "std::numeric_limits<float>::infinity()";
+    }
+    char text[32];
+    snprintf(text, sizeof(text), "%.9g", value);
+    std::string literal = text;
+    if (literal.find_first_of(".e") == std::string::npos) literal += ".0";
+    return literal + "f";
+}
+
+/**
+ * Запись строки в виде строкового литерала C++
+ */
+inline std::string stringLiteral(const std::string& text) {
+    std::string literal = "\"";
+    for (unsigned char ch : text) {
+        if (ch == '"' || ch == '\\') {
+            literal += '\\';
+            literal += (char)ch;
+        } else if (ch < 0x20 || ch >= 0x7F) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\%03o", ch);
+            literal += escaped;
+        } else {
+            literal += (char)ch;
+        }
+    }
+    return literal + "\"";
+}
+
+/**
+ * Генерация C++ кода скомпилированного плана
+ *
+ * @param plan - скомпилированный план инференса
+ * @param classNames - имена классов
+ * @param filePath - путь к выходному .cpp файлу
+ * @param source - описание источника модели (для комментария в файле)
+ * @return true при успешной записи
+ */
+bool emitModelCpp(const InferencePlan& plan, const vector<string>& classNames,
+                  const string& filePath, const string& source) {
+    const int receptors = plan.receptorCount();
+    const int inputs = plan.inputCount();
+    const int classCount = plan.classCount();
+    const std::vector<PlanInstruction>& code = plan.instructions();
+
+    // Выражения каждого значения плана: в поштучной функции (рецептор,
+    // переменная или константа) и в блочной (строка блока входов или
+    // рабочей памяти по строкам пакетного плана)
+    const size_t valueCount = inputs + code.size();
+    std::vector<std::string> expr(valueCount);
+    std::vector<std::string> lane(valueCount);
+    std::vector<char> isConstant(valueCount, 0);
+    std::vector<float> constant(valueCount, 0.0f);
+    for (int n = 0; n < receptors; n++) {
+        expr[n] = "r[" + std::to_string(n) + "]";
+        lane[n] = "r[" + std::to_string(n) + "][l]";
+    }
+    for (int n = receptors; n < inputs; n++) {
+        isConstant[n] = 1;
+        constant[n] = plan.basisValue(n);
+        expr[n] = lane[n] = floatLiteral(constant[n]);
+    }
+
+    std::string body;
+    std::string laneBody;
+    int emitted = 0;
+    int folded = 0;
+    for (size_t k = 0; k < code.size(); k++) {
+        const PlanInstruction& instr = code[k];
+        const int dst = instr.dst;
+
+        if (isConstant[instr.src1] && isConstant[instr.src2]) {
+            // Оба операнда известны при генерации: вычисляем так же, как интерпретатор
+            const float a = constant[instr.src1];
+            const float b = constant[instr.src2];
+            const float value = visitOp(static_cast<FusedOp>(instr.op), [a, b](auto tag) {
+                return OpKernel<decltype(tag)::value>::value(a, b);
+            });
+            isConstant[dst] = 1;
+            constant[dst] = value;
+            expr[dst] = lane[dst] = floatLiteral(value);
+            folded++;
+            continue;
+        }
+
+        // Выражения совпадают с fused_op_scalar (simd_ops.h), в том числе
+        // FUSED_BIG при нулевом делителе
+        const std::string zeroDivisor = floatLiteral(FUSED_BIG);
+        auto operation = [&instr, &zeroDivisor](const std::string& a, const std::string& b) -> std::string {
+            switch (instr.op) {
+                case FUSED_ADD:      return a + " + " + b;
+                case FUSED_SUB:      return a + " - " + b;
+                case FUSED_RSUB:     return b + " - " + a;
+                case FUSED_DIV:      return "(" + b + " != 0.0f) ? " + a + " / " + b + " : " + zeroDivisor;
+                case FUSED_RDIV:     return "(" + a + " != 0.0f) ? " + b + " / " + a + " : " + zeroDivisor;
+                case FUSED_SQ2_ADD:  return b + " * " + b + " + " + a;
+                case FUSED_SQ1_ADD:  return a + " * " + a + " + " + b;
+                case FUSED_SQ2_SUB:  return b + " * " + b + " - " + a;
+                case FUSED_SQ1_SUB:  return a + " * " + a + " - " + b;
+                case FUSED_PARALLEL:
+                    return "(" + a + " + " + b + " != 0.0f) ? " + a + " * " + b + " / (" + a + " + " + b + ") : "
+                           + zeroDivisor;
+                default:             return a + " * " + b;
+            }
+        };
+        expr[dst] = "v" + std::to_string(dst);
+        lane[dst] = "w[" + std::to_string(plan.batchRow(k)) + "][l]";
+        body += "    const float " + expr[dst] + " = " + operation(expr[instr.src1], expr[instr.src2]) + ";\n";
+        laneBody += "    for (int l = 0; l < NNETS_LANES; l++) " + lane[dst] + " = "
+                    + operation(lane[instr.src1], lane[instr.src2]) + ";\n";
+        emitted++;
+    }
+
+    std::ofstream out(filePath);
+    if (!out.is_open()) {
+        cerr << "Error: Cannot create file " << filePath << endl;
+        return false;
+    }
+
+    out << "// Generated by NNets --emit-cpp from " << source << "\n";
+    out << "// " << emitted << " operations (" << folded << " folded into constants), "
+        << receptors << " receptors, " << classCount << " classes\n\n";
+    out << "#include <cstddef>\n#include <limits>\n\n";
+    out << "#if defined(_WIN32)\n#define NNETS_EXPORT extern \"C\" __declspec(dllexport)\n"
+        << "#else\n#define NNETS_EXPORT extern \"C\" __attribute__((visibility(\"default\")))\n#endif\n\n";
+    out << "NNETS_EXPORT int nnets_abi_version() { return " << NNETS_MODEL_ABI << "; }\n";
+    out << "NNETS_EXPORT int nnets_receptors() { return " << receptors << "; }\n";
+    out << "NNETS_EXPORT int nnets_classes() { return " << classCount << "; }\n\n";
+
+    out << "NNETS_EXPORT const char* nnets_class_name(int c) {\n";
+    out << "    static const char* const names[] = {";
+    for (int c = 0; c < classCount; c++) {
+        out << (c > 0 ? ", " : "") << stringLiteral(c < (int)classNames.size() ? classNames[c] : string());
+    }
+    if (classCount == 0) out << "\"\"";
+    out << "};\n";
+    out << "    return (c >= 0 && c < " << classCount << ") ? names[c] : \"\";\n}\n\n";
+
+    out << "NNETS_EXPORT void nnets_classify(const float* r, float* scores) {\n";
+    out << body;
+    for (int c = 0; c < classCount; c++) {
+        int index = plan.outputValue(c);
+        out << "    scores[" << c << "] = " << (index < 0 ? std::string("0.0f") : expr[index]) << ";\n";
+    }
+    out << "}\n\n";
+
+    // Пакет считается блоками по NNETS_LANES входов: каждая операция - цикл
+    // по блоку, который компилятор векторизует
+    const int rows = std::max(1, plan.batchRows());
+    out << "// Block kernel: values of NNETS_LANES inputs per row, rows reused as in the batch plan\n";
+    out << "static const int NNETS_LANES = " << COMPILED_MODEL_LANES << ";\n\n";
+    out << "static void nnets_classify_lanes(const float (*r)[NNETS_LANES], float (*w)[NNETS_LANES], "
+        << "float (*scores)[NNETS_LANES]) {\n";
+    out << laneBody;
+    for (int c = 0; c < classCount; c++) {
+        int index = plan.outputValue(c);
+        out << "    for (int l = 0; l < NNETS_LANES; l++) scores[" << c << "][l] = "
+            << (index < 0 ? std::string("0.0f") : lane[index]) << ";\n";
+    }
+    out << "}\n\n";
+
+    out << "NNETS_EXPORT void nnets_classify_batch(const float* r, int count, float* scores) {\n";
+    out << "    static thread_local float w[" << rows << "][NNETS_LANES];\n";
+    out << "    float in[" << std::max(1, receptors) << "][NNETS_LANES];\n";
+    out << "    float out[" << std::max(1, classCount) << "][NNETS_LANES];\n";
+    out << "    for (int first = 0; first < count; first += NNETS_LANES) {\n";
+    out << "        const int n = (count - first < NNETS_LANES) ? count - first : NNETS_LANES;\n";
+    out << "        for (int l = 0; l < NNETS_LANES; l++) {\n";
+    out << "            for (int d = 0; d < " << receptors << "; d++) {\n";
+    out << "                in[d][l] = (l < n) ? r[(size_t)(first + l) * " << receptors << " + d] : 0.0f;\n";
+    out << "            }\n        }\n";
+    out << "        nnets_classify_lanes(in, w, out);\n";
+    out << "        for (int l = 0; l < n; l++) {\n";
+    out << "            for (int c = 0; c < " << classCount << "; c++) {\n";
+    out << "                scores[(size_t)(first + l) * " << classCount << " + c] = out[c][l];\n";
+    out << "            }\n        }\n    }\n}\n";
+
+    out.close();
+    if (!out) {
+        cerr << "Error: Cannot write file " << filePath << endl;
+        return false;
+    }
+
+    cout << "Generated " << filePath << ": " << emitted << " operations ("
+         << folded << " folded into constants)" << endl;
+    return true;
+}
+
+/**
+ * Сборка сгенерированного кода в разделяемую библиотеку
+ *
+ * Использует компилятор из переменной окружения CXX (по умолчанию c++)
+ * и дополнительные флаги из CXXFLAGS (например, -march=native для
+ * векторизации блочной функции под текущий процессор).
+ * Сжатие a*b+c в FMA отключается, чтобы результаты совпадали с интерпретатором.
+ *
+ * @param sourcePath - путь к сгенерированному .cpp
+ * @param libraryPath - путь к выходной библиотеке (.so/.dylib)
+ * @return true при успешной сборке
+ */
+bool buildModelLibrary(const string& sourcePath, const string& libraryPath) {
+#if defined(_WIN32)
+    (void)sourcePath;
+    (void)libraryPath;
+    cerr << "Error: Building model libraries is not supported on Windows; "
+         << "compile the generated source into a DLL manually" << endl;
+    return false;
+#else
+    const char* compiler = getenv("CXX");
+    const char* flags = getenv("CXXFLAGS");
+    string command = string((compiler != nullptr && compiler[0] != 0) ? compiler : "c++")
+        + " -O2 -std=c++17 -shared -fPIC " + ((flags != nullptr) ? flags : "")
+        + " -ffp-contract=off -o \"" + libraryPath + "\" \"" + sourcePath + "\"";
+    cout << "Building: " << command << endl;
+    if (std::system(command.c_str()) != 0) {
+        cerr << "Error: Cannot build model library " << libraryPath << endl;
+        return false;
+    }
+    return true;
+#endif
+}
+
+// ============================================================================
+// Загрузка скомпилированной модели
+// ============================================================================
+
+/**
+ * Скомпилированная модель, загруженная из разделяемой библиотеки
+ */
+class CompiledModel
+{
+public:
+    CompiledModel() : handle_(nullptr), receptors_(0), classes_(0), className_(nullptr), classify_(nullptr),
+                      classifyBatch_(nullptr) {}
+    ~CompiledModel() { unload(); }
+
+    CompiledModel(const CompiledModel&) = delete;
+    CompiledModel& operator=(const CompiledModel&) = delete;
+
+    /**
+     * Загрузка библиотеки модели
+     *
+     * @param path - путь к библиотеке
+     * @return true при успехе
+     */
+    bool load(const string& path) {
+        unload();
+#if defined(_WIN32)
+        handle_ = (void*)LoadLibraryA(path.c_str());
+#else
+        // Относительный путь без '/' dlopen искал бы в системных каталогах
+        string libraryPath = (path.find('/') == string::npos) ? "./" + path : path;
+        handle_ = dlopen(libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+        if (handle_ == nullptr) {
+            cerr << "Error: Cannot load compiled model " << path << endl;
+            return false;
+        }
+
+        typedef int (*IntFunc)();
+        IntFunc abiVersion = (IntFunc)symbol("nnets_abi_version");
+        IntFunc receptors = (IntFunc)symbol("nnets_receptors");
+        IntFunc classes = (IntFunc)symbol("nnets_classes");
+        className_ = (NameFunc)symbol("nnets_class_name");
+        classify_ = (ClassifyFunc)symbol("nnets_classify");
+        classifyBatch_ = (ClassifyBatchFunc)symbol("nnets_classify_batch");
+        if (abiVersion == nullptr || receptors == nullptr || classes == nullptr ||
+            className_ == nullptr || classify_ == nullptr || classifyBatch_ == nullptr) {
+            cerr << "Error: " << path << " is not an NNets compiled model" << endl;
+            unload();
+            return false;
+        }
+        if (abiVersion() != NNETS_MODEL_ABI) {
+            cerr << "Error: Compiled model " << path << " has interface version " << abiVersion()
+                 << " (expected " << NNETS_MODEL_ABI << ")" << endl;
+            unload();
+            return false;
+        }
+        receptors_ = receptors();
+        classes_ = classes();
+        return true;
+    }
+
+    void unload() {
+        if (handle_ != nullptr) {
+#if defined(_WIN32)
+            FreeLibrary((HMODULE)handle_);
+#else
+            dlclose(handle_);
+#endif
+        }
+        handle_ = nullptr;
+        className_ = nullptr;
+        classify_ = nullptr;
+        classifyBatch_ = nullptr;
+    }
+
+    bool isLoaded() const { return handle_ != nullptr; }
+    int receptors() const { return receptors_; }
+    int classes() const { return classes_; }
+    string className(int c) const { return className_(c); }
+
+    // Выходы всех классов для одного входа
+    void classify(const float* receptors, float* scores) const { classify_(receptors, scores); }
+
+    // Выходы для пакета входов (рецепторы образа s - receptors[s * receptors() + d])
+    void classifyBatch(const float* receptors, int count, float* scores) const {
+        classifyBatch_(receptors, count, scores);
+    }
+
+private:
+    typedef const char* (*NameFunc)(int);
+    typedef void (*ClassifyFunc)(const float*, float*);
+    typedef void (*ClassifyBatchFunc)(const float*, int, float*);
+
+    void* symbol(const char* name) const {
+#if defined(_WIN32)
+        return (void*)GetProcAddress((HMODULE)handle_, name);
+#else
+        return dlsym(handle_, name);
+#endif
+    }
+
+    void* handle_;
+    int receptors_;
+    int classes_;
+    NameFunc className_;
+    ClassifyFunc classify_;
+    ClassifyBatchFunc classifyBatch_;
+};
+
+#endif // COMPILED_MODEL_H
@@ -0,0 +1,347 @@
+/*
+ * config_reader.h - Потоковое чтение конфигурации обучения
+ *
+ * Этот модуль содержит:
+ * - Класс ConfigReader - SAX-обработчик конфигурации (nlohmann::json::sax_parse)
+ * - Чтение списка образов в формате "слово<TAB>класс" (images_file)
+ * - Функцию readConfig - разбор конфигурации с передачей образов
+ *   обработчику по мере чтения
+ *
+ * Дерево JSON не строится: каждый образ из "images" и "classes" передаётся
+ * обработчику, как только прочитан его объект, поэтому при загрузке
+ * больших наборов в памяти только сам набор (dataset.h). Ключи верхнего
+ * уровня идут в любом порядке (receptors и generate_shifts часто стоят
+ * после classes), так что обработчик не должен зависеть от них до конца
+ * разбора.
+ *
+ * Ключ "images_file" задаёт текстовый список образов (путь относительно
+ * файла конфигурации): по образу на строку, слово и номер класса через
+ * табуляцию, например "time\t1". Строки читаются как образы "images" и
+ * добавляются после них.
+ */
+
+#ifndef CONFIG_READER_H
+#define CONFIG_READER_H
+
+#include <climits>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+/**
+ * Параметры конфигурации, кроме самих образов
+ */
+struct ConfigContents {
+    bool hasReceptors = false;
+    int receptors = 0;
+    bool generateShifts = true;
+    bool hasDescription = false;
+    std::string description;
+    std::vector<std::string> funcs;
+    bool hasOps = false;
+    std::vector<std::string> ops;
+    bool hasImages = false;          // Есть images или images_file (образы без сдвигов)
+    bool hasClasses = false;         // Есть classes (используется, если нет images)
+    std::string imagesFile;          // Путь к списку образов; пусто - не задан
+};
+
+/**
+ * Получатель образов конфигурации
+ */
+struct ConfigSink {
+    // Образ: image - из images/images_file, иначе элемент classes
+    std::function<void(bool image, const std::string& word, int id)> entry;
+    // Отмена переданных элементов classes: после них встретились images
+    std::function<void()> reset;
+};
+
+/**
+ * SAX-обработчик конфигурации
+ *
+ * Разбирает ключи верхнего уровня и элементы images/classes; значения
+ * остальных ключей пропускаются. Ошибка типа останавливает разбор.
+ */
+class ConfigReader : public nlohmann::json_sax<nlohmann::json> {
+public:
+    ConfigReader(ConfigContents& config, const ConfigSink& sink) : config_(config), sink_(sink) {}
+
+    bool null() override { return scalar(VALUE_NULL); }
+    bool boolean(bool value) override {
+        boolean_ = value;
+        return scalar(VALUE_BOOLEAN);
+    }
+    bool number_integer(number_integer_t value) override { return number((double)value); }
+    bool number_unsigned(number_unsigned_t value) override { return number((double)value); }
+    bool number_float(number_float_t value, const string_t&) override { return number(value); }
+    bool string(string_t& value) override {
+        string_.swap(value);
+        return scalar(VALUE_STRING);
+    }
+    bool binary(binary_t&) override { return scalar(VALUE_NULL); }
+
+    bool start_object(std::size_t) override {
+        if (depth_ == 0) {
+            // Корень - объект с ключами конфигурации
+        } else if (depth_ == 2 && inEntries()) {
+            entryIndex_++;
+            hasWord_ = false;
+            hasId_ = false;
+        } else if (!container("an object")) {
+            return false;
+        }
+        depth_++;
+        return true;
+    }
+
+    bool end_object() override {
+        depth_--;
+        if (depth_ == 2 && inEntries()) return finishEntry();
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        if (depth_ == 0) return fail("config must be a JSON object");
+        if (depth_ == 1) {
+            if (key_ == KEY_IMAGES) {
+                // Образы важнее классов: уже переданные classes отменяются
+                if (classEntries_ > 0) sink_.reset();
+                classEntries_ = 0;
+                config_.hasImages = true;
+            } else if (key_ == KEY_CLASSES) {
+                config_.hasClasses = true;
+            } else if (key_ != KEY_FUNCS && key_ != KEY_OPS && !container("an array")) {
+                return false;
+            }
+            entryIndex_ = -1;
+        } else if (!container("an array")) {
+            return false;
+        }
+        depth_++;
+        return true;
+    }
+
+    bool end_array() override {
+        depth_--;
+        return true;
+    }
+
+    bool key(string_t& name) override {
+        if (depth_ == 1) {
+            key_ = KEY_OTHER;
+            keyName_ = name;
+            if (name == "receptors") key_ = KEY_RECEPTORS;
+            else if (name == "generate_shifts") key_ = KEY_GENERATE_SHIFTS;
+            else if (name == "description") key_ = KEY_DESCRIPTION;
+            else if (name == "funcs") key_ = KEY_FUNCS;
+            else if (name == "ops") key_ = KEY_OPS;
+            else if (name == "images") key_ = KEY_IMAGES;
+            else if (name == "classes") key_ = KEY_CLASSES;
+            else if (name == "images_file") key_ = KEY_IMAGES_FILE;
+            if (key_ == KEY_FUNCS) config_.funcs.clear();
+            if (key_ == KEY_OPS) {
+                config_.ops.clear();
+                config_.hasOps = true;
+            }
+        } else if (depth_ == 3 && inEntries()) {
+            field_ = name == "word" ? FIELD_WORD : name == "id" ? FIELD_ID : FIELD_OTHER;
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override {
+        error_ = ex.what();
+        return false;
+    }
+
+    const std::string& error() const { return error_; }
+
+private:
+    enum Key {
+        KEY_OTHER, KEY_RECEPTORS, KEY_GENERATE_SHIFTS, KEY_DESCRIPTION, KEY_FUNCS,
+        KEY_OPS, KEY_IMAGES, KEY_CLASSES, KEY_IMAGES_FILE
+    };
+    enum Field { FIELD_OTHER, FIELD_WORD, FIELD_ID };
+    enum Value { VALUE_NULL, VALUE_BOOLEAN, VALUE_NUMBER, VALUE_STRING };
+
+    // Внутри массива образов (images или classes, если не было images)
+    bool inEntries() const {
+        return key_ == KEY_IMAGES || (key_ == KEY_CLASSES && !config_.hasImages);
+    }
+
+    bool number(double value) {
+        number_ = value;
+        return scalar(VALUE_NUMBER);
+    }
+
+    // Значение-контейнер там, где его не ждут: ошибка для известных ключей
+    bool container(const char* kind) {
+        if (depth_ == 1 && key_ != KEY_OTHER) return fail("'" + keyName_ + "' must not be " + kind);
+        if (depth_ == 2 && (key_ == KEY_FUNCS || key_ == KEY_OPS)) return fail("'" + keyName_ + "' must list strings");
+        if (depth_ == 2 && inEntries()) return fail(entryName() + " must be an object");
+        if (depth_ == 3 && inEntries() && field_ != FIELD_OTHER) return fail(entryName() + " has an invalid field");
+        return true;
+    }
+
+    bool scalar(Value type) {
+        if (depth_ == 0) return fail("config must be a JSON object");
+        if (depth_ == 1) {
+            switch (key_) {
+            case KEY_RECEPTORS:
+                if (type != VALUE_NUMBER) return fail("'receptors' must be a number");
+                config_.hasReceptors = true;
+                config_.receptors = (int)number_;
+                return true;
+            case KEY_GENERATE_SHIFTS:
+                if (type != VALUE_BOOLEAN) return fail("'generate_shifts' must be a boolean");
+                config_.generateShifts = boolean_;
+                return true;
+            case KEY_DESCRIPTION:
+                if (type != VALUE_STRING) return fail("'description' must be a string");
+                config_.hasDescription = true;
+                config_.description = string_;
+                return true;
+            case KEY_IMAGES_FILE:
+                if (type != VALUE_STRING) return fail("'images_file' must be a string");
+                config_.imagesFile = string_;
+                return true;
+            case KEY_OTHER:
+                return true;
+            default:
+                return fail("'" + keyName_ + "' must be an array");
+            }
+        }
+        if (depth_ == 2 && (key_ == KEY_FUNCS || key_ == KEY_OPS)) {
+            if (type != VALUE_STRING) return fail("'" + keyName_ + "' must list strings");
+            (key_ == KEY_FUNCS ? config_.funcs : config_.ops).push_back(string_);
+            return true;
+        }
+        if (depth_ == 2 && inEntries()) return fail(entryName() + " must be an object");
+        if (depth_ == 3 && inEntries()) {
+            if (field_ == FIELD_WORD) {
+                if (type != VALUE_STRING) return fail(entryName() + ".word must be a string");
+                word_.swap(string_);
+                hasWord_ = true;
+            } else if (field_ == FIELD_ID) {
+                if (type != VALUE_NUMBER || number_ < 0 || number_ > INT_MAX) {
+                    return fail(entryName() + ".id must be a non-negative number");
+                }
+                id_ = (int)number_;
+                hasId_ = true;
+            }
+        }
+        return true;
+    }
+
+    bool finishEntry() {
+        if (!hasWord_) return fail(entryName() + " has no 'word'");
+        if (!hasId_) return fail(entryName() + " has no 'id'");
+        if (key_ == KEY_CLASSES) classEntries_++;
+        sink_.entry(key_ == KEY_IMAGES, word_, id_);
+        return true;
+    }
+
+    std::string entryName() const {
+        return (key_ == KEY_IMAGES ? "images[" : "classes[") + std::to_string(entryIndex_) + "]";
+    }
+
+    bool fail(const std::string& message) {
+        error_ = message;
+        return false;
+    }
+
+    ConfigContents& config_;
+    const ConfigSink& sink_;
+    int depth_ = 0;
+    Key key_ = KEY_OTHER;
+    std::string keyName_;
+    Field field_ = FIELD_OTHER;
+    long long entryIndex_ = -1;
+    size_t classEntries_ = 0;
+    bool hasWord_ = false;
+    bool hasId_ = false;
+    std::string word_;
+    int id_ = 0;
+    bool boolean_ = false;
+    double number_ = 0.0;
+    std::string string_;
+    std::string error_;
+};
+
+/**
+ * Чтение списка образов: строки "слово<TAB>класс"
+ *
+ * Разделитель - последняя табуляция строки, пустые строки пропускаются,
+ * '\r' в конце строки отбрасывается. Пустое слово ("\t0") - образ из пробелов.
+ *
+ * @param error - выход: описание ошибки
+ * @return false, если файл не открывается или строка некорректна
+ */
+bool readImageList(const std::string& path, const ConfigSink& sink, std::string& error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        error = "cannot open images file " + path;
+        return false;
+    }
+
+    std::string line;
+    size_t number = 0;
+    while (std::getline(in, line)) {
+        number++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        const size_t tab = line.rfind('\t');
+        const char* idText = tab == std::string::npos ? nullptr : line.c_str() + tab + 1;
+        char* idEnd = nullptr;
+        const long id = idText ? strtol(idText, &idEnd, 10) : -1;
+        if (idText == nullptr || idEnd == idText || *idEnd != '\0' || id < 0 || id > INT_MAX) {
+            error = path + ":" + std::to_string(number) + ": expected word<TAB>class";
+            return false;
+        }
+        line.resize(tab);
+        sink.entry(true, line, (int)id);
+    }
+    return true;
+}
+
+/**
+ * Потоковый разбор конфигурации
+ *
+ * Образы передаются sink.entry в порядке файла (образы images_file - после
+ * images); при наличии и images, и classes используются только images.
+ *
+ * @param config - выход: параметры конфигурации (imagesFile - путь от
+ *                 текущего каталога)
+ * @param error - выход: описание ошибки
+ * @return false при ошибке чтения, синтаксиса JSON или типа значения
+ */
+bool readConfig(const std::string& path, ConfigContents& config, const ConfigSink& sink, std::string& error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        error = "Cannot open config file: " + path;
+        return false;
+    }
+
+    config = ConfigContents();
+    ConfigReader reader(config, sink);
+    if (!nlohmann::json::sax_parse(in, &reader)) {
+        error = "Invalid config " + path + ": " + reader.error();
+        return false;
+    }
+
+    if (!config.imagesFile.empty()) {
+        std::filesystem::path imagesPath(config.imagesFile);
+        if (imagesPath.is_relative()) imagesPath = std::filesystem::path(path).parent_path() / imagesPath;
+        config.imagesFile = imagesPath.string();
+        if (config.hasClasses && !config.hasImages) sink.reset();
+        config.hasImages = true;
+        if (!readImageList(config.imagesFile, sink, error)) return false;
+    }
+    return true;
+}
+
+#endif // CONFIG_READER_H
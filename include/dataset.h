@@ -0,0 +1,582 @@
+/*
+ * dataset.h - Набор обучающих образов и его двоичный кэш
+ *
+ * Этот модуль содержит:
+ * - Класс Dataset - виртуальный набор образов: образ - слово из общего
+ *   пула и его сдвиг, номер класса и необязательный вес образа
+ * - Сведение одинаковых образов в один с весом (Dataset::deduplicate)
+ * - Потоковое заполнение при разборе конфигурации (append, finishAppend)
+ * - Двоичный кэш набора (--dataset-cache): сохранение и загрузку
+ *   через отображение файла в память (MappedFile)
+ *
+ * При generate_shifts слово длины n даёт Receptors - n + 1 образов,
+ * которые отличаются только положением слова. Поэтому символы слова
+ * хранятся один раз, а образ - парой (слово, сдвиг): код входа d -
+ * символ слова d - сдвиг или пробел вне слова. Память набора - символы
+ * слов и 10 байт на образ вместо Receptors кодов на каждый сдвиг.
+ * Значения входов сети (код / max_num) хранит матрица входов
+ * (receptor_matrix.h), она заполняется из пар на лету.
+ *
+ * Файл кэша (порядок байт машины, массивы по убыванию выравнивания,
+ * метаданные дополнены до 8 байт, поэтому все смещения выровнены):
+ *   DatasetCacheHeader
+ *   метаданные конфигурации (DatasetCacheInfo)
+ *   int32 ids[images]
+ *   float weights[images]              - при DATASET_CACHE_WEIGHTS
+ *   uint32 words[images]               - слово образа
+ *   uint32 wordOffsets[words + 1]      - начало слова в chars
+ *   uint16 shifts[images]              - сдвиг слова в образе
+ *   uint8 chars[charBytes]             - символы всех слов подряд
+ * Набор, загруженный из кэша, читает массивы прямо из отображения.
+ */
+
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "mapped_file.h"
+
+// ============================================================================
+// Формат кэша
+// ============================================================================
+
+const char DATASET_CACHE_MAGIC[8] = { 'N', 'N', 'D', 'S', 'E', 'T', '\r', '\n' };
+const uint32_t DATASET_CACHE_VERSION = 3;
+
+// Флаги DatasetCacheHeader::flags
+const uint32_t DATASET_CACHE_WEIGHTS = 1;      // Есть веса образов
+const uint32_t DATASET_CACHE_DESCRIPTION = 2;  // Есть описание конфигурации
+
+struct DatasetCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t sourceSize;       // Размер исходной конфигурации
+    int64_t sourceTime;        // Время изменения исходной конфигурации
+    int32_t sourceReceptors;   // Receptors по умолчанию при разборе конфигурации
+    int32_t receptors;
+    int32_t images;
+    uint32_t metaBytes;        // Размер метаданных (кратен 8)
+    int32_t words;             // Слов в пуле
+    uint32_t charBytes;        // Символов в пуле
+};
+
+/**
+ * Метаданные конфигурации, сохраняемые вместе с набором
+ *
+ * Всё, что кроме образов даёт разбор конфигурации, чтобы при
+ * действительном кэше JSON не разбирался вовсе. Кэш действителен,
+ * пока размер и время изменения конфигурации (и списка образов
+ * images_file, если он задан) совпадают с записанными.
+ */
+struct DatasetCacheInfo {
+    uint64_t sourceSize = 0;
+    int64_t sourceTime = 0;
+    int32_t sourceReceptors = 0;
+    std::vector<std::string> classNames;
+    std::vector<std::string> funcs;
+    std::vector<uint8_t> ops;          // FusedOp; пусто - операции не заданы
+    bool hasDescription = false;
+    std::string description;
+    std::string imagesFile;            // Список образов images_file; пусто - не задан
+    uint64_t imagesSize = 0;           // Его размер и время изменения
+    int64_t imagesTime = 0;
+};
+
+// ============================================================================
+// Набор образов
+// ============================================================================
+
+/**
+ * Противоречие набора: одни и те же коды входов у образов разных классов
+ */
+struct DatasetConflict {
+    std::string text;           // Коды входов (Receptors символов)
+    std::vector<int> ids;       // Классы в порядке появления
+};
+
+class Dataset {
+public:
+    // Наибольший сдвиг слова в образе (сдвиги хранятся в uint16)
+    static const int MAX_SHIFT = 0xFFFF;
+
+    Dataset()
+        : receptors_(0), count_(0), wordCount_(0), ids_(nullptr), weights_(nullptr),
+          words_(nullptr), shifts_(nullptr), wordOffsets_(nullptr), chars_(nullptr) {
+        sync();
+    }
+
+    Dataset(const Dataset&) = delete;
+    Dataset& operator=(const Dataset&) = delete;
+
+    // Пустой набор с receptors кодами на образ
+    void clear(int receptors) {
+        mapping_.close();
+        idStore_.clear();
+        weightStore_.clear();
+        wordStore_.clear();
+        shiftStore_.clear();
+        offsetStore_.assign(1, 0);
+        charStore_.clear();
+        receptors_ = receptors;
+        count_ = 0;
+        wordCount_ = 0;
+        sync();
+    }
+
+    /**
+     * Добавление образа
+     *
+     * Коды - символы text до конца строки (или до '\0'), оставшиеся
+     * позиции заполняются пробелами, символы сверх Receptors отбрасываются.
+     *
+     * @param weight - вес образа (веса хранятся, только если какой-то отличен от 1)
+     */
+    void add(std::string_view text, int id, float weight = 1.0f) {
+        detach();
+        addImage(addWord(text), 0, id, weight);
+    }
+
+    /**
+     * Добавление слова во всех позициях в пределах Receptors
+     *
+     * Например, слово "time" при receptors=20 даёт 17 образов:
+     * "time                " (слово в начале)
+     * " time               " (слово сдвинуто на 1)
+     * и т.д. Символы слова хранятся один раз на все сдвиги.
+     */
+    void addShifted(const std::string& word, int id) {
+        detach();
+        const uint32_t index = addWord(word);
+        const int shifts = std::min(receptors_ - (int)word.length(), MAX_SHIFT);
+        addImage(index, 0, id, 1.0f);
+        for (int shift = 1; shift <= shifts; shift++) {
+            addImage(index, shift, id, 1.0f);
+        }
+    }
+
+    /**
+     * Добавление образа при потоковой загрузке конфигурации (config_reader.h)
+     *
+     * Receptors и generate_shifts могут идти в файле после образов, поэтому
+     * слово добавляется без обрезки и без сдвигов; finishAppend приводит
+     * набор к тому виду, который дали бы add и addShifted.
+     */
+    void append(std::string_view text, int id) {
+        detach();
+        text = text.substr(0, text.find('\0'));
+        charStore_.insert(charStore_.end(), text.begin(), text.end());
+        offsetStore_.push_back((uint32_t)charStore_.size());
+        wordCount_++;
+        addImage((uint32_t)(wordCount_ - 1), 0, id, 1.0f);
+    }
+
+    /**
+     * Завершение потоковой загрузки: обрезка слов по receptors и сдвиги
+     *
+     * @param generateShifts - каждый непустой образ заменяется всеми сдвигами
+     *                         слова, как в addShifted
+     */
+    void finishAppend(int receptors, bool generateShifts) {
+        detach();
+        receptors_ = receptors;
+
+        // Обрезка слов длиннее receptors (пул переписывается, только если такие есть)
+        bool longWords = false;
+        for (size_t word = 0; word < wordCount_ && !longWords; word++) {
+            longWords = offsetStore_[word + 1] - offsetStore_[word] > (uint32_t)receptors;
+        }
+        if (longWords) {
+            uint32_t length = 0;
+            for (size_t word = 0; word < wordCount_; word++) {
+                const uint32_t begin = offsetStore_[word];
+                const uint32_t size = std::min(offsetStore_[word + 1] - begin, (uint32_t)receptors);
+                memmove(charStore_.data() + length, charStore_.data() + begin, size);
+                offsetStore_[word] = length;
+                length += size;
+            }
+            offsetStore_[wordCount_] = length;
+            charStore_.resize(length);
+        }
+
+        if (generateShifts) {
+            std::vector<uint32_t> words;
+            std::vector<uint16_t> shifts;
+            std::vector<int32_t> ids;
+            for (size_t img = 0; img < count_; img++) {
+                const uint32_t word = wordStore_[img];
+                const int length = (int)(offsetStore_[word + 1] - offsetStore_[word]);
+                const int last = length > 0 ? std::min(receptors - length, MAX_SHIFT) : 0;
+                for (int shift = 0; shift <= std::max(last, 0); shift++) {
+                    words.push_back(word);
+                    shifts.push_back((uint16_t)shift);
+                    ids.push_back(idStore_[img]);
+                }
+            }
+            wordStore_.swap(words);
+            shiftStore_.swap(shifts);
+            idStore_.swap(ids);
+            count_ = idStore_.size();
+        }
+        sync();
+    }
+
+    int size() const { return (int)count_; }
+    int receptors() const { return receptors_; }
+    int id(int img) const { return ids_[img]; }
+
+    // Код входа d образа img
+    uint8_t code(int img, int d) const {
+        const uint32_t word = words_[img];
+        const int position = d - shifts_[img];
+        const int length = (int)(wordOffsets_[word + 1] - wordOffsets_[word]);
+        return (position >= 0 && position < length) ? chars_[wordOffsets_[word] + position] : (uint8_t)' ';
+    }
+
+    // Коды всех входов образа img (receptors() кодов)
+    void codes(int img, uint8_t* out) const {
+        const uint32_t word = words_[img];
+        const int shift = std::min((int)shifts_[img], receptors_);
+        const int length = std::min((int)(wordOffsets_[word + 1] - wordOffsets_[word]), receptors_ - shift);
+        memset(out, ' ', receptors_);
+        memcpy(out + shift, chars_ + wordOffsets_[word], length);
+    }
+
+    // Веса образов заданы (иначе все веса - 1)
+    bool hasWeights() const { return weights_ != nullptr; }
+    float weight(int img) const { return weights_ ? weights_[img] : 1.0f; }
+
+    // Текст образа (Receptors символов)
+    std::string text(int img) const {
+        std::string result(receptors_, ' ');
+        codes(img, reinterpret_cast<uint8_t*>(&result[0]));
+        return result;
+    }
+
+    // Слов в пуле
+    int words() const { return (int)wordCount_; }
+
+    /**
+     * Сведение одинаковых образов в один с весом-количеством
+     *
+     * Образы одинаковы, если совпадают коды всех входов и класс: остаётся
+     * первый из них с суммой весов, порядок образов сохраняется. Ошибка
+     * обучения sum(w (t - y)^2) по уникальным образам та же, что по всем,
+     * а перебор кандидатов короче. Образы с одинаковыми кодами и разными
+     * классами (противоречия) остаются отдельными и попадают в conflicts.
+     *
+     * @param conflicts - выход: противоречия
+     * @return количество убранных образов
+     */
+    int deduplicate(std::vector<DatasetConflict>& conflicts) {
+        conflicts.clear();
+        std::unordered_map<std::string, size_t> unique;       // Коды и класс -> уникальный образ
+        std::unordered_map<std::string, int> inputClass;      // Коды -> класс первого образа
+        std::unordered_map<std::string, size_t> conflictOf;   // Коды -> противоречие
+        std::vector<uint32_t> words;
+        std::vector<uint16_t> shifts;
+        std::vector<int32_t> ids;
+        std::vector<float> weights;
+
+        std::string key;
+        for (size_t img = 0; img < count_; img++) {
+            const int id = ids_[img];
+            key = text((int)img);
+            auto input = inputClass.emplace(key, id);
+            if (!input.second && input.first->second != id) {
+                auto conflict = conflictOf.emplace(key, conflicts.size());
+                if (conflict.second) conflicts.push_back({ key, { input.first->second } });
+                std::vector<int>& classIds = conflicts[conflict.first->second].ids;
+                if (std::find(classIds.begin(), classIds.end(), id) == classIds.end()) classIds.push_back(id);
+            }
+
+            key.append(reinterpret_cast<const char*>(&id), sizeof(id));
+            auto found = unique.emplace(key, ids.size());
+            if (found.second) {
+                words.push_back(words_[img]);
+                shifts.push_back(shifts_[img]);
+                ids.push_back(id);
+                weights.push_back(weight((int)img));
+            } else {
+                weights[found.first->second] += weight((int)img);
+            }
+        }
+
+        const int removed = (int)(count_ - ids.size());
+        if (removed == 0) return 0;
+
+        detach();
+        wordStore_.swap(words);
+        shiftStore_.swap(shifts);
+        idStore_.swap(ids);
+        weightStore_.swap(weights);
+        count_ = idStore_.size();
+        sync();
+        return removed;
+    }
+
+    // Объём набора в байтах
+    size_t bytes() const {
+        return count_ * (sizeof(int32_t) + sizeof(uint32_t) + sizeof(uint16_t) + (weights_ ? sizeof(float) : 0)) +
+               (wordCount_ + 1) * sizeof(uint32_t) + wordOffsets_[wordCount_];
+    }
+
+    // Массивы читаются из отображения файла кэша
+    bool isMapped() const { return mapping_.isOpen(); }
+
+    /**
+     * Сохранение набора и метаданных в файл кэша
+     *
+     * @return false при ошибке записи
+     */
+    bool saveCache(const std::string& path, const DatasetCacheInfo& info) const {
+        std::string meta;
+        putU32(meta, (uint32_t)info.classNames.size());
+        for (const std::string& name : info.classNames) putString(meta, name);
+        putU32(meta, (uint32_t)info.funcs.size());
+        for (const std::string& func : info.funcs) putString(meta, func);
+        putU32(meta, (uint32_t)info.ops.size());
+        meta.append(info.ops.begin(), info.ops.end());
+        putString(meta, info.description);
+        putString(meta, info.imagesFile);
+        putU64(meta, info.imagesSize);
+        putU64(meta, (uint64_t)info.imagesTime);
+        meta.resize((meta.size() + 7) / 8 * 8, '\0');
+
+        DatasetCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, DATASET_CACHE_MAGIC, sizeof(header.magic));
+        header.version = DATASET_CACHE_VERSION;
+        header.flags = (weights_ ? DATASET_CACHE_WEIGHTS : 0) | (info.hasDescription ? DATASET_CACHE_DESCRIPTION : 0);
+        header.sourceSize = info.sourceSize;
+        header.sourceTime = info.sourceTime;
+        header.sourceReceptors = info.sourceReceptors;
+        header.receptors = receptors_;
+        header.images = (int32_t)count_;
+        header.metaBytes = (uint32_t)meta.size();
+        header.words = (int32_t)wordCount_;
+        header.charBytes = wordOffsets_[wordCount_];
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(meta.data(), (std::streamsize)meta.size());
+        out.write(reinterpret_cast<const char*>(ids_), (std::streamsize)(count_ * sizeof(int32_t)));
+        if (weights_) out.write(reinterpret_cast<const char*>(weights_), (std::streamsize)(count_ * sizeof(float)));
+        out.write(reinterpret_cast<const char*>(words_), (std::streamsize)(count_ * sizeof(uint32_t)));
+        out.write(reinterpret_cast<const char*>(wordOffsets_), (std::streamsize)((wordCount_ + 1) * sizeof(uint32_t)));
+        out.write(reinterpret_cast<const char*>(shifts_), (std::streamsize)(count_ * sizeof(uint16_t)));
+        out.write(reinterpret_cast<const char*>(chars_), (std::streamsize)header.charBytes);
+        out.close();
+        return !out.fail();
+    }
+
+    /**
+     * Загрузка набора из файла кэша (массивы остаются в отображении файла)
+     *
+     * @param info - выход: метаданные конфигурации
+     * @param error - выход: причина ошибки
+     * @return false, если файл не открывается или повреждён (набор пуст)
+     */
+    bool loadCache(const std::string& path, DatasetCacheInfo& info, std::string& error) {
+        clear(0);
+        if (!mapping_.open(path)) {
+            error = "cannot open file";
+            return false;
+        }
+        const uint8_t* data = mapping_.data();
+        const size_t size = mapping_.size();
+
+        DatasetCacheHeader header;
+        if (size < sizeof(header)) return fail("truncated header", error);
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, DATASET_CACHE_MAGIC, sizeof(header.magic)) != 0) {
+            return fail("not a dataset cache", error);
+        }
+        if (header.version != DATASET_CACHE_VERSION) return fail("unsupported version", error);
+        if (header.receptors <= 0 || header.images < 0 || header.words < 0 || header.metaBytes % 8 != 0) {
+            return fail("invalid header", error);
+        }
+
+        const size_t images = (size_t)header.images;
+        const size_t words = (size_t)header.words;
+        const bool weighted = (header.flags & DATASET_CACHE_WEIGHTS) != 0;
+        const size_t metaEnd = sizeof(header) + (size_t)header.metaBytes;
+        const size_t perImage = sizeof(int32_t) + (weighted ? sizeof(float) : 0) + sizeof(uint32_t) + sizeof(uint16_t);
+        const size_t expected = metaEnd + images * perImage + (words + 1) * sizeof(uint32_t) + header.charBytes;
+        if (metaEnd > size || expected != size) return fail("size mismatch", error);
+
+        // Метаданные
+        const uint8_t* pos = data + sizeof(header);
+        const uint8_t* end = data + metaEnd;
+        uint32_t count = 0;
+        info = DatasetCacheInfo();
+        if (!getU32(pos, end, count)) return fail("truncated metadata", error);
+        info.classNames.resize(count);
+        for (std::string& name : info.classNames) {
+            if (!getString(pos, end, name)) return fail("truncated metadata", error);
+        }
+        if (!getU32(pos, end, count)) return fail("truncated metadata", error);
+        info.funcs.resize(count);
+        for (std::string& func : info.funcs) {
+            if (!getString(pos, end, func)) return fail("truncated metadata", error);
+        }
+        if (!getU32(pos, end, count) || (size_t)(end - pos) < count) return fail("truncated metadata", error);
+        info.ops.assign(pos, pos + count);
+        pos += count;
+        uint64_t imagesTime = 0;
+        if (!getString(pos, end, info.description) || !getString(pos, end, info.imagesFile) ||
+            !getU64(pos, end, info.imagesSize) || !getU64(pos, end, imagesTime)) {
+            return fail("truncated metadata", error);
+        }
+        info.imagesTime = (int64_t)imagesTime;
+        info.hasDescription = (header.flags & DATASET_CACHE_DESCRIPTION) != 0;
+        info.sourceSize = header.sourceSize;
+        info.sourceTime = header.sourceTime;
+        info.sourceReceptors = header.sourceReceptors;
+
+        // Массивы - на месте
+        const uint8_t* array = end;
+        const int32_t* ids = reinterpret_cast<const int32_t*>(array);
+        array += images * sizeof(int32_t);
+        const float* weights = weighted ? reinterpret_cast<const float*>(array) : nullptr;
+        array += weighted ? images * sizeof(float) : 0;
+        const uint32_t* wordIndices = reinterpret_cast<const uint32_t*>(array);
+        array += images * sizeof(uint32_t);
+        const uint32_t* wordOffsets = reinterpret_cast<const uint32_t*>(array);
+        array += (words + 1) * sizeof(uint32_t);
+        const uint16_t* shifts = reinterpret_cast<const uint16_t*>(array);
+        array += images * sizeof(uint16_t);
+
+        // Ссылки на слова не должны выходить за пул
+        if (wordOffsets[0] != 0 || wordOffsets[words] != header.charBytes) return fail("invalid word table", error);
+        for (size_t word = 0; word < words; word++) {
+            if (wordOffsets[word] > wordOffsets[word + 1]) return fail("invalid word table", error);
+        }
+        for (size_t img = 0; img < images; img++) {
+            if (wordIndices[img] >= words) return fail("invalid word index", error);
+        }
+
+        receptors_ = header.receptors;
+        count_ = images;
+        wordCount_ = words;
+        ids_ = ids;
+        weights_ = weights;
+        words_ = wordIndices;
+        wordOffsets_ = wordOffsets;
+        shifts_ = shifts;
+        chars_ = array;
+        return true;
+    }
+
+private:
+    // Добавление слова в пул (символы до '\0', не больше Receptors)
+    uint32_t addWord(std::string_view text) {
+        text = text.substr(0, std::min(text.find('\0'), (size_t)receptors_));
+        charStore_.insert(charStore_.end(), text.begin(), text.end());
+        offsetStore_.push_back((uint32_t)charStore_.size());
+        wordCount_++;
+        sync();
+        return (uint32_t)(wordCount_ - 1);
+    }
+
+    void addImage(uint32_t word, int shift, int id, float weight) {
+        idStore_.push_back(id);
+        wordStore_.push_back(word);
+        shiftStore_.push_back((uint16_t)shift);
+        if (weight != 1.0f && weightStore_.empty()) weightStore_.assign(count_, 1.0f);
+        if (!weightStore_.empty()) weightStore_.push_back(weight);
+        count_++;
+        sync();
+    }
+
+    // Копирование массивов из отображения перед изменением набора
+    void detach() {
+        if (!mapping_.isOpen()) return;
+        idStore_.assign(ids_, ids_ + count_);
+        if (weights_) weightStore_.assign(weights_, weights_ + count_);
+        wordStore_.assign(words_, words_ + count_);
+        shiftStore_.assign(shifts_, shifts_ + count_);
+        offsetStore_.assign(wordOffsets_, wordOffsets_ + wordCount_ + 1);
+        charStore_.assign(chars_, chars_ + wordOffsets_[wordCount_]);
+        mapping_.close();
+        sync();
+    }
+
+    void sync() {
+        if (offsetStore_.empty()) offsetStore_.push_back(0);
+        ids_ = idStore_.data();
+        weights_ = weightStore_.empty() ? nullptr : weightStore_.data();
+        words_ = wordStore_.data();
+        shifts_ = shiftStore_.data();
+        wordOffsets_ = offsetStore_.data();
+        chars_ = charStore_.data();
+    }
+
+    bool fail(const char* reason, std::string& error) {
+        error = reason;
+        clear(0);
+        return false;
+    }
+
+    static void putU32(std::string& out, uint32_t value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    static void putU64(std::string& out, uint64_t value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    static void putString(std::string& out, const std::string& value) {
+        putU32(out, (uint32_t)value.size());
+        out += value;
+    }
+
+    static bool getU32(const uint8_t*& pos, const uint8_t* end, uint32_t& value) {
+        if ((size_t)(end - pos) < sizeof(value)) return false;
+        memcpy(&value, pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    }
+
+    static bool getU64(const uint8_t*& pos, const uint8_t* end, uint64_t& value) {
+        if ((size_t)(end - pos) < sizeof(value)) return false;
+        memcpy(&value, pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    }
+
+    static bool getString(const uint8_t*& pos, const uint8_t* end, std::string& value) {
+        uint32_t length;
+        if (!getU32(pos, end, length) || (size_t)(end - pos) < length) return false;
+        value.assign(reinterpret_cast<const char*>(pos), length);
+        pos += length;
+        return true;
+    }
+
+    int receptors_;
+    size_t count_;
+    size_t wordCount_;
+    const int32_t* ids_;            // Номера классов
+    const float* weights_;          // Веса образов или nullptr
+    const uint32_t* words_;         // Слово образа
+    const uint16_t* shifts_;        // Сдвиг слова в образе
+    const uint32_t* wordOffsets_;   // Начала слов в chars_ (wordCount_ + 1)
+    const uint8_t* chars_;          // Символы слов
+    std::vector<int32_t> idStore_;
+    std::vector<float> weightStore_;
+    std::vector<uint32_t> wordStore_;
+    std::vector<uint16_t> shiftStore_;
+    std::vector<uint32_t> offsetStore_;
+    std::vector<uint8_t> charStore_;
+    MappedFile mapping_;
+};
+
+#endif // DATASET_H
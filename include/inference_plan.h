@@ -0,0 +1,390 @@
+/*
+ * inference_plan.h - Скомпилированный план инференса
+ *
+ * Этот модуль содержит:
+ * - Структуру PlanInstruction - одну операцию плана (op, src1, src2, dst)
+ * - Класс InferencePlan - плоский список операций для классификации
+ * - Класс InferenceContext - буферы одного потока классификации
+ *
+ * План строится один раз после загрузки или обучения сети: из выходных
+ * нейронов (NetOutput) обходом в глубину собираются только достижимые
+ * нейроны, упорядоченные топологически (входы раньше потребителей).
+ * Значения хранятся в плотном буфере: сначала входы сети (рецепторы и
+ * базис), затем результаты операций в порядке выполнения.
+ *
+ * Классификация - один проход по массиву операций без рекурсии, без
+ * вызова операций по указателю и без сброса флагов кэша всех
+ * MAX_NEURONS нейронов перед каждым входом.
+ *
+ * После компиляции план только читается: входы, значения и рабочая
+ * память пакета принадлежат InferenceContext. Один план используется
+ * любым количеством потоков без блокировок - по контексту на поток.
+ *
+ * Пакетный режим (evaluateBatch) выполняет тот же план для многих входов
+ * сразу: каждая операция применяется к строке значений по всем образам
+ * пакета теми же SIMD-операциями OpKernel, что и при обучении. Строки
+ * промежуточных значений переиспользуются после последнего чтения,
+ * поэтому рабочая память пропорциональна "ширине" сети, а не её размеру.
+ *
+ * Примечание: Этот файл предназначен для включения в main.cpp после
+ * определения массивов нейронов и операций.
+ */
+
+#ifndef INFERENCE_PLAN_H
+#define INFERENCE_PLAN_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// ============================================================================
+// Операция плана
+// ============================================================================
+
+// Количество операций, которые выполняет интерпретатор плана (op_1..op_11)
+const int PLAN_OP_COUNT = FUSED_OP_COUNT;
+
+struct PlanInstruction {
+    int32_t op;    // Номер операции (getOpIndex, FusedOp)
+    int32_t src1;  // Номер значения первого входа в буфере
+    int32_t src2;  // Номер значения второго входа в буфере
+    int32_t dst;   // Номер значения результата в буфере
+};
+
+// Количество образов, обрабатываемых пакетным планом за один проход
+// (строка значений блока остаётся в L1/L2)
+const int PLAN_BATCH_TILE = 256;
+
+/**
+ * Рабочая память пакетного инференса
+ *
+ * Принадлежит вызывающему коду, поэтому один план можно выполнять
+ * с разными рабочими областями.
+ */
+struct BatchWorkspace {
+    AlignedFloatVector rows;             // Строки базиса, затем строки результатов
+    std::vector<const float*> values;    // Строка каждого значения плана в текущем блоке
+};
+
+// ============================================================================
+// Класс плана инференса
+// ============================================================================
+
+class InferencePlan
+{
+public:
+    InferencePlan() : receptors_(0), inputs_(0), neurons_(0), batchRows_(0) {}
+
+    /**
+     * Компиляция плана из текущей сети (nei, NetOutput, NetInput)
+     *
+     * @return true при успехе, false если структура сети некорректна
+     *         (ссылка за пределы сети или цикл)
+     */
+    bool compile() { return compile(describeNetwork()); }
+
+    /**
+     * Компиляция плана из описания сети
+     *
+     * Не читает глобальное состояние сети, поэтому новую модель можно
+     * скомпилировать в любом потоке, пока старый план обслуживает запросы.
+     *
+     * @param network - структура сети (parseNetworkFile или describeNetwork)
+     * @return true при успехе, false если структура сети некорректна
+     */
+    bool compile(const NetworkDescription& network) {
+        const int nodes = network.nodeCount();
+        receptors_ = network.receptors;
+        inputs_ = network.inputs;
+        neurons_ = nodes;
+        code_.clear();
+        outputs_.assign(network.outputs.size(), -1);
+
+        // Номер значения нейрона в буфере (-1 = ещё не вычислен, -2 = в обходе)
+        std::vector<int> slot(nodes, -1);
+        for (int n = 0; n < inputs_ && n < nodes; n++) slot[n] = n;
+        int valueCount = inputs_;
+
+        std::vector<int> stack;
+        for (size_t c = 0; c < network.outputs.size(); c++) {
+            int root = network.outputs[c];
+            if (root < 0) continue;  // Класс ещё не обучен
+            if (root >= nodes) {
+                cerr << "Error: Output neuron " << root << " of class " << c
+                     << " is outside the network (" << nodes << " neurons)" << endl;
+                return false;
+            }
+
+            // Обход в глубину без рекурсии: нейрон выдаётся после своих входов
+            stack.push_back(root);
+            while (!stack.empty()) {
+                int n = stack.back();
+                if (slot[n] >= 0) {
+                    stack.pop_back();
+                    continue;
+                }
+
+                const NetworkDescription::Neuron& neuron = network.neuron(n - inputs_);
+                if (neuron.i < 0 || neuron.i >= nodes || neuron.j < 0 || neuron.j >= nodes) {
+                    cerr << "Error: Neuron " << n << " references a neuron outside the network" << endl;
+                    return false;
+                }
+
+                if (slot[n] == -1) {
+                    // Первое посещение: сначала вычисляем входы
+                    slot[n] = -2;
+                    if (slot[neuron.j] == -2 || slot[neuron.i] == -2) {
+                        cerr << "Error: Cycle in network structure at neuron " << n << endl;
+                        return false;
+                    }
+                    if (slot[neuron.j] == -1) stack.push_back(neuron.j);
+                    if (slot[neuron.i] == -1) stack.push_back(neuron.i);
+                    continue;
+                }
+
+                // Повторное посещение: входы готовы, выдаём операцию
+                PlanInstruction instr;
+                instr.op = neuron.op;
+                if (instr.op >= PLAN_OP_COUNT) {
+                    cerr << "Error: Operation " << instr.op << " of neuron " << n
+                         << " is not supported by the inference plan" << endl;
+                    return false;
+                }
+                instr.src1 = slot[neuron.i];
+                instr.src2 = slot[neuron.j];
+                instr.dst = valueCount;
+                code_.push_back(instr);
+                slot[n] = valueCount++;
+                stack.pop_back();
+            }
+            outputs_[c] = slot[root];
+        }
+
+        // Базисные значения постоянны и копируются в буфер контекста один раз
+        values_.assign(valueCount, 0.0f);
+        for (int n = receptors_; n < inputs_; n++) values_[n] = network.basis[n - receptors_];
+
+        assignBatchRows();
+        return true;
+    }
+
+    /**
+     * Вычисление всех выходов для одного входа
+     *
+     * @param receptors - значения рецепторов (receptorCount() значений)
+     * @param v - буфер значений (valueCount() значений, базис из initialValues())
+     */
+    void evaluate(const float* receptors, float* v) const {
+        memcpy(v, receptors, receptors_ * sizeof(float));
+
+        for (const PlanInstruction& instr : code_) {
+            const float a = v[instr.src1];
+            const float b = v[instr.src2];
+            v[instr.dst] = visitOp(static_cast<FusedOp>(instr.op), [a, b](auto tag) {
+                return OpKernel<decltype(tag)::value>::value(a, b);
+            });
+        }
+    }
+
+    /**
+     * Вычисление выходов для пакета входов
+     *
+     * @param receptorMatrix - матрица рецепторов "рецептор x образ":
+     *                         значение рецептора d образа s - receptorMatrix[d * count + s]
+     * @param count - количество образов в пакете
+     * @param scores - выход: count x классов значений (по строке на образ)
+     * @param workspace - рабочая память
+     */
+    void evaluateBatch(const float* receptorMatrix, int count, float* scores, BatchWorkspace& workspace) const {
+        const int basisRows = inputs_ - receptors_;
+        const int classes = (int)outputs_.size();
+        workspace.rows.resize((size_t)(basisRows + batchRows_) * PLAN_BATCH_TILE);
+        workspace.values.resize(values_.size());
+
+        float* basis = workspace.rows.data();
+        float* rows = basis + (size_t)basisRows * PLAN_BATCH_TILE;
+        for (int b = 0; b < basisRows; b++) {
+            std::fill(basis + (size_t)b * PLAN_BATCH_TILE, basis + (size_t)(b + 1) * PLAN_BATCH_TILE,
+                      values_[receptors_ + b]);
+            workspace.values[receptors_ + b] = basis + (size_t)b * PLAN_BATCH_TILE;
+        }
+
+        for (int first = 0; first < count; first += PLAN_BATCH_TILE) {
+            const int n = std::min(PLAN_BATCH_TILE, count - first);
+
+            // Рецепторы читаются прямо из матрицы входов
+            for (int d = 0; d < receptors_; d++) {
+                workspace.values[d] = receptorMatrix + (size_t)d * count + first;
+            }
+
+            for (size_t k = 0; k < code_.size(); k++) {
+                const PlanInstruction& instr = code_[k];
+                float* dst = rows + (size_t)batchRow_[k] * PLAN_BATCH_TILE;
+                const float* a = workspace.values[instr.src1];
+                const float* b = workspace.values[instr.src2];
+                const bool basis1 = isBasis(instr.src1);
+                const bool basis2 = isBasis(instr.src2);
+                visitOp(static_cast<FusedOp>(instr.op), [&](auto tag) {
+                    // Базисный операнд - одним значением, без строки одинаковых значений
+                    OpKernel<decltype(tag)::value>().broadcast(dst, basis1 ? &values_[instr.src1] : a, basis1,
+                                                               basis2 ? &values_[instr.src2] : b, basis2, n);
+                });
+                workspace.values[instr.dst] = dst;
+            }
+
+            for (int c = 0; c < classes; c++) {
+                const int index = outputs_[c];
+                const float* out = (index < 0) ? nullptr : workspace.values[index];
+                for (int s = 0; s < n; s++) {
+                    scores[(size_t)(first + s) * classes + c] = (out != nullptr) ? out[s] : 0.0f;
+                }
+            }
+        }
+    }
+
+    // Выход класса c в буфере значений после evaluate() (0 для необученного класса)
+    float output(int c, const float* v) const {
+        int index = outputs_[c];
+        return (index < 0) ? 0.0f : v[index];
+    }
+
+    // Начальное содержимое буфера значений (базисные входы заполнены)
+    const std::vector<float>& initialValues() const { return values_; }
+
+    // Количество операций в плане
+    size_t instructionCount() const { return code_.size(); }
+
+    // Количество строк промежуточных значений пакетного плана
+    int batchRows() const { return batchRows_; }
+
+    // Строка рабочей памяти пакетного плана для результата операции k
+    int batchRow(size_t k) const { return batchRow_[k]; }
+
+    // Операции плана в порядке выполнения
+    const std::vector<PlanInstruction>& instructions() const { return code_; }
+
+    // Номер значения выхода класса c (-1 для необученного класса)
+    int outputValue(int c) const { return outputs_[c]; }
+
+    // Количество классов, рецепторов и входов сети плана
+    int classCount() const { return (int)outputs_.size(); }
+    int receptorCount() const { return receptors_; }
+    int inputCount() const { return inputs_; }
+
+    // Постоянное значение базисного входа (receptorCount() <= index < inputCount())
+    float basisValue(int index) const { return values_[index]; }
+
+    // Значение index - базисный вход (постоянное для всех входов сети)
+    bool isBasis(int index) const { return index >= receptors_ && index < inputs_; }
+
+    // Количество нейронов сети на момент компиляции (без входов)
+    int networkNeurons() const { return neurons_ - inputs_; }
+
+private:
+    /**
+     * Назначение строк рабочей памяти результатам операций
+     *
+     * Строка освобождается после последнего чтения значения и отдаётся
+     * следующему результату (выходы классов не освобождаются). Результат
+     * может занять строку своего входа: операции поэлементные.
+     */
+    void assignBatchRows() {
+        std::vector<int> lastUse(values_.size(), -1);
+        for (size_t k = 0; k < code_.size(); k++) {
+            lastUse[code_[k].src1] = (int)k;
+            lastUse[code_[k].src2] = (int)k;
+        }
+        for (int index : outputs_) {
+            if (index >= 0) lastUse[index] = (int)code_.size();
+        }
+
+        std::vector<int> freeRows;
+        batchRow_.assign(code_.size(), -1);
+        batchRows_ = 0;
+        for (size_t k = 0; k < code_.size(); k++) {
+            const PlanInstruction& instr = code_[k];
+            for (int src : { instr.src1, instr.src2 }) {
+                if (src >= inputs_ && lastUse[src] == (int)k) {
+                    freeRows.push_back(batchRow_[src - inputs_]);
+                    lastUse[src] = -1;  // src1 == src2: освобождаем один раз
+                }
+            }
+            if (freeRows.empty()) {
+                batchRow_[k] = batchRows_++;
+            } else {
+                batchRow_[k] = freeRows.back();
+                freeRows.pop_back();
+            }
+        }
+    }
+
+    int receptors_;                       // Количество рецепторов
+    int inputs_;                          // Количество входов (рецепторы + базис)
+    int neurons_;                         // Количество нейронов сети при компиляции
+    std::vector<PlanInstruction> code_;   // Операции в топологическом порядке
+    std::vector<int> outputs_;            // Номер значения выхода каждого класса
+    std::vector<float> values_;           // Начальный буфер значений (входы, затем результаты)
+    std::vector<int> batchRow_;           // Строка рабочей памяти результата каждой операции
+    int batchRows_;                       // Количество строк промежуточных значений
+};
+
+// ============================================================================
+// Контекст инференса
+// ============================================================================
+
+/**
+ * Контекст классификации одного потока
+ *
+ * Владеет входами, буфером значений и рабочей памятью пакета; план
+ * (модель) только читается и может быть общим для многих контекстов.
+ * Контекст не потокобезопасен: каждому потоку нужен свой.
+ */
+class InferenceContext
+{
+public:
+    InferenceContext() : plan_(nullptr) {}
+    explicit InferenceContext(const InferencePlan& plan) { bind(plan); }
+
+    /**
+     * Привязка к плану (после каждой компиляции плана)
+     */
+    void bind(const InferencePlan& plan) {
+        plan_ = &plan;
+        values_ = plan.initialValues();
+        input_.assign(plan.receptorCount(), 0.0f);
+    }
+
+    // Буфер входов для evaluate() (receptorCount() значений)
+    float* input() { return input_.data(); }
+
+    // Вычисление выходов для входов из input()
+    void evaluate() { plan_->evaluate(input_.data(), values_.data()); }
+
+    // Вычисление выходов для заданных входов
+    void evaluate(const float* receptors) { plan_->evaluate(receptors, values_.data()); }
+
+    // Выход класса c после evaluate()
+    float output(int c) const { return plan_->output(c, values_.data()); }
+
+    /**
+     * Вычисление выходов для пакета входов (см. InferencePlan::evaluateBatch)
+     */
+    void evaluateBatch(const float* receptorMatrix, int count, float* scores) {
+        plan_->evaluateBatch(receptorMatrix, count, scores, workspace_);
+    }
+
+    // Буфер матрицы входов пакета (размер задаёт вызывающий код)
+    std::vector<float>& batchInput() { return batchInput_; }
+
+    const InferencePlan& plan() const { return *plan_; }
+
+private:
+    const InferencePlan* plan_;         // Общий план (только чтение)
+    std::vector<float> input_;          // Входы одного образа
+    std::vector<float> values_;         // Буфер значений одного образа
+    std::vector<float> batchInput_;     // Матрица входов пакета
+    BatchWorkspace workspace_;          // Рабочая память пакета
+};
+
+#endif // INFERENCE_PLAN_H
@@ -0,0 +1,871 @@
+/*
+ * inference_server.h - Сервер классификации на Unix domain socket
+ *
+ * Этот модуль содержит:
+ * - Структуру ServerOptions - параметры сервера (--serve и связанные флаги)
+ * - Класс ServerStats - счётчики запросов и задержек (p50/p99)
+ * - Структуру ServedModel - обслуживаемая модель (план и имена классов)
+ * - Класс InferenceServer - приём соединений, очередь запросов и пул обработчиков
+ * - Функцию serveModel() - запуск сервера (и нагрузочного теста при -b)
+ *
+ * Протокол: клиент отправляет тексты по одному на строку, сервер отвечает
+ * строкой результата на каждый запрос в порядке запросов соединения
+ * (формат --stream-format: TSV или JSONL). Строки, начинающиеся с "#!",
+ * - команды: "#!stats" возвращает счётчики, "#!shutdown" останавливает сервер,
+ * "#!reload [path]" перезагружает модель.
+ *
+ * Запросы всех соединений попадают в общую очередь. Обработчик пула
+ * (по InferenceContext на поток) забирает пакет, когда в очереди набралось
+ * maxBatch запросов или самый старый запрос ждёт дольше maxWait, и
+ * классифицирует его одним вызовом classifyBatch().
+ *
+ * У каждого соединения свои потоки чтения и записи. Обработчики только
+ * дописывают ответы в буфер соединения и в сокет не пишут: клиент,
+ * который перестал читать ответы, задерживает лишь свой поток записи,
+ * а не пул обработчиков и не другие соединения.
+ *
+ * Перезагрузка модели (команда #!reload или --serve-watch) выполняется
+ * отдельным потоком: файл читается и план компилируется "в стороне",
+ * затем указатель на модель атомарно подменяется (RCU). Обработчик берёт
+ * указатель один раз на пакет и держит его до конца пакета, поэтому
+ * начатые пакеты дообрабатываются старой моделью, а запросы не ждут
+ * разбора файла. Старая модель освобождается вместе с последней ссылкой.
+ *
+ * Примечание: Этот файл предназначен для включения в main.cpp после
+ * batch_inference.h. Сервер доступен только на POSIX-системах.
+ */
+
+#ifndef INFERENCE_SERVER_H
+#define INFERENCE_SERVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+    #include <csignal>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+    #define NNETS_HAS_UNIX_SOCKETS 1
+#endif
+
+// ============================================================================
+// Параметры и статистика
+// ============================================================================
+
+// Префикс управляющих команд в протоколе сервера
+const char* const SERVER_COMMAND_PREFIX = "#!";
+
+// Интервал вывода счётчиков работающего сервера (секунды)
+const int SERVER_STATS_INTERVAL = 10;
+
+// Интервал проверки файла модели при --serve-watch (мс)
+const int SERVER_WATCH_INTERVAL_MS = 500;
+
+struct ServerOptions {
+    std::string socketPath;      // Путь к Unix domain socket
+    std::string modelPath;       // Файл модели (для перезагрузки)
+    bool watchModel;             // Перезагружать модель при изменении файла
+    int maxBatch;                // Максимальный размер пакета
+    double maxWaitMs;            // Максимальное ожидание пакета для первого запроса (мс)
+    StreamFormat format;         // Формат ответов
+    bool benchmark;              // Нагрузочный тест встроенными клиентами
+
+    ServerOptions() : watchModel(false), maxBatch(64), maxWaitMs(1.0), format(STREAM_TSV), benchmark(false) {}
+};
+
+/**
+ * Модель, обслуживаемая сервером
+ *
+ * Неизменяема после построения и разделяется обработчиками через
+ * shared_ptr: подмена модели не затрагивает пакеты, начатые со старой.
+ */
+struct ServedModel {
+    InferencePlan plan;
+    std::vector<std::string> classNames;
+    std::string path;
+    unsigned long long version;
+    bool compiled;               // Пакеты считает g_compiledModel (только исходная модель)
+
+    ServedModel() : version(0), compiled(false) {}
+};
+
+typedef std::shared_ptr<const ServedModel> ServedModelPtr;
+
+/**
+ * Загрузка модели для сервера без изменения глобального состояния
+ *
+ * @param path - файл модели
+ * @param version - номер версии новой модели
+ * @param error - выход: описание ошибки
+ * @return модель или nullptr при ошибке
+ */
+ServedModelPtr loadServedModel(const std::string& path, unsigned long long version, std::string& error) {
+    NetworkDescription network;
+    if (!parseNetworkFile(path, network, error)) return nullptr;
+
+    auto model = std::make_shared<ServedModel>();
+    if (!model->plan.compile(network)) {
+        error = "Cannot compile inference plan for " + path;
+        return nullptr;
+    }
+    model->classNames = std::move(network.classNames);
+    model->path = path;
+    model->version = version;
+    return model;
+}
+
+/**
+ * Счётчики сервера
+ *
+ * Задержки (от получения запроса до отправки ответа) хранятся в кольцевом
+ * буфере последних LATENCY_WINDOW запросов; по нему считаются перцентили.
+ */
+class ServerStats
+{
+public:
+    static constexpr size_t LATENCY_WINDOW = 65536;
+
+    ServerStats() : requests_(0), batches_(0), latencyCount_(0), latencies_(LATENCY_WINDOW),
+                    start_(std::chrono::steady_clock::now()) {}
+
+    // Учёт обработанного пакета и задержек его запросов (мкс)
+    void recordBatch(const std::vector<float>& latenciesUs) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batches_++;
+        requests_ += latenciesUs.size();
+        for (float latency : latenciesUs) {
+            latencies_[latencyCount_ % LATENCY_WINDOW] = latency;
+            latencyCount_++;
+        }
+    }
+
+    unsigned long long requests() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return requests_;
+    }
+
+    // Строка со счётчиками: запросы, пакеты, пропускная способность, p50/p99
+    std::string report() const {
+        std::vector<float> window;
+        unsigned long long requests, batches;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            requests = requests_;
+            batches = batches_;
+            window.assign(latencies_.begin(), latencies_.begin() + std::min(latencyCount_, LATENCY_WINDOW));
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+
+        char text[256];
+        snprintf(text, sizeof(text),
+                 "requests=%llu batches=%llu avg_batch=%.2f throughput=%.1f/s p50_us=%.1f p99_us=%.1f",
+                 requests, batches, (batches > 0) ? (double)requests / batches : 0.0,
+                 (seconds > 0.0) ? requests / seconds : 0.0, percentile(window, 0.50), percentile(window, 0.99));
+        return text;
+    }
+
+private:
+    static double percentile(std::vector<float>& values, double q) {
+        if (values.empty()) return 0.0;
+        size_t k = std::min(values.size() - 1, (size_t)(q * values.size()));
+        std::nth_element(values.begin(), values.begin() + k, values.end());
+        return values[k];
+    }
+
+    mutable std::mutex mutex_;
+    unsigned long long requests_;
+    unsigned long long batches_;
+    size_t latencyCount_;
+    std::vector<float> latencies_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#if defined(NNETS_HAS_UNIX_SOCKETS)
+
+// ============================================================================
+// Сервер
+// ============================================================================
+
+/**
+ * Сервер классификации
+ *
+ * Поток приёма соединений, поток чтения на каждое соединение и пул
+ * обработчиков. Ответы соединения пишутся в порядке запросов: готовый
+ * ответ ждёт в ready, пока не записаны все предыдущие.
+ */
+class InferenceServer
+{
+public:
+    explicit InferenceServer(const ServerOptions& options)
+        : options_(options), listenFd_(-1), stopping_(false), reloaderStopping_(false) {
+        // Исходная модель - уже загруженная сеть (и скомпилированная библиотека, если есть)
+        auto model = std::make_shared<ServedModel>();
+        model->plan = g_inferencePlan;
+        model->classNames = classes;
+        model->path = options.modelPath;
+        model->version = 1;
+        model->compiled = g_compiledModel.isLoaded();
+        model_ = model;
+    }
+
+    ~InferenceServer() { stop(); }
+
+    /**
+     * Создание сокета и запуск потоков
+     *
+     * @param workers - количество обработчиков
+     * @return true при успехе
+     */
+    bool start(int workers) {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (options_.socketPath.size() >= sizeof(address.sun_path)) {
+            std::cerr << "Error: Socket path is too long: " << options_.socketPath << std::endl;
+            return false;
+        }
+        strncpy(address.sun_path, options_.socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+        listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd_ < 0) {
+            std::cerr << "Error: Cannot create socket" << std::endl;
+            return false;
+        }
+        unlink(options_.socketPath.c_str());
+        if (bind(listenFd_, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd_, 64) != 0) {
+            std::cerr << "Error: Cannot listen on socket " << options_.socketPath << std::endl;
+            close(listenFd_);
+            listenFd_ = -1;
+            return false;
+        }
+
+        // Запись в закрытое клиентом соединение не должна завершать процесс
+        std::signal(SIGPIPE, SIG_IGN);
+
+        for (int t = 0; t < workers; t++) {
+            workers_.emplace_back(&InferenceServer::workerLoop, this);
+        }
+        reloader_ = std::thread(&InferenceServer::reloadLoop, this);
+        acceptor_ = std::thread(&InferenceServer::acceptLoop, this);
+        return true;
+    }
+
+    /**
+     * Ожидание остановки (команда #!shutdown или Ctrl+C)
+     *
+     * Раз в SERVER_STATS_INTERVAL секунд выводит счётчики в stderr,
+     * если были новые запросы.
+     */
+    void wait() {
+        auto lastReport = std::chrono::steady_clock::now();
+        unsigned long long reported = 0;
+        while (!stopping_.load() && g_interruptRequested == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastReport >= std::chrono::seconds(SERVER_STATS_INTERVAL) && stats_.requests() != reported) {
+                reported = stats_.requests();
+                std::cerr << "[serve] " << statsReport() << std::endl;
+                lastReport = now;
+            }
+        }
+    }
+
+    /**
+     * Остановка сервера: запросы из очереди дообрабатываются
+     */
+    void stop() {
+        if (listenFd_ < 0) return;
+        stopping_.store(true);
+        queueReady_.notify_all();
+        if (acceptor_.joinable()) acceptor_.join();
+        for (auto& worker : workers_) worker.join();
+        workers_.clear();
+
+        // Обработчики могли передать последние команды #!reload
+        {
+            std::lock_guard<std::mutex> lock(reloadMutex_);
+            reloaderStopping_ = true;
+        }
+        reloadReady_.notify_all();
+        if (reloader_.joinable()) reloader_.join();
+
+        // Читающие потоки ждут данных от клиентов, пишущие - пока клиент
+        // прочитает ответы: прерываем и тех, и другие
+        for (auto& connection : connections_) {
+            {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                if (connection->fd >= 0) shutdown(connection->fd, SHUT_RDWR);
+                connection->closing = true;
+            }
+            connection->outputReady.notify_one();
+        }
+        for (auto& connection : connections_) {
+            connection->reader.join();
+            connection->writer.join();
+        }
+        connections_.clear();
+
+        close(listenFd_);
+        listenFd_ = -1;
+        unlink(options_.socketPath.c_str());
+    }
+
+    // Счётчики сервера с версией текущей модели
+    std::string statsReport() const {
+        return "model_version=" + std::to_string(currentModel()->version) + " " + stats_.report();
+    }
+
+private:
+    // Соединение клиента
+    struct Connection {
+        int fd;
+        std::thread reader;                             // Поток чтения запросов
+        std::thread writer;                             // Поток записи ответов
+        std::atomic<bool> finished;                     // Оба потока завершены
+        std::mutex mutex;                               // Защищает fd, буфер и очередь ответов
+        std::condition_variable outputReady;            // Появились ответы или клиент закончил
+        unsigned long long nextWrite;                   // Номер следующего ответа в буфер
+        unsigned long long total;                       // Всего запросов (известно после EOF)
+        bool eof;                                       // Клиент закончил отправку
+        bool closing;                                   // Сервер остановлен: ответов больше не будет
+        std::map<unsigned long long, std::string> ready;  // Готовые ответы, ждущие предыдущих
+        std::string output;                             // Ответы по порядку, ещё не записанные в сокет
+
+        explicit Connection(int socket) : fd(socket), finished(false), nextWrite(0), total(0), eof(false), closing(false) {}
+
+        // Поток чтения завершён и ответы на все запросы записаны (вызывается под mutex)
+        bool done() const {
+            return eof && output.empty() && (closing || nextWrite == total);
+        }
+
+        void closeSocket() {
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+    };
+
+    // Запрос в очереди
+    struct Request {
+        std::shared_ptr<Connection> connection;
+        unsigned long long sequence;                    // Номер запроса в соединении
+        std::string text;
+        std::chrono::steady_clock::time_point arrival;
+    };
+
+    void acceptLoop() {
+        while (!stopping_.load()) {
+            // Завершённые соединения больше не нужны
+            for (size_t k = 0; k < connections_.size();) {
+                if (connections_[k]->finished.load()) {
+                    connections_[k]->reader.join();
+                    connections_[k]->writer.join();
+                    connections_.erase(connections_.begin() + k);
+                } else {
+                    k++;
+                }
+            }
+
+            pollfd descriptor = { listenFd_, POLLIN, 0 };
+            if (poll(&descriptor, 1, 100) <= 0) continue;
+            int fd = accept(listenFd_, nullptr, nullptr);
+            if (fd < 0) continue;
+
+            auto connection = std::make_shared<Connection>(fd);
+            connection->reader = std::thread(&InferenceServer::readLoop, this, connection);
+            connection->writer = std::thread(&InferenceServer::writeLoop, this, connection);
+            connections_.push_back(connection);
+        }
+    }
+
+    void readLoop(std::shared_ptr<Connection> connection) {
+        std::string pending;
+        std::vector<char> buffer(64 * 1024);
+        std::vector<Request> requests;
+        unsigned long long sequence = 0;
+        const int fd = connection->fd;
+        while (true) {
+            ssize_t received = read(fd, buffer.data(), buffer.size());
+            if (received <= 0) break;
+            pending.append(buffer.data(), (size_t)received);
+
+            size_t begin = 0;
+            size_t end;
+            requests.clear();
+            auto now = std::chrono::steady_clock::now();
+            while ((end = pending.find('\n', begin)) != std::string::npos) {
+                size_t length = end - begin;
+                if (length > 0 && pending[end - 1] == '\r') length--;
+                requests.push_back(Request{ connection, sequence++, pending.substr(begin, length), now });
+                begin = end + 1;
+            }
+            pending.erase(0, begin);
+            if (!requests.empty()) enqueue(requests);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            connection->eof = true;
+            connection->total = sequence;
+        }
+        connection->outputReady.notify_one();
+    }
+
+    /**
+     * Поток записи ответов соединения
+     *
+     * Забирает накопленные ответы из буфера и пишет их в сокет без
+     * блокировки mutex соединения. Если клиент закрыл соединение,
+     * остальные ответы отбрасываются. Сокет закрывается, когда поток
+     * чтения завершён и все ответы записаны (при остановке сервера
+     * shutdown() прерывает и чтение, и запись).
+     */
+    void writeLoop(std::shared_ptr<Connection> connection) {
+        std::string chunk;
+        bool broken = false;
+        const int fd = connection->fd;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(connection->mutex);
+                connection->outputReady.wait(lock, [&] { return !connection->output.empty() || connection->done(); });
+                if (connection->done()) break;
+                chunk.swap(connection->output);
+            }
+            if (!broken) broken = !writeAll(fd, chunk);
+            chunk.clear();
+        }
+
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->closeSocket();
+        connection->finished.store(true);
+    }
+
+    void enqueue(std::vector<Request>& requests) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            for (Request& request : requests) queue_.push_back(std::move(request));
+        }
+        queueReady_.notify_one();
+    }
+
+    ServedModelPtr currentModel() const { return std::atomic_load(&model_); }
+
+    void workerLoop() {
+        InferenceContext context;
+        std::vector<Request> batch;
+        std::vector<std::string_view> texts;
+        std::vector<float> scores;
+        std::vector<float> latencies;
+        const auto maxWait = std::chrono::microseconds((long long)(options_.maxWaitMs * 1000.0));
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(queueMutex_);
+                queueReady_.wait(lock, [this] { return !queue_.empty() || stopping_.load(); });
+                if (queue_.empty()) return;  // Остановка и очередь пуста
+
+                // Ждём заполнения пакета не дольше maxWait от прихода первого запроса
+                const auto deadline = queue_.front().arrival + maxWait;
+                queueReady_.wait_until(lock, deadline, [this] {
+                    return (int)queue_.size() >= options_.maxBatch || stopping_.load();
+                });
+
+                const size_t count = std::min(queue_.size(), (size_t)options_.maxBatch);
+                batch.clear();
+                for (size_t k = 0; k < count; k++) {
+                    batch.push_back(std::move(queue_.front()));
+                    queue_.pop_front();
+                }
+                if (!queue_.empty()) queueReady_.notify_one();
+            }
+
+            // Модель берётся после выборки пакета и удерживается до его конца
+            ServedModelPtr model = currentModel();
+            if (&context.plan() != &model->plan) context.bind(model->plan);
+            process(batch, *model, context, texts, scores, latencies);
+        }
+    }
+
+    void process(std::vector<Request>& batch, const ServedModel& model, InferenceContext& context,
+                 std::vector<std::string_view>& texts, std::vector<float>& scores, std::vector<float>& latencies) {
+        texts.clear();
+        for (const Request& request : batch) {
+            if (!isCommand(request.text)) texts.push_back(request.text);
+        }
+        if (!texts.empty()) classifyBatch(texts.data(), (int)texts.size(), scores, context, model.compiled);
+
+        latencies.clear();
+        const size_t classCount = model.classNames.size();
+        size_t index = 0;
+        for (Request& request : batch) {
+            std::string response;
+            if (isCommand(request.text)) {
+                if (request.text == "#!reload" || request.text.compare(0, 9, "#!reload ") == 0) {
+                    requestReload(request);  // Ответит поток перезагрузки
+                    continue;
+                }
+                response = runCommand(request.text);
+            } else {
+                appendClassification(response, request.text, scores.data() + index * classCount,
+                                     model.classNames, options_.format);
+                index++;
+            }
+            respond(request, std::move(response));
+            if (!isCommand(request.text)) {
+                latencies.push_back(std::chrono::duration<float, std::micro>(
+                    std::chrono::steady_clock::now() - request.arrival).count());
+            }
+        }
+        if (!latencies.empty()) stats_.recordBatch(latencies);
+    }
+
+    static bool isCommand(const std::string& text) {
+        return text.compare(0, 2, SERVER_COMMAND_PREFIX) == 0;
+    }
+
+    std::string runCommand(const std::string& text) {
+        std::string command = text.substr(2);
+        if (command == "stats") return statsReport() + "\n";
+        if (command == "shutdown") {
+            stopping_.store(true);
+            return "ok\n";
+        }
+        return "error unknown command '" + command + "'\n";
+    }
+
+    void requestReload(Request& request) {
+        {
+            std::lock_guard<std::mutex> lock(reloadMutex_);
+            reloadQueue_.push_back(std::move(request));
+        }
+        reloadReady_.notify_one();
+    }
+
+    /**
+     * Поток перезагрузки модели
+     *
+     * Обрабатывает команды #!reload (накопившиеся команды объединяются в
+     * одну перезагрузку) и при --serve-watch следит за файлом модели:
+     * изменённый файл загружается, когда его время изменения и размер
+     * не меняются в течение интервала проверки (запись завершена).
+     */
+    void reloadLoop() {
+        namespace fs = std::filesystem;
+        typedef std::pair<fs::file_time_type, std::uintmax_t> FileSignature;
+        auto signature = [](const std::string& path, FileSignature& result) {
+            std::error_code error;
+            result.first = fs::last_write_time(path, error);
+            if (error) return false;
+            result.second = fs::file_size(path, error);
+            return !error;
+        };
+
+        FileSignature loaded, candidate;
+        bool haveLoaded = signature(options_.modelPath, loaded);
+        bool haveCandidate = false;
+        std::vector<Request> pending;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(reloadMutex_);
+                auto ready = [this] { return !reloadQueue_.empty() || reloaderStopping_; };
+                if (options_.watchModel) {
+                    reloadReady_.wait_for(lock, std::chrono::milliseconds(SERVER_WATCH_INTERVAL_MS), ready);
+                } else {
+                    reloadReady_.wait(lock, ready);
+                }
+                if (reloadQueue_.empty() && reloaderStopping_) return;
+                pending.clear();
+                for (Request& request : reloadQueue_) pending.push_back(std::move(request));
+                reloadQueue_.clear();
+            }
+
+            if (!pending.empty()) {
+                // "#!reload <path>" переключает сервер на другой файл
+                std::string path = currentModel()->path;
+                for (const Request& request : pending) {
+                    if (request.text.size() > 9) path = request.text.substr(9);
+                }
+                std::string response = reload(path);
+                for (Request& request : pending) respond(request, std::string(response));
+                haveLoaded = signature(currentModel()->path, loaded);
+                haveCandidate = false;
+                continue;
+            }
+
+            // Слежение за файлом: перезагрузка после стабилизации изменений
+            FileSignature current;
+            if (!options_.watchModel || !signature(currentModel()->path, current)) continue;
+            if (haveLoaded && current == loaded) {
+                haveCandidate = false;
+            } else if (haveCandidate && current == candidate) {
+                reload(currentModel()->path);
+                loaded = current;  // Неудачный файл не перечитывается, пока не изменится
+                haveLoaded = true;
+                haveCandidate = false;
+            } else {
+                candidate = current;
+                haveCandidate = true;
+            }
+        }
+    }
+
+    /**
+     * Загрузка модели и атомарная подмена текущей
+     *
+     * @return строка ответа на команду #!reload
+     */
+    std::string reload(const std::string& path) {
+        std::string error;
+        auto start = std::chrono::steady_clock::now();
+        ServedModelPtr model = loadServedModel(path, currentModel()->version + 1, error);
+        if (!model) {
+            std::cerr << "[serve] Reload failed, keeping model version " << currentModel()->version
+                      << ": " << error << std::endl;
+            return "error " + error + "\n";
+        }
+        std::atomic_store(&model_, model);
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::string summary = "version=" + std::to_string(model->version) +
+                              " neurons=" + std::to_string(model->plan.networkNeurons()) +
+                              " classes=" + std::to_string(model->classNames.size());
+        std::cerr << "[serve] Reloaded " << path << " (" << summary << ") in " << ms << " ms" << std::endl;
+        return "ok " + summary + "\n";
+    }
+
+    // Передача ответа потоку записи в порядке запросов соединения (без записи в сокет)
+    void respond(Request& request, std::string&& response) {
+        Connection& connection = *request.connection;
+        {
+            std::lock_guard<std::mutex> lock(connection.mutex);
+            connection.ready.emplace(request.sequence, std::move(response));
+            auto it = connection.ready.begin();
+            while (it != connection.ready.end() && it->first == connection.nextWrite) {
+                connection.output += it->second;
+                connection.nextWrite++;
+                it = connection.ready.erase(it);
+            }
+        }
+        connection.outputReady.notify_one();
+    }
+
+    // @return false, если клиент закрыл соединение
+    static bool writeAll(int fd, const std::string& data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t result = write(fd, data.data() + written, data.size() - written);
+            if (result <= 0) return false;
+            written += (size_t)result;
+        }
+        return true;
+    }
+
+    ServerOptions options_;
+    int listenFd_;
+    std::atomic<bool> stopping_;
+    ServerStats stats_;
+    ServedModelPtr model_;                              // Текущая модель (atomic_load/atomic_store)
+
+    std::mutex reloadMutex_;
+    std::condition_variable reloadReady_;
+    std::vector<Request> reloadQueue_;                  // Команды #!reload, ждущие потока перезагрузки
+    bool reloaderStopping_;
+    std::thread reloader_;
+
+    std::mutex queueMutex_;
+    std::condition_variable queueReady_;
+    std::deque<Request> queue_;
+
+    std::vector<std::shared_ptr<Connection>> connections_;  // Только поток приёма и stop()
+    std::vector<std::thread> workers_;
+    std::thread acceptor_;
+};
+
+// ============================================================================
+// Нагрузочный тест
+// ============================================================================
+
+/**
+ * Клиент нагрузочного теста: отправляет тексты окнами и читает ответы
+ *
+ * @param socketPath - путь к сокету
+ * @param texts - запросы
+ * @param window - количество запросов, отправляемых до чтения ответов
+ * @param responses - выход: полученные ответы (по строке на запрос)
+ * @return true, если получены ответы на все запросы
+ */
+bool runServerClient(const std::string& socketPath, const std::vector<std::string>& texts, size_t window,
+                     std::vector<std::string>& responses) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    std::string pending;
+    std::vector<char> buffer(64 * 1024);
+    responses.clear();
+    for (size_t first = 0; first < texts.size(); first += window) {
+        size_t last = std::min(texts.size(), first + window);
+        std::string request;
+        for (size_t k = first; k < last; k++) request += texts[k] + "\n";
+        size_t written = 0;
+        while (written < request.size()) {
+            ssize_t result = write(fd, request.data() + written, request.size() - written);
+            if (result <= 0) break;
+            written += (size_t)result;
+        }
+
+        while (responses.size() < last) {
+            size_t end = pending.find('\n');
+            if (end != std::string::npos) {
+                responses.push_back(pending.substr(0, end + 1));
+                pending.erase(0, end + 1);
+                continue;
+            }
+            ssize_t received = read(fd, buffer.data(), buffer.size());
+            if (received <= 0) {
+                close(fd);
+                return false;
+            }
+            pending.append(buffer.data(), (size_t)received);
+        }
+    }
+    close(fd);
+    return true;
+}
+
+/**
+ * Нагрузочный тест сервера встроенными клиентами
+ *
+ * Несколько клиентов одновременно отправляют случайные тексты; ответы
+ * сравниваются с классификацией основного потока. Параллельно отдельный
+ * клиент несколько раз перезагружает модель (тот же файл), поэтому
+ * ответы не должны меняться.
+ *
+ * @return true, если все ответы получены и совпадают
+ */
+bool benchmarkServer(const ServerOptions& options) {
+    const int clients = 8;
+    const int requestsPerClient = 4000;
+    const size_t window = 16;
+    const int reloads = 5;
+
+    std::vector<std::vector<std::string>> texts(clients);
+    std::vector<std::vector<std::string>> responses(clients);
+    std::vector<char> completed(clients, 0);
+    for (int client = 0; client < clients; client++) {
+        texts[client] = randomInputs(requestsPerClient, 42u + (unsigned)client);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int client = 0; client < clients; client++) {
+        threads.emplace_back([&, client]() {
+            completed[client] = runServerClient(options.socketPath, texts[client], window, responses[client]);
+        });
+    }
+
+    // Перезагрузки модели во время нагрузки
+    int reloadsOk = 0;
+    std::thread reloader([&]() {
+        std::vector<std::string> command(1, "#!reload");
+        std::vector<std::string> response;
+        for (int r = 0; r < reloads; r++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            if (runServerClient(options.socketPath, command, 1, response) && response[0].compare(0, 3, "ok ") == 0) {
+                reloadsOk++;
+            }
+        }
+    });
+
+    for (auto& thread : threads) thread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    reloader.join();
+
+    // Ожидаемые ответы - классификация тех же текстов основным потоком
+    int failedClients = 0;
+    int mismatches = 0;
+    std::vector<float> scores;
+    for (int client = 0; client < clients; client++) {
+        if (!completed[client]) {
+            failedClients++;
+            continue;
+        }
+        classifyBatch(texts[client], scores);
+        for (int k = 0; k < requestsPerClient; k++) {
+            std::string expected;
+            appendClassification(expected, texts[client][k], scores.data() + (size_t)k * Classes, classes,
+                                 options.format);
+            if (expected != responses[client][k]) mismatches++;
+        }
+    }
+
+    std::cout << "\n=== Server benchmark ===" << std::endl;
+    std::cout << "Clients: " << clients << " x " << requestsPerClient << " requests (window " << window << ")" << std::endl;
+    std::cout << "Client time: " << (seconds * 1000.0) << " ms";
+    if (seconds > 0.0) std::cout << " (" << (clients * requestsPerClient / seconds) << " requests/sec)";
+    std::cout << std::endl;
+    std::cout << "Failed clients: " << failedClients << std::endl;
+    std::cout << "Mismatched responses: " << mismatches << std::endl;
+    std::cout << "Model reloads: " << reloadsOk << " of " << reloads << std::endl;
+    return failedClients == 0 && mismatches == 0 && reloadsOk == reloads;
+}
+
+#endif // NNETS_HAS_UNIX_SOCKETS
+
+/**
+ * Запуск сервера классификации
+ *
+ * Работает до команды #!shutdown или Ctrl+C; в режиме бенчмарка -
+ * до завершения встроенных клиентов. При остановке выводит счётчики.
+ *
+ * @return код возврата программы
+ */
+int serveModel(const ServerOptions& options) {
+#if defined(NNETS_HAS_UNIX_SOCKETS)
+    if (options.maxBatch < 1 || options.maxWaitMs < 0.0) {
+        std::cerr << "Error: --serve-batch must be >= 1 and --serve-wait >= 0" << std::endl;
+        return 1;
+    }
+
+    const int workers = inferenceThreadCount();
+    InferenceServer server(options);
+    if (!server.start(workers)) {
+        return 1;
+    }
+    std::cout << "Serving on " << options.socketPath << ": " << workers << " workers, max batch "
+              << options.maxBatch << ", max wait " << options.maxWaitMs << " ms" << std::endl;
+
+    bool passed = true;
+    if (options.benchmark) {
+        passed = benchmarkServer(options);
+    } else {
+        server.wait();
+    }
+    server.stop();
+
+    std::cout << "Server stats: " << server.statsReport() << std::endl;
+    return passed ? 0 : 1;
+#else
+    (void)options;
+    std::cerr << "Error: --serve requires Unix domain sockets (not supported on this platform)" << std::endl;
+    return 1;
+#endif
+}
+
+#endif // INFERENCE_SERVER_H
@@ -2,9 +2,10 @@
  * json_io.h - Функции загрузки и сохранения данных в формате JSON
  *
  * Этот модуль содержит функции для:
- * - Загрузки конфигурации обучения из JSON файла
- * - Сохранения обученной нейронной сети в JSON файл
- * - Загрузки обученной нейронной сети из JSON файла для инференса
+ * - Загрузки конфигурации обучения из JSON файла (в том числе через
+ *   двоичный кэш набора образов, см. dataset.h)
+ * - Сохранения обученной нейронной сети в JSON или двоичный файл
+ * - Загрузки обученной нейронной сети из JSON или двоичного файла
  *
  * Примечание: Этот файл предназначен для включения в main.cpp после
  * определения всех необходимых типов и переменных.
@@ -13,6 +14,8 @@
 #ifndef JSON_IO_H
 #define JSON_IO_H
 
+#include <filesystem>
+
 // ============================================================================
 // Глобальные переменные для конфигурации функций обучения
 // ============================================================================
@@ -25,41 +28,48 @@ std::vector<std::string> g_trainingFuncs;
 // ============================================================================
 
 /**
- * Генерация сдвинутых вариантов слова
- *
- * Создаёт все возможные позиции слова в пределах заданной ширины рецепторов.
- * Например, слово "time" длиной 4 символа при receptors=20 даст 17 вариантов:
- * "time                " (слово в начале)
- * " time               " (слово сдвинуто на 1)
- * и т.д.
+ * Вывод параметров загруженной конфигурации
  *
- * @param word - исходное слово
- * @param id - идентификатор класса
- * @param receptors - количество входов нейронной сети
+ * @param description - описание конфигурации или nullptr
+ * @param hasOps - набор операций задан в конфигурации
  */
-void generateShiftedImages(const string& word, int id, int receptors) {
-    // Дополняем слово пробелами до длины receptors
-    string padded = word;
-    while ((int)padded.length() < receptors) {
-        padded += ' ';
-    }
-    padded = padded.substr(0, receptors);
-
-    // Добавляем оригинальную версию (выровненную по левому краю)
-    const_words.push_back({padded, id});
-
-    // Генерируем все сдвинутые версии (слово может находиться в любой позиции)
-    int wordLen = word.length();
-    for (int shift = 1; shift <= receptors - wordLen; shift++) {
-        string shifted(shift, ' ');
-        shifted += word;
-        while ((int)shifted.length() < receptors) {
-            shifted += ' ';
+void printConfigSummary(int receptors, const string* description, bool hasOps) {
+    cout << "  Receptors: " << receptors << endl;
+    cout << "  Classes: " << Classes << endl;
+    cout << "  Images: " << g_dataset.size() << endl;
+    if (description != nullptr) {
+        cout << "  Description: " << *description << endl;
+    }
+    if (!g_trainingFuncs.empty()) {
+        cout << "  Training funcs: ";
+        for (size_t i = 0; i < g_trainingFuncs.size(); i++) {
+            if (i > 0) cout << ", ";
+            cout << g_trainingFuncs[i];
+        }
+        cout << endl;
+    }
+    if (hasOps) {
+        cout << "  Operations: ";
+        for (int k = 0; k < op_count; k++) {
+            if (k > 0) cout << ", ";
+            cout << fusedOpName(op_kind[k]);
         }
-        const_words.push_back({shifted.substr(0, receptors), id});
+        cout << " (search cost x" << std::round(opSetCost() * 100.0f) / 100.0f << ")" << endl;
     }
 }
 
+/**
+ * Подпись файла конфигурации (или списка образов) для проверки кэша набора:
+ * размер и время изменения
+ */
+bool configSignature(const string& path, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    size = (uint64_t)std::filesystem::file_size(path, error);
+    if (error) return false;
+    time = (int64_t)std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    return !error;
+}
+
 /**
  * Загрузка конфигурации из JSON файла
  *
@@ -67,121 +77,181 @@ void generateShiftedImages(const string& word, int id, int receptors) {
  * - receptors: количество входов нейронной сети
  * - classes: массив классов с их словами для обучения
  * - images: напрямую заданные образы (альтернатива classes)
+ * - images_file: список образов "слово<TAB>класс" (дополняет images)
  * - generate_shifts: флаг генерации сдвинутых образов
+ * - ops: операции нейронов для обучения (add, sub, rsub, mul, div, rdiv,
+ *   sq2_add, sq1_add, sq2_sub, sq1_sub, parallel; по умолчанию первые четыре)
  * - description: описание конфигурации
  *
+ * Файл разбирается потоково (config_reader.h): образы добавляются в набор
+ * по мере чтения, без дерева JSON; обрезка по receptors и сдвиги
+ * применяются после разбора (Dataset::finishAppend).
+ *
  * @param configPath - путь к JSON файлу конфигурации
  * @param receptors - выходной параметр: количество рецепторов
+ * @param info - если задан, выход: метаданные для кэша набора (--dataset-cache)
  * @return true при успешной загрузке, false при ошибке
  */
-bool loadConfig(const string& configPath, int& receptors) {
-    ifstream configFile(configPath);
-    if (!configFile.is_open()) {
-        cerr << "Error: Cannot open config file: " << configPath << endl;
+bool loadConfig(const string& configPath, int& receptors, DatasetCacheInfo* info = nullptr) {
+    // Очищаем набор перед загрузкой
+    g_dataset.clear(receptors);
+    classes.clear();
+
+    int classEntries = 0;
+    ConfigSink sink;
+    sink.entry = [&classEntries](bool image, const string& word, int id) {
+        g_dataset.append(word, id);
+        if (id >= (int)classes.size()) {
+            classes.resize(id + 1);
+        }
+        if (!image) {
+            // Сохраняем уникальное имя класса
+            classes[id] = word;
+            classEntries++;
+        } else if (classes[id].empty()) {
+            // Сохраняем первое слово как имя класса (с удалением пробелов)
+            size_t end = word.find_last_not_of(' ');
+            classes[id] = (end != string::npos) ? word.substr(0, end + 1) : "";
+        }
+    };
+    sink.reset = [&classEntries, receptors]() {
+        g_dataset.clear(receptors);
+        classes.clear();
+        classEntries = 0;
+    };
+
+    ConfigContents config;
+    string error;
+    if (!readConfig(configPath, config, sink, error)) {
+        cerr << "Error: " << error << endl;
         return false;
     }
 
-    try {
-        json config;
-        configFile >> config;
-
-        // Загружаем количество рецепторов (входов нейронной сети)
-        if (config.contains("receptors")) {
-            receptors = config["receptors"].get<int>();
-        }
+    // Загружаем количество рецепторов (входов нейронной сети)
+    if (config.hasReceptors) {
+        receptors = config.receptors;
+    }
+    g_dataset.finishAppend(receptors, !config.hasImages && config.generateShifts);
 
-        // Очищаем векторы перед загрузкой
-        const_words.clear();
-        classes.clear();
+    if (config.hasImages) {
+        Classes = (int)classes.size();
+    } else if (config.hasClasses) {
+        Classes = std::max(classEntries, (int)classes.size());
+        classes.resize(Classes);
+    }
 
-        // Проверяем, заданы ли образы напрямую
-        if (config.contains("images")) {
-            // Загружаем образы напрямую из JSON
-            Classes = 0;
-            for (const auto& img : config["images"]) {
-                string word = img["word"].get<string>();
-                int id = img["id"].get<int>();
-                const_words.push_back({word, id});
-                if (id >= Classes) {
-                    Classes = id + 1;
-                }
-            }
-            // Создаём вектор классов из уникальных идентификаторов
-            classes.resize(Classes);
-            for (const auto& img : const_words) {
-                if (classes[img.id].empty()) {
-                    // Сохраняем первое слово как имя класса (с удалением пробелов)
-                    string trimmed = img.word;
-                    size_t end = trimmed.find_last_not_of(' ');
-                    if (end != string::npos) {
-                        trimmed = trimmed.substr(0, end + 1);
-                    } else {
-                        trimmed = "";  // Все пробелы - пустой класс
-                    }
-                    classes[img.id] = trimmed;
-                }
+    // Последовательность функций обучения (если задана)
+    g_trainingFuncs = config.funcs;
+
+    // Загружаем набор операций (если задан)
+    if (config.hasOps) {
+        vector<FusedOp> kinds;
+        for (const string& name : config.ops) {
+            FusedOp kind;
+            if (!parseFusedOp(name, kind)) {
+                cerr << "Error: Unknown operation '" << name << "' in " << configPath << endl;
+                return false;
             }
+            kinds.push_back(kind);
         }
-        // Иначе генерируем из классов
-        else if (config.contains("classes")) {
-            Classes = config["classes"].size();
-            classes.resize(Classes);
-            bool generateShifts = true;
-            if (config.contains("generate_shifts")) {
-                generateShifts = config["generate_shifts"].get<bool>();
-            }
+        if (kinds.empty()) {
+            cerr << "Error: Empty operation list in " << configPath << endl;
+            return false;
+        }
+        configureOps(kinds);
+        if (info != nullptr) info->ops.assign(kinds.begin(), kinds.end());
+    }
+
+    if (info != nullptr) {
+        info->classNames = classes;
+        info->funcs = g_trainingFuncs;
+        info->hasDescription = config.hasDescription;
+        info->description = config.description;
+        info->imagesFile = config.imagesFile;
+        if (!config.imagesFile.empty()) {
+            configSignature(config.imagesFile, info->imagesSize, info->imagesTime);
+        }
+    }
 
-            for (const auto& cls : config["classes"]) {
-                string word = cls["word"].get<string>();
-                int id = cls["id"].get<int>();
+    cout << "Loaded config: " << configPath << endl;
+    if (!config.imagesFile.empty()) {
+        cout << "  Images file: " << config.imagesFile << endl;
+    }
+    printConfigSummary(receptors, config.hasDescription ? &config.description : nullptr, config.hasOps);
+    return true;
+}
 
-                // Сохраняем уникальное имя класса
-                classes[id] = word;
+/**
+ * Загрузка конфигурации через двоичный кэш набора (--dataset-cache)
+ *
+ * Если кэш действителен (размер и время изменения конфигурации и её
+ * images_file, а также количество рецепторов по умолчанию совпадают
+ * с записанными), образы и метаданные берутся из него без разбора JSON
+ * и генерации сдвигов, а образы остаются в отображении файла. Иначе конфигурация разбирается
+ * (loadConfig) и кэш перезаписывается; ошибка записи кэша не прерывает
+ * обучение.
+ *
+ * @param cachePath - путь к файлу кэша (пустой - без кэша)
+ */
+bool loadConfigCached(const string& configPath, const string& cachePath, int& receptors) {
+    if (cachePath.empty()) {
+        return loadConfig(configPath, receptors);
+    }
 
-                if (generateShifts && word.length() > 0) {
-                    generateShiftedImages(word, id, receptors);
-                } else {
-                    // Просто добавляем слово, дополненное до длины receptors
-                    string padded = word;
-                    while ((int)padded.length() < receptors) {
-                        padded += ' ';
+    DatasetCacheInfo info;
+    uint64_t sourceSize = 0;
+    int64_t sourceTime = 0;
+    bool haveSignature = configSignature(configPath, sourceSize, sourceTime);
+
+    string error;
+    if (haveSignature && g_dataset.loadCache(cachePath, info, error)) {
+        uint64_t imagesSize = 0;
+        int64_t imagesTime = 0;
+        const bool imagesValid = info.imagesFile.empty() ||
+            (configSignature(info.imagesFile, imagesSize, imagesTime) && info.imagesSize == imagesSize &&
+             info.imagesTime == imagesTime);
+        if (info.sourceSize == sourceSize && info.sourceTime == sourceTime && info.sourceReceptors == receptors &&
+            imagesValid) {
+            receptors = g_dataset.receptors();
+            classes = info.classNames;
+            Classes = (int)classes.size();
+            g_trainingFuncs = info.funcs;
+            if (!info.ops.empty()) {
+                vector<FusedOp> kinds;
+                for (uint8_t kind : info.ops) {
+                    if (kind >= FUSED_OP_COUNT) {
+                        cerr << "Error: Unknown operation " << (int)kind << " in dataset cache " << cachePath << endl;
+                        return false;
                     }
-                    const_words.push_back({padded.substr(0, receptors), id});
+                    kinds.push_back((FusedOp)kind);
                 }
+                configureOps(kinds);
             }
-        }
 
-        // Загружаем последовательность функций обучения (если задана)
-        g_trainingFuncs.clear();
-        if (config.contains("funcs")) {
-            for (const auto& func : config["funcs"]) {
-                string funcName = func.get<string>();
-                g_trainingFuncs.push_back(funcName);
-            }
-        }
-
-        cout << "Loaded config: " << configPath << endl;
-        cout << "  Receptors: " << receptors << endl;
-        cout << "  Classes: " << Classes << endl;
-        cout << "  Images: " << const_words.size() << endl;
-        if (config.contains("description")) {
-            cout << "  Description: " << config["description"].get<string>() << endl;
+            cout << "Loaded dataset cache: " << cachePath << " (" << configPath << ", "
+                 << (g_dataset.isMapped() ? "mapped" : "read") << ")" << endl;
+            printConfigSummary(receptors, info.hasDescription ? &info.description : nullptr, !info.ops.empty());
+            return true;
         }
-        if (!g_trainingFuncs.empty()) {
-            cout << "  Training funcs: ";
-            for (size_t i = 0; i < g_trainingFuncs.size(); i++) {
-                if (i > 0) cout << ", ";
-                cout << g_trainingFuncs[i];
-            }
-            cout << endl;
-        }
-
-        return true;
+        cout << "Dataset cache " << cachePath << " is stale, rebuilding" << endl;
+    } else if (haveSignature && error != "cannot open file") {
+        cerr << "Warning: Ignoring dataset cache " << cachePath << ": " << error << endl;
     }
-    catch (const json::exception& e) {
-        cerr << "JSON parsing error: " << e.what() << endl;
+
+    info = DatasetCacheInfo();
+    info.sourceSize = sourceSize;
+    info.sourceTime = sourceTime;
+    info.sourceReceptors = receptors;
+    if (!loadConfig(configPath, receptors, &info)) {
         return false;
     }
+    if (haveSignature && g_dataset.saveCache(cachePath, info)) {
+        cout << "Saved dataset cache: " << cachePath << " (" << g_dataset.size() << " images, "
+             << g_dataset.bytes() / 1024 << " KB)" << endl;
+    } else {
+        cerr << "Warning: Cannot write dataset cache " << cachePath << endl;
+    }
+    return true;
 }
 
 /**
@@ -197,26 +267,26 @@ bool loadConfig(const string& configPath, int& receptors) {
  */
 void initDefaultConfig(int receptors) {
     Classes = 4;
-    const_words.clear();
+    g_dataset.clear(receptors);
     classes.clear();
 
     // Генерируем пустой класс
     string empty(receptors, ' ');
-    const_words.push_back({empty, 0});
+    g_dataset.add(empty, 0);
     classes.push_back(empty);
 
     // Генерируем сдвинутые образы для каждого слова
-    generateShiftedImages("time", 1, receptors);
+    g_dataset.addShifted("time", 1);
     classes.push_back("time");
-    generateShiftedImages("hour", 2, receptors);
+    g_dataset.addShifted("hour", 2);
     classes.push_back("hour");
-    generateShiftedImages("main", 3, receptors);
+    g_dataset.addShifted("main", 3);
     classes.push_back("main");
 
     cout << "Using default configuration" << endl;
     cout << "  Receptors: " << receptors << endl;
     cout << "  Classes: " << classes.size() << endl;
-    cout << "  Images: " << const_words.size() << endl;
+    cout << "  Images: " << g_dataset.size() << endl;
 }
 
 // ============================================================================
@@ -224,7 +294,24 @@ void initDefaultConfig(int receptors) {
 // ============================================================================
 
 /**
- * Сохранение обученной нейронной сети в JSON файл
+ * Описание текущей сети (nei, NetOutput, NetInput) для компиляции плана
+ */
+NetworkDescription describeNetwork() {
+    NetworkDescription network;
+    network.receptors = Receptors;
+    network.inputs = Inputs;
+    network.basis.assign(NetInput.begin() + Receptors, NetInput.begin() + Inputs);
+    network.classNames = classes;
+    network.outputs = NetOutput;
+    network.neurons.reserve(std::max(0, Neirons - Inputs));
+    for (int n = Inputs; n < Neirons; n++) {
+        network.neurons.push_back({ nei[n].i, nei[n].j, getOpIndex(nei[n].op) });
+    }
+    return network;
+}
+
+/**
+ * Запись описания сети в JSON файл
  *
  * Сохраняемая информация:
  * - Параметры сети (receptors, inputs, neurons_count)
@@ -232,169 +319,242 @@ void initDefaultConfig(int receptors) {
  * - Классы и их выходные нейроны
  * - Структура нейронов (входы i, j и операция op)
  *
- * @param filePath - путь для сохранения JSON файла
- * @return true при успешном сохранении, false при ошибке
+ * Файл пишется потоково, нейрон за нейроном (ModelFileWriter), без
+ * дерева json; текст совпадает с json::dump(2): ключи по алфавиту,
+ * отступ 2 пробела. Числа с плавающей точкой и строки форматирует json.
+ *
+ * @param error - выход: описание ошибки
+ * @return true при успешной записи
  */
-bool saveNetwork(const string& filePath) {
-    try {
-        json network;
-
-        // Сохраняем конфигурацию
-        network["receptors"] = Receptors;
-        network["base_size"] = base_size;
-        network["inputs"] = Inputs;
-        network["neurons_count"] = Neirons;
-
-        // Сохраняем базисные значения
-        json basisArray = json::array();
-        for (int i = 0; i < base_size; i++) {
-            basisArray.push_back(base[i]);
-        }
-        network["basis"] = basisArray;
-
-        // Сохраняем имена классов
-        json classesArray = json::array();
-        for (int c = 0; c < Classes; c++) {
-            json cls;
-            cls["id"] = c;
-            cls["name"] = classes[c];
-            cls["output_neuron"] = NetOutput[c];
-            classesArray.push_back(cls);
-        }
-        network["classes"] = classesArray;
-
-        // Сохраняем нейроны (только созданные, т.к. 0..Inputs-1 это входы)
-        // ID нейронов неявные - это Inputs + индекс_в_массиве
-        json neuronsArray = json::array();
-        for (int n = Inputs; n < Neirons; n++) {
-            json neuron;
-            neuron["i"] = nei[n].i;
-            neuron["j"] = nei[n].j;
-            neuron["op"] = getOpIndex(nei[n].op);
-            neuronsArray.push_back(neuron);
-        }
-        network["neurons"] = neuronsArray;
-
-        // Добавляем метаданные
-        network["version"] = "1.0";
-        network["description"] = "Trained neural network model";
-
-        // Записываем в файл с форматированием
-        ofstream outFile(filePath);
-        if (!outFile.is_open()) {
-            cerr << "Error: Cannot open output file: " << filePath << endl;
-            return false;
-        }
-        outFile << network.dump(2);
-        outFile.close();
-
-        cout << "Network saved to: " << filePath << endl;
-        cout << "  Classes: " << Classes << endl;
-        cout << "  Neurons: " << (Neirons - Inputs) << endl;
-        cout << "  Total nodes: " << Neirons << endl;
+bool writeNetworkJson(const string& filePath, const NetworkDescription& description, string& error) {
+    ModelFileWriter out(filePath);
+    if (!out.isOpen()) {
+        error = "Cannot open output file: " + filePath;
+        return false;
+    }
 
-        return true;
+    // Сохраняем конфигурацию и базисные значения
+    out.write("{\n  \"base_size\": ");
+    out.writeInt((long long)description.basis.size());
+    out.write(",\n  \"basis\": [");
+    for (size_t k = 0; k < description.basis.size(); k++) {
+        out.write(k == 0 ? "\n    " : ",\n    ");
+        out.write(json(description.basis[k]).dump());
     }
-    catch (const exception& e) {
-        cerr << "Error saving network: " << e.what() << endl;
+    out.write(description.basis.empty() ? "]" : "\n  ]");
+
+    // Сохраняем имена классов
+    out.write(",\n  \"classes\": [");
+    for (size_t c = 0; c < description.outputs.size(); c++) {
+        out.write(c == 0 ? "\n    {\n      \"id\": " : ",\n    {\n      \"id\": ");
+        out.writeInt((long long)c);
+        out.write(",\n      \"name\": ");
+        out.write(json(description.classNames[c]).dump());
+        out.write(",\n      \"output_neuron\": ");
+        out.writeInt(description.outputs[c]);
+        out.write("\n    }");
+    }
+    out.write(description.outputs.empty() ? "]" : "\n  ]");
+
+    out.write(",\n  \"description\": \"Trained neural network model\",\n  \"inputs\": ");
+    out.writeInt(description.inputs);
+
+    // Сохраняем нейроны (только созданные, т.к. 0..Inputs-1 это входы)
+    // ID нейронов неявные - это Inputs + индекс_в_массиве
+    out.write(",\n  \"neurons\": [");
+    for (size_t k = 0; k < description.neuronCount(); k++) {
+        const NetworkDescription::Neuron& n = description.neuron(k);
+        out.write(k == 0 ? "\n    {\n      \"i\": " : ",\n    {\n      \"i\": ");
+        out.writeInt(n.i);
+        out.write(",\n      \"j\": ");
+        out.writeInt(n.j);
+        out.write(",\n      \"op\": ");
+        out.writeInt(n.op);
+        out.write("\n    }");
+    }
+    out.write(description.neuronCount() == 0 ? "]" : "\n  ]");
+
+    out.write(",\n  \"neurons_count\": ");
+    out.writeInt(description.nodeCount());
+    out.write(",\n  \"receptors\": ");
+    out.writeInt(description.receptors);
+    out.write(",\n  \"version\": \"1.0\"\n}");
+    return out.commit(error);
+}
+
+/**
+ * Сохранение обученной нейронной сети в файл модели
+ *
+ * @param filePath - путь для сохранения
+ * @param format - формат файла: JSON или двоичный (model_file.h)
+ * @return true при успешном сохранении, false при ошибке
+ */
+bool saveNetwork(const string& filePath, ModelFormat format = MODEL_JSON) {
+    const NetworkDescription network = describeNetwork();
+    string error;
+    bool saved = (format == MODEL_BINARY) ? writeModelFile(filePath, network, error)
+                                          : writeNetworkJson(filePath, network, error);
+    if (!saved) {
+        cerr << "Error: " << error << endl;
         return false;
     }
+
+    cout << "Network saved to: " << filePath << (format == MODEL_BINARY ? " (binary)" : "") << endl;
+    cout << "  Classes: " << Classes << endl;
+    cout << "  Neurons: " << (Neirons - Inputs) << endl;
+    cout << "  Total nodes: " << Neirons << endl;
+    return true;
 }
 
 /**
- * Загрузка обученной нейронной сети из JSON файла
+ * Чтение модели из файла без изменения глобального состояния
  *
- * Используется в режиме инференса для загрузки ранее обученной сети.
- * После загрузки сеть готова к классификации входных данных.
+ * Формат определяется по сигнатуре: двоичная модель (model_file.h)
+ * отображается в память без разбора, иначе файл читается как JSON.
  *
- * @param filePath - путь к JSON файлу с моделью
- * @return true при успешной загрузке, false при ошибке
+ * @param filePath - путь к файлу модели
+ * @param network - выход: структура сети
+ * @param error - выход: описание ошибки
+ * @return true при успешном чтении
  */
-bool loadNetwork(const string& filePath) {
+bool parseNetworkFile(const string& filePath, NetworkDescription& network, string& error) {
+    if (isModelFile(filePath)) {
+        return readModelFile(filePath, FUSED_OP_COUNT, network, error);
+    }
+
     ifstream inFile(filePath);
     if (!inFile.is_open()) {
-        cerr << "Error: Cannot open network file: " << filePath << endl;
+        error = "Cannot open network file: " + filePath;
         return false;
     }
 
     try {
-        json network;
-        inFile >> network;
-
-        // Загружаем конфигурацию
-        Receptors = network["receptors"].get<int>();
-        Inputs = network["inputs"].get<int>();
-        Neirons = network["neurons_count"].get<int>();
+        json model;
+        inFile >> model;
+
+        network.receptors = model["receptors"].get<int>();
+        network.inputs = model["inputs"].get<int>();
+        int nodes = model["neurons_count"].get<int>();
+        if (network.receptors <= 0 || network.inputs < network.receptors || nodes < network.inputs) {
+            error = "Invalid network dimensions in " + filePath;
+            return false;
+        }
 
         // Проверяем совпадение размера базиса
-        int loadedBaseSize = network["base_size"].get<int>();
+        int loadedBaseSize = model["base_size"].get<int>();
         if (loadedBaseSize != base_size) {
             cerr << "Warning: Basis size mismatch (file: " << loadedBaseSize
                  << ", expected: " << base_size << ")" << endl;
         }
 
-        // Выделяем массив входов сети
-        NetInput.resize(Inputs);
-
-        // Устанавливаем базисные значения
-        for (int i = 0; i < base_size; i++) {
-            NetInput[i + Receptors] = base[i];
+        // Базисные значения
+        network.basis.assign(network.inputs - network.receptors, 0.0f);
+        for (int i = 0; i < base_size && i < (int)network.basis.size(); i++) {
+            network.basis[i] = base[i];
         }
 
-        // Загружаем классы
-        const auto& classesArray = network["classes"];
-        Classes = classesArray.size();
-        classes.clear();
-        classes.resize(Classes);
-        NetOutput.resize(Classes);
-
+        // Классы
+        const auto& classesArray = model["classes"];
+        const int classCount = (int)classesArray.size();
+        network.classNames.assign(classCount, string());
+        network.outputs.assign(classCount, -1);
         for (const auto& cls : classesArray) {
             int id = cls["id"].get<int>();
-            classes[id] = cls["name"].get<string>();
-            NetOutput[id] = cls["output_neuron"].get<int>();
-        }
-
-        // Инициализируем нейроны (без кэша образов, т.к. данные обучения не нужны)
-        nei.resize(MAX_NEURONS);
-        for (int n = 0; n < MAX_NEURONS; n++) {
-            nei[n].cached = false;
-            nei[n].val_cached = false;
+            if (id < 0 || id >= classCount) {
+                error = "Class id " + to_string(id) + " is out of range in " + filePath;
+                return false;
+            }
+            network.classNames[id] = cls["name"].get<string>();
+            network.outputs[id] = cls["output_neuron"].get<int>();
         }
 
-        // Загружаем структуру нейронов
+        // Структура нейронов
         // ID нейронов неявные - это Inputs + индекс_в_массиве
-        const auto& neuronsArray = network["neurons"];
-        int neuronIndex = Inputs;  // Начинаем с Inputs, т.к. 0..Inputs-1 это входы
-        for (const auto& neuron : neuronsArray) {
-            nei[neuronIndex].i = neuron["i"].get<int>();
-            nei[neuronIndex].j = neuron["j"].get<int>();
-            int opIndex = neuron["op"].get<int>();
-            if (opIndex >= 0 && opIndex < op_count) {
-                nei[neuronIndex].op = op[opIndex];
-            } else {
-                nei[neuronIndex].op = op[0];  // По умолчанию первая операция
-            }
-            neuronIndex++;
+        const auto& neuronsArray = model["neurons"];
+        if ((int)neuronsArray.size() != nodes - network.inputs) {
+            error = "Neuron count mismatch in " + filePath;
+            return false;
         }
-
-        cout << "Network loaded from: " << filePath << endl;
-        cout << "  Receptors: " << Receptors << endl;
-        cout << "  Classes: " << Classes << endl;
-        for (int c = 0; c < Classes; c++) {
-            cout << "    " << c << ": " << classes[c] << endl;
+        network.neurons.clear();
+        network.neurons.reserve(neuronsArray.size());
+        for (const auto& neuron : neuronsArray) {
+            NetworkDescription::Neuron n;
+            n.i = neuron["i"].get<int>();
+            n.j = neuron["j"].get<int>();
+            n.op = neuron["op"].get<int>();
+            if (n.op < 0 || n.op >= FUSED_OP_COUNT) n.op = 0;  // По умолчанию первая операция
+            network.neurons.push_back(n);
         }
-        cout << "  Neurons: " << (Neirons - Inputs) << endl;
-
         return true;
     }
     catch (const json::exception& e) {
-        cerr << "JSON parsing error: " << e.what() << endl;
+        error = string("JSON parsing error: ") + e.what();
         return false;
     }
     catch (const exception& e) {
-        cerr << "Error loading network: " << e.what() << endl;
+        error = string("Error loading network: ") + e.what();
+        return false;
+    }
+}
+
+/**
+ * Загрузка обученной нейронной сети из файла модели (JSON или двоичного)
+ *
+ * Используется в режиме инференса для загрузки ранее обученной сети.
+ * После загрузки сеть готова к классификации входных данных.
+ *
+ * @param filePath - путь к файлу модели
+ * @return true при успешной загрузке, false при ошибке
+ */
+bool loadNetwork(const string& filePath) {
+    NetworkDescription network;
+    string error;
+    if (!parseNetworkFile(filePath, network, error)) {
+        cerr << "Error: " << error << endl;
         return false;
     }
+    if (network.nodeCount() > MAX_NEURONS) {
+        cerr << "Error: Network has " << network.nodeCount() << " nodes (maximum " << MAX_NEURONS << ")" << endl;
+        return false;
+    }
+
+    // Загружаем конфигурацию
+    Receptors = network.receptors;
+    Inputs = network.inputs;
+    Neirons = network.nodeCount();
+
+    // Входы сети: базисные значения после рецепторов
+    NetInput.assign(Inputs, 0.0f);
+    std::copy(network.basis.begin(), network.basis.end(), NetInput.begin() + Receptors);
+
+    // Классы
+    Classes = (int)network.classNames.size();
+    classes = network.classNames;
+    NetOutput = network.outputs;
+
+    // Инициализируем нейроны (без кэша образов, т.к. данные обучения не нужны)
+    nei.resize(MAX_NEURONS);
+    for (int n = 0; n < MAX_NEURONS; n++) {
+        nei[n].cached = false;
+    }
+
+    // Загружаем структуру нейронов
+    for (size_t k = 0; k < network.neuronCount(); k++) {
+        Neiron& neuron = nei[Inputs + k];
+        neuron.i = network.neuron(k).i;
+        neuron.j = network.neuron(k).j;
+        neuron.op = op_all[network.neuron(k).op];
+    }
+
+    cout << "Network loaded from: " << filePath << (network.mapping ? " (binary)" : "") << endl;
+    cout << "  Receptors: " << Receptors << endl;
+    cout << "  Classes: " << Classes << endl;
+    for (int c = 0; c < Classes; c++) {
+        cout << "    " << c << ": " << classes[c] << endl;
+    }
+    cout << "  Neurons: " << (Neirons - Inputs) << endl;
+
+    return true;
 }
 
 /**
@@ -409,6 +569,18 @@ bool loadNetwork(const string& filePath) {
  * @return true при успешной загрузке, false при ошибке
  */
 bool loadNetworkForRetraining(const string& filePath, vector<int>& trainedClasses) {
+    // Двоичная модель хранит выходной нейрон каждого класса: все классы обучены
+    if (isModelFile(filePath)) {
+        if (!loadNetwork(filePath)) {
+            return false;
+        }
+        trainedClasses.clear();
+        for (int c = 0; c < Classes; c++) {
+            trainedClasses.push_back(c);
+        }
+        return true;
+    }
+
     ifstream inFile(filePath);
     if (!inFile.is_open()) {
         cerr << "Error: Cannot open network file: " << filePath << endl;
@@ -464,7 +636,6 @@ bool loadNetworkForRetraining(const string& filePath, vector<int>& trainedClasse
         nei.resize(MAX_NEURONS);
         for (int n = 0; n < MAX_NEURONS; n++) {
             nei[n].cached = false;
-            nei[n].val_cached = false;
         }
 
         // Загружаем структуру нейронов
@@ -474,10 +645,10 @@ bool loadNetworkForRetraining(const string& filePath, vector<int>& trainedClasse
             nei[neuronIndex].i = neuron["i"].get<int>();
             nei[neuronIndex].j = neuron["j"].get<int>();
             int opIndex = neuron["op"].get<int>();
-            if (opIndex >= 0 && opIndex < op_count) {
-                nei[neuronIndex].op = op[opIndex];
+            if (opIndex >= 0 && opIndex < FUSED_OP_COUNT) {
+                nei[neuronIndex].op = op_all[opIndex];
             } else {
-                nei[neuronIndex].op = op[0];
+                nei[neuronIndex].op = op_all[0];
             }
             neuronIndex++;
         }
@@ -515,113 +686,79 @@ bool loadNetworkForRetraining(const string& filePath, vector<int>& trainedClasse
  * @return true при успешном объединении, false при ошибке
  */
 bool mergeConfigForRetraining(const string& configPath, const vector<int>& trainedClasses, vector<int>& newClassIds) {
-    ifstream configFile(configPath);
-    if (!configFile.is_open()) {
-        cerr << "Error: Cannot open config file: " << configPath << endl;
-        return false;
-    }
-
-    try {
-        json config;
-        configFile >> config;
-
-        // Проверяем совместимость receptors
-        int configReceptors = Receptors;
-        if (config.contains("receptors")) {
-            configReceptors = config["receptors"].get<int>();
+    newClassIds.clear();
+    g_dataset.clear(Receptors);
+
+    auto isTrained = [&trainedClasses](int id) {
+        return std::find(trainedClasses.begin(), trainedClasses.end(), id) != trainedClasses.end();
+    };
+
+    // Образы добавляются по мере разбора (как в loadConfig)
+    const vector<string> modelClasses = classes;
+    const int modelClassCount = Classes;
+    ConfigSink sink;
+    sink.entry = [&](bool image, const string& word, int id) {
+        g_dataset.append(word, id);
+
+        // Расширяем массив классов если нужно
+        if (id >= Classes) {
+            classes.resize(id + 1);
+            NetOutput.resize(id + 1, -1);
+            Classes = id + 1;
         }
-        if (configReceptors != Receptors) {
-            cerr << "Error: Config receptors (" << configReceptors << ") don't match model (" << Receptors << ")" << endl;
-            return false;
-        }
-
-        newClassIds.clear();
-
-        // Загружаем образы из конфигурации
-        if (config.contains("images")) {
-            // Режим прямых образов
-            int maxClassId = Classes - 1;
-            for (const auto& img : config["images"]) {
-                string word = img["word"].get<string>();
-                int id = img["id"].get<int>();
-                const_words.push_back({word, id});
-                if (id > maxClassId) {
-                    maxClassId = id;
-                }
-            }
-
-            // Расширяем классы если нужно
-            if (maxClassId >= Classes) {
-                classes.resize(maxClassId + 1);
-                NetOutput.resize(maxClassId + 1, -1);
-                Classes = maxClassId + 1;
+        if (!image) {
+            // Сохраняем имя класса
+            if (classes[id].empty()) {
+                classes[id] = word;
             }
 
-            // Определяем какие классы нужно обучить
-            for (int c = 0; c < Classes; c++) {
-                bool isTrained = (std::find(trainedClasses.begin(), trainedClasses.end(), c) != trainedClasses.end());
-                if (!isTrained) {
-                    newClassIds.push_back(c);
-                }
+            // Добавляем в список для обучения если не обучен
+            if (!isTrained(id) && std::find(newClassIds.begin(), newClassIds.end(), id) == newClassIds.end()) {
+                newClassIds.push_back(id);
             }
         }
-        else if (config.contains("classes")) {
-            bool generateShifts = true;
-            if (config.contains("generate_shifts")) {
-                generateShifts = config["generate_shifts"].get<bool>();
-            }
-
-            for (const auto& cls : config["classes"]) {
-                string word = cls["word"].get<string>();
-                int id = cls["id"].get<int>();
-
-                // Проверяем, есть ли это новый класс
-                bool isTrained = (std::find(trainedClasses.begin(), trainedClasses.end(), id) != trainedClasses.end());
-
-                // Расширяем массив классов если нужно
-                if (id >= Classes) {
-                    classes.resize(id + 1);
-                    NetOutput.resize(id + 1, -1);
-                    Classes = id + 1;
-                }
+    };
+    sink.reset = [&]() {
+        g_dataset.clear(Receptors);
+        classes = modelClasses;
+        Classes = modelClassCount;
+        NetOutput.resize(Classes);
+        newClassIds.clear();
+    };
 
-                // Сохраняем имя класса
-                if (classes[id].empty()) {
-                    classes[id] = word;
-                }
+    ConfigContents config;
+    string error;
+    if (!readConfig(configPath, config, sink, error)) {
+        cerr << "Error: " << error << endl;
+        return false;
+    }
 
-                // Генерируем образы для класса
-                if (generateShifts && word.length() > 0) {
-                    generateShiftedImages(word, id, Receptors);
-                } else {
-                    string padded = word;
-                    while ((int)padded.length() < Receptors) {
-                        padded += ' ';
-                    }
-                    const_words.push_back({padded.substr(0, Receptors), id});
-                }
+    // Проверяем совместимость receptors
+    int configReceptors = config.hasReceptors ? config.receptors : Receptors;
+    if (configReceptors != Receptors) {
+        cerr << "Error: Config receptors (" << configReceptors << ") don't match model (" << Receptors << ")" << endl;
+        return false;
+    }
+    g_dataset.finishAppend(Receptors, !config.hasImages && config.generateShifts);
 
-                // Добавляем в список для обучения если не обучен
-                if (!isTrained && std::find(newClassIds.begin(), newClassIds.end(), id) == newClassIds.end()) {
-                    newClassIds.push_back(id);
-                }
+    // Для прямых образов обучаются все классы, которых нет в модели
+    if (config.hasImages) {
+        for (int c = 0; c < Classes; c++) {
+            if (!isTrained(c)) {
+                newClassIds.push_back(c);
             }
         }
-
-        cout << "Config merged for retraining: " << configPath << endl;
-        cout << "  Total classes: " << Classes << endl;
-        cout << "  New classes to train: " << newClassIds.size() << endl;
-        for (int c : newClassIds) {
-            cout << "    " << c << ": " << classes[c] << endl;
-        }
-        cout << "  Total images: " << const_words.size() << endl;
-
-        return true;
     }
-    catch (const json::exception& e) {
-        cerr << "JSON parsing error: " << e.what() << endl;
-        return false;
+
+    cout << "Config merged for retraining: " << configPath << endl;
+    cout << "  Total classes: " << Classes << endl;
+    cout << "  New classes to train: " << newClassIds.size() << endl;
+    for (int c : newClassIds) {
+        cout << "    " << c << ": " << classes[c] << endl;
     }
+    cout << "  Total images: " << g_dataset.size() << endl;
+
+    return true;
 }
 
 #endif // JSON_IO_H
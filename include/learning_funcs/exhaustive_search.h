@@ -8,12 +8,38 @@
  *
  * Эти функции гарантируют нахождение оптимального решения в пределах
  * заданного пространства поиска, но работают медленнее случайных методов.
+ *
+ * Для операций op_1..op_4 пары оцениваются за O(1) по матрицам скалярных
+ * произведений (gram_scoring.h); прямой перебор по всем образам остаётся
+ * для остальных операций, --no-gram и превышения бюджета памяти матриц.
  */
 
 #ifndef EXHAUSTIVE_SEARCH_H
 #define EXHAUSTIVE_SEARCH_H
 
 #include "learning_func_base.h"
+#include "gram_scoring.h"
+
+/**
+ * Добавление найденного нейрона в сеть
+ *
+ * @param result - лучший кандидат
+ * @param suffix - пометка в выводе (" [parallel]" для параллельных версий)
+ * @return ошибка нейрона (big, если кандидат не найден - нейрон не создаётся)
+ */
+float commitExhaustiveResult(const ExhaustiveSearchResult& result, const char* suffix) {
+    if (!result.found) return big;
+
+    Neiron& cur = nei[Neirons];
+    cur.cached = false;
+    cur.i = result.optimal_i;
+    cur.j = result.optimal_j;
+    cur.op = op[result.optimal_op_index];
+    std::cout << "min = " << result.min_error << ", (" << Neirons << ") = ("
+              << cur.i << ")op(" << cur.j << ")" << suffix << "\n";
+    Neirons++;
+    return result.min_error;
+}
 
 // ============================================================================
 // Последовательные версии функций
@@ -32,32 +58,36 @@
  * @return минимальная достигнутая ошибка
  */
 float exhaustive_full_search() {
+    ExhaustiveSearchResult gram;
+    if (gramSearchPairs(1, Neirons, 0, -1, 1, gram)) return commitExhaustiveResult(gram, "");
+
     int     i;
     float   min = big;
     int     optimal_i = 0;
     int     optimal_j = 0;
     oper    optimal_op = op[0];
-    float   square, sum;
+    float   sum;
     Neiron& cur = nei[Neirons];
-    float*  curval;
+    AlignedFloatVector curval(Images);
+    NeuronScratch scratch;
 
     for (cur.i = 1; cur.i < Neirons; cur.i++)               // Выбор 1-го нейрона
     {
+        scratch.release(0);
+        ActivationRef icache = GetNeironVectorShared(cur.i, scratch);
+        size_t imark = scratch.mark();
+
         for (cur.j = 0; cur.j < cur.i; cur.j++)             // Выбор 2-го нейрона
         {
+            scratch.release(imark);
+            ActivationRef jcache = GetNeironVectorShared(cur.j, scratch);
+
             for (i = 0; i < op_count; i++)                  // Выбор операции
             {
-                cur.cached = false;
                 cur.op = op[i];
-                sum = 0.0;
-                curval = GetNeironVector(Neirons);
 
-                // Вычисляем сумму квадратов ошибок
-                for (int index = 0; index < Images && sum < min; index++)
-                {
-                    square = vz[index] - curval[index];
-                    sum += square * square;
-                }
+                // Сумма квадратов ошибок (без записи вектора кандидата)
+                sum = candidateError(cur.op, icache, jcache, min, curval.data());
 
                 if (min > sum)
                 {
@@ -93,31 +123,32 @@ float exhaustive_full_search() {
  * @return минимальная достигнутая ошибка
  */
 float exhaustive_last_combine() {
+    ExhaustiveSearchResult gram;
+    if (gramSearchPairs(Neirons - 1, Neirons, 0, -1, 1, gram)) return commitExhaustiveResult(gram, "");
+
     int     i;
     float   min = big;
     int     optimal_i = 0;
     int     optimal_j = 0;
     oper    optimal_op = op[0];
-    float   square, sum;
+    float   sum;
     Neiron& cur = nei[Neirons];
-    float*  curval;
+    AlignedFloatVector curval(Images);
+    NeuronScratch scratch;
 
     cur.i = Neirons - 1;                                    // Фиксируем последний нейрон
+    ActivationRef icache = GetNeironVectorShared(cur.i, scratch);
+    size_t imark = scratch.mark();
 
     for (cur.j = 0; cur.j < cur.i; cur.j++)                 // Выбор 2-го нейрона
     {
+        scratch.release(imark);
+        ActivationRef jcache = GetNeironVectorShared(cur.j, scratch);
+
         for (i = 0; i < op_count; i++)                      // Выбор операции
         {
             cur.op = op[i];
-            sum = 0.0;
-            cur.cached = false;
-            curval = GetNeironVector(Neirons);
-
-            for (int index = 0; index < Images && sum < min; index++)
-            {
-                square = vz[index] - curval[index];
-                sum += square * square;
-            }
+            sum = candidateError(cur.op, icache, jcache, min, curval.data());
 
             if (min > sum)
             {
@@ -150,31 +181,36 @@ float exhaustive_last_combine() {
  * @return минимальная достигнутая ошибка
  */
 float combine_old_new() {
+    ExhaustiveSearchResult gram;
+    if (gramSearchPairs(0, Neirons - Classes * 3, Neirons - Classes * 3, Neirons, 1, gram)) {
+        return commitExhaustiveResult(gram, "");
+    }
+
     int     i;
     float   min = big;
     int     optimal_i = 0;
     int     optimal_j = 0;
     oper    optimal_op = op[0];
-    float   square, sum;
+    float   sum;
     Neiron& cur = nei[Neirons];
-    float*  curval;
+    AlignedFloatVector curval(Images);
+    NeuronScratch scratch;
 
     for (cur.i = 0; cur.i < Neirons - Classes * 3; cur.i++)         // Старые нейроны
     {
+        scratch.release(0);
+        ActivationRef icache = GetNeironVectorShared(cur.i, scratch);
+        size_t imark = scratch.mark();
+
         for (cur.j = Neirons - Classes * 3; cur.j < Neirons; cur.j++) // Новые нейроны
         {
+            scratch.release(imark);
+            ActivationRef jcache = GetNeironVectorShared(cur.j, scratch);
+
             for (i = 0; i < op_count; i++)
             {
-                cur.cached = false;
                 cur.op = op[i];
-                sum = 0.0;
-                curval = GetNeironVector(Neirons);
-
-                for (int index = 0; index < Images && sum < min; index++)
-                {
-                    square = vz[index] - curval[index];
-                    sum += square * square;
-                }
+                sum = candidateError(cur.op, icache, jcache, min, curval.data());
 
                 if (min > sum)
                 {
@@ -200,19 +236,6 @@ float combine_old_new() {
 // Многопоточные версии функций
 // ============================================================================
 
-/**
- * Структура результата поиска для потока (exhaustive search)
- */
-struct ExhaustiveSearchResult {
-    float min_error;
-    int optimal_i;
-    int optimal_j;
-    int optimal_op_index;
-    bool found;
-
-    ExhaustiveSearchResult() : min_error(big), optimal_i(0), optimal_j(0), optimal_op_index(0), found(false) {}
-};
-
 /**
  * Функция потока для параллельного полного перебора
  */
@@ -224,29 +247,26 @@ void ExhaustiveSearchThreadFunc(
     std::atomic<float>* global_min)
 {
     Neiron local_cur;
-    std::vector<float> local_cache(Images);
+    AlignedFloatVector local_cache(Images);
+    NeuronScratch scratch;
 
     for (local_cur.i = start_i; local_cur.i < end_i; local_cur.i++)
     {
-        float* i_cache = GetNeironVector(local_cur.i);
+        scratch.release(0);
+        ActivationRef i_cache = GetNeironVectorShared(local_cur.i, scratch);
+        size_t i_mark = scratch.mark();
 
         for (local_cur.j = 0; local_cur.j < local_cur.i; local_cur.j++)
         {
-            float* j_cache = GetNeironVector(local_cur.j);
+            scratch.release(i_mark);
+            ActivationRef j_cache = GetNeironVectorShared(local_cur.j, scratch);
+            g_activationCache.prefetch(local_cur.j + 1);  // Строки идут с постоянным шагом
 
             for (int op_idx = 0; op_idx < op_count; op_idx++)
             {
                 local_cur.op = op[op_idx];
-                (*local_cur.op)(local_cache.data(), i_cache, j_cache, Images);
-
                 float current_global_min = global_min->load(std::memory_order_relaxed);
-                float sum = 0.0f;
-
-                for (int index = 0; index < Images && sum < current_global_min; index++)
-                {
-                    float square = vz[index] - local_cache[index];
-                    sum += square * square;
-                }
+                float sum = candidateError(local_cur.op, i_cache, j_cache, current_global_min, local_cache.data());
 
                 if (result.min_error > sum)
                 {
@@ -282,10 +302,8 @@ float exhaustive_full_search_parallel() {
         return exhaustive_full_search();
     }
 
-    // Прогреваем кэши всех существующих нейронов
-    for (int n = 0; n < Neirons; n++) {
-        GetNeironVector(n);
-    }
+    ExhaustiveSearchResult gram;
+    if (gramSearchPairs(1, Neirons, 0, -1, NumThreads, gram)) return commitExhaustiveResult(gram, " [parallel]");
 
     std::vector<ExhaustiveSearchResult> results(NumThreads);
     std::atomic<float> global_min(big);
@@ -347,13 +365,13 @@ float exhaustive_last_combine_parallel() {
         return exhaustive_last_combine();
     }
 
-    // Прогреваем кэши
-    for (int n = 0; n < Neirons; n++) {
-        GetNeironVector(n);
+    ExhaustiveSearchResult gram;
+    if (gramSearchPairs(Neirons - 1, Neirons, 0, -1, NumThreads, gram)) {
+        return commitExhaustiveResult(gram, " [parallel]");
     }
 
     int last_neuron = Neirons - 1;
-    float* last_cache = GetNeironVector(last_neuron);
+    ActivationRef last_cache = GetNeironVector(last_neuron);
 
     std::vector<ExhaustiveSearchResult> results(NumThreads);
     std::atomic<float> global_min(big);
@@ -362,21 +380,17 @@ float exhaustive_last_combine_parallel() {
 
     // Лямбда для потока
     auto thread_func = [&](int start_j, int end_j, int thread_id) {
-        std::vector<float> local_cache(Images);
+        AlignedFloatVector local_cache(Images);
+        NeuronScratch scratch;
 
         for (int j = start_j; j < end_j; j++) {
-            float* j_cache = GetNeironVector(j);
+            scratch.release(0);
+            ActivationRef j_cache = GetNeironVectorShared(j, scratch);
+            g_activationCache.prefetch(j + 1);
 
             for (int op_idx = 0; op_idx < op_count; op_idx++) {
-                (*op[op_idx])(local_cache.data(), last_cache, j_cache, Images);
-
                 float current_global_min = global_min.load(std::memory_order_relaxed);
-                float sum = 0.0f;
-
-                for (int index = 0; index < Images && sum < current_global_min; index++) {
-                    float square = vz[index] - local_cache[index];
-                    sum += square * square;
-                }
+                float sum = candidateError(op[op_idx], last_cache, j_cache, current_global_min, local_cache.data());
 
                 if (results[thread_id].min_error > sum) {
                     results[thread_id].found = true;
@@ -453,9 +467,9 @@ float combine_old_new_parallel() {
         return combine_old_new();
     }
 
-    // Прогреваем кэши
-    for (int n = 0; n < Neirons; n++) {
-        GetNeironVector(n);
+    ExhaustiveSearchResult gram;
+    if (gramSearchPairs(0, boundary, boundary, Neirons, NumThreads, gram)) {
+        return commitExhaustiveResult(gram, " [parallel]");
     }
 
     std::vector<ExhaustiveSearchResult> results(NumThreads);
@@ -464,24 +478,22 @@ float combine_old_new_parallel() {
     threads.reserve(NumThreads);
 
     auto thread_func = [&](int start_i, int end_i, int thread_id) {
-        std::vector<float> local_cache(Images);
+        AlignedFloatVector local_cache(Images);
+        NeuronScratch scratch;
 
         for (int i = start_i; i < end_i; i++) {
-            float* i_cache = GetNeironVector(i);
+            scratch.release(0);
+            ActivationRef i_cache = GetNeironVectorShared(i, scratch);
+            size_t i_mark = scratch.mark();
 
             for (int j = boundary; j < Neirons; j++) {
-                float* j_cache = GetNeironVector(j);
+                scratch.release(i_mark);
+                ActivationRef j_cache = GetNeironVectorShared(j, scratch);
+                g_activationCache.prefetch(j + 1);
 
                 for (int op_idx = 0; op_idx < op_count; op_idx++) {
-                    (*op[op_idx])(local_cache.data(), i_cache, j_cache, Images);
-
                     float current_global_min = global_min.load(std::memory_order_relaxed);
-                    float sum = 0.0f;
-
-                    for (int index = 0; index < Images && sum < current_global_min; index++) {
-                        float square = vz[index] - local_cache[index];
-                        sum += square * square;
-                    }
+                    float sum = candidateError(op[op_idx], i_cache, j_cache, current_global_min, local_cache.data());
 
                     if (results[thread_id].min_error > sum) {
                         results[thread_id].found = true;
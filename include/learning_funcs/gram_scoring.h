@@ -0,0 +1,465 @@
+/*
+ * gram_scoring.h - Оценка пар нейронов по матрицам скалярных произведений
+ *
+ * Этот модуль содержит:
+ * - Класс GramScorer - матрицы скалярных произведений векторов нейронов
+ * - Функцию gramSearchPairs() - полный перебор пар с оценкой за O(1)
+ *
+ * Для операций op_1..op_4 квадратичная ошибка кандидата (i, j) по
+ * ожидаемым выходам t выражается через скалярные произведения векторов
+ * a = значения нейрона i и b = значения нейрона j по всем образам:
+ *
+ *   a + b:  t·t - 2 t·a - 2 t·b + a·a + b·b + 2 a·b
+ *   a - b:  t·t - 2 t·a + 2 t·b + a·a + b·b - 2 a·b
+ *   b - a:  t·t + 2 t·a - 2 t·b + a·a + b·b - 2 a·b
+ *   a * b:  t·t - 2 (t∘a)·b + (a∘a)·(b∘b)
+ *
+ * С весами образов (imageWeights) все произведения взвешены: a·b =
+ * sum(w a b) и т.д., что даёт взвешенную ошибку sum(w (t - op(a, b))^2).
+ *
+ * Произведения a·b и (a∘a)·(b∘b) не зависят от t и хранятся в нижнем
+ * треугольнике: строка r содержит пары (r, c) для c < r. Строки вычисляются
+ * лениво и только один раз - при появлении нейрона r. Произведения (t∘a)·b
+ * зависят от ожидаемых выходов, которые меняются при переходе к другому
+ * классу, поэтому для каждого встреченного вектора t хранится своя таблица
+ * (вытесняется по давности использования при нехватке бюджета).
+ *
+ * Оценка отличается от прямого вычисления во float на погрешность
+ * округления (сумма по образам во float и сокращение больших слагаемых
+ * в double). Поэтому оценка по матрицам только отбирает кандидатов, чей
+ * интервал погрешности пересекается с лучшим, а их ошибка считается
+ * напрямую, как в исходном переборе: выбранный нейрон (и при равенстве
+ * ошибок - первый в порядке перебора) и выведенная ошибка совпадают с ним.
+ *
+ * Примечание: Этот файл включается из exhaustive_search.h.
+ */
+
+#ifndef GRAM_SCORING_H
+#define GRAM_SCORING_H
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "learning_func_base.h"
+
+// ============================================================================
+// Параметры
+// ============================================================================
+
+// Количество операций, ошибка которых выражается через матрицы (op_1..op_4)
+const int GRAM_OP_COUNT = 4;
+
+// Относительная погрешность сокращения слагаемых оценки в double (с запасом)
+const double GRAM_DOUBLE_NOISE = 1.0 / (1ull << 44);
+
+// Относительная погрешность суммы Images квадратов во float: (Images + 16) * 2^-23
+inline double gramFloatNoise() { return (Images + 16) / double(1 << 23); }
+
+// Погрешность округления op(a, b) до float в ядре ошибки (с запасом): сдвиг
+// каждого значения до 2^-24 |op| меняет сумму квадратов не больше чем на
+// 2^-23 * sqrt(ошибка * sum op^2) (неравенство Коши-Буняковского)
+const double GRAM_ROUND_NOISE = 1.0 / (1 << 22);
+
+// Количество строк, векторы которых готовятся за один проход потоков
+const int GRAM_ROW_GROUP = 32;
+
+// Количество столбцов в одной задаче потока
+const int GRAM_COLUMN_BLOCK = 64;
+
+// Количество независимых сумм на одно произведение (векторизуются компилятором)
+const int GRAM_LANES = 8;
+
+// ============================================================================
+// Матрицы скалярных произведений
+// ============================================================================
+
+class GramScorer
+{
+public:
+    GramScorer() : clock_(0), bytes_(0), exhausted_(false) {}
+
+    /**
+     * Сброс матриц (вызывается при смене обучающих образов)
+     */
+    void reset() {
+        norms_.clear();
+        rows_.clear();
+        targets_.clear();
+        bytes_ = 0;
+        exhausted_ = false;
+    }
+
+    /**
+     * Подготовка оценки пар для текущих ожидаемых выходов vz
+     *
+     * Досчитывает нормы новых нейронов и строки [rowFrom, Neirons) обеих
+     * таблиц для текущего vz.
+     *
+     * @param rowFrom - первая нужная строка (строка r - пары (r, c), c < r)
+     * @param threads - количество потоков вычисления строк
+     * @return false, если оценка недоступна (среди операций нет op_1..op_4,
+     *         --no-gram или превышен бюджет памяти) - нужен прямой перебор
+     */
+    bool prepare(int rowFrom, int threads) {
+        if (!UseGramScoring || Images == 0 || exhausted_) return false;
+        bool scorable = false;
+        for (int k = 0; k < op_count; k++) scorable = scorable || op_kind[k] < GRAM_OP_COUNT;
+        if (!scorable) return false;
+
+        current_ = findTarget();
+        Target& target = targets_[current_];
+        target.lastUse = ++clock_;
+
+        const int neurons = Neirons;
+        const size_t rowsNeeded = rowBytes(rowFrom, neurons, target);
+        while (bytes_ + rowsNeeded > GramBudgetBytes && evictTarget(current_)) {}
+        if (bytes_ + rowsNeeded > GramBudgetBytes) {
+            std::cout << "Gram scoring: memory budget (" << (GramBudgetBytes >> 20)
+                      << " MB) exceeded, using direct search" << std::endl;
+            reset();
+            exhausted_ = true;
+            return false;
+        }
+
+        // Нормы a·a и t·a новых нейронов
+        NeuronScratch scratch;
+        AlignedFloatVector buffer(Images);
+        for (int n = (int)norms_.size(); n < neurons; n++) {
+            scratch.release(0);
+            const float* a = GetNeironVectorShared(n, scratch).widen(buffer.data(), Images);
+            norms_.push_back(dot(a, a));
+        }
+        for (int n = (int)target.dots.size(); n < neurons; n++) {
+            scratch.release(0);
+            const float* a = GetNeironVectorShared(n, scratch).widen(buffer.data(), Images);
+            target.dots.push_back(dot(target.values.data(), a));
+        }
+
+        // Строки, которых ещё нет
+        if ((int)rows_.size() < neurons) rows_.resize(neurons);
+        if ((int)target.rows.size() < neurons) target.rows.resize(neurons);
+        std::vector<int> missing;
+        for (int r = std::max(rowFrom, 1); r < neurons; r++) {
+            if (rows_[r].empty() || target.rows[r].empty()) missing.push_back(r);
+        }
+        for (size_t first = 0; first < missing.size(); first += GRAM_ROW_GROUP) {
+            size_t last = std::min(missing.size(), first + GRAM_ROW_GROUP);
+            computeRows(missing.data() + first, (int)(last - first), target, threads);
+        }
+        return true;
+    }
+
+    /**
+     * Оценка квадратичной ошибки кандидата op(i, j) после prepare()
+     *
+     * @param i - первый вход (значения a)
+     * @param j - второй вход (значения b), j != i
+     * @param opIndex - операция FusedOp (0..GRAM_OP_COUNT-1)
+     * @param magnitude - выход: сумма модулей слагаемых (для оценки погрешности)
+     */
+    double score(int i, int j, int opIndex, double& magnitude) const {
+        const Target& target = targets_[current_];
+        const int row = std::max(i, j);
+        const int column = std::min(i, j);
+        const double ab = rows_[row][2 * column];
+        const double aabb = rows_[row][2 * column + 1];
+        const double tab = target.rows[row][column];
+        const double ta = target.dots[i];
+        const double tb = target.dots[j];
+        const double squares = target.norm + norms_[i] + norms_[j];
+
+        if (opIndex >= 3) {
+            magnitude = target.norm + 2.0 * std::fabs(tab) + aabb;
+            return target.norm - 2.0 * tab + aabb;                     // a * b
+        }
+        magnitude = squares + 2.0 * (std::fabs(ta) + std::fabs(tb) + std::fabs(ab));
+        switch (opIndex) {
+            case 0:  return squares - 2.0 * ta - 2.0 * tb + 2.0 * ab;  // a + b
+            case 1:  return squares - 2.0 * ta + 2.0 * tb - 2.0 * ab;  // a - b
+            default: return squares + 2.0 * ta - 2.0 * tb - 2.0 * ab;  // b - a
+        }
+    }
+
+private:
+    // Таблица (t∘a)·b для одного вектора ожидаемых выходов
+    struct Target {
+        std::vector<float> values;                // Ожидаемые выходы t
+        double norm;                              // t·t
+        std::vector<double> dots;                 // t·a для каждого нейрона
+        std::vector<std::vector<double>> rows;    // Строка r: (t∘a_r)·a_c для c < r
+        unsigned long long lastUse;
+    };
+
+    // Вес образа index (1 без весов)
+    static double weight(const float* w, int index) { return w ? (double)w[index] : 1.0; }
+
+    static double dot(const float* x, const float* y) {
+        const float* w = imageWeights();
+        double lanes[GRAM_LANES] = {};
+        int index = 0;
+        for (; index + GRAM_LANES <= Images; index += GRAM_LANES) {
+            for (int l = 0; l < GRAM_LANES; l++) {
+                lanes[l] += weight(w, index + l) * (double)x[index + l] * (double)y[index + l];
+            }
+        }
+        double sum = 0.0;
+        for (; index < Images; index++) sum += weight(w, index) * (double)x[index] * (double)y[index];
+        for (int l = 0; l < GRAM_LANES; l++) sum += lanes[l];
+        return sum;
+    }
+
+    size_t findTarget() {
+        for (size_t k = 0; k < targets_.size(); k++) {
+            if (targets_[k].values.size() == (size_t)Images &&
+                std::equal(targets_[k].values.begin(), targets_[k].values.end(), vz.begin())) {
+                return k;
+            }
+        }
+        Target target;
+        target.values.assign(vz.begin(), vz.begin() + Images);
+        target.norm = dot(target.values.data(), target.values.data());
+        target.lastUse = 0;
+        targets_.push_back(std::move(target));
+        return targets_.size() - 1;
+    }
+
+    // Память, которую займут недостающие строки [rowFrom, neurons)
+    size_t rowBytes(int rowFrom, int neurons, const Target& target) const {
+        size_t bytes = 0;
+        for (int r = std::max(rowFrom, 1); r < neurons; r++) {
+            if (r >= (int)rows_.size() || rows_[r].empty()) bytes += 2 * (size_t)r * sizeof(double);
+            if (r >= (int)target.rows.size() || target.rows[r].empty()) bytes += (size_t)r * sizeof(double);
+        }
+        return bytes;
+    }
+
+    // Вытеснение давно не использованной таблицы (кроме keep)
+    bool evictTarget(size_t& keep) {
+        size_t victim = targets_.size();
+        for (size_t k = 0; k < targets_.size(); k++) {
+            if (k != keep && (victim == targets_.size() || targets_[k].lastUse < targets_[victim].lastUse)) {
+                victim = k;
+            }
+        }
+        if (victim == targets_.size()) return false;
+
+        for (const auto& row : targets_[victim].rows) bytes_ -= row.size() * sizeof(double);
+        targets_.erase(targets_.begin() + victim);
+        if (keep > victim) keep--;
+        return true;
+    }
+
+    /**
+     * Вычисление строк rows[0..count) обеих таблиц
+     *
+     * Для каждой строки заранее готовятся векторы a, a∘a и t∘a в double
+     * (умноженные на веса образов);
+     * затем задачи "строка x блок столбцов" разбираются потоками. Вектор
+     * столбца читается один раз и даёт сразу три произведения.
+     */
+    void computeRows(const int* rows, int count, Target& target, int threads) {
+        std::vector<std::vector<double>> prepared(count);
+        const float* w = imageWeights();
+        NeuronScratch scratch;
+        AlignedFloatVector buffer(Images);
+        for (int k = 0; k < count; k++) {
+            scratch.release(0);
+            const float* a = GetNeironVectorShared(rows[k], scratch).widen(buffer.data(), Images);
+            std::vector<double>& p = prepared[k];
+            p.resize(3 * (size_t)Images);
+            for (int index = 0; index < Images; index++) {
+                const double x = a[index];
+                const double wx = weight(w, index) * x;
+                p[index] = wx;
+                p[Images + index] = wx * x;
+                p[2 * Images + index] = wx * target.values[index];
+            }
+
+            const int r = rows[k];
+            if (rows_[r].empty()) {
+                rows_[r].assign(2 * (size_t)r, 0.0);
+                bytes_ += rows_[r].size() * sizeof(double);
+            }
+            if (target.rows[r].empty()) {
+                target.rows[r].assign(r, 0.0);
+                bytes_ += target.rows[r].size() * sizeof(double);
+            }
+        }
+
+        // Задачи: (строка, блок столбцов)
+        std::vector<std::pair<int, int>> tasks;
+        for (int k = 0; k < count; k++) {
+            for (int c = 0; c < rows[k]; c += GRAM_COLUMN_BLOCK) tasks.push_back({ k, c });
+        }
+        std::atomic<size_t> next(0);
+
+        auto worker = [&]() {
+            NeuronScratch local;
+            AlignedFloatVector column(Images);
+            size_t task;
+            while ((task = next.fetch_add(1)) < tasks.size()) {
+                const int k = tasks[task].first;
+                const int r = rows[k];
+                const double* x = prepared[k].data();
+                const double* xx = x + Images;
+                const double* xt = xx + Images;
+                const int last = std::min(r, tasks[task].second + GRAM_COLUMN_BLOCK);
+                for (int c = tasks[task].second; c < last; c++) {
+                    local.release(0);
+                    const float* y = GetNeironVectorShared(c, local).widen(column.data(), Images);
+
+                    double ab[GRAM_LANES] = {}, aabb[GRAM_LANES] = {}, tab[GRAM_LANES] = {};
+                    int index = 0;
+                    for (; index + GRAM_LANES <= Images; index += GRAM_LANES) {
+                        for (int l = 0; l < GRAM_LANES; l++) {
+                            const double b = y[index + l];
+                            ab[l] += x[index + l] * b;
+                            aabb[l] += xx[index + l] * (b * b);
+                            tab[l] += xt[index + l] * b;
+                        }
+                    }
+                    double sumAB = 0.0, sumAABB = 0.0, sumTAB = 0.0;
+                    for (; index < Images; index++) {
+                        const double b = y[index];
+                        sumAB += x[index] * b;
+                        sumAABB += xx[index] * (b * b);
+                        sumTAB += xt[index] * b;
+                    }
+                    for (int l = 0; l < GRAM_LANES; l++) {
+                        sumAB += ab[l];
+                        sumAABB += aabb[l];
+                        sumTAB += tab[l];
+                    }
+                    rows_[r][2 * c] = sumAB;
+                    rows_[r][2 * c + 1] = sumAABB;
+                    target.rows[r][c] = sumTAB;
+                }
+            }
+        };
+
+        const int threadCount = std::max(1, std::min(threads, (int)tasks.size()));
+        if (threadCount == 1) {
+            worker();
+        } else {
+            std::vector<std::thread> pool;
+            for (int t = 0; t < threadCount; t++) pool.emplace_back(worker);
+            for (auto& t : pool) t.join();
+        }
+    }
+
+    std::vector<double> norms_;                   // a·a для каждого нейрона
+    std::vector<std::vector<double>> rows_;       // Строка r: (a·b, a²·b²) для c < r
+    std::vector<Target> targets_;
+    size_t current_;                              // Таблица текущего vz (после prepare)
+    unsigned long long clock_;
+    size_t bytes_;                                // Память строк обеих таблиц
+    bool exhausted_;                              // Бюджет превышен: до reset() только прямой перебор
+};
+
+GramScorer g_gramScorer;
+
+void resetGramScoring() {
+    g_gramScorer.reset();
+}
+
+// ============================================================================
+// Перебор пар с оценкой по матрицам
+// ============================================================================
+
+/**
+ * Полный перебор пар (i, j) с оценкой ошибки по матрицам
+ *
+ * Пары: i из [iBegin, iEnd), j из [jBegin, jEnd) (jEnd < 0 - j < i),
+ * операции op[0..op_count). Первый проход находит наименьшую верхнюю
+ * границу ошибки по операциям op_1..op_4, второй - пересчитывает напрямую
+ * всех кандидатов, нижняя граница которых не больше неё; при равной ошибке
+ * выбирается первый в порядке перебора (как в прямом переборе). Ошибка
+ * расширенных операций (op_5..op_11) через матрицы не выражается: они
+ * считаются напрямую с границей не выше найденной верхней.
+ *
+ * @param threads - количество потоков вычисления новых строк
+ * @param result - выход: лучший кандидат
+ * @return false, если оценка по матрицам недоступна (нужен прямой перебор)
+ */
+bool gramSearchPairs(int iBegin, int iEnd, int jBegin, int jEnd, int threads, ExhaustiveSearchResult& result) {
+    // Строка пары (i, j) - max(i, j): нужны строки, начиная с наименьшего максимума
+    int rowFrom = Neirons;
+    for (int i = iBegin; i < iEnd && rowFrom > 0; i++) {
+        const int last = (jEnd < 0) ? i : jEnd;
+        if (jBegin < last) rowFrom = std::min(rowFrom, std::max(i, jBegin));
+    }
+    if (!g_gramScorer.prepare(rowFrom, threads)) return false;
+
+    // Интервал ошибки кандидата: оценка +- погрешность (сумма во float,
+    // сокращение в double и округление op(a, b); magnitude >= sum op^2)
+    const double floatNoise = gramFloatNoise();
+    auto tolerance = [floatNoise](double score, double magnitude) {
+        const double absolute = std::fabs(score);
+        return floatNoise * absolute + GRAM_DOUBLE_NOISE * magnitude +
+               GRAM_ROUND_NOISE * std::sqrt(absolute * magnitude);
+    };
+
+    // Оценки пары считаются для операций op_1..op_4 с постоянным номером
+    // (цикл разворачивается), а не по порядку op[]
+    bool scored[GRAM_OP_COUNT] = {};
+    for (int k = 0; k < op_count; k++) {
+        if (op_kind[k] < GRAM_OP_COUNT) scored[op_kind[k]] = true;
+    }
+
+    double bestUpper = (double)big;
+    double magnitude;
+    for (int i = iBegin; i < iEnd; i++) {
+        const int last = (jEnd < 0) ? i : jEnd;
+        for (int j = jBegin; j < last; j++) {
+            for (int kind = 0; kind < GRAM_OP_COUNT; kind++) {
+                const double s = g_gramScorer.score(i, j, kind, magnitude);
+                const double upper = s + tolerance(s, magnitude);
+                if (scored[kind] && upper < bestUpper) bestUpper = upper;
+            }
+        }
+    }
+
+    // Граница расширенных операций: кандидат с ошибкой выше bestUpper
+    // не может быть лучшим, а ошибки не выше неё считаются полностью
+    const float extendedBound = std::nextafter((float)std::min(bestUpper, (double)big), big);
+
+    // Точная ошибка претендентов - тем же вычислением, что и в прямом переборе
+    NeuronScratch scratch;
+    AlignedFloatVector values(Images);
+    for (int i = iBegin; i < iEnd; i++) {
+        const int last = (jEnd < 0) ? i : jEnd;
+        for (int j = jBegin; j < last; j++) {
+            bool candidate[GRAM_OP_COUNT];
+            for (int kind = 0; kind < GRAM_OP_COUNT; kind++) {
+                const double s = g_gramScorer.score(i, j, kind, magnitude);
+                candidate[kind] = s - tolerance(s, magnitude) <= bestUpper;  // NaN - не претендент
+            }
+
+            for (int k = 0; k < op_count; k++) {
+                float bound = result.min_error;
+                if (op_kind[k] < GRAM_OP_COUNT) {
+                    if (!candidate[op_kind[k]]) continue;
+                } else {
+                    bound = std::min(bound, extendedBound);
+                }
+
+                scratch.release(0);
+                ActivationRef a = GetNeironVectorShared(i, scratch);
+                ActivationRef b = GetNeironVectorShared(j, scratch);
+                const float sum = candidateError(op[k], a, b, bound, values.data());
+                if (sum < bound && result.min_error > sum) {
+                    result.found = true;
+                    result.min_error = sum;
+                    result.optimal_i = i;
+                    result.optimal_j = j;
+                    result.optimal_op_index = k;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+#endif // GRAM_SCORING_H
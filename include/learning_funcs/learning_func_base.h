@@ -19,15 +19,17 @@
 #include <atomic>
 #include <algorithm>
 #include <iostream>
+#include <limits>
 
 // Максимальное значение ошибки (используется для инициализации)
 extern const float big;
 
 // Количество операций
-extern const int op_count;
+extern int op_count;
 
-// Массив операций
+// Массив операций обучения и их FusedOp (configureOps)
 extern oper op[];
+extern FusedOp op_kind[];
 
 // Количество потоков и флаг многопоточности
 extern int NumThreads;
@@ -41,8 +43,14 @@ extern int Receptors;
 extern int Classes;
 extern std::vector<Neiron> nei;
 extern std::vector<float> vz;
-extern std::vector<std::vector<float>> vx;
+extern std::vector<float> ImageWeights;
+extern ReceptorMatrix g_receptorMatrix;
 extern std::vector<float> NetInput;
+extern ActivationCache g_activationCache;
+extern size_t CacheBudgetBytes;
+extern ActivationFormat ActivationStorage;
+extern bool UseGramScoring;
+extern size_t GramBudgetBytes;
 
 // Константы итераций
 extern const int rod2_iter;
@@ -71,20 +79,103 @@ struct LearningFuncInfo {
     bool is_parallel;        // Является ли функция параллельной
 };
 
+/**
+ * Результат поиска пары нейронов (полный перебор)
+ */
+struct ExhaustiveSearchResult {
+    float min_error;
+    int optimal_i;
+    int optimal_j;
+    int optimal_op_index;
+    bool found;
+
+    ExhaustiveSearchResult() : min_error(big), optimal_i(0), optimal_j(0), optimal_op_index(0), found(false) {}
+};
+
 // ============================================================================
 // Прототипы функций из neuron_generation.h
 // ============================================================================
 
-// Функция получения вектора значений нейрона (для всех образов)
-float* __fastcall GetNeironVector(const int i);
+// Функция получения вектора значений нейрона (для всех образов, в формате кэша)
+ActivationRef __fastcall GetNeironVector(const int i);
+
+// Функция получения вектора значений нейрона в fp32
+const float* GetNeironValues(const int i);
+
+// Функция получения вектора значений нейрона из потока поиска (без изменения кэша)
+struct NeuronScratch;
+ActivationRef GetNeironVectorShared(const int i, NeuronScratch& scratch);
+
+// Учёт входов новых нейронов в fan-out кэша
+void registerNewNeurons();
 
-// Функция получения одиночного значения нейрона
-float __fastcall GetNeironVal(const int i);
+// Обновление кэша между шагами обучения
+void updateNeuronCache();
 
-// Функция очистки кэша значений
-void clear_val_cache(std::vector<Neiron>& n, const int size);
+// Операция на этапе компиляции для указателя (main.cpp)
+FusedOp fusedOpKind(oper operation);
+
+// Применение операции нейрона к векторам в любом формате (main.cpp)
+void applyOp(oper operation, float* r, const ActivationRef& a, const ActivationRef& b, const int size);
 
 // Функция инициализации нейронов
-void initNeurons();
+bool initNeurons();
+
+// ============================================================================
+// Ошибка кандидата
+// ============================================================================
+
+/**
+ * Веса образов для ядер ошибки
+ *
+ * Одинаковые образы сведены в один с весом-количеством (Dataset::deduplicate),
+ * поэтому ошибка - sum(w * (vz - значение)^2) по уникальным образам.
+ *
+ * @return nullptr, если все веса - 1
+ */
+inline const float* imageWeights() {
+    return ImageWeights.empty() ? nullptr : ImageWeights.data();
+}
+
+/**
+ * Квадратичная ошибка вектора значений относительно ожидаемых выходов vz
+ *
+ * @param bound - граница: суммирование прекращается, когда сумма её достигла
+ */
+inline float outputError(const float* values, float bound = std::numeric_limits<float>::infinity()) {
+    const float* w = imageWeights();
+    float sum = 0.0f;
+    for (int index = 0; index < Images && sum < bound; index++) {
+        float square = vz[index] - values[index];
+        sum += w ? (w[index] * square) * square : square * square;
+    }
+    return sum;
+}
+
+/**
+ * Квадратичная ошибка кандидата f(a, b) относительно ожидаемых выходов vz
+ *
+ * Для операций op_1..op_11 вычисляется слитным ядром (simd_ops.h) без записи
+ * вектора кандидата (базисный вход - одним значением); для остальных
+ * операций вектор вычисляется в scratch.
+ *
+ * @param bound - граница: суммирование прекращается, когда сумма её достигла
+ * @param scratch - буфер на Images значений
+ * @return ошибка (если не меньше bound - возможно, частичная сумма)
+ */
+inline float candidateError(oper f, const ActivationRef& a, const ActivationRef& b, float bound, float* scratch) {
+    const FusedOp kind = fusedOpKind(f);
+    if (kind != FUSED_NONE) {
+        if (a.isScalar() || b.isScalar()) return errorOpBroadcast(kind, a, b, vz.data(), imageWeights(), Images, bound);
+        auto kernel = [kind](const float* z1, const float* z2, const float* t, const float* w, int count,
+                             float sum, float limit) {
+            return op_error_simd(kind, z1, z2, t, w, count, sum, limit);
+        };
+        return errorOpMixed(kernel, a, b, vz.data(), imageWeights(), Images, bound);
+    }
+
+    applyOpMixed(f, scratch, a, b, Images);
+    return outputError(scratch, bound);
+}
 
 #endif // LEARNING_FUNC_BASE_H
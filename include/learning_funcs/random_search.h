@@ -59,12 +59,8 @@ float random_neurons() {
     nei[Neirons].op = op[rand() % op_count];
 
     // Вычисляем ошибку созданного нейрона
-    float* curval = GetNeironVector(Neirons);
-    float sum = 0.0f;
-    for (int index = 0; index < Images; index++) {
-        float square = vz[index] - curval[index];
-        sum += square * square;
-    }
+    const float* curval = GetNeironValues(Neirons);
+    float sum = outputError(curval);
 
     std::cout << "(" << Neirons << ") = (" << nei[Neirons].i << ")op(" << nei[Neirons].j << "), error = " << sum << "\n";
     Neirons++;
@@ -106,12 +102,8 @@ float random_from_inputs() {
     nei[Neirons].op = op[rand() % op_count];
 
     // Вычисляем ошибку
-    float* curval = GetNeironVector(Neirons);
-    float sum = 0.0f;
-    for (int index = 0; index < Images; index++) {
-        float square = vz[index] - curval[index];
-        sum += square * square;
-    }
+    const float* curval = GetNeironValues(Neirons);
+    float sum = outputError(curval);
 
     std::cout << "(" << Neirons << ") = (" << nei[Neirons].i << ")op(" << nei[Neirons].j << "), error = " << sum << "\n";
     Neirons++;
@@ -133,12 +125,14 @@ float random_from_inputs() {
 float random_pair_optimized() {
     int     count, count_max = Inputs * Neirons * rndrod_iter;
     float   min = big;
-    float   square, sum;
+    float   sum;
     int     r[5] = { 0,0,0,0,0 };
     oper    ro[5] = { 0,0,0,0,0 };
     int     Neirons_p_1 = Neirons + 1;
     Neiron& Neiron_A = nei[Neirons];
     Neiron& Neiron_B = nei[Neirons_p_1];
+    AlignedFloatVector A_Vector(Images), B_Vector(Images);
+    NeuronScratch scratch;
 
     Neiron_B.i = Neirons;
 
@@ -154,15 +148,14 @@ float random_pair_optimized() {
         Neiron_B.j = rand() % Inputs;
         Neiron_B.op = op[rand() % op_count];
 
-        float* NBVal = GetNeironVector(Neirons_p_1);
+        // Вектор A вычисляется один раз, ошибка B - без записи его вектора
+        scratch.release(0);
+        ActivationRef A_i_cache = GetNeironVectorShared(Neiron_A.i, scratch);
+        ActivationRef A_j_cache = GetNeironVectorShared(Neiron_A.j, scratch);
+        ActivationRef B_j_cache = GetNeironVectorShared(Neiron_B.j, scratch);
+        applyOp(Neiron_A.op, A_Vector.data(), A_i_cache, A_j_cache, Images);
 
-        sum = 0.0;
-
-        for (int index = 0; index < Images && sum < min; index++)
-        {
-            square = vz[index] - NBVal[index];
-            sum += square * square;
-        }
+        sum = candidateError(Neiron_B.op, A_Vector.data(), B_j_cache, min, B_Vector.data());
 
         if (min > sum)
         {
@@ -201,12 +194,14 @@ float random_pair_optimized() {
 float random_pair_extended() {
     int     count, count_max = Neirons * Neirons * 6;
     float   min = big;
-    float   square, sum;
+    float   sum;
     int     r[5] = { 0,0,0,0,0 };
     oper    ro[5] = { 0,0,0,0,0 };
     int     Neirons_p_1 = Neirons + 1;
     Neiron& Neiron_A = nei[Neirons];
     Neiron& Neiron_B = nei[Neirons_p_1];
+    AlignedFloatVector A_Vector(Images), B_Vector(Images);
+    NeuronScratch scratch;
 
     Neiron_B.i = Neirons;
 
@@ -221,15 +216,14 @@ float random_pair_extended() {
         Neiron_B.j = rand() % Neirons;
         Neiron_B.op = op[rand() % op_count];
 
-        float* NBVal = GetNeironVector(Neirons_p_1);
-
-        sum = 0.0;
+        // Вектор A вычисляется один раз, ошибка B - без записи его вектора
+        scratch.release(0);
+        ActivationRef A_i_cache = GetNeironVectorShared(Neiron_A.i, scratch);
+        ActivationRef A_j_cache = GetNeironVectorShared(Neiron_A.j, scratch);
+        ActivationRef B_j_cache = GetNeironVectorShared(Neiron_B.j, scratch);
+        applyOp(Neiron_A.op, A_Vector.data(), A_i_cache, A_j_cache, Images);
 
-        for (int index = 0; index < Images && sum < min; index++)
-        {
-            square = vz[index] - NBVal[index];
-            sum += square * square;
-        }
+        sum = candidateError(Neiron_B.op, A_Vector.data(), B_j_cache, min, B_Vector.data());
 
         if (min > sum)
         {
@@ -289,7 +283,8 @@ void PairSearchThreadFunc(
         return (int)((local_seed >> 16) & 0x7FFF);
     };
 
-    std::vector<float> A_Vector(Images), B_Vector(Images);
+    AlignedFloatVector A_Vector(Images), B_Vector(Images);
+    NeuronScratch scratch;
 
     for (int count = 0; count < iterations_per_thread; count++)
     {
@@ -308,26 +303,19 @@ void PairSearchThreadFunc(
             B_j = local_rand() % current_neirons;
         }
 
-        float* A_i_cache = GetNeironVector(A_i);
-        float* A_j_cache = GetNeironVector(A_j);
-        float* B_j_cache = GetNeironVector(B_j);
+        scratch.release(0);
+        ActivationRef A_i_cache = GetNeironVectorShared(A_i, scratch);
+        ActivationRef A_j_cache = GetNeironVectorShared(A_j, scratch);
+        ActivationRef B_j_cache = GetNeironVectorShared(B_j, scratch);
 
         for (int A_op = 0; A_op < op_count; A_op++)
         {
-            (*op[A_op])(A_Vector.data(), A_i_cache, A_j_cache, Images);
+            applyOp(op[A_op], A_Vector.data(), A_i_cache, A_j_cache, Images);
 
             for (int B_op = 0; B_op < op_count; B_op++)
             {
-                (*op[B_op])(B_Vector.data(), A_Vector.data(), B_j_cache, Images);
-
                 float current_global_min = global_min->load(std::memory_order_relaxed);
-                float sum = 0.0f;
-
-                for (int index = 0; index < Images && sum < current_global_min; index++)
-                {
-                    float square = vz[index] - B_Vector[index];
-                    sum += square * square;
-                }
+                float sum = candidateError(op[B_op], A_Vector.data(), B_j_cache, current_global_min, B_Vector.data());
 
                 if (result.min_error > sum)
                 {
@@ -364,11 +352,6 @@ float random_pair_optimized_parallel() {
     int count_max = Inputs * Neirons * rndrod_iter;
     int iterations_per_thread = std::max(100, (count_max + NumThreads - 1) / NumThreads);
 
-    // Прогреваем кэши
-    for (int n = 0; n < Neirons; n++) {
-        GetNeironVector(n);
-    }
-
     std::vector<PairSearchResult> results(NumThreads);
     std::atomic<float> global_min(big);
     std::vector<std::thread> threads;
@@ -433,11 +416,6 @@ float random_pair_extended_parallel() {
     int count_max = Neirons * Neirons * 6;
     int iterations_per_thread = std::max(100, (count_max + NumThreads - 1) / NumThreads);
 
-    // Прогреваем кэши
-    for (int n = 0; n < Neirons; n++) {
-        GetNeironVector(n);
-    }
-
     std::vector<PairSearchResult> results(NumThreads);
     std::atomic<float> global_min(big);
     std::vector<std::thread> threads;
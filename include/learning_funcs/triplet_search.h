@@ -12,6 +12,9 @@
  *
  * Это основной метод обучения в текущей версии, обеспечивающий
  * создание более сложных функций за счёт иерархической структуры.
+ *
+ * Для каждой пары входов B ошибки всех сочетаний операций B и C
+ * считаются блочным ядром (simd_ops.h) за один проход по образам.
  */
 
 #ifndef TRIPLET_SEARCH_H
@@ -19,6 +22,55 @@
 
 #include "learning_func_base.h"
 
+/**
+ * Ошибки сочетаний операций B и C для одной пары входов B
+ *
+ * Блочное ядро считает все сочетания op_1..op_4 сразу, пока вектор A
+ * не меняется. Сочетания с расширенными операциями (op_5..op_11) и все
+ * сочетания после улучшения (A заменяется на B) считаются по одному,
+ * как в исходном переборе.
+ */
+struct TripletCombos {
+    bool usable;                      // Среди op[0..op_count) есть операции блочного ядра
+    int kinds[FUSED_OP_COUNT];        // FusedOp для каждой операции
+    float errors[TRIPLET_COMBOS];
+    AlignedFloatVector i_values;      // Входы B в fp32 (при 16-битном кэше)
+    AlignedFloatVector j_values;
+
+    TripletCombos() : usable(false) {
+        for (int k = 0; k < op_count; k++) {
+            kinds[k] = op_kind[k];
+            usable = usable || kinds[k] < TRIPLET_OPS;
+        }
+    }
+
+    // Ошибка сочетания посчитана блочным ядром
+    bool covers(int B_op, int C_op) const {
+        return kinds[B_op] < TRIPLET_OPS && kinds[C_op] < TRIPLET_OPS;
+    }
+
+    /**
+     * Ошибки всех сочетаний C = opC(A, opB(Bi, Bj))
+     *
+     * @param bound - граница ошибки (сочетания, достигшие её, не досчитываются)
+     * @return false, если блочное ядро недоступно для текущих операций
+     */
+    bool evaluate(const float* A, const ActivationRef& Bi, const ActivationRef& Bj, float bound) {
+        if (!usable) return false;
+        if (!Bi.isFloat() || !Bj.isFloat()) {
+            i_values.resize(Images);
+            j_values.resize(Images);
+        }
+        op_triplet_errors_simd(A, Bi.widen(i_values.data(), Images), Bj.widen(j_values.data(), Images),
+                               vz.data(), imageWeights(), Images, bound, errors);
+        return true;
+    }
+
+    float error(int B_op, int C_op) const {
+        return errors[kinds[B_op] * TRIPLET_OPS + kinds[C_op]];
+    }
+};
+
 // ============================================================================
 // Последовательная версия функции
 // ============================================================================
@@ -38,7 +90,7 @@
 float triplet_random() {
     int     count, count_max = Neirons * Receptors * 4;
     float   min = big;
-    float   square, sum;
+    float   sum;
     int     A_id = Neirons;
     int     B_id = Neirons + 1;
     int     C_id = Neirons + 2;
@@ -47,6 +99,9 @@ float triplet_random() {
     Neiron& Neiron_C = nei[C_id];
     Neiron  optimal_A, optimal_B, optimal_C;
     bool    finded = false;
+    AlignedFloatVector A_Vector(Images), B_Vector(Images), C_Vector(Images);
+    NeuronScratch scratch;
+    TripletCombos combos;
 
     // C объединяет A и B
     Neiron_C.i = A_id;
@@ -57,6 +112,8 @@ float triplet_random() {
     Neiron_A.j = rand() % Neirons;
     Neiron_A.op = op[rand() % op_count];
     Neiron_A.cached = false;
+    applyOp(Neiron_A.op, A_Vector.data(),
+            GetNeironVectorShared(Neiron_A.i, scratch), GetNeironVectorShared(Neiron_A.j, scratch), Images);
 
     for (count = 0; count < count_max; count++)
     {
@@ -64,25 +121,31 @@ float triplet_random() {
         Neiron_B.i = rand() % Neirons;
         Neiron_B.j = rand() % Neirons;
 
+        scratch.release(0);
+        ActivationRef B_i_cache = GetNeironVectorShared(Neiron_B.i, scratch);
+        ActivationRef B_j_cache = GetNeironVectorShared(Neiron_B.j, scratch);
+
+        // Ошибки всех сочетаний операций B и C - одним проходом
+        bool combined = combos.evaluate(A_Vector.data(), B_i_cache, B_j_cache, min);
+
         // Перебираем операции для B и C
         for (int B_op = 0; B_op < op_count; B_op++)
         {
             Neiron_B.op = op[B_op];
-            Neiron_B.cached = false;
+            bool B_ready = false;
 
             for (int C_op = 0; C_op < op_count; C_op++)
             {
                 Neiron_C.op = op[C_op];
-                Neiron_C.cached = false;
-
-                float* C_Vector = GetNeironVector(C_id);
-                sum = 0.0;
 
-                // Вычисляем ошибку по всем образам
-                for (int index = 0; index < Images && sum < min; index++)
+                // Вычисляем ошибку по всем образам (без записи вектора C)
+                if (combined && combos.covers(B_op, C_op))
+                    sum = combos.error(B_op, C_op);
+                else
                 {
-                    square = vz[index] - C_Vector[index];
-                    sum += square * square;
+                    if (!B_ready) applyOp(Neiron_B.op, B_Vector.data(), B_i_cache, B_j_cache, Images);
+                    B_ready = true;
+                    sum = candidateError(Neiron_C.op, A_Vector.data(), B_Vector.data(), min, C_Vector.data());
                 }
 
                 if (min > sum)
@@ -94,7 +157,13 @@ float triplet_random() {
                     optimal_C = Neiron_C;
 
                     // Используем оптимальный нейрон B как новый A
+                    // (остальные сочетания этой пары считаются уже с ним)
+                    if (!B_ready) applyOp(Neiron_B.op, B_Vector.data(), B_i_cache, B_j_cache, Images);
+                    B_ready = true;
+                    combined = false;
                     Neiron_A = Neiron_B;
+                    Neiron_A.cached = false;
+                    std::copy(B_Vector.begin(), B_Vector.end(), A_Vector.begin());
                 }
             }
         }
@@ -102,9 +171,13 @@ float triplet_random() {
 
     if (finded)
     {
+        // Строки кэша соответствуют последним кандидатам, а не оптимальным
         Neiron_A = optimal_A;
+        Neiron_A.cached = false;
         Neiron_B = optimal_B;
+        Neiron_B.cached = false;
         Neiron_C = optimal_C;
+        Neiron_C.cached = false;
         Neirons += 3;
         return min;
     }
@@ -148,44 +221,60 @@ void TripletSearchThreadFunc(
     };
 
     Neiron local_A, local_B, local_C;
-    std::vector<float> A_Vector(Images), B_Vector(Images), C_Vector(Images);
+    AlignedFloatVector A_Vector(Images), B_Vector(Images), C_Vector(Images);
+    NeuronScratch scratch;
+    TripletCombos combos;
 
     // Инициализируем A случайными значениями
     local_A.i = local_rand() % current_neirons;
     local_A.j = local_rand() % current_neirons;
     local_A.op = op[local_rand() % op_count];
 
-    float* A_i_cache = GetNeironVector(local_A.i);
-    float* A_j_cache = GetNeironVector(local_A.j);
-    (*local_A.op)(A_Vector.data(), A_i_cache, A_j_cache, Images);
+    ActivationRef A_i_cache = GetNeironVectorShared(local_A.i, scratch);
+    ActivationRef A_j_cache = GetNeironVectorShared(local_A.j, scratch);
+    applyOp(local_A.op, A_Vector.data(), A_i_cache, A_j_cache, Images);
+
+    // Параметры B выбираются на итерацию вперёд, чтобы успеть предвыбрать их строки кэша
+    int next_B_i = local_rand() % current_neirons;
+    int next_B_j = local_rand() % current_neirons;
 
     for (int count = 0; count < iterations_per_thread; count++)
     {
         // Генерируем случайные параметры для B
-        local_B.i = local_rand() % current_neirons;
-        local_B.j = local_rand() % current_neirons;
+        local_B.i = next_B_i;
+        local_B.j = next_B_j;
+        next_B_i = local_rand() % current_neirons;
+        next_B_j = local_rand() % current_neirons;
+        g_activationCache.prefetch(next_B_i);
+        g_activationCache.prefetch(next_B_j);
+
+        scratch.release(0);
+        ActivationRef B_i_cache = GetNeironVectorShared(local_B.i, scratch);
+        ActivationRef B_j_cache = GetNeironVectorShared(local_B.j, scratch);
 
-        float* B_i_cache = GetNeironVector(local_B.i);
-        float* B_j_cache = GetNeironVector(local_B.j);
+        // Ошибки всех сочетаний операций B и C - одним проходом
+        bool combined = combos.evaluate(A_Vector.data(), B_i_cache, B_j_cache,
+                                        global_min->load(std::memory_order_relaxed));
 
         // Перебираем операции для B и C
         for (int B_op = 0; B_op < op_count; B_op++)
         {
             local_B.op = op[B_op];
-            (*local_B.op)(B_Vector.data(), B_i_cache, B_j_cache, Images);
+            bool B_ready = false;
 
             for (int C_op = 0; C_op < op_count; C_op++)
             {
                 local_C.op = op[C_op];
-                (*local_C.op)(C_Vector.data(), A_Vector.data(), B_Vector.data(), Images);
 
-                // Вычисляем ошибку по всем образам
-                float current_global_min = global_min->load(std::memory_order_relaxed);
-                float sum = 0.0f;
-                for (int index = 0; index < Images && sum < current_global_min; index++)
-                {
-                    float square = vz[index] - C_Vector[index];
-                    sum += square * square;
+                // Вычисляем ошибку по всем образам (без записи вектора C)
+                float sum;
+                if (combined && combos.covers(B_op, C_op)) {
+                    sum = combos.error(B_op, C_op);
+                } else {
+                    if (!B_ready) applyOp(local_B.op, B_Vector.data(), B_i_cache, B_j_cache, Images);
+                    B_ready = true;
+                    float current_global_min = global_min->load(std::memory_order_relaxed);
+                    sum = candidateError(local_C.op, A_Vector.data(), B_Vector.data(), current_global_min, C_Vector.data());
                 }
 
                 if (result.min_error > sum)
@@ -205,6 +294,10 @@ void TripletSearchThreadFunc(
                     }
 
                     // Используем оптимальный нейрон B как новый A
+                    // (остальные сочетания этой пары считаются уже с ним)
+                    if (!B_ready) applyOp(local_B.op, B_Vector.data(), B_i_cache, B_j_cache, Images);
+                    B_ready = true;
+                    combined = false;
                     local_A = local_B;
                     for (int im = 0; im < Images; im++) {
                         A_Vector[im] = B_Vector[im];
@@ -262,11 +355,6 @@ float triplet_random_parallel() {
     // Получаем начальное значение для генераторов случайных чисел
     unsigned int base_seed = (unsigned int)(Neirons * 1099087573u + 12345u);
 
-    // Предварительно прогреваем кэши всех существующих нейронов
-    for (int n = 0; n < Neirons; n++) {
-        GetNeironVector(n);
-    }
-
     // Запускаем потоки
     std::vector<std::thread> threads;
     threads.reserve(NumThreads);
@@ -0,0 +1,143 @@
+/*
+ * mapped_file.h - Отображение файла в память только для чтения
+ *
+ * Этот модуль содержит:
+ * - Класс MappedFile - содержимое файла как непрерывный блок байт
+ *
+ * На Windows и POSIX файл отображается в память (mmap/MapViewOfFile):
+ * страницы читаются с диска по мере обращения и разделяются между
+ * процессами через страничный кэш ОС. На других платформах файл
+ * читается в буфер целиком.
+ *
+ * Начало отображения выровнено по странице, поэтому массивы, смещения
+ * которых в файле кратны их выравниванию, можно читать на месте.
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define NNETS_HAS_FILE_MMAP 1
+#endif
+
+class MappedFile {
+public:
+    MappedFile() : data_(nullptr), size_(0), mapped_(false) {}
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * Отображение файла в память
+     *
+     * @param path - путь к файлу
+     * @return false, если файл не открывается или пуст
+     */
+    bool open(const std::string& path) {
+        close();
+#if defined(_WIN32)
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ != INVALID_HANDLE_VALUE) {
+            LARGE_INTEGER size;
+            if (GetFileSizeEx(file_, &size) && size.QuadPart > 0) {
+                mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping_ != nullptr) {
+                    data_ = static_cast<const unsigned char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+                    if (data_ != nullptr) {
+                        size_ = (size_t)size.QuadPart;
+                        mapped_ = true;
+                        return true;
+                    }
+                }
+            }
+            close();
+        }
+#elif defined(NNETS_HAS_FILE_MMAP)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            struct stat info;
+            void* ptr = MAP_FAILED;
+            if (fstat(fd, &info) == 0 && info.st_size > 0) {
+                ptr = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            ::close(fd);
+            if (ptr != MAP_FAILED) {
+                data_ = static_cast<const unsigned char*>(ptr);
+                size_ = (size_t)info.st_size;
+                mapped_ = true;
+                return true;
+            }
+        }
+#endif
+        // Без отображения (или если оно не удалось) - чтение в буфер
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in.is_open()) return false;
+        std::streamoff size = in.tellg();
+        if (size <= 0) return false;
+        buffer_.resize((size_t)size);
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(buffer_.data()), size)) {
+            buffer_.clear();
+            return false;
+        }
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+        return true;
+    }
+
+    void close() {
+#if defined(_WIN32)
+        if (mapped_) UnmapViewOfFile(data_);
+        if (mapping_ != nullptr) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#elif defined(NNETS_HAS_FILE_MMAP)
+        if (mapped_) munmap(const_cast<unsigned char*>(data_), size_);
+#endif
+        buffer_.clear();
+        buffer_.shrink_to_fit();
+        data_ = nullptr;
+        size_ = 0;
+        mapped_ = false;
+    }
+
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool isOpen() const { return data_ != nullptr; }
+
+    // Файл отображён в память (а не прочитан в буфер)
+    bool isMapped() const { return mapped_; }
+
+private:
+    const unsigned char* data_;
+    size_t size_;
+    bool mapped_;
+    std::vector<unsigned char> buffer_;
+#if defined(_WIN32)
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,377 @@
+/*
+ * model_file.h - Описание обученной сети и двоичный формат модели
+ *
+ * Этот модуль содержит:
+ * - Структуру NetworkDescription - обученную сеть независимо от
+ *   глобального состояния
+ * - Класс ModelFileWriter - буферизованную запись файла модели
+ *   с атомарной заменой
+ * - Двоичный файл модели (--model-format binary): запись и чтение
+ *   через отображение файла в память (MappedFile)
+ *
+ * Файл модели (порядок байт машины, все массивы выровнены на 4 байта):
+ *   ModelFileHeader
+ *   float basis[inputs - receptors]     - значения базисных входов
+ *   int32 outputs[classes]              - выходной нейрон класса (-1 = не обучен)
+ *   ModelNeuron neurons[neurons]        - (i, j, op) нейронов inputs, inputs + 1, ...
+ *   uint32 nameOffsets[classes + 1]     - начало имени класса в names
+ *   char names[nameBytes]               - имена классов подряд
+ * checksum заголовка - FNV-1a 64 всех байт после заголовка.
+ *
+ * Модели (JSON и двоичные) записываются потоково через ModelFileWriter:
+ * во временный файл рядом с целевым, который затем атомарно заменяет
+ * его, поэтому прерванная запись не оставляет обрезанной модели.
+ *
+ * Записи нейронов совпадают по раскладке с NetworkDescription::Neuron,
+ * поэтому при загрузке они не разбираются и не копируются: описание
+ * ссылается на отображение файла, а его страницы разделяются между
+ * процессами, загрузившими одну модель, через страничный кэш ОС.
+ */
+
+#ifndef MODEL_FILE_H
+#define MODEL_FILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+
+// ============================================================================
+// Описание сети
+// ============================================================================
+
+/**
+ * Структура обученной сети, прочитанная из файла модели
+ *
+ * Не зависит от глобального состояния: по описанию можно скомпилировать
+ * план инференса (InferencePlan::compile) "в стороне", не трогая
+ * загруженную сеть, - так сервер подменяет модель на лету.
+ */
+struct NetworkDescription {
+    struct Neuron {
+        int32_t i;   // Номер первого входного нейрона
+        int32_t j;   // Номер второго входного нейрона
+        int32_t op;  // Индекс операции в op[]
+    };
+
+    int receptors;                  // Количество рецепторов
+    int inputs;                     // Количество входов (рецепторы + базис)
+    std::vector<float> basis;       // Значения базисных входов (inputs - receptors)
+    std::vector<std::string> classNames;
+    std::vector<int> outputs;       // Выходной нейрон каждого класса (-1 = не обучен)
+    std::vector<Neuron> neurons;    // Нейроны inputs, inputs + 1, ... (если не отображены)
+
+    // Двоичная модель: нейроны читаются прямо из отображения файла
+    std::shared_ptr<const MappedFile> mapping;
+    const Neuron* mappedNeurons;
+    size_t mappedCount;
+
+    NetworkDescription() : receptors(0), inputs(0), mappedNeurons(nullptr), mappedCount(0) {}
+
+    // Количество нейронов (без входов) и нейрон inputs + k
+    size_t neuronCount() const { return mappedNeurons ? mappedCount : neurons.size(); }
+    const Neuron& neuron(size_t k) const { return mappedNeurons ? mappedNeurons[k] : neurons[k]; }
+
+    // Общее количество узлов сети (входы и нейроны)
+    int nodeCount() const { return inputs + (int)neuronCount(); }
+};
+
+// ============================================================================
+// Запись файла модели
+// ============================================================================
+
+/**
+ * Буферизованная запись файла модели с атомарной заменой
+ *
+ * Данные пишутся в "<path>.tmp" блоками по BUFFER_BYTES; commit()
+ * переименовывает его в path (на POSIX - атомарно). Если commit() не
+ * вызван или запись не удалась, временный файл удаляется, а прежний
+ * path остаётся нетронутым.
+ */
+class ModelFileWriter {
+public:
+    static const size_t BUFFER_BYTES = 1 << 16;
+
+    explicit ModelFileWriter(const std::string& path)
+        : path_(path), temporary_(path + ".tmp"), committed_(false) {
+        out_.open(temporary_, std::ios::binary | std::ios::trunc);
+        buffer_.reserve(BUFFER_BYTES);
+    }
+
+    ~ModelFileWriter() {
+        if (!committed_) {
+            out_.close();
+            std::error_code code;
+            std::filesystem::remove(temporary_, code);
+        }
+    }
+
+    ModelFileWriter(const ModelFileWriter&) = delete;
+    ModelFileWriter& operator=(const ModelFileWriter&) = delete;
+
+    bool isOpen() const { return out_.is_open(); }
+
+    void write(const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        if (buffer_.size() + size > BUFFER_BYTES) flush();
+        if (size >= BUFFER_BYTES) {
+            out_.write(bytes, (std::streamsize)size);
+        } else {
+            buffer_.append(bytes, size);
+        }
+    }
+
+    void write(const std::string& text) { write(text.data(), text.size()); }
+
+    // Десятичная запись целого числа
+    void writeInt(long long value) {
+        char digits[24];
+        int length = snprintf(digits, sizeof(digits), "%lld", value);
+        write(digits, (size_t)length);
+    }
+
+    /**
+     * Завершение записи: сброс буфера и замена path временным файлом
+     *
+     * @param error - выход: описание ошибки
+     */
+    bool commit(std::string& error) {
+        flush();
+        out_.close();
+        if (out_.fail()) {
+            error = "Cannot write file: " + temporary_;
+            return false;
+        }
+        std::error_code code;
+        std::filesystem::rename(temporary_, path_, code);
+        if (code) {
+            error = "Cannot replace " + path_ + ": " + code.message();
+            return false;
+        }
+        committed_ = true;
+        return true;
+    }
+
+private:
+    void flush() {
+        out_.write(buffer_.data(), (std::streamsize)buffer_.size());
+        buffer_.clear();
+    }
+
+    std::string path_;
+    std::string temporary_;
+    std::ofstream out_;
+    std::string buffer_;
+    bool committed_;
+};
+
+// ============================================================================
+// Формат файла
+// ============================================================================
+
+// Формат файла модели для сохранения
+enum ModelFormat {
+    MODEL_JSON,     // Текстовый JSON (переносимый, читается человеком)
+    MODEL_BINARY    // Двоичный формат этого модуля (загрузка без разбора)
+};
+
+/**
+ * Разбор имени формата модели (json, binary)
+ *
+ * @return true, если имя распознано
+ */
+inline bool parseModelFormat(const std::string& name, ModelFormat& format) {
+    if (name == "json") { format = MODEL_JSON; return true; }
+    if (name == "binary") { format = MODEL_BINARY; return true; }
+    return false;
+}
+
+const char MODEL_FILE_MAGIC[8] = { 'N', 'N', 'M', 'O', 'D', 'L', '\r', '\n' };
+const uint32_t MODEL_FILE_VERSION = 1;
+
+struct ModelFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;            // Зарезервировано (0)
+    int32_t receptors;
+    int32_t inputs;
+    int32_t classes;
+    int32_t neurons;           // Нейронов без входов
+    uint32_t nameBytes;        // Символов в именах классов
+    uint32_t reserved;
+    uint64_t checksum;         // FNV-1a 64 байт после заголовка
+};
+
+static_assert(sizeof(NetworkDescription::Neuron) == 3 * sizeof(int32_t), "neuron records are read in place");
+static_assert(sizeof(ModelFileHeader) % 8 == 0, "arrays follow the header aligned");
+
+// FNV-1a 64: продолжение хэша hash байтами data
+inline uint64_t modelChecksum(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t k = 0; k < size; k++) {
+        hash = (hash ^ bytes[k]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * Файл - двоичная модель (по сигнатуре, а не по расширению)
+ */
+inline bool isModelFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(MODEL_FILE_MAGIC)];
+    return in.read(magic, sizeof(magic)) && memcmp(magic, MODEL_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+/**
+ * Запись описания сети в двоичный файл модели
+ *
+ * Контрольная сумма считается по массивам до записи, поэтому файл
+ * пишется одним проходом (ModelFileWriter).
+ *
+ * @param error - выход: описание ошибки
+ * @return false при ошибке записи
+ */
+inline bool writeModelFile(const std::string& path, const NetworkDescription& network, std::string& error) {
+    const int classes = (int)network.outputs.size();
+    const size_t neurons = network.neuronCount();
+
+    std::vector<int32_t> outputs(network.outputs.begin(), network.outputs.end());
+    std::vector<uint32_t> nameOffsets(1, 0);
+    std::string names;
+    for (int c = 0; c < classes; c++) {
+        if (c < (int)network.classNames.size()) names += network.classNames[c];
+        nameOffsets.push_back((uint32_t)names.size());
+    }
+    const NetworkDescription::Neuron* records = network.mappedNeurons ? network.mappedNeurons : network.neurons.data();
+
+    ModelFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_FILE_VERSION;
+    header.receptors = network.receptors;
+    header.inputs = network.inputs;
+    header.classes = classes;
+    header.neurons = (int32_t)neurons;
+    header.nameBytes = (uint32_t)names.size();
+
+    uint64_t hash = modelChecksum(network.basis.data(), network.basis.size() * sizeof(float));
+    hash = modelChecksum(outputs.data(), outputs.size() * sizeof(int32_t), hash);
+    hash = modelChecksum(records, neurons * sizeof(NetworkDescription::Neuron), hash);
+    hash = modelChecksum(nameOffsets.data(), nameOffsets.size() * sizeof(uint32_t), hash);
+    header.checksum = modelChecksum(names.data(), names.size(), hash);
+
+    ModelFileWriter out(path);
+    if (!out.isOpen()) {
+        error = "Cannot open output file: " + path;
+        return false;
+    }
+    out.write(&header, sizeof(header));
+    out.write(network.basis.data(), network.basis.size() * sizeof(float));
+    out.write(outputs.data(), outputs.size() * sizeof(int32_t));
+    out.write(records, neurons * sizeof(NetworkDescription::Neuron));
+    out.write(nameOffsets.data(), nameOffsets.size() * sizeof(uint32_t));
+    out.write(names);
+    return out.commit(error);
+}
+
+/**
+ * Чтение двоичного файла модели
+ *
+ * Нейроны остаются в отображении файла (network.mapping); проверяются
+ * размеры, контрольная сумма и номера операций.
+ *
+ * @param opCount - количество операций (допустимые op: 0..opCount-1)
+ * @param error - выход: описание ошибки
+ * @return false, если файл не открывается или повреждён
+ */
+inline bool readModelFile(const std::string& path, int opCount, NetworkDescription& network, std::string& error) {
+    auto mapping = std::make_shared<MappedFile>();
+    if (!mapping->open(path)) {
+        error = "Cannot open network file: " + path;
+        return false;
+    }
+    const uint8_t* data = mapping->data();
+    const size_t size = mapping->size();
+
+    ModelFileHeader header;
+    if (size < sizeof(header)) {
+        error = "Truncated model file: " + path;
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        error = "Not a model file: " + path;
+        return false;
+    }
+    if (header.version != MODEL_FILE_VERSION) {
+        error = "Unsupported model file version " + std::to_string(header.version) + " in " + path;
+        return false;
+    }
+    if (header.receptors <= 0 || header.inputs < header.receptors || header.classes < 0 || header.neurons < 0) {
+        error = "Invalid network dimensions in " + path;
+        return false;
+    }
+
+    const size_t basisCount = (size_t)(header.inputs - header.receptors);
+    const size_t classes = (size_t)header.classes;
+    const size_t neurons = (size_t)header.neurons;
+    const size_t expected = sizeof(header) + basisCount * sizeof(float) + classes * sizeof(int32_t) +
+                            neurons * sizeof(NetworkDescription::Neuron) + (classes + 1) * sizeof(uint32_t) +
+                            header.nameBytes;
+    if (expected != size) {
+        error = "Model file size mismatch: " + path;
+        return false;
+    }
+    if (modelChecksum(data + sizeof(header), size - sizeof(header)) != header.checksum) {
+        error = "Model file checksum mismatch: " + path;
+        return false;
+    }
+
+    const uint8_t* pos = data + sizeof(header);
+    const float* basis = reinterpret_cast<const float*>(pos);
+    pos += basisCount * sizeof(float);
+    const int32_t* outputs = reinterpret_cast<const int32_t*>(pos);
+    pos += classes * sizeof(int32_t);
+    const NetworkDescription::Neuron* records = reinterpret_cast<const NetworkDescription::Neuron*>(pos);
+    pos += neurons * sizeof(NetworkDescription::Neuron);
+    const uint32_t* nameOffsets = reinterpret_cast<const uint32_t*>(pos);
+    pos += (classes + 1) * sizeof(uint32_t);
+    const char* names = reinterpret_cast<const char*>(pos);
+
+    for (size_t k = 0; k < neurons; k++) {
+        if (records[k].op < 0 || records[k].op >= opCount) {
+            error = "Invalid operation of neuron " + std::to_string(header.inputs + k) + " in " + path;
+            return false;
+        }
+    }
+    if (nameOffsets[0] != 0 || nameOffsets[classes] != header.nameBytes) {
+        error = "Invalid class table in " + path;
+        return false;
+    }
+
+    network = NetworkDescription();
+    network.receptors = header.receptors;
+    network.inputs = header.inputs;
+    network.basis.assign(basis, basis + basisCount);
+    network.outputs.assign(outputs, outputs + classes);
+    network.classNames.resize(classes);
+    for (size_t c = 0; c < classes; c++) {
+        if (nameOffsets[c] > nameOffsets[c + 1]) {
+            error = "Invalid class table in " + path;
+            return false;
+        }
+        network.classNames[c].assign(names + nameOffsets[c], nameOffsets[c + 1] - nameOffsets[c]);
+    }
+    network.mappedNeurons = records;
+    network.mappedCount = neurons;
+    network.mapping = std::move(mapping);
+    return true;
+}
+
+#endif // MODEL_FILE_H
@@ -24,109 +24,415 @@
 // Функции инициализации и работы с кэшем
 // ============================================================================
 
+// Минимум слотов кэша: входы вычисляемого нейрона и кандидатов
+// закреплены и не могут быть вытеснены (входы сети слотов не занимают)
+const int CACHE_MIN_EXTRA_SLOTS = 256;
+
+// Количество нейронов, входы которых уже учтены в fan-out кэша
+int g_fanoutRegistered = 0;
+
+// Количество нейронов, векторы которых уже хотя бы раз вычислены в кэш
+int g_neuronsCached = 0;
+
+// Возврат вытесненных векторов в кэш (updateNeuronCache): доля слотов за шаг
+// и наименьшее число пересчётов нейрона потоками поиска
+const size_t CACHE_ADMIT_DIVISOR = 32;
+const uint32_t CACHE_ADMIT_MIN_MISSES = 2;
+
+// Сброс матриц оценки пар (learning_funcs/gram_scoring.h) при смене образов
+void resetGramScoring();
+
+// Максимальное количество одновременно оцениваемых кандидатов (тройка A, B, C)
+const int MAX_CANDIDATES = 3;
+
+/**
+ * Векторы кандидатов
+ *
+ * Кандидаты (нейроны с номерами Neirons..Neirons+2) пересчитываются на
+ * каждой итерации поиска и сразу читаются для оценки ошибки, поэтому их
+ * векторы хранятся в fp32 вне g_activationCache: они не вытесняют векторы
+ * сети и не требуют преобразования формата кэша. После фиксации кандидат
+ * становится нейроном сети, и его вектор вычисляется заново уже в кэше.
+ */
+struct CandidateRows {
+    int owner[MAX_CANDIDATES];                     // Нейрон, чей вектор хранится в строке
+    AlignedFloatVector rows[MAX_CANDIDATES];
+
+    CandidateRows() { reset(); }
+
+    void reset() {
+        for (int k = 0; k < MAX_CANDIDATES; k++) owner[k] = -1;
+    }
+};
+
+CandidateRows g_candidateRows;
+
+/**
+ * Учёт входов новых нейронов в fan-out кэша
+ *
+ * Нейроны, которые используются как входы многими другими, дороже
+ * пересчитывать, поэтому кэш вытесняет их в последнюю очередь.
+ * Вызывается после каждого шага обучения (когда Neirons увеличивается).
+ */
+void registerNewNeurons() {
+    for (int n = std::max(g_fanoutRegistered, Inputs); n < Neirons; n++) {
+        g_activationCache.addFanout(nei[n].i);
+        g_activationCache.addFanout(nei[n].j);
+    }
+    if (Neirons > g_fanoutRegistered) g_fanoutRegistered = Neirons;
+}
+
 /**
  * Инициализация массива нейронов
  *
- * Выделяет память для нейронов и их кэшей.
+ * Выделяет память для нейронов и резервирует единую область их кэшей
+ * (g_activationCache). Физическая память под кэш нейрона выделяется лениво,
+ * при первом вычислении его вектора в GetNeironVector(); при заданном
+ * бюджете (CacheBudgetBytes) холодные векторы вытесняются.
+ * Структура уже существующих нейронов (i, j, op) сохраняется.
  * Должна вызываться после загрузки конфигурации.
+ *
+ * @return true при успешном выделении памяти
  */
-void initNeurons() {
+bool initNeurons() {
     nei.resize(MAX_NEURONS);
     for (int n = 0; n < MAX_NEURONS; n++) {
-        nei[n].c.resize(Images);
         nei[n].cached = false;
-        nei[n].val_cached = false;
     }
+    if (!g_activationCache.init(MAX_NEURONS, Images, ActivationStorage, CacheBudgetBytes,
+                                CACHE_MIN_EXTRA_SLOTS, UseHugePages)) {
+        return false;
+    }
+    g_candidateRows.reset();
+    resetGramScoring();
+    g_fanoutRegistered = 0;
+    g_neuronsCached = 0;
+    registerNewNeurons();
+    return true;
 }
 
+// ============================================================================
+// Функции вычисления значений нейронов
+// ============================================================================
+
 /**
- * Очистка кэша одиночных значений
+ * Значение базисного нейрона (Receptors <= i < Inputs) для всех образов
  *
- * Необходимо вызывать перед каждым новым вычислением в режиме инференса.
+ * Ссылка ACTIVATION_SCALAR на NetInput[i]: операции и слитные ядра
+ * держат значение в регистре, а не читают вектор одинаковых значений.
+ */
+inline ActivationRef basisValue(const int i) {
+    return ActivationRef(&NetInput[i], ACTIVATION_SCALAR);
+}
+
+/**
+ * Вектор значений входного нейрона (i < Inputs) без копирования
  *
- * @param n - массив нейронов
- * @param size - размер массива
+ * Рецепторы - строка матрицы входов g_receptorMatrix (в её формате),
+ * базисные нейроны - скаляр (basisValue).
  */
-void clear_val_cache(vector<Neiron>& n, const int size) {
-    int limit = (size < (int)n.size()) ? size : (int)n.size();
-    for (int i = 0; i < limit; i++)
-        n[i].val_cached = false;
+inline ActivationRef inputValues(const int i) {
+    return (i < Receptors) ? g_receptorMatrix.row(i) : basisValue(i);
 }
 
-// ============================================================================
-// Функции вычисления значений нейронов
-// ============================================================================
+/**
+ * Рабочая память потока поиска
+ *
+ * Стек временных векторов для пересчёта вытесненных нейронов, стеки
+ * обхода графа входов и локальные счётчики попаданий/промахов
+ * (переносятся в кэш в flushStats() и flushMisses(), чтобы не делить
+ * атомарные счётчики между потоками).
+ */
+struct NeuronScratch {
+    // Шаг обхода: нейрон и признак того, что его входы уже в стеке значений
+    struct Step {
+        int n;
+        bool expanded;
+    };
+
+    // Значение в стеке обхода: owned - вектор занимает временный вектор
+    struct Value {
+        ActivationRef ref;
+        bool owned;
+    };
+
+    std::vector<AlignedFloatVector> rows;  // Временные векторы (адреса стабильны)
+    size_t top;                            // Количество занятых векторов
+    std::vector<Step> steps;
+    std::vector<Value> values;
+    std::vector<uint32_t> missed;          // Пересчёты по номеру нейрона
+    unsigned long long hits;
+    unsigned long long misses;
+
+    NeuronScratch() : top(0), hits(0), misses(0) {}
+    ~NeuronScratch() {
+        flushStats();
+        flushMisses();
+    }
+
+    // Текущая вершина стека и освобождение до неё
+    size_t mark() const { return top; }
+    void release(size_t m) { top = m; }
+
+    // Количество образов могло измениться после initNeurons()
+    float* push() {
+        if (top == rows.size()) rows.emplace_back(Images);
+        if (rows[top].size() != (size_t)Images) rows[top].resize(Images);
+        return rows[top++].data();
+    }
+
+    void flushStats() {
+        g_activationCache.countHits(hits);
+        g_activationCache.countMisses(misses);
+        hits = 0;
+        misses = 0;
+    }
+
+    void countMiss(int n) {
+        if ((size_t)n >= missed.size()) missed.resize(std::max(n + 1, Neirons), 0);
+        missed[n]++;
+        misses++;
+    }
+
+    void flushMisses() {
+        g_activationCache.addMisses(missed);
+        missed.clear();
+    }
+};
+
+// Рабочая память основного потока (пересчёт входов в GetNeironVector)
+NeuronScratch g_mainScratch;
+
+/**
+ * Расчёт вектора значений нейрона без изменения кэша
+ *
+ * Если вектор есть в g_activationCache - возвращает его (в формате кэша),
+ * иначе пересчитывает во временный fp32-вектор scratch (с точностью
+ * формата кэша, чтобы результат не зависел от вытеснений). Граф входов
+ * обходится явным стеком, а не рекурсией: цепочки нейронов бывают
+ * глубиной до Neirons. Результат нейрона переносится на место первого
+ * временного вектора его входов, поэтому цепочке любой глубины хватает
+ * нескольких временных векторов.
+ *
+ * Используется потоками поиска и основным потоком при промахе
+ * GetNeironVector(). Возвращённая ссылка действительна до
+ * scratch.release() с меткой, взятой до вызова.
+ *
+ * @param i - номер нейрона (i < Neirons)
+ * @param scratch - рабочая память потока
+ * @return ссылка на вектор значений для всех образов
+ */
+ActivationRef GetNeironVectorShared(const int i, NeuronScratch& scratch) {
+    if (i < Inputs) return inputValues(i);
+    ActivationRef cached = g_activationCache.lookup(i);
+    if (cached.data != nullptr && nei[i].cached)
+    {
+        scratch.hits++;
+        return cached;
+    }
+
+    // Промах: обход графа входов
+    std::vector<NeuronScratch::Step>& steps = scratch.steps;
+    std::vector<NeuronScratch::Value>& values = scratch.values;
+    const size_t stepBase = steps.size();
+
+    steps.push_back({i, false});
+    while (steps.size() > stepBase) {
+        const NeuronScratch::Step step = steps.back();
+        steps.pop_back();
+        const Neiron& current = nei[step.n];
+
+        if (!step.expanded) {
+            if (step.n < Inputs) {
+                values.push_back({inputValues(step.n), false});
+                continue;
+            }
+            ActivationRef cached = g_activationCache.lookup(step.n);
+            if (cached.data != nullptr && current.cached) {
+                scratch.hits++;
+                values.push_back({cached, false});
+                continue;
+            }
+            // Сначала вычисляется вход i, затем j, затем сам нейрон
+            scratch.countMiss(step.n);
+            steps.push_back({step.n, true});
+            steps.push_back({current.j, false});
+            steps.push_back({current.i, false});
+            continue;
+        }
+
+        // Входы вычислены: b на вершине стека значений, a под ним.
+        // Их временные векторы - верхние в стеке scratch
+        const NeuronScratch::Value b = values.back();
+        values.pop_back();
+        const NeuronScratch::Value a = values.back();
+        values.pop_back();
+        const size_t base = scratch.mark() - (a.owned ? 1 : 0) - (b.owned ? 1 : 0);
+
+        float* out = scratch.push();
+        applyOp(current.op, out, a.ref, b.ref, Images);
+        roundValues(out, g_activationCache.format(), Images);
+        std::swap(scratch.rows[base], scratch.rows[scratch.mark() - 1]);
+        scratch.release(base + 1);
+        values.push_back({ActivationRef(out), true});
+    }
+
+    const ActivationRef result = values.back().ref;
+    values.pop_back();
+    return result;
+}
 
 /**
  * Расчёт вектора значений для i-го нейрона
  *
  * Вычисляет выходные значения нейрона для всех образов одновременно.
- * Использует кэширование для избежания повторных вычислений.
+ * Использует кэширование для избежания повторных вычислений:
+ * значения хранятся в слоте g_activationCache в формате кэша
+ * (ActivationStorage). Если вектор был вытеснен, он пересчитывается
+ * из входов i/j; вытесненные входы пересчитываются во временные
+ * векторы (GetNeironVectorShared) и в кэш не возвращаются, поэтому
+ * промах закрепляет не больше двух слотов при любой глубине сети.
+ *
+ * Изменяет кэш, поэтому вызывается только из основного потока;
+ * потоки поиска используют GetNeironVectorShared().
  *
  * @param i - номер нейрона
- * @return указатель на массив значений для всех образов
+ * @return ссылка на вектор значений для всех образов
+ *         (действительна до следующего вызова GetNeironVector)
  */
-float* __fastcall GetNeironVector(const int i) {
+ActivationRef __fastcall GetNeironVector(const int i) {
     Neiron& current = nei[i];
-    if (!current.cached)
+
+    // Входы не хранятся в кэше: строка матрицы входов или скаляр
+    if (i < Inputs) return inputValues(i);
+
+    if (i >= Neirons)
     {
-        current.cached = true;
-        if (i < Receptors)
-        {
-            // Входные нейроны: берём значения из образов
-            for (int im = 0; im < Images; im++)
-                current.c[im] = vx[im][i];
-        }
-        else if (i < Inputs)
+        // Кандидат: вектор в fp32 вне кэша (в статистику кэша не входит)
+        int k = i - Neirons;
+        const bool overflow = (k >= MAX_CANDIDATES);
+        if (overflow)
         {
-            // Базисные нейроны: постоянные значения
-            for (int im = 0; im < Images; im++)
-                current.c[im] = NetInput[i];
+            static bool reported = false;
+            if (!reported)
+            {
+                cerr << "Error: Candidate neuron " << i << " is out of range (" << MAX_CANDIDATES
+                     << " candidates), its vector is recomputed on every call" << endl;
+                reported = true;
+            }
         }
-        else
+        static AlignedFloatVector overflowRow;
+        AlignedFloatVector& row = overflow ? overflowRow : g_candidateRows.rows[k];
+        if (!overflow && g_candidateRows.owner[k] == i && current.cached) return row.data();
+
+        ActivationRef icache = GetNeironVector(current.i);
+        g_activationCache.pin(current.i);
+        ActivationRef jcache = GetNeironVector(current.j);
+        g_activationCache.unpin(current.i);
+
+        row.resize(Images);
+        applyOp(current.op, row.data(), icache, jcache, Images);
+        if (!overflow)
         {
-            // Вычисляемые нейроны: применяем операцию к входам
-            float* icache = GetNeironVector(current.i);
-            float* jcache = GetNeironVector(current.j);
-            (*current.op)(current.c.data(), icache, jcache, Images);
+            g_candidateRows.owner[k] = i;
+            current.cached = true;
         }
+        return row.data();
     }
 
-    return current.c.data();
+    ActivationRef cached = g_activationCache.lookup(i);
+    if (cached.data != nullptr && current.cached)
+    {
+        g_activationCache.touch(i);
+        g_activationCache.hit();
+        return cached;
+    }
+
+    g_activationCache.miss();
+
+    int evicted = -1;
+    const ActivationFormat format = g_activationCache.format();
+    void* c;
+
+    // Вычисляемые нейроны: применяем операцию к входам.
+    // Входы берутся из кэша или пересчитываются во временные векторы;
+    // входы из кэша закрепляются, чтобы выделение слота не вытеснило их
+    NeuronScratch& scratch = g_mainScratch;
+    const size_t m = scratch.mark();
+    ActivationRef icache = GetNeironVectorShared(current.i, scratch);
+    ActivationRef jcache = GetNeironVectorShared(current.j, scratch);
+    g_activationCache.touch(current.i);
+    g_activationCache.touch(current.j);
+    g_activationCache.pin(current.i);
+    g_activationCache.pin(current.j);
+
+    c = g_activationCache.allocate(i, evicted);
+    if (c != nullptr) storeOp(current.op, c, format, icache, jcache, Images);
+
+    g_activationCache.unpin(current.i);
+    g_activationCache.unpin(current.j);
+    scratch.release(m);
+    scratch.flushStats();
+
+    if (c == nullptr)
+    {
+        cerr << "Error: Cannot allocate cache for neuron " << i
+             << " (increase --cache-budget)" << endl;
+        exit(1);
+    }
+    if (evicted >= 0) nei[evicted].cached = false;
+
+    current.cached = true;
+    return ActivationRef(c, format);
 }
 
 /**
- * Расчёт одиночного значения для i-го нейрона
+ * Обновление кэша между шагами обучения (только основной поток)
  *
- * Вычисляет выходное значение нейрона для текущего входа (NetInput).
- * Используется в режиме инференса.
+ * Векторы новых нейронов (и нейронов загруженной сети при начале
+ * обучения) вычисляются в кэш один раз. Функции поиска читают векторы
+ * через GetNeironVectorShared() и кэш не изменяют, поэтому вытесненные
+ * векторы возвращаются в кэш здесь: до slots / CACHE_ADMIT_DIVISOR
+ * нейронов, которые потоки поиска пересчитывали чаще других (не меньше
+ * CACHE_ADMIT_MIN_MISSES раз). Прогрев всей сети перед каждым поиском
+ * при ограниченном бюджете пересчитывал бы все вытесненные векторы и
+ * уравнивал их кредиты.
  *
- * @param i - номер нейрона
- * @return выходное значение нейрона
+ * Вызывается после registerNewNeurons(), когда матрица входов заполнена.
  */
-float __fastcall GetNeironVal(const int i) {
-    if (i < Inputs)
-    {
-        // Входные и базисные нейроны: возвращаем напрямую
-        return NetInput[i];
+void updateNeuronCache() {
+    for (int n = std::max(g_neuronsCached, Inputs); n < Neirons; n++) {
+        GetNeironVector(n);
     }
-    else
-    {
-        Neiron& current = nei[i];
-        if (current.val_cached)
-            return current.val;
-        else
-        {
-            // Рекурсивно вычисляем значение
-            float ival = GetNeironVal(current.i);
-            float jval = GetNeironVal(current.j);
-            (*current.op)(&current.val, &ival, &jval, 1);
-            current.val_cached = true;
-            return current.val;
-        }
+    if (Neirons > g_neuronsCached) g_neuronsCached = Neirons;
+
+    static std::vector<int> admitted;
+    g_mainScratch.flushMisses();
+    g_activationCache.takeMissed(admitted, g_activationCache.slots() / CACHE_ADMIT_DIVISOR, CACHE_ADMIT_MIN_MISSES);
+    for (int n : admitted) {
+        if (n < Neirons) GetNeironVector(n);
     }
 }
 
+/**
+ * Вектор значений i-го нейрона в fp32
+ *
+ * Для последовательных функций обучения, которые читают значения
+ * кандидата напрямую. При 16-битном формате кэша вектор расширяется
+ * во внутренний буфер.
+ *
+ * @param i - номер нейрона
+ * @return указатель на Images значений (действителен до следующего вызова)
+ */
+const float* GetNeironValues(const int i) {
+    ActivationRef row = GetNeironVector(i);
+    if (row.isFloat()) return row.floats();
+
+    static AlignedFloatVector values;
+    values.resize(Images);
+    return row.widen(values.data(), Images);
+}
+
 // ============================================================================
 // Подключение модульных функций обучения
 // ============================================================================
@@ -0,0 +1,121 @@
+/*
+ * receptor_matrix.h - Матрица входов обучающих образов
+ *
+ * Этот модуль содержит:
+ * - Класс ReceptorMatrix - значения рецепторов всех образов в одной
+ *   непрерывной матрице "рецептор x образ"
+ * - Разбор формата хранения матрицы (--dataset-format)
+ *
+ * Строка матрицы - вектор значений рецепторного нейрона для всех образов,
+ * поэтому GetNeironVector() возвращает ссылку прямо на неё: рецепторы не
+ * копируются в кэш нейронов и набор данных хранится в памяти один раз.
+ *
+ * Входы сети - коды символов (код / max_num), поэтому матрицу можно
+ * хранить кодами uint8 (ACTIVATION_U8) с таблицей расширения: памяти
+ * вчетверо меньше, значения те же. В fp32 строка передаётся в ядра без
+ * расширения (быстрее при поиске).
+ */
+
+#ifndef RECEPTOR_MATRIX_H
+#define RECEPTOR_MATRIX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "activation_arena.h"
+#include "activation_format.h"
+
+/**
+ * Разбор имени формата матрицы входов (fp32, u8)
+ *
+ * @return false, если имя неизвестно
+ */
+inline bool parseDatasetFormat(const std::string& name, ActivationFormat& format) {
+    if (name == "fp32") { format = ACTIVATION_FP32; return true; }
+    if (name == "u8")   { format = ACTIVATION_U8; return true; }
+    return false;
+}
+
+/**
+ * Матрица входов "рецептор x образ"
+ *
+ * Значение рецептора d образа img хранится по индексу d * images + img
+ * (строка на рецептор, как receptorMatrix в InferencePlan::evaluateBatch).
+ */
+class ReceptorMatrix {
+public:
+    ReceptorMatrix() : receptors_(0), images_(0), format_(ACTIVATION_FP32), codeCount_(1) {}
+
+    /**
+     * Выделение матрицы
+     *
+     * @param format - ACTIVATION_FP32 или ACTIVATION_U8
+     * @param codeCount - количество состояний входа: значение кода - код / codeCount
+     */
+    void reset(int receptors, int images, ActivationFormat format, int codeCount) {
+        receptors_ = receptors;
+        images_ = images;
+        format_ = format;
+        codeCount_ = codeCount;
+        const size_t count = (size_t)receptors * images;
+        if (format == ACTIVATION_U8) {
+            for (int code = 0; code < 256; code++) ActivationU8Table[code] = decode(code);
+            codes_.assign(count, 0);
+            values_.clear();
+            values_.shrink_to_fit();
+        } else {
+            values_.assign(count, 0.0f);
+            codes_.clear();
+            codes_.shrink_to_fit();
+        }
+    }
+
+    // Запись кода входа d образа img
+    void set(int d, int img, unsigned char code) {
+        const size_t index = (size_t)d * images_ + img;
+        if (format_ == ACTIVATION_U8) codes_[index] = code;
+        else values_[index] = decode(code);
+    }
+
+    // Запись кодов всех входов образа img (receptors() кодов)
+    void setImage(int img, const uint8_t* codes) {
+        for (int d = 0; d < receptors_; d++) set(d, img, codes[d]);
+    }
+
+    // Значение входа d образа img
+    float value(int d, int img) const {
+        const size_t index = (size_t)d * images_ + img;
+        return (format_ == ACTIVATION_U8) ? ActivationU8Table[codes_[index]] : values_[index];
+    }
+
+    // Значения всех входов образа img (receptors() значений)
+    void image(int img, float* out) const {
+        for (int d = 0; d < receptors_; d++) out[d] = value(d, img);
+    }
+
+    // Вектор значений рецептора d для всех образов (без копирования)
+    ActivationRef row(int d) const {
+        const size_t index = (size_t)d * images_;
+        if (format_ == ACTIVATION_U8) return ActivationRef(codes_.data() + index, ACTIVATION_U8);
+        return ActivationRef(values_.data() + index);
+    }
+
+    int receptors() const { return receptors_; }
+    int images() const { return images_; }
+    ActivationFormat format() const { return format_; }
+
+    // Объём матрицы в байтах
+    size_t bytes() const { return values_.size() * sizeof(float) + codes_.size(); }
+
+private:
+    float decode(int code) const { return float(code) / float(codeCount_); }
+
+    int receptors_;
+    int images_;
+    ActivationFormat format_;
+    int codeCount_;
+    AlignedFloatVector values_;     // fp32: значения
+    std::vector<uint8_t> codes_;    // u8: коды (значение - ActivationU8Table[код])
+};
+
+#endif // RECEPTOR_MATRIX_H
@@ -6,34 +6,272 @@
  * - Разность z1 - z2 (op_2)
  * - Разность z2 - z1 (op_3)
  * - Произведение (op_4)
+ * - Расширенные операции (op_5..op_11): деление, квадрат плюс/минус
+ *   второй вход, параллельное соединение
+ * - Слитные ядра "операция + ошибка": квадратичная ошибка op(z1, z2)
+ *   относительно ожидаемых выходов без записи вектора кандидата
+ *   (с весами образов или без них)
+ * - Блочное ядро тройки: ошибки всех сочетаний операций opC(A, opB(Bi, Bj))
+ *   за один проход
  *
- * Поддерживаемые наборы инструкций (в порядке приоритета):
- * - AVX (256-bit, 8 float за раз)
- * - SSE (128-bit, 4 float за раз)
+ * Уровни реализации (SIMDTier, в порядке приоритета):
+ * - AVX-512 (512-bit, 16 float за раз)
+ * - AVX2 + FMA (256-bit, 8 float за раз)
+ * - SSE4.1 (128-bit, 4 float за раз)
  * - Скалярный код (fallback)
  *
- * Примечание: Для включения SIMD оптимизаций необходимо
- * компилировать с флагами -mavx/-msse или использовать -march=native
+ * Уровень выбирается при запуске по CPUID (detectSIMDTier), а не при
+ * компиляции: ядра каждого уровня компилируются атрибутом target
+ * (GCC/Clang) для своего набора инструкций, поэтому переносимая сборка
+ * без -march=native работает на любом x86-64 с полной скоростью.
+ * На других архитектурах используется скалярный код.
  */
 
 #ifndef SIMD_OPS_H
 #define SIMD_OPS_H
 
-// Определяем доступность SIMD инструкций на этапе компиляции
-// AVX проверяется первым, так как он более эффективен
-#if defined(__AVX__) || defined(__AVX2__)
-    #define SIMD_AVX_ENABLED 1
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// Векторные ядра есть только для x86/x86-64
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define SIMD_X86 1
     #include <immintrin.h>
-#elif defined(__SSE__) || defined(__SSE2__) || defined(__SSE4_1__)
-    #define SIMD_SSE_ENABLED 1
-    #include <xmmintrin.h>
-    #include <emmintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        // MSVC разрешает интринсики любого набора инструкций без атрибутов
+        #include <intrin.h>
+        #define SIMD_TARGET(features)
+    #else
+        #include <cpuid.h>
+        #define SIMD_TARGET(features) __attribute__((target(features)))
+    #endif
+    #define SIMD_TARGET_SSE41 SIMD_TARGET("sse4.1")
+    #define SIMD_TARGET_AVX2 SIMD_TARGET("avx2,fma,f16c")
+    #define SIMD_TARGET_AVX512 SIMD_TARGET("avx512f,avx2,fma,f16c")
 #endif
 
 // Флаг для включения/выключения SIMD во время выполнения
 // Позволяет тестировать производительность с/без SIMD
 extern bool UseSIMD;
 
+// ============================================================================
+// Выбор уровня реализации
+// ============================================================================
+
+enum SIMDTier {
+    SIMD_TIER_SCALAR = 0,  // Скалярный код
+    SIMD_TIER_SSE41 = 1,   // SSE4.1
+    SIMD_TIER_AVX2 = 2,    // AVX2 + FMA + F16C
+    SIMD_TIER_AVX512 = 3   // AVX-512F (+ уровень AVX2)
+};
+
+#ifdef SIMD_X86
+
+// cpuid(leaf, subleaf): regs = {eax, ebx, ecx, edx}
+inline void simdCpuid(unsigned int leaf, unsigned int subleaf, unsigned int* regs) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int k = 0; k < 4; k++) regs[k] = static_cast<unsigned int>(info[k]);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Состояния регистров, сохраняемые ОС (XCR0)
+inline uint64_t simdXcr0() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+#endif
+}
+
+#endif // SIMD_X86
+
+/**
+ * Лучший уровень, поддерживаемый процессором и ОС
+ *
+ * AVX-уровни требуют, чтобы ОС сохраняла YMM (и ZMM/маски для AVX-512)
+ * регистры при переключении контекста: это проверяется по XCR0.
+ */
+inline SIMDTier detectSIMDTier() {
+#ifdef SIMD_X86
+    unsigned int regs[4];
+    simdCpuid(0, 0, regs);
+    const unsigned int maxLeaf = regs[0];
+    if (maxLeaf < 1) return SIMD_TIER_SCALAR;
+
+    simdCpuid(1, 0, regs);
+    const unsigned int ecx1 = regs[2];
+    unsigned int ebx7 = 0;
+    if (maxLeaf >= 7) {
+        simdCpuid(7, 0, regs);
+        ebx7 = regs[1];
+    }
+
+    if (!(ecx1 & (1u << 19))) return SIMD_TIER_SCALAR;            // SSE4.1
+
+    const bool osxsave = (ecx1 & (1u << 27)) != 0;
+    const uint64_t xcr0 = osxsave ? simdXcr0() : 0;
+    const bool avx = (ecx1 & (1u << 28)) && (xcr0 & 0x6) == 0x6;  // AVX + XMM/YMM
+    const bool fma = (ecx1 & (1u << 12)) != 0;
+    const bool f16c = (ecx1 & (1u << 29)) != 0;
+    const bool avx2 = (ebx7 & (1u << 5)) != 0;
+    if (!(avx && avx2 && fma && f16c)) return SIMD_TIER_SSE41;
+
+    const bool avx512 = (ebx7 & (1u << 16)) && (xcr0 & 0xE6) == 0xE6;  // AVX-512F + opmask/ZMM
+    return avx512 ? SIMD_TIER_AVX512 : SIMD_TIER_AVX2;
+#else
+    return SIMD_TIER_SCALAR;
+#endif
+}
+
+// Уровень, поддерживаемый процессором (определяется один раз при запуске)
+inline const SIMDTier SupportedSIMDTier = detectSIMDTier();
+
+// Выбранный уровень (--simd; не выше SupportedSIMDTier)
+inline SIMDTier SelectedSIMDTier = SupportedSIMDTier;
+
+// Уровень, которым выполняются операции (с учётом --no-simd)
+inline SIMDTier activeSIMDTier() {
+    return UseSIMD ? SelectedSIMDTier : SIMD_TIER_SCALAR;
+}
+
+// Имя уровня для командной строки
+inline const char* simdTierName(SIMDTier tier) {
+    switch (tier) {
+        case SIMD_TIER_AVX512: return "avx512";
+        case SIMD_TIER_AVX2:   return "avx2";
+        case SIMD_TIER_SSE41:  return "sse4.1";
+        default:               return "scalar";
+    }
+}
+
+/**
+ * Разбор имени уровня (scalar, sse4.1, avx2, avx512)
+ *
+ * @return false, если имя неизвестно
+ */
+inline bool parseSIMDTier(const std::string& name, SIMDTier& tier) {
+    for (int k = SIMD_TIER_SCALAR; k <= SIMD_TIER_AVX512; k++) {
+        if (name == simdTierName(static_cast<SIMDTier>(k))) {
+            tier = static_cast<SIMDTier>(k);
+            return true;
+        }
+    }
+    return false;
+}
+
+// ============================================================================
+// Операции
+// ============================================================================
+
+// Операции, для которых есть векторные и слитные ядра. Номер операции
+// совпадает с номером в файле модели (op_1..op_11 - 0..10)
+enum FusedOp {
+    FUSED_ADD = 0,        // z1 + z2 (op_1)
+    FUSED_SUB = 1,        // z1 - z2 (op_2)
+    FUSED_RSUB = 2,       // z2 - z1 (op_3)
+    FUSED_MUL = 3,        // z1 * z2 (op_4)
+    FUSED_DIV = 4,        // z1 / z2 (op_5)
+    FUSED_RDIV = 5,       // z2 / z1 (op_6)
+    FUSED_SQ2_ADD = 6,    // z2 * z2 + z1 (op_7)
+    FUSED_SQ1_ADD = 7,    // z1 * z1 + z2 (op_8)
+    FUSED_SQ2_SUB = 8,    // z2 * z2 - z1 (op_9)
+    FUSED_SQ1_SUB = 9,    // z1 * z1 - z2 (op_10)
+    FUSED_PARALLEL = 10,  // z1 * z2 / (z1 + z2) (op_11)
+    FUSED_OP_COUNT = 11,
+    FUSED_NONE = 11       // Нет ядра: вектор кандидата вычисляется отдельно
+};
+
+// Результат операций деления при нулевом делителе (big в main.cpp)
+constexpr float FUSED_BIG = 1000000000000000000.f;
+
+/**
+ * Значение операции для одного элемента
+ *
+ * Деление на ноль (в том числе -0) даёт FUSED_BIG, а не inf/NaN;
+ * векторные версии выбирают FUSED_BIG маской после деления, поэтому
+ * совпадают со скалярной побитово (NaN на входе даёт NaN, как и здесь).
+ */
+template <int Kind>
+inline float fused_op_scalar(float a, float b) {
+    switch (Kind) {
+        case FUSED_ADD:      return a + b;
+        case FUSED_SUB:      return a - b;
+        case FUSED_RSUB:     return b - a;
+        case FUSED_DIV:      return (b != 0.0f) ? a / b : FUSED_BIG;
+        case FUSED_RDIV:     return (a != 0.0f) ? b / a : FUSED_BIG;
+        case FUSED_SQ2_ADD:  return b * b + a;
+        case FUSED_SQ1_ADD:  return a * a + b;
+        case FUSED_SQ2_SUB:  return b * b - a;
+        case FUSED_SQ1_SUB:  return a * a - b;
+        case FUSED_PARALLEL: return (a + b != 0.0f) ? a * b / (a + b) : FUSED_BIG;
+        default:             return a * b;
+    }
+}
+
+// Имя операции для конфигурации ("ops")
+inline const char* fusedOpName(FusedOp kind) {
+    switch (kind) {
+        case FUSED_ADD:      return "add";
+        case FUSED_SUB:      return "sub";
+        case FUSED_RSUB:     return "rsub";
+        case FUSED_MUL:      return "mul";
+        case FUSED_DIV:      return "div";
+        case FUSED_RDIV:     return "rdiv";
+        case FUSED_SQ2_ADD:  return "sq2_add";
+        case FUSED_SQ1_ADD:  return "sq1_add";
+        case FUSED_SQ2_SUB:  return "sq2_sub";
+        case FUSED_SQ1_SUB:  return "sq1_sub";
+        case FUSED_PARALLEL: return "parallel";
+        default:             return "none";
+    }
+}
+
+/**
+ * Разбор имени операции
+ *
+ * @return false, если имя неизвестно
+ */
+inline bool parseFusedOp(const std::string& name, FusedOp& kind) {
+    for (int k = 0; k < FUSED_OP_COUNT; k++) {
+        if (name == fusedOpName(static_cast<FusedOp>(k))) {
+            kind = static_cast<FusedOp>(k);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Относительная стоимость слитного ядра ошибки операции (сумма = 1)
+ *
+ * Измерено на ядрах SSE4.1, AVX2 и AVX-512 (вектор из 4096 значений в L1):
+ * ядра op_1..op_4 упираются в загрузки, квадраты добавляют одно умножение,
+ * деление ограничено пропускной способностью делителя. Используется для
+ * порядка перебора операций (дешёвые первыми - дорогие проверяются уже
+ * с найденной границей и обычно прерываются после первого блока) и для
+ * оценки стоимости набора операций из конфигурации.
+ */
+inline float fusedOpCost(FusedOp kind) {
+    switch (kind) {
+        case FUSED_DIV:
+        case FUSED_RDIV:     return 2.0f;
+        case FUSED_SQ2_ADD:
+        case FUSED_SQ1_ADD:
+        case FUSED_SQ2_SUB:
+        case FUSED_SQ1_SUB:  return 1.1f;
+        case FUSED_PARALLEL: return 2.5f;
+        default:             return 1.0f;
+    }
+}
+
 // ============================================================================
 // Скалярные версии операций (базовые, без оптимизаций)
 // ============================================================================
@@ -75,287 +313,878 @@ inline void op_mul_scalar(float* r, const float* z1, const float* z2, const int
 }
 
 // ============================================================================
-// AVX версии операций (256-bit, 8 float за итерацию)
+// Операнды-скаляры
+//
+// Базисные нейроны постоянны для всех образов, поэтому их значения
+// передаются в ядра одним числом (S1/S2 - z1/z2 указывают на одно значение),
+// а не вектором из Images одинаковых значений: ядро держит значение в
+// регистре и читает из памяти только второй операнд.
+// ============================================================================
+
+// Операнд ядра: p[i] или (Scalar) одно значение *p для всех элементов
+template <bool Scalar>
+inline float operand_scalar(const float* p, int i) {
+    return Scalar ? *p : p[i];
+}
+
+template <int Kind, bool S1 = false, bool S2 = false>
+inline void op_apply_scalar(float* r, const float* z1, const float* z2, const int size) {
+    if (S1 || S2) {
+        for (int i = 0; i < size; i++) {
+            r[i] = fused_op_scalar<Kind>(operand_scalar<S1>(z1, i), operand_scalar<S2>(z2, i));
+        }
+        return;
+    }
+    switch (Kind) {
+        case FUSED_ADD:  op_add_scalar(r, z1, z2, size); break;
+        case FUSED_SUB:  op_sub_scalar(r, z1, z2, size); break;
+        case FUSED_RSUB: op_rsub_scalar(r, z1, z2, size); break;
+        case FUSED_MUL:  op_mul_scalar(r, z1, z2, size); break;
+        default:
+            for (int i = 0; i < size; i++) {
+                r[i] = fused_op_scalar<Kind>(z1[i], z2[i]);
+            }
+            break;
+    }
+}
+
+// ============================================================================
+// Слитные ядра "операция + ошибка"
+//
+// Циклы поиска оценивают кандидата как sum((t - op(z1, z2))^2) и прекращают
+// суммирование, как только сумма достигла границы (лучшей ошибки). Слитные
+// ядра вычисляют операцию, разность и квадрат в регистрах, не записывая
+// вектор кандидата, а границу проверяют раз в FUSED_CHECK_BLOCK значений:
+// поэлементная проверка мешает векторизации.
+//
+// Сумма возвращается полностью, если она меньше границы; иначе - частичная
+// сумма, которая уже не меньше границы (слагаемые неотрицательны, поэтому
+// частичные суммы не превышают полную и кандидат отбрасывается так же).
+// Скалярная версия суммирует в исходном порядке с поэлементной проверкой;
+// векторные уровни суммируют по дорожкам, поэтому их результаты могут
+// отличаться от скалярного и друг от друга в последних битах.
+//
+// С весами образов (параметр шаблона W, массив w) слагаемое образа i -
+// (w[i] * d) * d: одинаковые образы обучающего набора сведены в один с
+// весом-количеством. Без весов ядра те же, что и до их появления.
 // ============================================================================
 
-#ifdef SIMD_AVX_ENABLED
+// Интервал проверки границы в векторных ядрах (значений)
+const int FUSED_CHECK_BLOCK = 128;
+
+// Слагаемое ошибки: d * d или (W) (w[i] * d) * d
+template <bool W>
+inline float weighted_square(float d, const float* w, int i) {
+    return W ? (w[i] * d) * d : d * d;
+}
 
 /**
- * AVX сумма векторов: r[i] = z1[i] + z2[i]
- * Обрабатывает 8 элементов за итерацию
+ * Скалярная ошибка: sum + sum((t[i] - op(z1[i], z2[i]))^2)
+ * с поэлементной проверкой sum < bound
  */
-inline void op_add_avx(float* r, const float* z1, const float* z2, const int size) {
-    int i = 0;
+template <int Kind, bool S1 = false, bool S2 = false, bool W = false>
+inline float op_error_scalar(const float* z1, const float* z2, const float* t, const float* w, const int size,
+                             float sum, const float bound) {
+    for (int i = 0; i < size && sum < bound; i++) {
+        float d = t[i] - fused_op_scalar<Kind>(operand_scalar<S1>(z1, i), operand_scalar<S2>(z2, i));
+        sum += weighted_square<W>(d, w, i);
+    }
+    return sum;
+}
 
-    // Обработка по 8 элементов (256 бит)
-    for (; i <= size - 8; i += 8) {
-        __m256 v1 = _mm256_loadu_ps(z1 + i);
-        __m256 v2 = _mm256_loadu_ps(z2 + i);
-        __m256 result = _mm256_add_ps(v1, v2);
-        _mm256_storeu_ps(r + i, result);
+// ============================================================================
+// Блочное ядро тройки нейронов
+//
+// Поиск тройки оценивает C = opC(A, opB(Bi, Bj)) для всех сочетаний операций
+// B и C. Ядро читает A, Bi, Bj и t один раз и считает ошибки всех
+// TRIPLET_COMBOS сочетаний в регистрах: за проход по данным обрабатываются
+// две операции B (8 сумм), пока блок из FUSED_CHECK_BLOCK значений в L1.
+// После каждого блока операции B, у которых все суммы достигли границы,
+// отбрасываются; если отброшены все - ядро завершается.
+//
+// Индекс сочетания: kindB * TRIPLET_OPS + kindC (kind - FusedOp). Скалярная
+// версия суммирует каждое сочетание в исходном порядке (как op_error_scalar).
+// ============================================================================
+
+// Количество операций и сочетаний блочного ядра (op_1..op_4)
+const int TRIPLET_OPS = 4;
+const int TRIPLET_COMBOS = TRIPLET_OPS * TRIPLET_OPS;
+
+/**
+ * Скалярные ошибки сочетаний для значений [from, to)
+ */
+template <bool W>
+inline void triplet_errors_scalar(const float* a, const float* bi, const float* bj, const float* t, const float* w,
+                                  const int from, const int to, const bool* alive, float* errors) {
+    for (int kb = 0; kb < TRIPLET_OPS; kb++) {
+        if (!alive[kb]) continue;
+        float* e = errors + kb * TRIPLET_OPS;
+        for (int i = from; i < to; i++) {
+            float b;
+            switch (kb) {
+                case FUSED_ADD:  b = fused_op_scalar<FUSED_ADD>(bi[i], bj[i]); break;
+                case FUSED_SUB:  b = fused_op_scalar<FUSED_SUB>(bi[i], bj[i]); break;
+                case FUSED_RSUB: b = fused_op_scalar<FUSED_RSUB>(bi[i], bj[i]); break;
+                default:         b = fused_op_scalar<FUSED_MUL>(bi[i], bj[i]); break;
+            }
+            float d0 = t[i] - fused_op_scalar<FUSED_ADD>(a[i], b);
+            float d1 = t[i] - fused_op_scalar<FUSED_SUB>(a[i], b);
+            float d2 = t[i] - fused_op_scalar<FUSED_RSUB>(a[i], b);
+            float d3 = t[i] - fused_op_scalar<FUSED_MUL>(a[i], b);
+            e[0] += weighted_square<W>(d0, w, i);
+            e[1] += weighted_square<W>(d1, w, i);
+            e[2] += weighted_square<W>(d2, w, i);
+            e[3] += weighted_square<W>(d3, w, i);
+        }
     }
+}
 
-    // Обработка оставшихся элементов скалярно
-    for (; i < size; i++) {
-        r[i] = z1[i] + z2[i];
+// Отбрасывание операций B, все суммы которых достигли границы
+inline bool triplet_prune(const float* errors, const float bound, bool* alive) {
+    bool any = false;
+    for (int kb = 0; kb < TRIPLET_OPS; kb++) {
+        if (!alive[kb]) continue;
+        alive[kb] = false;
+        for (int kc = 0; kc < TRIPLET_OPS; kc++) {
+            if (errors[kb * TRIPLET_OPS + kc] < bound) alive[kb] = true;
+        }
+        any = any || alive[kb];
+    }
+    return any;
+}
+
+template <bool W = false>
+inline void op_triplet_errors_scalar(const float* a, const float* bi, const float* bj, const float* t, const float* w,
+                                     const int size, const float bound, float* errors) {
+    bool alive[TRIPLET_OPS] = { true, true, true, true };
+    for (int k = 0; k < TRIPLET_COMBOS; k++) errors[k] = 0.0f;
+    for (int i = 0; i < size; i += FUSED_CHECK_BLOCK) {
+        triplet_errors_scalar<W>(a, bi, bj, t, w, i, std::min(size, i + FUSED_CHECK_BLOCK), alive, errors);
+        if (!triplet_prune(errors, bound, alive)) break;
+    }
+}
+
+#ifdef SIMD_X86
+
+// ============================================================================
+// SSE4.1 (128-bit, 4 float за итерацию)
+// ============================================================================
+
+// q там, где divisor != 0, иначе FUSED_BIG (без ветвлений)
+SIMD_TARGET_SSE41 inline __m128 guard_divisor_sse41(__m128 q, __m128 divisor) {
+    return _mm_blendv_ps(q, _mm_set1_ps(FUSED_BIG), _mm_cmpeq_ps(divisor, _mm_setzero_ps()));
+}
+
+template <int Kind>
+SIMD_TARGET_SSE41 inline __m128 fused_op_sse41(__m128 a, __m128 b) {
+    switch (Kind) {
+        case FUSED_ADD:      return _mm_add_ps(a, b);
+        case FUSED_SUB:      return _mm_sub_ps(a, b);
+        case FUSED_RSUB:     return _mm_sub_ps(b, a);
+        case FUSED_DIV:      return guard_divisor_sse41(_mm_div_ps(a, b), b);
+        case FUSED_RDIV:     return guard_divisor_sse41(_mm_div_ps(b, a), a);
+        case FUSED_SQ2_ADD:  return _mm_add_ps(_mm_mul_ps(b, b), a);
+        case FUSED_SQ1_ADD:  return _mm_add_ps(_mm_mul_ps(a, a), b);
+        case FUSED_SQ2_SUB:  return _mm_sub_ps(_mm_mul_ps(b, b), a);
+        case FUSED_SQ1_SUB:  return _mm_sub_ps(_mm_mul_ps(a, a), b);
+        case FUSED_PARALLEL: {
+            const __m128 s = _mm_add_ps(a, b);
+            return guard_divisor_sse41(_mm_div_ps(_mm_mul_ps(a, b), s), s);
+        }
+        default:             return _mm_mul_ps(a, b);
     }
 }
 
+// Горизонтальная сумма 4 значений
+SIMD_TARGET_SSE41 inline float hsum_sse41(__m128 s) {
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+// Операнд ядра: вектор p + i или (Scalar) значение value во всех элементах
+template <bool Scalar>
+SIMD_TARGET_SSE41 inline __m128 operand_sse41(const float* p, int i, __m128 value) {
+    return Scalar ? value : _mm_loadu_ps(p + i);
+}
+
+// Веса образов w + i (без весов не читаются)
+template <bool W>
+SIMD_TARGET_SSE41 inline __m128 weight_sse41(const float* w, int i) {
+    return W ? _mm_loadu_ps(w + i) : _mm_setzero_ps();
+}
+
+// acc + d * d или (W) acc + (w * d) * d
+template <bool W>
+SIMD_TARGET_SSE41 inline __m128 square_acc_sse41(__m128 acc, __m128 d, __m128 w) {
+    return _mm_add_ps(acc, _mm_mul_ps(W ? _mm_mul_ps(w, d) : d, d));
+}
+
 /**
- * AVX разность векторов: r[i] = z1[i] - z2[i]
+ * SSE4.1 операция: r[i] = op(z1[i], z2[i]), 4 элемента за итерацию
  */
-inline void op_sub_avx(float* r, const float* z1, const float* z2, const int size) {
+template <int Kind, bool S1 = false, bool S2 = false>
+SIMD_TARGET_SSE41 inline void op_apply_sse41(float* r, const float* z1, const float* z2, const int size) {
+    const __m128 s1 = _mm_set1_ps(S1 ? *z1 : 0.0f);
+    const __m128 s2 = _mm_set1_ps(S2 ? *z2 : 0.0f);
     int i = 0;
-
-    for (; i <= size - 8; i += 8) {
-        __m256 v1 = _mm256_loadu_ps(z1 + i);
-        __m256 v2 = _mm256_loadu_ps(z2 + i);
-        __m256 result = _mm256_sub_ps(v1, v2);
-        _mm256_storeu_ps(r + i, result);
+    for (; i <= size - 4; i += 4) {
+        _mm_storeu_ps(r + i, fused_op_sse41<Kind>(operand_sse41<S1>(z1, i, s1), operand_sse41<S2>(z2, i, s2)));
     }
-
     for (; i < size; i++) {
-        r[i] = z1[i] - z2[i];
+        r[i] = fused_op_scalar<Kind>(operand_scalar<S1>(z1, i), operand_scalar<S2>(z2, i));
     }
 }
 
 /**
- * AVX обратная разность векторов: r[i] = z2[i] - z1[i]
+ * SSE4.1 ошибка: 8 значений за итерацию в двух независимых суммах,
+ * проверка границы раз в FUSED_CHECK_BLOCK значений
  */
-inline void op_rsub_avx(float* r, const float* z1, const float* z2, const int size) {
+template <int Kind, bool S1 = false, bool S2 = false, bool W = false>
+SIMD_TARGET_SSE41 inline float op_error_sse41(const float* z1, const float* z2, const float* t, const float* w,
+                                              const int size, const float sum, const float bound) {
+    const __m128 s1 = _mm_set1_ps(S1 ? *z1 : 0.0f);
+    const __m128 s2 = _mm_set1_ps(S2 ? *z2 : 0.0f);
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
     int i = 0;
 
-    for (; i <= size - 8; i += 8) {
-        __m256 v1 = _mm256_loadu_ps(z1 + i);
-        __m256 v2 = _mm256_loadu_ps(z2 + i);
-        __m256 result = _mm256_sub_ps(v2, v1);
-        _mm256_storeu_ps(r + i, result);
+    while (i <= size - 8) {
+        const int stop = std::min(size - 8, i + FUSED_CHECK_BLOCK - 8);
+        for (; i <= stop; i += 8) {
+            __m128 d0 = _mm_sub_ps(_mm_loadu_ps(t + i),
+                                   fused_op_sse41<Kind>(operand_sse41<S1>(z1, i, s1), operand_sse41<S2>(z2, i, s2)));
+            __m128 d1 = _mm_sub_ps(_mm_loadu_ps(t + i + 4),
+                                   fused_op_sse41<Kind>(operand_sse41<S1>(z1, i + 4, s1), operand_sse41<S2>(z2, i + 4, s2)));
+            acc0 = square_acc_sse41<W>(acc0, d0, weight_sse41<W>(w, i));
+            acc1 = square_acc_sse41<W>(acc1, d1, weight_sse41<W>(w, i + 4));
+        }
+        const float partial = sum + hsum_sse41(_mm_add_ps(acc0, acc1));
+        if (!(partial < bound)) return partial;
+    }
+    if (i <= size - 4) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(t + i),
+                              fused_op_sse41<Kind>(operand_sse41<S1>(z1, i, s1), operand_sse41<S2>(z2, i, s2)));
+        acc0 = square_acc_sse41<W>(acc0, d, weight_sse41<W>(w, i));
+        i += 4;
     }
 
+    float total = sum + hsum_sse41(_mm_add_ps(acc0, acc1));
     for (; i < size; i++) {
-        r[i] = z2[i] - z1[i];
+        float d = t[i] - fused_op_scalar<Kind>(operand_scalar<S1>(z1, i), operand_scalar<S2>(z2, i));
+        total += weighted_square<W>(d, w, i);
     }
+    return total;
 }
 
 /**
- * AVX произведение векторов: r[i] = z1[i] * z2[i]
+ * SSE4.1: 8 сумм для двух операций B на значениях [from, to), to - from кратно 4
  */
-inline void op_mul_avx(float* r, const float* z1, const float* z2, const int size) {
-    int i = 0;
-
-    for (; i <= size - 8; i += 8) {
-        __m256 v1 = _mm256_loadu_ps(z1 + i);
-        __m256 v2 = _mm256_loadu_ps(z2 + i);
-        __m256 result = _mm256_mul_ps(v1, v2);
-        _mm256_storeu_ps(r + i, result);
+template <int KB0, int KB1, bool W>
+SIMD_TARGET_SSE41 inline void triplet_pair_sse41(const float* a, const float* bi, const float* bj, const float* t,
+                                                 const float* w, const int from, const int to, __m128* acc) {
+    __m128 s0 = acc[0], s1 = acc[1], s2 = acc[2], s3 = acc[3];
+    __m128 s4 = acc[4], s5 = acc[5], s6 = acc[6], s7 = acc[7];
+    for (int i = from; i < to; i += 4) {
+        const __m128 va = _mm_loadu_ps(a + i);
+        const __m128 vi = _mm_loadu_ps(bi + i);
+        const __m128 vj = _mm_loadu_ps(bj + i);
+        const __m128 vt = _mm_loadu_ps(t + i);
+        const __m128 vw = weight_sse41<W>(w, i);
+        const __m128 b0 = fused_op_sse41<KB0>(vi, vj);
+        const __m128 b1 = fused_op_sse41<KB1>(vi, vj);
+        s0 = square_acc_sse41<W>(s0, _mm_sub_ps(vt, fused_op_sse41<FUSED_ADD>(va, b0)), vw);
+        s1 = square_acc_sse41<W>(s1, _mm_sub_ps(vt, fused_op_sse41<FUSED_SUB>(va, b0)), vw);
+        s2 = square_acc_sse41<W>(s2, _mm_sub_ps(vt, fused_op_sse41<FUSED_RSUB>(va, b0)), vw);
+        s3 = square_acc_sse41<W>(s3, _mm_sub_ps(vt, fused_op_sse41<FUSED_MUL>(va, b0)), vw);
+        s4 = square_acc_sse41<W>(s4, _mm_sub_ps(vt, fused_op_sse41<FUSED_ADD>(va, b1)), vw);
+        s5 = square_acc_sse41<W>(s5, _mm_sub_ps(vt, fused_op_sse41<FUSED_SUB>(va, b1)), vw);
+        s6 = square_acc_sse41<W>(s6, _mm_sub_ps(vt, fused_op_sse41<FUSED_RSUB>(va, b1)), vw);
+        s7 = square_acc_sse41<W>(s7, _mm_sub_ps(vt, fused_op_sse41<FUSED_MUL>(va, b1)), vw);
     }
+    acc[0] = s0; acc[1] = s1; acc[2] = s2; acc[3] = s3;
+    acc[4] = s4; acc[5] = s5; acc[6] = s6; acc[7] = s7;
+}
 
-    for (; i < size; i++) {
-        r[i] = z1[i] * z2[i];
+template <bool W = false>
+SIMD_TARGET_SSE41 inline void op_triplet_errors_sse41(const float* a, const float* bi, const float* bj, const float* t,
+                                                      const float* w, const int size, const float bound, float* errors) {
+    __m128 acc[TRIPLET_COMBOS];
+    for (int k = 0; k < TRIPLET_COMBOS; k++) acc[k] = _mm_setzero_ps();
+    bool alive[TRIPLET_OPS] = { true, true, true, true };
+    bool any = true;
+
+    const int vectorEnd = size - size % 4;
+    int i = 0;
+    while (i < vectorEnd && any) {
+        const int stop = std::min(vectorEnd, i + FUSED_CHECK_BLOCK);
+        if (alive[FUSED_ADD] || alive[FUSED_SUB]) {
+            triplet_pair_sse41<FUSED_ADD, FUSED_SUB, W>(a, bi, bj, t, w, i, stop, acc);
+        }
+        if (alive[FUSED_RSUB] || alive[FUSED_MUL]) {
+            triplet_pair_sse41<FUSED_RSUB, FUSED_MUL, W>(a, bi, bj, t, w, i, stop, acc + 2 * TRIPLET_OPS);
+        }
+        i = stop;
+        for (int k = 0; k < TRIPLET_COMBOS; k++) errors[k] = hsum_sse41(acc[k]);
+        any = triplet_prune(errors, bound, alive);
+    }
+    if (i == 0) {
+        for (int k = 0; k < TRIPLET_COMBOS; k++) errors[k] = 0.0f;
     }
+    if (any) triplet_errors_scalar<W>(a, bi, bj, t, w, i, size, alive, errors);
 }
 
-#endif // SIMD_AVX_ENABLED
-
 // ============================================================================
-// SSE версии операций (128-bit, 4 float за итерацию)
+// AVX2 + FMA (256-bit, 8 float за итерацию)
 // ============================================================================
 
-#ifdef SIMD_SSE_ENABLED
+// q там, где divisor != 0, иначе FUSED_BIG (без ветвлений)
+SIMD_TARGET_AVX2 inline __m256 guard_divisor_avx2(__m256 q, __m256 divisor) {
+    return _mm256_blendv_ps(q, _mm256_set1_ps(FUSED_BIG), _mm256_cmp_ps(divisor, _mm256_setzero_ps(), _CMP_EQ_OQ));
+}
+
+// Операции с квадратом - отдельными умножением и сложением (без FMA),
+// чтобы результат совпадал со скалярным
+template <int Kind>
+SIMD_TARGET_AVX2 inline __m256 fused_op_avx2(__m256 a, __m256 b) {
+    switch (Kind) {
+        case FUSED_ADD:      return _mm256_add_ps(a, b);
+        case FUSED_SUB:      return _mm256_sub_ps(a, b);
+        case FUSED_RSUB:     return _mm256_sub_ps(b, a);
+        case FUSED_DIV:      return guard_divisor_avx2(_mm256_div_ps(a, b), b);
+        case FUSED_RDIV:     return guard_divisor_avx2(_mm256_div_ps(b, a), a);
+        case FUSED_SQ2_ADD:  return _mm256_add_ps(_mm256_mul_ps(b, b), a);
+        case FUSED_SQ1_ADD:  return _mm256_add_ps(_mm256_mul_ps(a, a), b);
+        case FUSED_SQ2_SUB:  return _mm256_sub_ps(_mm256_mul_ps(b, b), a);
+        case FUSED_SQ1_SUB:  return _mm256_sub_ps(_mm256_mul_ps(a, a), b);
+        case FUSED_PARALLEL: {
+            const __m256 s = _mm256_add_ps(a, b);
+            return guard_divisor_avx2(_mm256_div_ps(_mm256_mul_ps(a, b), s), s);
+        }
+        default:             return _mm256_mul_ps(a, b);
+    }
+}
+
+// acc + d * d или (W) acc + (w * d) * d
+template <bool W>
+SIMD_TARGET_AVX2 inline __m256 square_acc_avx2(__m256 acc, __m256 d, __m256 w) {
+    return _mm256_fmadd_ps(W ? _mm256_mul_ps(w, d) : d, d, acc);
+}
+
+// Веса образов w + i (без весов не читаются)
+template <bool W>
+SIMD_TARGET_AVX2 inline __m256 weight_avx2(const float* w, int i) {
+    return W ? _mm256_loadu_ps(w + i) : _mm256_setzero_ps();
+}
+
+// Горизонтальная сумма 8 значений
+SIMD_TARGET_AVX2 inline float hsum_avx2(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+// Операнд ядра: вектор p + i или (Scalar) значение value во всех элементах
+template <bool Scalar>
+SIMD_TARGET_AVX2 inline __m256 operand_avx2(const float* p, int i, __m256 value) {
+    return Scalar ? value : _mm256_loadu_ps(p + i);
+}
 
 /**
- * SSE сумма векторов: r[i] = z1[i] + z2[i]
- * Обрабатывает 4 элемента за итерацию
+ * AVX2 операция: r[i] = op(z1[i], z2[i]), 8 элементов за итерацию
  */
-inline void op_add_sse(float* r, const float* z1, const float* z2, const int size) {
+template <int Kind, bool S1 = false, bool S2 = false>
+SIMD_TARGET_AVX2 inline void op_apply_avx2(float* r, const float* z1, const float* z2, const int size) {
+    const __m256 s1 = _mm256_set1_ps(S1 ? *z1 : 0.0f);
+    const __m256 s2 = _mm256_set1_ps(S2 ? *z2 : 0.0f);
     int i = 0;
-
-    // Обработка по 4 элемента (128 бит)
-    for (; i <= size - 4; i += 4) {
-        __m128 v1 = _mm_loadu_ps(z1 + i);
-        __m128 v2 = _mm_loadu_ps(z2 + i);
-        __m128 result = _mm_add_ps(v1, v2);
-        _mm_storeu_ps(r + i, result);
+    for (; i <= size - 8; i += 8) {
+        _mm256_storeu_ps(r + i, fused_op_avx2<Kind>(operand_avx2<S1>(z1, i, s1), operand_avx2<S2>(z2, i, s2)));
     }
-
-    // Обработка оставшихся элементов
     for (; i < size; i++) {
-        r[i] = z1[i] + z2[i];
+        r[i] = fused_op_scalar<Kind>(operand_scalar<S1>(z1, i), operand_scalar<S2>(z2, i));
     }
 }
 
 /**
- * SSE разность векторов: r[i] = z1[i] - z2[i]
+ * AVX2 ошибка: 16 значений за итерацию в двух независимых суммах,
+ * проверка границы раз в FUSED_CHECK_BLOCK значений
  */
-inline void op_sub_sse(float* r, const float* z1, const float* z2, const int size) {
+template <int Kind, bool S1 = false, bool S2 = false, bool W = false>
+SIMD_TARGET_AVX2 inline float op_error_avx2(const float* z1, const float* z2, const float* t, const float* w,
+                                            const int size, const float sum, const float bound) {
+    const __m256 s1 = _mm256_set1_ps(S1 ? *z1 : 0.0f);
+    const __m256 s2 = _mm256_set1_ps(S2 ? *z2 : 0.0f);
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
     int i = 0;
 
-    for (; i <= size - 4; i += 4) {
-        __m128 v1 = _mm_loadu_ps(z1 + i);
-        __m128 v2 = _mm_loadu_ps(z2 + i);
-        __m128 result = _mm_sub_ps(v1, v2);
-        _mm_storeu_ps(r + i, result);
+    while (i <= size - 16) {
+        const int stop = std::min(size - 16, i + FUSED_CHECK_BLOCK - 16);
+        for (; i <= stop; i += 16) {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(t + i),
+                                      fused_op_avx2<Kind>(operand_avx2<S1>(z1, i, s1), operand_avx2<S2>(z2, i, s2)));
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(t + i + 8),
+                                      fused_op_avx2<Kind>(operand_avx2<S1>(z1, i + 8, s1), operand_avx2<S2>(z2, i + 8, s2)));
+            acc0 = square_acc_avx2<W>(acc0, d0, weight_avx2<W>(w, i));
+            acc1 = square_acc_avx2<W>(acc1, d1, weight_avx2<W>(w, i + 8));
+        }
+        const float partial = sum + hsum_avx2(_mm256_add_ps(acc0, acc1));
+        if (!(partial < bound)) return partial;
+    }
+    if (i <= size - 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(t + i),
+                                 fused_op_avx2<Kind>(operand_avx2<S1>(z1, i, s1), operand_avx2<S2>(z2, i, s2)));
+        acc0 = square_acc_avx2<W>(acc0, d, weight_avx2<W>(w, i));
+        i += 8;
     }
 
+    float total = sum + hsum_avx2(_mm256_add_ps(acc0, acc1));
     for (; i < size; i++) {
-        r[i] = z1[i] - z2[i];
+        float d = t[i] - fused_op_scalar<Kind>(operand_scalar<S1>(z1, i), operand_scalar<S2>(z2, i));
+        total += weighted_square<W>(d, w, i);
     }
+    return total;
 }
 
 /**
- * SSE обратная разность векторов: r[i] = z2[i] - z1[i]
+ * AVX2: 8 сумм для двух операций B на значениях [from, to), to - from кратно 8
  */
-inline void op_rsub_sse(float* r, const float* z1, const float* z2, const int size) {
+template <int KB0, int KB1, bool W>
+SIMD_TARGET_AVX2 inline void triplet_pair_avx2(const float* a, const float* bi, const float* bj, const float* t,
+                                               const float* w, const int from, const int to, __m256* acc) {
+    __m256 s0 = acc[0], s1 = acc[1], s2 = acc[2], s3 = acc[3];
+    __m256 s4 = acc[4], s5 = acc[5], s6 = acc[6], s7 = acc[7];
+    for (int i = from; i < to; i += 8) {
+        const __m256 va = _mm256_loadu_ps(a + i);
+        const __m256 vi = _mm256_loadu_ps(bi + i);
+        const __m256 vj = _mm256_loadu_ps(bj + i);
+        const __m256 vt = _mm256_loadu_ps(t + i);
+        const __m256 vw = weight_avx2<W>(w, i);
+        const __m256 b0 = fused_op_avx2<KB0>(vi, vj);
+        const __m256 b1 = fused_op_avx2<KB1>(vi, vj);
+        s0 = square_acc_avx2<W>(s0, _mm256_sub_ps(vt, fused_op_avx2<FUSED_ADD>(va, b0)), vw);
+        s1 = square_acc_avx2<W>(s1, _mm256_sub_ps(vt, fused_op_avx2<FUSED_SUB>(va, b0)), vw);
+        s2 = square_acc_avx2<W>(s2, _mm256_sub_ps(vt, fused_op_avx2<FUSED_RSUB>(va, b0)), vw);
+        s3 = square_acc_avx2<W>(s3, _mm256_sub_ps(vt, fused_op_avx2<FUSED_MUL>(va, b0)), vw);
+        s4 = square_acc_avx2<W>(s4, _mm256_sub_ps(vt, fused_op_avx2<FUSED_ADD>(va, b1)), vw);
+        s5 = square_acc_avx2<W>(s5, _mm256_sub_ps(vt, fused_op_avx2<FUSED_SUB>(va, b1)), vw);
+        s6 = square_acc_avx2<W>(s6, _mm256_sub_ps(vt, fused_op_avx2<FUSED_RSUB>(va, b1)), vw);
+        s7 = square_acc_avx2<W>(s7, _mm256_sub_ps(vt, fused_op_avx2<FUSED_MUL>(va, b1)), vw);
+    }
+    acc[0] = s0; acc[1] = s1; acc[2] = s2; acc[3] = s3;
+    acc[4] = s4; acc[5] = s5; acc[6] = s6; acc[7] = s7;
+}
+
+template <bool W = false>
+SIMD_TARGET_AVX2 inline void op_triplet_errors_avx2(const float* a, const float* bi, const float* bj, const float* t,
+                                                    const float* w, const int size, const float bound, float* errors) {
+    __m256 acc[TRIPLET_COMBOS];
+    for (int k = 0; k < TRIPLET_COMBOS; k++) acc[k] = _mm256_setzero_ps();
+    bool alive[TRIPLET_OPS] = { true, true, true, true };
+    bool any = true;
+
+    const int vectorEnd = size - size % 8;
     int i = 0;
+    while (i < vectorEnd && any) {
+        const int stop = std::min(vectorEnd, i + FUSED_CHECK_BLOCK);
+        if (alive[FUSED_ADD] || alive[FUSED_SUB]) {
+            triplet_pair_avx2<FUSED_ADD, FUSED_SUB, W>(a, bi, bj, t, w, i, stop, acc);
+        }
+        if (alive[FUSED_RSUB] || alive[FUSED_MUL]) {
+            triplet_pair_avx2<FUSED_RSUB, FUSED_MUL, W>(a, bi, bj, t, w, i, stop, acc + 2 * TRIPLET_OPS);
+        }
+        i = stop;
+        for (int k = 0; k < TRIPLET_COMBOS; k++) errors[k] = hsum_avx2(acc[k]);
+        any = triplet_prune(errors, bound, alive);
+    }
+    if (i == 0) {
+        for (int k = 0; k < TRIPLET_COMBOS; k++) errors[k] = 0.0f;
+    }
+    if (any) triplet_errors_scalar<W>(a, bi, bj, t, w, i, size, alive, errors);
+}
 
-    for (; i <= size - 4; i += 4) {
-        __m128 v1 = _mm_loadu_ps(z1 + i);
-        __m128 v2 = _mm_loadu_ps(z2 + i);
-        __m128 result = _mm_sub_ps(v2, v1);
-        _mm_storeu_ps(r + i, result);
+// ============================================================================
+// AVX-512 (512-bit, 16 float за итерацию)
+// ============================================================================
+
+// q там, где divisor != 0, иначе FUSED_BIG (без ветвлений)
+SIMD_TARGET_AVX512 inline __m512 guard_divisor_avx512(__m512 q, __m512 divisor) {
+    const __mmask16 zero = _mm512_cmp_ps_mask(divisor, _mm512_setzero_ps(), _CMP_EQ_OQ);
+    return _mm512_mask_blend_ps(zero, q, _mm512_set1_ps(FUSED_BIG));
+}
+
+template <int Kind>
+SIMD_TARGET_AVX512 inline __m512 fused_op_avx512(__m512 a, __m512 b) {
+    switch (Kind) {
+        case FUSED_ADD:      return _mm512_add_ps(a, b);
+        case FUSED_SUB:      return _mm512_sub_ps(a, b);
+        case FUSED_RSUB:     return _mm512_sub_ps(b, a);
+        case FUSED_DIV:      return guard_divisor_avx512(_mm512_div_ps(a, b), b);
+        case FUSED_RDIV:     return guard_divisor_avx512(_mm512_div_ps(b, a), a);
+        case FUSED_SQ2_ADD:  return _mm512_add_ps(_mm512_mul_ps(b, b), a);
+        case FUSED_SQ1_ADD:  return _mm512_add_ps(_mm512_mul_ps(a, a), b);
+        case FUSED_SQ2_SUB:  return _mm512_sub_ps(_mm512_mul_ps(b, b), a);
+        case FUSED_SQ1_SUB:  return _mm512_sub_ps(_mm512_mul_ps(a, a), b);
+        case FUSED_PARALLEL: {
+            const __m512 s = _mm512_add_ps(a, b);
+            return guard_divisor_avx512(_mm512_div_ps(_mm512_mul_ps(a, b), s), s);
+        }
+        default:             return _mm512_mul_ps(a, b);
     }
+}
 
-    for (; i < size; i++) {
-        r[i] = z2[i] - z1[i];
+// Горизонтальная сумма 16 значений
+SIMD_TARGET_AVX512 inline float hsum_avx512(__m512 v) {
+    // Половины читаются через память: извлечение 256 бит в GCC 12 даёт
+    // ложное -Wmaybe-uninitialized (сумма нужна только раз в блок)
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, v);
+    return hsum_avx2(_mm256_add_ps(_mm256_load_ps(lanes), _mm256_load_ps(lanes + 8)));
+}
+
+// Операнд ядра: вектор p + i или (Scalar) значение value во всех элементах
+template <bool Scalar>
+SIMD_TARGET_AVX512 inline __m512 operand_avx512(const float* p, int i, __m512 value) {
+    return Scalar ? value : _mm512_loadu_ps(p + i);
+}
+
+// Веса образов w + i (без весов не читаются)
+template <bool W>
+SIMD_TARGET_AVX512 inline __m512 weight_avx512(const float* w, int i) {
+    return W ? _mm512_loadu_ps(w + i) : _mm512_setzero_ps();
+}
+
+// acc + d * d или (W) acc + (w * d) * d
+template <bool W>
+SIMD_TARGET_AVX512 inline __m512 square_acc_avx512(__m512 acc, __m512 d, __m512 w) {
+    return _mm512_fmadd_ps(W ? _mm512_mul_ps(w, d) : d, d, acc);
+}
+
+/**
+ * AVX-512 операция: r[i] = op(z1[i], z2[i]), 16 элементов за итерацию;
+ * остаток обрабатывается одной итерацией с маской
+ */
+template <int Kind, bool S1 = false, bool S2 = false>
+SIMD_TARGET_AVX512 inline void op_apply_avx512(float* r, const float* z1, const float* z2, const int size) {
+    const __m512 s1 = _mm512_set1_ps(S1 ? *z1 : 0.0f);
+    const __m512 s2 = _mm512_set1_ps(S2 ? *z2 : 0.0f);
+    int i = 0;
+    for (; i <= size - 16; i += 16) {
+        _mm512_storeu_ps(r + i, fused_op_avx512<Kind>(operand_avx512<S1>(z1, i, s1), operand_avx512<S2>(z2, i, s2)));
+    }
+    if (i < size) {
+        const __mmask16 mask = static_cast<__mmask16>((1u << (size - i)) - 1);
+        _mm512_mask_storeu_ps(r + i, mask, fused_op_avx512<Kind>((S1 ? s1 : _mm512_maskz_loadu_ps(mask, z1 + i)),
+                                                                 (S2 ? s2 : _mm512_maskz_loadu_ps(mask, z2 + i))));
     }
 }
 
 /**
- * SSE произведение векторов: r[i] = z1[i] * z2[i]
+ * AVX-512 ошибка: 32 значения за итерацию в двух независимых суммах,
+ * проверка границы раз в FUSED_CHECK_BLOCK значений
  */
-inline void op_mul_sse(float* r, const float* z1, const float* z2, const int size) {
+template <int Kind, bool S1 = false, bool S2 = false, bool W = false>
+SIMD_TARGET_AVX512 inline float op_error_avx512(const float* z1, const float* z2, const float* t, const float* w,
+                                                const int size, const float sum, const float bound) {
+    const __m512 s1 = _mm512_set1_ps(S1 ? *z1 : 0.0f);
+    const __m512 s2 = _mm512_set1_ps(S2 ? *z2 : 0.0f);
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
     int i = 0;
 
-    for (; i <= size - 4; i += 4) {
-        __m128 v1 = _mm_loadu_ps(z1 + i);
-        __m128 v2 = _mm_loadu_ps(z2 + i);
-        __m128 result = _mm_mul_ps(v1, v2);
-        _mm_storeu_ps(r + i, result);
+    while (i <= size - 32) {
+        const int stop = std::min(size - 32, i + FUSED_CHECK_BLOCK - 32);
+        for (; i <= stop; i += 32) {
+            __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(t + i),
+                                      fused_op_avx512<Kind>(operand_avx512<S1>(z1, i, s1), operand_avx512<S2>(z2, i, s2)));
+            __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(t + i + 16),
+                                      fused_op_avx512<Kind>(operand_avx512<S1>(z1, i + 16, s1), operand_avx512<S2>(z2, i + 16, s2)));
+            acc0 = square_acc_avx512<W>(acc0, d0, weight_avx512<W>(w, i));
+            acc1 = square_acc_avx512<W>(acc1, d1, weight_avx512<W>(w, i + 16));
+        }
+        const float partial = sum + hsum_avx512(_mm512_add_ps(acc0, acc1));
+        if (!(partial < bound)) return partial;
+    }
+    if (i <= size - 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(t + i),
+                                 fused_op_avx512<Kind>(operand_avx512<S1>(z1, i, s1), operand_avx512<S2>(z2, i, s2)));
+        acc0 = square_acc_avx512<W>(acc0, d, weight_avx512<W>(w, i));
+        i += 16;
     }
 
+    float total = sum + hsum_avx512(_mm512_add_ps(acc0, acc1));
     for (; i < size; i++) {
-        r[i] = z1[i] * z2[i];
+        float d = t[i] - fused_op_scalar<Kind>(operand_scalar<S1>(z1, i), operand_scalar<S2>(z2, i));
+        total += weighted_square<W>(d, w, i);
+    }
+    return total;
+}
+
+/**
+ * AVX-512: 8 сумм для двух операций B на значениях [from, to), to - from кратно 16
+ */
+template <int KB0, int KB1, bool W>
+SIMD_TARGET_AVX512 inline void triplet_pair_avx512(const float* a, const float* bi, const float* bj, const float* t,
+                                                   const float* w, const int from, const int to, __m512* acc) {
+    __m512 s0 = acc[0], s1 = acc[1], s2 = acc[2], s3 = acc[3];
+    __m512 s4 = acc[4], s5 = acc[5], s6 = acc[6], s7 = acc[7];
+    for (int i = from; i < to; i += 16) {
+        const __m512 va = _mm512_loadu_ps(a + i);
+        const __m512 vi = _mm512_loadu_ps(bi + i);
+        const __m512 vj = _mm512_loadu_ps(bj + i);
+        const __m512 vt = _mm512_loadu_ps(t + i);
+        const __m512 vw = weight_avx512<W>(w, i);
+        const __m512 b0 = fused_op_avx512<KB0>(vi, vj);
+        const __m512 b1 = fused_op_avx512<KB1>(vi, vj);
+        s0 = square_acc_avx512<W>(s0, _mm512_sub_ps(vt, fused_op_avx512<FUSED_ADD>(va, b0)), vw);
+        s1 = square_acc_avx512<W>(s1, _mm512_sub_ps(vt, fused_op_avx512<FUSED_SUB>(va, b0)), vw);
+        s2 = square_acc_avx512<W>(s2, _mm512_sub_ps(vt, fused_op_avx512<FUSED_RSUB>(va, b0)), vw);
+        s3 = square_acc_avx512<W>(s3, _mm512_sub_ps(vt, fused_op_avx512<FUSED_MUL>(va, b0)), vw);
+        s4 = square_acc_avx512<W>(s4, _mm512_sub_ps(vt, fused_op_avx512<FUSED_ADD>(va, b1)), vw);
+        s5 = square_acc_avx512<W>(s5, _mm512_sub_ps(vt, fused_op_avx512<FUSED_SUB>(va, b1)), vw);
+        s6 = square_acc_avx512<W>(s6, _mm512_sub_ps(vt, fused_op_avx512<FUSED_RSUB>(va, b1)), vw);
+        s7 = square_acc_avx512<W>(s7, _mm512_sub_ps(vt, fused_op_avx512<FUSED_MUL>(va, b1)), vw);
+    }
+    acc[0] = s0; acc[1] = s1; acc[2] = s2; acc[3] = s3;
+    acc[4] = s4; acc[5] = s5; acc[6] = s6; acc[7] = s7;
+}
+
+template <bool W = false>
+SIMD_TARGET_AVX512 inline void op_triplet_errors_avx512(const float* a, const float* bi, const float* bj, const float* t,
+                                                        const float* w, const int size, const float bound, float* errors) {
+    __m512 acc[TRIPLET_COMBOS];
+    for (int k = 0; k < TRIPLET_COMBOS; k++) acc[k] = _mm512_setzero_ps();
+    bool alive[TRIPLET_OPS] = { true, true, true, true };
+    bool any = true;
+
+    const int vectorEnd = size - size % 16;
+    int i = 0;
+    while (i < vectorEnd && any) {
+        const int stop = std::min(vectorEnd, i + FUSED_CHECK_BLOCK);
+        if (alive[FUSED_ADD] || alive[FUSED_SUB]) {
+            triplet_pair_avx512<FUSED_ADD, FUSED_SUB, W>(a, bi, bj, t, w, i, stop, acc);
+        }
+        if (alive[FUSED_RSUB] || alive[FUSED_MUL]) {
+            triplet_pair_avx512<FUSED_RSUB, FUSED_MUL, W>(a, bi, bj, t, w, i, stop, acc + 2 * TRIPLET_OPS);
+        }
+        i = stop;
+        for (int k = 0; k < TRIPLET_COMBOS; k++) errors[k] = hsum_avx512(acc[k]);
+        any = triplet_prune(errors, bound, alive);
     }
+    if (i == 0) {
+        for (int k = 0; k < TRIPLET_COMBOS; k++) errors[k] = 0.0f;
+    }
+    if (any) triplet_errors_scalar<W>(a, bi, bj, t, w, i, size, alive, errors);
 }
 
-#endif // SIMD_SSE_ENABLED
+#endif // SIMD_X86
 
 // ============================================================================
-// Диспетчеризация: выбор оптимальной реализации
+// Диспетчеризация: выбор реализации по activeSIMDTier()
 // Использует флаг UseSIMD для возможности отключения SIMD во время выполнения
 // ============================================================================
 
+template <int Kind, bool S1 = false, bool S2 = false>
+inline void op_apply_simd(float* r, const float* z1, const float* z2, const int size) {
+    switch (activeSIMDTier()) {
+#ifdef SIMD_X86
+        case SIMD_TIER_AVX512: op_apply_avx512<Kind, S1, S2>(r, z1, z2, size); return;
+        case SIMD_TIER_AVX2:   op_apply_avx2<Kind, S1, S2>(r, z1, z2, size); return;
+        case SIMD_TIER_SSE41:  op_apply_sse41<Kind, S1, S2>(r, z1, z2, size); return;
+#endif
+        default:               op_apply_scalar<Kind, S1, S2>(r, z1, z2, size); return;
+    }
+}
+
 /**
  * Сумма векторов с автоматическим выбором реализации
- * Выбирает AVX -> SSE -> скалярный код в зависимости от доступности и флага UseSIMD
  */
 inline void op_add_simd(float* r, const float* z1, const float* z2, const int size) {
-#ifdef SIMD_AVX_ENABLED
-    if (UseSIMD) {
-        op_add_avx(r, z1, z2, size);
-    } else {
-        op_add_scalar(r, z1, z2, size);
-    }
-#elif defined(SIMD_SSE_ENABLED)
-    if (UseSIMD) {
-        op_add_sse(r, z1, z2, size);
-    } else {
-        op_add_scalar(r, z1, z2, size);
-    }
-#else
-    op_add_scalar(r, z1, z2, size);
-#endif
+    op_apply_simd<FUSED_ADD>(r, z1, z2, size);
 }
 
 /**
  * Разность векторов с автоматическим выбором реализации
  */
 inline void op_sub_simd(float* r, const float* z1, const float* z2, const int size) {
-#ifdef SIMD_AVX_ENABLED
-    if (UseSIMD) {
-        op_sub_avx(r, z1, z2, size);
-    } else {
-        op_sub_scalar(r, z1, z2, size);
-    }
-#elif defined(SIMD_SSE_ENABLED)
-    if (UseSIMD) {
-        op_sub_sse(r, z1, z2, size);
-    } else {
-        op_sub_scalar(r, z1, z2, size);
-    }
-#else
-    op_sub_scalar(r, z1, z2, size);
-#endif
+    op_apply_simd<FUSED_SUB>(r, z1, z2, size);
 }
 
 /**
  * Обратная разность векторов с автоматическим выбором реализации
  */
 inline void op_rsub_simd(float* r, const float* z1, const float* z2, const int size) {
-#ifdef SIMD_AVX_ENABLED
-    if (UseSIMD) {
-        op_rsub_avx(r, z1, z2, size);
-    } else {
-        op_rsub_scalar(r, z1, z2, size);
-    }
-#elif defined(SIMD_SSE_ENABLED)
-    if (UseSIMD) {
-        op_rsub_sse(r, z1, z2, size);
-    } else {
-        op_rsub_scalar(r, z1, z2, size);
-    }
-#else
-    op_rsub_scalar(r, z1, z2, size);
-#endif
+    op_apply_simd<FUSED_RSUB>(r, z1, z2, size);
 }
 
 /**
  * Произведение векторов с автоматическим выбором реализации
  */
 inline void op_mul_simd(float* r, const float* z1, const float* z2, const int size) {
-#ifdef SIMD_AVX_ENABLED
-    if (UseSIMD) {
-        op_mul_avx(r, z1, z2, size);
-    } else {
-        op_mul_scalar(r, z1, z2, size);
-    }
-#elif defined(SIMD_SSE_ENABLED)
-    if (UseSIMD) {
-        op_mul_sse(r, z1, z2, size);
-    } else {
-        op_mul_scalar(r, z1, z2, size);
+    op_apply_simd<FUSED_MUL>(r, z1, z2, size);
+}
+
+// ============================================================================
+// Список операций на этапе компиляции
+//
+// Каждая операция FusedOp - отдельный тип OpKernel<Kind>: код, получивший
+// операцию параметром шаблона, компилятор встраивает в окружающий цикл.
+// visitOp() переводит номер операции времени выполнения в такой параметр
+// одним switch на вызов, а не на элемент. Таблицы указателей op_all[] и op[]
+// в main.cpp остаются для сериализации (getOpIndex) и набора операций обучения.
+// ============================================================================
+
+template <int Kind>
+using OpTag = std::integral_constant<int, Kind>;
+
+template <int Kind>
+struct OpKernel {
+    // Значение операции для одного элемента
+    static float value(float a, float b) { return fused_op_scalar<Kind>(a, b); }
+
+    // r[i] = op(z1[i], z2[i]) (сигнатура oper)
+    void operator()(float* r, const float* z1, const float* z2, const int size) const {
+        op_apply_simd<Kind>(r, z1, z2, size);
     }
-#else
-    op_mul_scalar(r, z1, z2, size);
+
+    // То же, операнд со scalar1/scalar2 задан одним значением (*z1 или *z2)
+    void broadcast(float* r, const float* z1, const bool scalar1, const float* z2, const bool scalar2,
+                   const int size) const {
+        if (scalar1 && scalar2) op_apply_simd<Kind, true, true>(r, z1, z2, size);
+        else if (scalar1)       op_apply_simd<Kind, true, false>(r, z1, z2, size);
+        else if (scalar2)       op_apply_simd<Kind, false, true>(r, z1, z2, size);
+        else                    op_apply_simd<Kind>(r, z1, z2, size);
+    }
+};
+
+/**
+ * Вызов f(OpTag<Kind>()) для операции kind (кроме FUSED_NONE)
+ */
+template <typename F>
+inline decltype(auto) visitOp(FusedOp kind, F&& f) {
+    switch (kind) {
+        case FUSED_ADD:      return f(OpTag<FUSED_ADD>());
+        case FUSED_SUB:      return f(OpTag<FUSED_SUB>());
+        case FUSED_RSUB:     return f(OpTag<FUSED_RSUB>());
+        case FUSED_DIV:      return f(OpTag<FUSED_DIV>());
+        case FUSED_RDIV:     return f(OpTag<FUSED_RDIV>());
+        case FUSED_SQ2_ADD:  return f(OpTag<FUSED_SQ2_ADD>());
+        case FUSED_SQ1_ADD:  return f(OpTag<FUSED_SQ1_ADD>());
+        case FUSED_SQ2_SUB:  return f(OpTag<FUSED_SQ2_SUB>());
+        case FUSED_SQ1_SUB:  return f(OpTag<FUSED_SQ1_SUB>());
+        case FUSED_PARALLEL: return f(OpTag<FUSED_PARALLEL>());
+        default:             return f(OpTag<FUSED_MUL>());
+    }
+}
+
+template <int Kind, bool S1 = false, bool S2 = false, bool W = false>
+inline float op_error_dispatch(const float* z1, const float* z2, const float* t, const float* w, const int size,
+                               const float sum, const float bound) {
+    switch (activeSIMDTier()) {
+#ifdef SIMD_X86
+        case SIMD_TIER_AVX512: return op_error_avx512<Kind, S1, S2, W>(z1, z2, t, w, size, sum, bound);
+        case SIMD_TIER_AVX2:   return op_error_avx2<Kind, S1, S2, W>(z1, z2, t, w, size, sum, bound);
+        case SIMD_TIER_SSE41:  return op_error_sse41<Kind, S1, S2, W>(z1, z2, t, w, size, sum, bound);
 #endif
+        default:               return op_error_scalar<Kind, S1, S2, W>(z1, z2, t, w, size, sum, bound);
+    }
+}
+
+// Ядро с весами образов, если они заданы (w != nullptr)
+template <int Kind, bool S1 = false, bool S2 = false>
+inline float op_error_weighted(const float* z1, const float* z2, const float* t, const float* w, const int size,
+                               const float sum, const float bound) {
+    if (w != nullptr) return op_error_dispatch<Kind, S1, S2, true>(z1, z2, t, w, size, sum, bound);
+    return op_error_dispatch<Kind, S1, S2>(z1, z2, t, w, size, sum, bound);
+}
+
+/**
+ * Квадратичная ошибка операции с автоматическим выбором реализации
+ *
+ * @param kind - операция (кроме FUSED_NONE)
+ * @param t - ожидаемые выходы
+ * @param w - веса образов или nullptr (все веса - 1)
+ * @param sum - уже накопленная сумма (для обработки вектора частями)
+ * @param bound - граница: суммирование прекращается, когда сумма её достигла
+ * @return sum + ошибка (или частичная сумма, не меньшая bound)
+ */
+inline float op_error_simd(FusedOp kind, const float* z1, const float* z2, const float* t, const float* w,
+                           const int size, const float sum, const float bound) {
+    return visitOp(kind, [&](auto tag) {
+        return op_error_weighted<decltype(tag)::value>(z1, z2, t, w, size, sum, bound);
+    });
+}
+
+/**
+ * Квадратичная ошибка op(z1, z2), где scalar1/scalar2 - операнд задан одним
+ * значением для всех элементов (*z1 или *z2, см. operand_scalar)
+ *
+ * Значения и порядок суммирования те же, что у op_error_simd для вектора
+ * из одинаковых значений, поэтому результаты совпадают побитово.
+ */
+inline float op_error_broadcast_simd(FusedOp kind, const float* z1, const bool scalar1,
+                                     const float* z2, const bool scalar2, const float* t, const float* w,
+                                     const int size, const float sum, const float bound) {
+    return visitOp(kind, [&](auto tag) {
+        constexpr int Kind = decltype(tag)::value;
+        if (scalar1 && scalar2) return op_error_weighted<Kind, true, true>(z1, z2, t, w, size, sum, bound);
+        if (scalar1) return op_error_weighted<Kind, true, false>(z1, z2, t, w, size, sum, bound);
+        if (scalar2) return op_error_weighted<Kind, false, true>(z1, z2, t, w, size, sum, bound);
+        return op_error_weighted<Kind>(z1, z2, t, w, size, sum, bound);
+    });
+}
+
+template <bool W>
+inline void op_triplet_errors_dispatch(const float* a, const float* bi, const float* bj, const float* t,
+                                       const float* w, const int size, const float bound, float* errors) {
+    switch (activeSIMDTier()) {
+#ifdef SIMD_X86
+        case SIMD_TIER_AVX512: op_triplet_errors_avx512<W>(a, bi, bj, t, w, size, bound, errors); return;
+        case SIMD_TIER_AVX2:   op_triplet_errors_avx2<W>(a, bi, bj, t, w, size, bound, errors); return;
+        case SIMD_TIER_SSE41:  op_triplet_errors_sse41<W>(a, bi, bj, t, w, size, bound, errors); return;
+#endif
+        default:               op_triplet_errors_scalar<W>(a, bi, bj, t, w, size, bound, errors); return;
+    }
+}
+
+/**
+ * Ошибки всех сочетаний opC(a, opB(bi, bj)) с автоматическим выбором реализации
+ *
+ * @param t - ожидаемые выходы
+ * @param w - веса образов или nullptr (все веса - 1)
+ * @param bound - граница: сочетания, достигшие её, не досчитываются
+ * @param errors - выход: TRIPLET_COMBOS ошибок (индекс kindB * TRIPLET_OPS + kindC);
+ *        ошибка, не меньшая bound, может быть частичной суммой
+ */
+inline void op_triplet_errors_simd(const float* a, const float* bi, const float* bj, const float* t,
+                                   const float* w, const int size, const float bound, float* errors) {
+    if (w != nullptr) op_triplet_errors_dispatch<true>(a, bi, bj, t, w, size, bound, errors);
+    else op_triplet_errors_dispatch<false>(a, bi, bj, t, w, size, bound, errors);
 }
 
 // ============================================================================
-// Информация о доступных SIMD расширениях
+// Информация о выбранном уровне
 // ============================================================================
 
 /**
- * Возвращает строку с информацией о доступных SIMD расширениях
+ * Возвращает строку с информацией о выбранном уровне SIMD
  */
 inline const char* getSIMDInfo() {
-#ifdef SIMD_AVX_ENABLED
-    return "AVX (256-bit, 8 floats per operation)";
-#elif defined(SIMD_SSE_ENABLED)
-    return "SSE (128-bit, 4 floats per operation)";
-#else
-    return "None (scalar operations)";
-#endif
+    switch (activeSIMDTier()) {
+        case SIMD_TIER_AVX512: return "AVX-512 (512-bit, 16 floats per operation)";
+        case SIMD_TIER_AVX2:   return "AVX2+FMA (256-bit, 8 floats per operation)";
+        case SIMD_TIER_SSE41:  return "SSE4.1 (128-bit, 4 floats per operation)";
+        default:               return "None (scalar operations)";
+    }
 }
 
 /**
- * Проверяет, включены ли SIMD оптимизации при компиляции
+ * Проверяет, поддерживает ли процессор хотя бы один векторный уровень
  */
 inline bool isSIMDEnabled() {
-#if defined(SIMD_AVX_ENABLED) || defined(SIMD_SSE_ENABLED)
-    return true;
-#else
-    return false;
-#endif
+    return SupportedSIMDTier > SIMD_TIER_SCALAR;
 }
 
 #endif // SIMD_OPS_H
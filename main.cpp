@@ -28,27 +28,24 @@
 #include <csignal>
 #include <nlohmann/json.hpp>
 #include "simd_ops.h"
+#include "activation_arena.h"
+#include "activation_format.h"
+#include "activation_cache.h"
+#include "receptor_matrix.h"
+#include "dataset.h"
+#include "config_reader.h"
+#include "model_file.h"
 
 using namespace std;
 using json = nlohmann::json;
 
-// ============================================================================
-// Структура данных для обучающего образа
-// ============================================================================
-
-struct Image
-{
-	string word;  // Строковое представление образа
-	int id;       // Идентификатор класса
-};
-
 // ============================================================================
 // Глобальные переменные конфигурации
 // ============================================================================
 
 int Classes = 4;                                  // Количество классов
 vector<string> classes;                           // Имена классов
-vector<Image> const_words;                        // Обучающие образы
+Dataset g_dataset;                                // Обучающие образы
 
 // ============================================================================
 // Константы и параметры обучения
@@ -77,7 +74,7 @@ const float base[] = {                            // Базисные значе
 	-4.0,
 	-8.0,
 };
-const float big = 1000000000000000000.f;           // Большое число для инициализации
+const float big = FUSED_BIG;                      // Большое число для инициализации
 const int max_num = 256;                          // Количество состояний входа
 int Images = 0;                                   // Количество обучающих образов
 int Receptors = 20;                               // Количество входов сети
@@ -86,8 +83,12 @@ const int base_size = sizeof(base) / sizeof(float);
 int Inputs = 0;                                   // Общее количество входов (Receptors + base_size)
 int Neirons = 0;                                  // Количество созданных нейронов
 vector<float> NetInput;                           // Входные значения сети
-vector<vector<float>> vx;                         // Входные значения для образов
+ReceptorMatrix g_receptorMatrix;                  // Входные значения образов (рецептор x образ)
+ActivationFormat DatasetStorage = ACTIVATION_FP32;  // Формат хранения матрицы входов
+string DatasetCachePath;                          // Двоичный кэш набора образов (--dataset-cache)
 vector<float> vz;                                 // Ожидаемые выходные значения
+vector<float> ImageWeights;                       // Веса образов при обучении (пусто - все 1)
+bool DeduplicateImages = true;                    // Сводить одинаковые образы в один с весом
 vector<int> NetOutput;                            // Выходные нейроны для классов
 char InputStr[StringSize], word_buf[StringSize];  // Буферы для ввода
 
@@ -110,78 +111,149 @@ bool UseSIMD = true;
 
 // Сумма - SIMD оптимизированная версия
 void __fastcall op_1(float* r, const float* z1, const float* z2, const int size) {
-	op_add_simd(r, z1, z2, size);
+	OpKernel<FUSED_ADD>()(r, z1, z2, size);
 }
 
 // Разность (z1 - z2) - SIMD оптимизированная версия
 void __fastcall op_2(float* r, const float* z1, const float* z2, const int size) {
-	op_sub_simd(r, z1, z2, size);
+	OpKernel<FUSED_SUB>()(r, z1, z2, size);
 }
 
 // Разность (z2 - z1) - SIMD оптимизированная версия
 void __fastcall op_3(float* r, const float* z1, const float* z2, const int size) {
-	op_rsub_simd(r, z1, z2, size);
+	OpKernel<FUSED_RSUB>()(r, z1, z2, size);
 }
 
 // Произведение - SIMD оптимизированная версия
 void __fastcall op_4(float* r, const float* z1, const float* z2, const int size) {
-	op_mul_simd(r, z1, z2, size);
+	OpKernel<FUSED_MUL>()(r, z1, z2, size);
 }
 
-// Деление (z1 / z2)
+// Деление (z1 / z2), при z2 == 0 - big
 void __fastcall op_5(float* r, const float* z1, const float* z2, const int size) {
-	for (int i = size; i > 0; i--, r++, z1++, z2++)
-		if (*z2 != 0.0) *r = *z1 / *z2; else *r = big;
+	OpKernel<FUSED_DIV>()(r, z1, z2, size);
 }
 
-// Деление (z2 / z1)
+// Деление (z2 / z1), при z1 == 0 - big
 void __fastcall op_6(float* r, const float* z1, const float* z2, const int size) {
-	for (int i = size; i > 0; i--, r++, z1++, z2++)
-		if (*z1 != 0.0) *r = *z2 / *z1; else *r = big;
+	OpKernel<FUSED_RDIV>()(r, z1, z2, size);
 }
 
 // Квадрат z2 + z1
 void __fastcall op_7(float* r, const float* z1, const float* z2, const int size) {
-	for (int i = size; i > 0; i--, r++, z1++, z2++) *r = *z2 * *z2 + *z1;
+	OpKernel<FUSED_SQ2_ADD>()(r, z1, z2, size);
 }
 
 // Квадрат z1 + z2
 void __fastcall op_8(float* r, const float* z1, const float* z2, const int size) {
-	for (int i = size; i > 0; i--, r++, z1++, z2++) *r = *z1 * *z1 + *z2;
+	OpKernel<FUSED_SQ1_ADD>()(r, z1, z2, size);
 }
 
 // Квадрат z2 - z1
 void __fastcall op_9(float* r, const float* z1, const float* z2, const int size) {
-	for (int i = size; i > 0; i--, r++, z1++, z2++) *r = *z2 * *z2 - *z1;
+	OpKernel<FUSED_SQ2_SUB>()(r, z1, z2, size);
 }
 
 // Квадрат z1 - z2
 void __fastcall op_10(float* r, const float* z1, const float* z2, const int size) {
-	for (int i = size; i > 0; i--, r++, z1++, z2++) *r = *z1 * *z1 - *z2;
+	OpKernel<FUSED_SQ1_SUB>()(r, z1, z2, size);
 }
 
-// Параллельное соединение
+// Параллельное соединение, при z1 + z2 == 0 - big
 void __fastcall op_11(float* r, const float* z1, const float* z2, const int size) {
-	for (int i = size; i > 0; i--, r++, z1++, z2++) *r = *z1 * *z2 / (*z1 + *z2);
+	OpKernel<FUSED_PARALLEL>()(r, z1, z2, size);
 }
 
-// Массив доступных операций (используются только первые 4 для скорости)
-oper op[] = {
+// Все операции в порядке FusedOp: индекс - номер операции в файле модели
+oper op_all[] = {
+	op_1,   // Сумма
+	op_2,   // Разность
+	op_3,   // Обратная разность
+	op_4,   // Произведение
+	op_5,   // Деление
+	op_6,   // Обратное деление
+	op_7,   // Квадрат z2 + z1
+	op_8,   // Квадрат z1 + z2
+	op_9,   // Квадрат z2 - z1
+	op_10,  // Квадрат z1 - z2
+	op_11,  // Параллельное соединение
+};
+static_assert(sizeof(op_all) / sizeof(oper) == FUSED_OP_COUNT, "op_all must match FusedOp");
+
+// Операции, перебираемые при обучении (по умолчанию op_1..op_4; "ops" в конфигурации)
+oper op[FUSED_OP_COUNT] = {
 	op_1,   // Сумма
 	op_2,   // Разность
 	op_3,   // Обратная разность
 	op_4,   // Произведение
 };
-const int op_count = sizeof(op) / sizeof(oper);
+int op_count = 4;
+
+// Операция на этапе компиляции (OpKernel) для каждого элемента op[]
+FusedOp op_kind[FUSED_OP_COUNT] = {
+	FUSED_ADD,
+	FUSED_SUB,
+	FUSED_RSUB,
+	FUSED_MUL,
+};
 
-// Получение индекса операции по указателю (для сериализации)
+// Получение номера операции по указателю (для сериализации)
 int getOpIndex(oper operation) {
-	for (int i = 0; i < op_count; i++) {
-		if (op[i] == operation) return i;
+	for (int i = 0; i < FUSED_OP_COUNT; i++) {
+		if (op_all[i] == operation) return i;
 	}
 	return 0;  // По умолчанию первая операция
 }
 
+// Операция на этапе компиляции для указателя (FUSED_NONE - нет экземпляра OpKernel)
+FusedOp fusedOpKind(oper operation) {
+	for (int i = 0; i < FUSED_OP_COUNT; i++) {
+		if (op_all[i] == operation) return static_cast<FusedOp>(i);
+	}
+	return FUSED_NONE;
+}
+
+// Выбор операций для обучения: перебор идёт от дешёвых к дорогим
+// (fusedOpCost), при равной стоимости - в порядке FusedOp
+void configureOps(vector<FusedOp> kinds) {
+	std::sort(kinds.begin(), kinds.end());
+	kinds.erase(std::unique(kinds.begin(), kinds.end()), kinds.end());
+	std::stable_sort(kinds.begin(), kinds.end(), [](FusedOp x, FusedOp y) { return fusedOpCost(x) < fusedOpCost(y); });
+	op_count = (int)kinds.size();
+	for (int k = 0; k < op_count; k++) {
+		op_kind[k] = kinds[k];
+		op[k] = op_all[kinds[k]];
+	}
+}
+
+// Стоимость перебора операций op[] относительно op_1..op_4
+float opSetCost() {
+	float cost = 0.0f;
+	for (int k = 0; k < op_count; k++) cost += fusedOpCost(op_kind[k]);
+	return cost / 4.0f;
+}
+
+// Применение операции нейрона: для операций из списка OpKernel - встроенный
+// экземпляр, для остальных - вызов по указателю
+void applyOp(oper operation, float* r, const ActivationRef& a, const ActivationRef& b, const int size) {
+	const FusedOp kind = fusedOpKind(operation);
+	if (kind == FUSED_NONE) {
+		applyOpMixed(operation, r, a, b, size);
+		return;
+	}
+	visitOp(kind, [&](auto tag) { applyOpMixed(OpKernel<decltype(tag)::value>(), r, a, b, size); });
+}
+
+// То же с сохранением результата в формате format
+void storeOp(oper operation, void* out, ActivationFormat format, const ActivationRef& a, const ActivationRef& b, const int size) {
+	const FusedOp kind = fusedOpKind(operation);
+	if (kind == FUSED_NONE) {
+		storeOpMixed(operation, out, format, a, b, size);
+		return;
+	}
+	visitOp(kind, [&](auto tag) { storeOpMixed(OpKernel<decltype(tag)::value>(), out, format, a, b, size); });
+}
+
 // ============================================================================
 // Класс нейрона
 // ============================================================================
@@ -192,16 +264,19 @@ public:
 	int i;                                        // Номер первого входного нейрона
 	int j;                                        // Номер второго входного нейрона
 	oper op;                                      // Операция нейрона
-	vector<float> c;                              // Кэш значений для образов
-	bool cached;                                  // Флаг валидности кэша образов
-	float val;                                    // Кэш одиночного значения
-	bool val_cached;                              // Флаг валидности одиночного значения
+	bool cached;                                  // Флаг валидности кэша образов (слот в g_activationCache)
 
-	Neiron() : i(0), j(0), op(nullptr), cached(false), val(0), val_cached(false) {}
+	Neiron() : i(0), j(0), op(nullptr), cached(false) {}
 };
 
 vector<Neiron> nei;                               // Массив нейронов
 const int MAX_NEURONS = 64000;                    // Максимальное количество нейронов
+ActivationCache g_activationCache;                // Кэши значений нейронов для образов
+bool UseHugePages = false;                        // Запрашивать большие страницы для кэшей
+size_t CacheBudgetBytes = 0;                      // Бюджет памяти кэшей (0 = без ограничения)
+ActivationFormat ActivationStorage = ACTIVATION_FP32;  // Формат хранения кэшей (вычисления в fp32)
+bool UseGramScoring = true;                       // Оценка пар полного перебора по матрицам произведений
+size_t GramBudgetBytes = (size_t)512 << 20;       // Бюджет памяти матриц оценки пар
 
 // ============================================================================
 // Подключение модулей
@@ -209,6 +284,17 @@ const int MAX_NEURONS = 64000;                    // Максимальное к
 
 #include "json_io.h"
 #include "neuron_generation.h"
+#include "inference_plan.h"
+
+InferencePlan g_inferencePlan;                    // План инференса (компилируется после загрузки/обучения)
+InferenceContext g_inferenceContext;              // Контекст классификации основного потока
+
+#include "compiled_model.h"
+
+CompiledModel g_compiledModel;                    // Скомпилированная модель (--compiled), если загружена
+
+#include "batch_inference.h"
+#include "inference_server.h"
 
 // ============================================================================
 // Вспомогательные функции
@@ -245,7 +331,9 @@ void printUsage(const char* programName) {
 	cout << endl;
 	cout << "TRAINING OPTIONS:" << endl;
 	cout << "  -c, --config <file>  Load training configuration from JSON file" << endl;
-	cout << "  -s, --save <file>    Save trained network to JSON file after training" << endl;
+	cout << "  -s, --save <file>    Save trained network to a model file after training" << endl;
+	cout << "  --model-format <fmt>  Model file format for -s and --convert-model: json (default) or" << endl;
+	cout << "                       binary (memory-mapped on load, no parsing). Loading detects the format." << endl;
 	cout << "  -t, --test           Run automated test after training (no interactive mode)" << endl;
 	cout << "  -b, --benchmark      Run benchmark to measure training speed" << endl;
 	cout << endl;
@@ -255,14 +343,55 @@ void printUsage(const char* programName) {
 	cout << "                       New classes in config (without output_neuron) will be trained." << endl;
 	cout << endl;
 	cout << "INFERENCE OPTIONS:" << endl;
-	cout << "  -l, --load <file>    Load trained network from JSON file (inference mode)" << endl;
+	cout << "  -l, --load <file>    Load trained network from a JSON or binary model (inference mode)" << endl;
 	cout << "  -i, --input <text>   Classify single input text and exit (non-interactive)" << endl;
 	cout << "  --verify             Verify accuracy of loaded model on training config (-c required)" << endl;
+	cout << "  --classify-batch <file>  Classify each line of file in one vectorized batch" << endl;
+	cout << "                       With -b, compares speed and results with per-input classification." << endl;
+	cout << "  --classify-stream <file|->  Classify each line of file or stdin ('-') in parallel" << endl;
+	cout << "                       batches and write results to stdout" << endl;
+	cout << "  --stream-format <fmt>  Stream output format: tsv (default) or jsonl" << endl;
+	cout << "  --compiled <lib>     Classify with a model library built by --emit-so (with -l)" << endl;
+	cout << "  --serve <socket>     Serve classification requests on a Unix domain socket (one text per line;" << endl;
+	cout << "                       '#!stats' and '#!shutdown' are commands). With -b, runs a built-in load test." << endl;
+	cout << "  --serve-batch <n>    Maximum requests per server batch (default 64)" << endl;
+	cout << "  --serve-wait <ms>    Maximum time a request waits for its batch to fill (default 1)" << endl;
+	cout << "  --serve-watch        Reload the model when its file changes ('#!reload [file]' reloads on demand)." << endl;
+	cout << "                       Requests in flight finish on the old model; none wait for the reload." << endl;
+	cout << endl;
+	cout << "MODEL FILE OPTIONS:" << endl;
+	cout << "  --convert-model <in> <out>  Convert a model between JSON and binary (the other format" << endl;
+	cout << "                       unless --model-format is given). With -b, compares load times." << endl;
+	cout << endl;
+	cout << "CODE GENERATION OPTIONS:" << endl;
+	cout << "  --emit-cpp <model.json> <out.cpp>  Generate straight-line C++ code for a saved model" << endl;
+	cout << "  --emit-so <lib>      With --emit-cpp, also build a shared library (uses $CXX, $CXXFLAGS)." << endl;
+	cout << "                       With -b, benchmarks the library against the interpreter." << endl;
 	cout << endl;
 	cout << "PERFORMANCE OPTIONS:" << endl;
 	cout << "  -j, --threads <n>    Number of threads to use (0 = auto, default)" << endl;
 	cout << "  --single-thread      Disable multithreading (use single thread)" << endl;
 	cout << "  --no-simd            Disable SIMD optimizations (use scalar operations)" << endl;
+	cout << "  --simd <tier>        SIMD kernel tier: scalar, sse4.1, avx2, avx512" << endl;
+	cout << "                       (default: the best tier supported by the CPU)" << endl;
+	cout << "  --no-gram            Score exhaustive search pairs directly over all images instead of" << endl;
+	cout << "                       incrementally maintained dot-product (Gram) matrices" << endl;
+	cout << "  --no-dedup           Train on every image as listed. By default identical images are" << endl;
+	cout << "                       merged into one weighted image, and inputs shared by several" << endl;
+	cout << "                       classes are reported." << endl;
+	cout << "  --huge-pages         Back neuron caches with huge pages (Linux, transparent)" << endl;
+	cout << "  --cache-budget <MB>  Memory budget for neuron caches (0 = unlimited)." << endl;
+	cout << "                       Default: 3/4 of the cgroup memory limit, if any." << endl;
+	cout << "                       Cold caches are evicted and recomputed on demand." << endl;
+	cout << "  --activations <fmt>  Neuron cache storage format: fp32 (default), fp16, bf16." << endl;
+	cout << "                       16-bit formats halve cache memory; math stays fp32." << endl;
+	cout << "                       With --verify, accuracy is compared against fp32." << endl;
+	cout << "  --dataset-format <fmt>  Training input matrix storage: fp32 (default) or u8." << endl;
+	cout << "                       u8 keeps character codes plus a decode table (4x smaller," << endl;
+	cout << "                       same values); fp32 is read by the kernels without widening." << endl;
+	cout << "  --dataset-cache <file>  Binary cache of the config's encoded images. Reused (memory-" << endl;
+	cout << "                       mapped, no JSON parsing or shift generation) while the config" << endl;
+	cout << "                       file (and its images_file) is unchanged; rebuilt otherwise." << endl;
 	cout << endl;
 	cout << "GENERAL OPTIONS:" << endl;
 	cout << "  -h, --help           Show this help message" << endl;
@@ -279,6 +408,11 @@ void printUsage(const char* programName) {
 	cout << "  " << programName << " -l model.json -i \"time\"                # Single classification" << endl;
 	cout << "  " << programName << " -r model.json -c configs/new.json -s model_v2.json  # Retrain" << endl;
 	cout << "  " << programName << " -l model.json -c configs/test.json --verify  # Verify accuracy" << endl;
+	cout << "  " << programName << " -l model.json --classify-batch words.txt  # Batch classification" << endl;
+	cout << "  " << programName << " -l model.json --classify-stream - < log.txt > scores.tsv  # Stream" << endl;
+	cout << "  " << programName << " -l model.json --serve /tmp/nnets.sock  # Classification server" << endl;
+	cout << "  " << programName << " --emit-cpp model.json model.cpp --emit-so model.so -b  # Compile model" << endl;
+	cout << "  " << programName << " -l model.json --compiled ./model.so -i \"time\"  # Compiled inference" << endl;
 	cout << endl;
 	cout << "JSON config format (training):" << endl;
 	cout << "  {" << endl;
@@ -290,6 +424,7 @@ void printUsage(const char* programName) {
 	cout << "    \"generate_shifts\": true," << endl;
 	cout << "    \"funcs\": [\"triplet_parallel\"]  // Optional: specify training functions" << endl;
 	cout << "  }" << endl;
+	cout << "  Bulk images: \"images_file\": \"images.tsv\" with one \"word<TAB>class\" line per image." << endl;
 	cout << endl;
 	cout << "Use --list-funcs to see all available training functions." << endl;
 }
@@ -337,31 +472,54 @@ float sum(const float* ar, const int size)
 	return res;
 }
 
+/**
+ * Компиляция плана инференса для текущей сети
+ *
+ * Вызывается после загрузки или обучения сети, до классификации.
+ *
+ * @return true при успехе
+ */
+bool compileInferencePlan() {
+	if (!g_inferencePlan.compile()) {
+		cerr << "Error: Cannot compile inference plan" << endl;
+		return false;
+	}
+	g_inferenceContext.bind(g_inferencePlan);
+	cout << "Inference plan: " << g_inferencePlan.instructionCount() << " operations ("
+		 << g_inferencePlan.networkNeurons() << " neurons in network)" << endl;
+	return true;
+}
+
 /**
  * Классификация входного текста
  *
  * Устанавливает входные значения сети из текста и выводит результат классификации.
+ * Использует скомпилированную модель (g_compiledModel), если она загружена,
+ * иначе план инференса (g_inferencePlan).
  *
  * @param inputText - входной текст для классификации
  * @param verbose - выводить ли результаты на экран
  */
 void classifyInput(const string& inputText, bool verbose = true) {
 	// Устанавливаем входные значения из текста
+	float* input = g_inferenceContext.input();
 	for (int d = 0; d < Receptors; d++) {
-		if (d < (int)inputText.length() && inputText[d] != 0) {
-			NetInput[d] = float((unsigned char)inputText[d]) / float(max_num);
-		} else {
-			NetInput[d] = float((unsigned char)' ') / float(max_num);
-		}
+		input[d] = encodeReceptor(inputText, d);
 	}
 
-	// Очищаем кэш значений
-	clear_val_cache(nei, MAX_NEURONS);
+	// Вычисляем выходы всех классов за один проход
+	vector<float> outputs(Classes);
+	if (g_compiledModel.isLoaded()) {
+		g_compiledModel.classify(input, outputs.data());
+	} else {
+		g_inferenceContext.evaluate();
+		for (int out = 0; out < Classes; out++) outputs[out] = g_inferenceContext.output(out);
+	}
 
-	// Вычисляем и выводим результаты для каждого класса
+	// Выводим результаты для каждого класса
 	if (verbose) {
 		for (int out = 0; out < Classes; out++) {
-			float z1 = GetNeironVal(NetOutput[out]) * 100.0f;
+			float z1 = outputs[out] * 100.0f;
 			// Обработка NaN и бесконечных значений
 			if (!std::isfinite(z1)) z1 = 0.0f;
 			if (z1 < 0.0f) z1 = 0.0f;
@@ -371,6 +529,283 @@ void classifyInput(const string& inputText, bool verbose = true) {
 	}
 }
 
+/**
+ * Классификация текстов из файла (по одному на строку)
+ *
+ * Выводит для каждой строки "текст<TAB>класс<TAB>выход" и итоговую
+ * скорость. В режиме бенчмарка те же тексты классифицируются
+ * поштучно интерпретатором плана для сравнения скорости и результатов,
+ * в одном потоке и в inferenceThreadCount() потоках с общим планом.
+ *
+ * @param path - путь к файлу
+ * @param benchmark - сравнить с поштучной классификацией
+ * @return код возврата программы
+ */
+int classifyBatchFile(const string& path, bool benchmark) {
+	ifstream file(path);
+	if (!file.is_open()) {
+		cerr << "Error: Cannot open input file " << path << endl;
+		return 1;
+	}
+
+	vector<string> inputs;
+	string line;
+	while (getline(file, line)) {
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		inputs.push_back(line);
+	}
+
+	vector<float> scores;
+	auto batchStart = chrono::high_resolution_clock::now();
+	classifyBatch(inputs, scores);
+	auto batchEnd = chrono::high_resolution_clock::now();
+
+	for (size_t s = 0; s < inputs.size(); s++) {
+		const float* outputs = scores.data() + s * Classes;
+		int predictedClass = predictClass(outputs);
+		cout << inputs[s] << "\t" << (predictedClass >= 0 ? classes[predictedClass] : string("?"))
+			 << "\t" << (predictedClass >= 0 ? outputs[predictedClass] : 0.0f) << endl;
+	}
+
+	double batchSeconds = chrono::duration<double>(batchEnd - batchStart).count();
+	cout << "\n=== Batch classification ===" << endl;
+	cout << "Inputs: " << inputs.size() << endl;
+	cout << "Batch engine: " << (g_compiledModel.isLoaded() ? "compiled model" : "inference plan") << endl;
+	cout << "Batch time: " << (batchSeconds * 1000.0) << " ms";
+	if (batchSeconds > 0.0) cout << " (" << (inputs.size() / batchSeconds) << " inputs/sec)";
+	cout << endl;
+
+	if (benchmark) {
+		int mismatches = 0;
+		auto singleStart = chrono::high_resolution_clock::now();
+		float* input = g_inferenceContext.input();
+		for (size_t s = 0; s < inputs.size(); s++) {
+			for (int d = 0; d < Receptors; d++) {
+				input[d] = encodeReceptor(inputs[s], d);
+			}
+			g_inferenceContext.evaluate();
+			for (int c = 0; c < Classes; c++) {
+				float single = g_inferenceContext.output(c);
+				float batch = scores[s * Classes + c];
+				// Переполнение даёт NaN в обоих режимах
+				if (single != batch && !(std::isnan(single) && std::isnan(batch))) {
+					mismatches++;
+					break;
+				}
+			}
+		}
+		auto singleEnd = chrono::high_resolution_clock::now();
+		double singleSeconds = chrono::duration<double>(singleEnd - singleStart).count();
+		cout << "Per-input time: " << (singleSeconds * 1000.0) << " ms";
+		if (batchSeconds > 0.0) cout << " (batch speedup " << (singleSeconds / batchSeconds) << "x)";
+		cout << endl;
+		cout << "Mismatches vs per-input: " << mismatches << endl;
+
+		// Тот же поштучный расчёт в нескольких потоках: у каждого свой контекст,
+		// план общий
+		const int threadCount = inferenceThreadCount();
+		const int perThread = ((int)inputs.size() + threadCount - 1) / threadCount;
+		std::atomic<int> parallelMismatches(0);
+		auto parallelStart = chrono::high_resolution_clock::now();
+		vector<thread> threads;
+		for (int t = 0; t < threadCount; t++) {
+			threads.emplace_back([&, t]() {
+				InferenceContext context(g_inferencePlan);
+				float* input = context.input();
+				int last = min((int)inputs.size(), (t + 1) * perThread);
+				for (int s = t * perThread; s < last; s++) {
+					for (int d = 0; d < Receptors; d++) {
+						input[d] = encodeReceptor(inputs[s], d);
+					}
+					context.evaluate();
+					for (int c = 0; c < Classes; c++) {
+						float single = context.output(c);
+						float batch = scores[(size_t)s * Classes + c];
+						if (single != batch && !(std::isnan(single) && std::isnan(batch))) {
+							parallelMismatches++;
+							break;
+						}
+					}
+				}
+			});
+		}
+		for (auto& t : threads) t.join();
+		double parallelSeconds = chrono::duration<double>(chrono::high_resolution_clock::now() - parallelStart).count();
+		cout << "Parallel per-input time: " << (parallelSeconds * 1000.0) << " ms (" << threadCount << " threads)" << endl;
+		cout << "Parallel mismatches vs batch: " << parallelMismatches.load() << endl;
+		if (mismatches > 0 || parallelMismatches.load() > 0) return 1;
+	}
+	return 0;
+}
+
+/**
+ * Загрузка скомпилированной модели для инференса
+ *
+ * Библиотека должна соответствовать загруженной сети (рецепторы и классы).
+ *
+ * @param path - путь к библиотеке (--emit-so)
+ * @return true при успехе
+ */
+bool loadCompiledModel(const string& path) {
+	if (!g_compiledModel.load(path)) {
+		return false;
+	}
+	if (g_compiledModel.receptors() != Receptors || g_compiledModel.classes() != Classes) {
+		cerr << "Error: Compiled model " << path << " (" << g_compiledModel.receptors() << " receptors, "
+			 << g_compiledModel.classes() << " classes) does not match the loaded network" << endl;
+		g_compiledModel.unload();
+		return false;
+	}
+	cout << "Compiled model: " << path << endl;
+	return true;
+}
+
+/**
+ * Сведение одинаковых обучающих образов в один с весом-количеством
+ *
+ * Выводит, сколько образов сведено, и противоречия: одинаковые входы
+ * у образов разных классов (такие образы сеть не может различить).
+ */
+void deduplicateDataset() {
+	const int total = g_dataset.size();
+	vector<DatasetConflict> conflicts;
+	const int removed = g_dataset.deduplicate(conflicts);
+	if (removed > 0) {
+		cout << "Deduplicated images: " << total << " -> " << g_dataset.size() << " unique ("
+			 << removed << " duplicates merged into weights)" << endl;
+	}
+	if (!conflicts.empty()) {
+		const size_t shown = min(conflicts.size(), (size_t)10);
+		cout << "Warning: " << conflicts.size() << " input(s) belong to several classes:" << endl;
+		for (size_t k = 0; k < shown; k++) {
+			string text = conflicts[k].text;
+			text.erase(text.find_last_not_of(' ') + 1);
+			cout << "  \"" << text << "\": classes";
+			for (size_t c = 0; c < conflicts[k].ids.size(); c++) {
+				cout << (c == 0 ? " " : ", ") << conflicts[k].ids[c];
+			}
+			cout << endl;
+		}
+		if (shown < conflicts.size()) cout << "  ..." << endl;
+	}
+}
+
+/**
+ * Сравнение скомпилированной модели с интерпретатором плана
+ *
+ * Классифицирует одни и те же случайные тексты поштучно планом,
+ * пакетным планом и скомпилированной моделью, выводит время и
+ * количество расхождений.
+ *
+ * @return 0, если результаты совпадают
+ */
+int benchmarkCompiledModel() {
+	const int samples = 100000;
+
+	vector<string> inputs = randomInputs(samples, 42u);
+	vector<float> receptors((size_t)samples * Receptors);
+	for (int s = 0; s < samples; s++) {
+		for (int d = 0; d < Receptors; d++) {
+			receptors[(size_t)s * Receptors + d] = encodeReceptor(inputs[s], d);
+		}
+	}
+
+	vector<float> receptorMatrix((size_t)Receptors * samples);
+	for (int s = 0; s < samples; s++) {
+		for (int d = 0; d < Receptors; d++) {
+			receptorMatrix[(size_t)d * samples + s] = receptors[(size_t)s * Receptors + d];
+		}
+	}
+
+	// Интерпретатор: поштучно и пакетом
+	vector<float> planScores((size_t)samples * Classes);
+	auto planStart = chrono::high_resolution_clock::now();
+	for (int s = 0; s < samples; s++) {
+		g_inferenceContext.evaluate(receptors.data() + (size_t)s * Receptors);
+		for (int c = 0; c < Classes; c++) planScores[(size_t)s * Classes + c] = g_inferenceContext.output(c);
+	}
+	auto planEnd = chrono::high_resolution_clock::now();
+
+	vector<float> batchScores((size_t)samples * Classes);
+	g_inferenceContext.evaluateBatch(receptorMatrix.data(), samples, batchScores.data());
+	auto batchEnd = chrono::high_resolution_clock::now();
+
+	// Скомпилированная модель
+	vector<float> compiledScores((size_t)samples * Classes);
+	g_compiledModel.classifyBatch(receptors.data(), samples, compiledScores.data());
+	auto compiledEnd = chrono::high_resolution_clock::now();
+
+	int mismatches = 0;
+	for (size_t k = 0; k < planScores.size(); k++) {
+		float a = planScores[k];
+		float b = compiledScores[k];
+		// Переполнение даёт NaN в обоих режимах
+		if (a != b && !(std::isnan(a) && std::isnan(b))) mismatches++;
+	}
+
+	double planSeconds = chrono::duration<double>(planEnd - planStart).count();
+	double batchSeconds = chrono::duration<double>(batchEnd - planEnd).count();
+	double compiledSeconds = chrono::duration<double>(compiledEnd - batchEnd).count();
+	cout << "\n=== Compiled model benchmark ===" << endl;
+	cout << "Inputs: " << samples << endl;
+	cout << "Interpreter time: " << (planSeconds * 1000.0) << " ms (per input), "
+		 << (batchSeconds * 1000.0) << " ms (batch)" << endl;
+	cout << "Compiled time: " << (compiledSeconds * 1000.0) << " ms";
+	if (compiledSeconds > 0.0) cout << " (speedup " << (planSeconds / compiledSeconds) << "x per input, "
+									<< (batchSeconds / compiledSeconds) << "x batch)";
+	cout << endl;
+	cout << "Mismatches vs interpreter: " << mismatches << endl;
+	return (mismatches == 0) ? 0 : 1;
+}
+
+/**
+ * Преобразование файла модели между JSON и двоичным форматом
+ *
+ * Сеть не загружается в глобальное состояние: описание читается
+ * (parseNetworkFile) и записывается в другом формате. С -b сравнивается
+ * время загрузки модели из обоих файлов (чтение и компиляция плана).
+ *
+ * @param format - формат результата
+ * @return 0 при успехе
+ */
+int convertModelFile(const string& inputPath, const string& outputPath, ModelFormat format, bool benchmark) {
+	NetworkDescription network;
+	string error;
+	if (!parseNetworkFile(inputPath, network, error)) {
+		cerr << "Error: " << error << endl;
+		return 1;
+	}
+	bool written = (format == MODEL_BINARY) ? writeModelFile(outputPath, network, error)
+											: writeNetworkJson(outputPath, network, error);
+	if (!written) {
+		cerr << "Error: " << error << endl;
+		return 1;
+	}
+	cout << "Model converted: " << inputPath << " -> " << outputPath << " ("
+		 << (format == MODEL_BINARY ? "binary" : "json") << ", " << network.neuronCount() << " neurons, "
+		 << network.outputs.size() << " classes)" << endl;
+
+	if (benchmark) {
+		const int runs = 20;
+		cout << "\n=== Model load benchmark ===" << endl;
+		for (const string& path : { inputPath, outputPath }) {
+			auto start = chrono::high_resolution_clock::now();
+			for (int run = 0; run < runs; run++) {
+				NetworkDescription loaded;
+				InferencePlan plan;
+				if (!parseNetworkFile(path, loaded, error) || !plan.compile(loaded)) {
+					cerr << "Error: Cannot load " << path << ": " << error << endl;
+					return 1;
+				}
+			}
+			double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+			cout << "Load time (" << (isModelFile(path) ? "binary" : "json") << "): "
+				 << (seconds * 1000.0 / runs) << " ms (" << path << ")" << endl;
+		}
+	}
+	return 0;
+}
+
 // ============================================================================
 // Главная функция
 // ============================================================================
@@ -383,11 +818,24 @@ int main(int argc, char* argv[])
 	string loadPath = "";
 	string retrainPath = "";
 	string inputText = "";
+	string batchPath = "";
+	string streamPath = "";
+	string emitModelPath = "";
+	string emitCppPath = "";
+	string emitLibraryPath = "";
+	string compiledPath = "";
+	StreamFormat streamFormat = STREAM_TSV;
+	ModelFormat modelFormat = MODEL_JSON;
+	bool modelFormatGiven = false;
+	string convertInputPath = "";
+	string convertOutputPath = "";
+	ServerOptions serverOptions;
 	bool testMode = false;
 	bool benchmarkMode = false;
 	bool inferenceMode = false;
 	bool retrainMode = false;
 	bool verifyMode = false;
+	double cacheBudgetMB = -1.0;  // < 0 = определить по лимиту cgroup
 
 	for (int i = 1; i < argc; i++) {
 		string arg = argv[i];
@@ -403,6 +851,41 @@ int main(int argc, char* argv[])
 			retrainMode = true;
 		} else if ((arg == "-i" || arg == "--input") && i + 1 < argc) {
 			inputText = argv[++i];
+		} else if (arg == "--classify-batch" && i + 1 < argc) {
+			batchPath = argv[++i];
+		} else if (arg == "--classify-stream" && i + 1 < argc) {
+			streamPath = argv[++i];
+		} else if (arg == "--stream-format" && i + 1 < argc) {
+			string formatName = argv[++i];
+			if (!parseStreamFormat(formatName, streamFormat)) {
+				cerr << "Error: Unknown stream format '" << formatName << "' (expected tsv or jsonl)" << endl;
+				return 1;
+			}
+		} else if (arg == "--serve" && i + 1 < argc) {
+			serverOptions.socketPath = argv[++i];
+		} else if (arg == "--serve-batch" && i + 1 < argc) {
+			serverOptions.maxBatch = atoi(argv[++i]);
+		} else if (arg == "--serve-wait" && i + 1 < argc) {
+			serverOptions.maxWaitMs = atof(argv[++i]);
+		} else if (arg == "--serve-watch") {
+			serverOptions.watchModel = true;
+		} else if (arg == "--model-format" && i + 1 < argc) {
+			string formatName = argv[++i];
+			if (!parseModelFormat(formatName, modelFormat)) {
+				cerr << "Error: Unknown model format '" << formatName << "' (expected json or binary)" << endl;
+				return 1;
+			}
+			modelFormatGiven = true;
+		} else if (arg == "--convert-model" && i + 2 < argc) {
+			convertInputPath = argv[++i];
+			convertOutputPath = argv[++i];
+		} else if (arg == "--emit-cpp" && i + 2 < argc) {
+			emitModelPath = argv[++i];
+			emitCppPath = argv[++i];
+		} else if (arg == "--emit-so" && i + 1 < argc) {
+			emitLibraryPath = argv[++i];
+		} else if (arg == "--compiled" && i + 1 < argc) {
+			compiledPath = argv[++i];
 		} else if (arg == "-t" || arg == "--test") {
 			testMode = true;
 		} else if (arg == "-b" || arg == "--benchmark") {
@@ -415,6 +898,39 @@ int main(int argc, char* argv[])
 			UseMultithreading = false;
 		} else if (arg == "--no-simd") {
 			UseSIMD = false;
+		} else if (arg == "--simd" && i + 1 < argc) {
+			string tierName = argv[++i];
+			if (!parseSIMDTier(tierName, SelectedSIMDTier)) {
+				cerr << "Error: Unknown SIMD tier '" << tierName << "' (expected scalar, sse4.1, avx2 or avx512)" << endl;
+				return 1;
+			}
+			if (SelectedSIMDTier > SupportedSIMDTier) {
+				cerr << "Error: SIMD tier '" << tierName << "' is not supported by this CPU (best: "
+					<< simdTierName(SupportedSIMDTier) << ")" << endl;
+				return 1;
+			}
+		} else if (arg == "--no-gram") {
+			UseGramScoring = false;
+		} else if (arg == "--no-dedup") {
+			DeduplicateImages = false;
+		} else if (arg == "--huge-pages") {
+			UseHugePages = true;
+		} else if (arg == "--cache-budget" && i + 1 < argc) {
+			cacheBudgetMB = atof(argv[++i]);
+		} else if (arg == "--activations" && i + 1 < argc) {
+			string formatName = argv[++i];
+			if (!parseActivationFormat(formatName, ActivationStorage)) {
+				cerr << "Error: Unknown activation format '" << formatName << "' (expected fp32, fp16 or bf16)" << endl;
+				return 1;
+			}
+		} else if (arg == "--dataset-format" && i + 1 < argc) {
+			string formatName = argv[++i];
+			if (!parseDatasetFormat(formatName, DatasetStorage)) {
+				cerr << "Error: Unknown dataset format '" << formatName << "' (expected fp32 or u8)" << endl;
+				return 1;
+			}
+		} else if (arg == "--dataset-cache" && i + 1 < argc) {
+			DatasetCachePath = argv[++i];
 		} else if (arg == "-h" || arg == "--help") {
 			printUsage(argv[0]);
 			return 0;
@@ -428,6 +944,38 @@ int main(int argc, char* argv[])
 	std::signal(SIGINT, interruptHandler);
 	g_autoSavePath = savePath;
 
+	// ===== РЕЖИМ ПРЕОБРАЗОВАНИЯ МОДЕЛИ =====
+	// По умолчанию JSON преобразуется в двоичный формат и обратно
+	if (!convertInputPath.empty()) {
+		if (!modelFormatGiven) {
+			modelFormat = isModelFile(convertInputPath) ? MODEL_JSON : MODEL_BINARY;
+		}
+		return convertModelFile(convertInputPath, convertOutputPath, modelFormat, benchmarkMode);
+	}
+
+	// ===== РЕЖИМ ГЕНЕРАЦИИ КОДА =====
+	// Генерируем C++ код модели и, при необходимости, собираем библиотеку
+	if (!emitCppPath.empty()) {
+		if (!loadNetwork(emitModelPath) || !compileInferencePlan()) {
+			return 1;
+		}
+		if (!emitModelCpp(g_inferencePlan, classes, emitCppPath, emitModelPath)) {
+			return 1;
+		}
+		if (emitLibraryPath.empty()) {
+			return 0;
+		}
+		if (!buildModelLibrary(emitCppPath, emitLibraryPath) || !g_compiledModel.load(emitLibraryPath)) {
+			return 1;
+		}
+		cout << "Compiled model: " << emitLibraryPath << endl;
+		return benchmarkMode ? benchmarkCompiledModel() : 0;
+	}
+	if (!emitLibraryPath.empty()) {
+		cerr << "Error: --emit-so requires --emit-cpp <model.json> <out.cpp>" << endl;
+		return 1;
+	}
+
 	// ===== РЕЖИМ ВЕРИФИКАЦИИ ТОЧНОСТИ =====
 	// Загружаем обученную сеть и тестируем на данных из конфига
 	if (verifyMode) {
@@ -441,13 +989,13 @@ int main(int argc, char* argv[])
 		}
 
 		// Загружаем сеть
-		if (!loadNetwork(loadPath)) {
+		if (!loadNetwork(loadPath) || !compileInferencePlan()) {
 			return 1;
 		}
 
 		// Загружаем конфиг для тестовых данных (сохраняем текущие Receptors для проверки)
 		int savedReceptors = Receptors;
-		if (!loadConfig(configPath, Receptors)) {
+		if (!loadConfigCached(configPath, DatasetCachePath, Receptors)) {
 			return 1;
 		}
 
@@ -461,32 +1009,41 @@ int main(int argc, char* argv[])
 
 		int passed = 0;
 		int failed = 0;
-		int total = const_words.size();
+		int total = g_dataset.size();
+
+		// Значение d-го входа сети для образа img
+		auto imageInput = [](int img, int d) -> float {
+			return float(g_dataset.code(img, d)) / float(max_num);
+		};
+
+		// Выходы и предсказания fp32 для сравнения с 16-битным хранением
+		vector<float> fp32Outputs((size_t)total * Classes);
+		vector<int> fp32Predicted(total);
 
 		for (int img = 0; img < total; img++) {
 			// Устанавливаем входы сети из образа
+			float* input = g_inferenceContext.input();
 			for (int d = 0; d < Receptors; d++) {
-				if (d < (int)const_words[img].word.length() && const_words[img].word[d] != 0) {
-					NetInput[d] = float((unsigned char)const_words[img].word[d]) / float(max_num);
-				} else {
-					NetInput[d] = float((unsigned char)' ') / float(max_num);
-				}
+				input[d] = imageInput(img, d);
 			}
-			clear_val_cache(nei, MAX_NEURONS);
+			g_inferenceContext.evaluate();
 
 			// Находим класс с максимальным выходом
 			int predictedClass = -1;
 			float maxOutput = -big;
 			for (int c = 0; c < Classes; c++) {
-				float output = GetNeironVal(NetOutput[c]);
+				float output = g_inferenceContext.output(c);
+				fp32Outputs[(size_t)img * Classes + c] = output;
 				if (output > maxOutput) {
 					maxOutput = output;
 					predictedClass = c;
 				}
 			}
 
-			int expectedClass = const_words[img].id;
-			float expectedOutput = (expectedClass < Classes) ? GetNeironVal(NetOutput[expectedClass]) : 0.0f;
+			fp32Predicted[img] = predictedClass;
+
+			int expectedClass = g_dataset.id(img);
+			float expectedOutput = (expectedClass < Classes) ? g_inferenceContext.output(expectedClass) : 0.0f;
 
 			// Проверяем корректность
 			bool testPassed = (predictedClass == expectedClass) || (expectedOutput >= 0.5f);
@@ -495,7 +1052,7 @@ int main(int argc, char* argv[])
 				passed++;
 			} else {
 				failed++;
-				string shortWord = const_words[img].word.substr(0, 10);
+				string shortWord = g_dataset.text(img).substr(0, 10);
 				cout << "[FAIL] \"" << shortWord << "...\" expected class " << expectedClass
 					 << ", predicted " << predictedClass << " (conf=" << (int)(expectedOutput*100) << "%)" << endl;
 			}
@@ -508,16 +1065,96 @@ int main(int argc, char* argv[])
 		float accuracy = (float)passed / (float)total * 100.0f;
 		cout << "Accuracy: " << accuracy << "%" << endl;
 
-		return (failed == 0) ? 0 : 1;
+		// Сравнение с 16-битным хранением кэшей: те же образы считаются
+		// пакетно через GetNeironVector(), как при обучении
+		int storageFailed = 0;
+		if (ActivationStorage != ACTIVATION_FP32) {
+			Images = total;
+			g_receptorMatrix.reset(Receptors, Images, DatasetStorage, max_num);
+			vector<uint8_t> codes(Receptors);
+			for (int img = 0; img < Images; img++) {
+				g_dataset.codes(img, codes.data());
+				g_receptorMatrix.setImage(img, codes.data());
+			}
+			if (!initNeurons()) {
+				cerr << "Error: Cannot reserve neuron caches (" << MAX_NEURONS << " x " << Images << " values)" << endl;
+				return 1;
+			}
+
+			vector<vector<float>> outputs(Classes, vector<float>(Images));
+			for (int c = 0; c < Classes; c++) {
+				GetNeironVector(NetOutput[c]).widen(outputs[c].data(), Images);
+			}
+
+			int storagePassed = 0;
+			int changedPredictions = 0;
+			float maxDifference = 0.0f;
+			for (int img = 0; img < Images; img++) {
+				int predictedClass = -1;
+				float maxOutput = -big;
+				for (int c = 0; c < Classes; c++) {
+					float output = outputs[c][img];
+					maxDifference = max(maxDifference, fabsf(output - fp32Outputs[(size_t)img * Classes + c]));
+					if (output > maxOutput) {
+						maxOutput = output;
+						predictedClass = c;
+					}
+				}
+				if (predictedClass != fp32Predicted[img]) changedPredictions++;
+
+				int expectedClass = g_dataset.id(img);
+				float expectedOutput = (expectedClass < Classes) ? outputs[expectedClass][img] : 0.0f;
+				if ((predictedClass == expectedClass) || (expectedOutput >= 0.5f)) {
+					storagePassed++;
+				} else {
+					storageFailed++;
+				}
+			}
+
+			const char* formatName = activationFormatName(ActivationStorage);
+			cout << "\n=== " << formatName << " storage vs fp32 ===" << endl;
+			cout << "Accuracy: " << ((float)storagePassed / (float)Images * 100.0f) << "% ("
+				 << formatName << "), " << accuracy << "% (fp32)" << endl;
+			cout << "Changed predictions: " << changedPredictions << endl;
+			cout << "Max output difference: " << maxDifference << endl;
+		}
+
+		return (failed == 0 && storageFailed == 0) ? 0 : 1;
 	}
 
 	// ===== РЕЖИМ ИНФЕРЕНСА =====
 	// Загружаем обученную сеть и переходим к классификации
 	if (inferenceMode && !retrainMode) {
-		if (!loadNetwork(loadPath)) {
+		// В потоковом режиме stdout занят результатами: сообщения загрузки идут в stderr
+		streambuf* coutBuffer = cout.rdbuf();
+		if (!streamPath.empty()) cout.rdbuf(cerr.rdbuf());
+		bool loaded = loadNetwork(loadPath) && compileInferencePlan();
+		if (loaded && !compiledPath.empty()) {
+			loaded = loadCompiledModel(compiledPath);
+		}
+		cout.rdbuf(coutBuffer);
+		if (!loaded) {
 			return 1;
 		}
 
+		// Если задан поток входов - классифицируем его построчно и выходим
+		if (!streamPath.empty()) {
+			return classifyStream(streamPath, streamFormat);
+		}
+
+		// Если задан сокет - обслуживаем запросы до остановки сервера
+		if (!serverOptions.socketPath.empty()) {
+			serverOptions.modelPath = loadPath;
+			serverOptions.format = streamFormat;
+			serverOptions.benchmark = benchmarkMode;
+			return serveModel(serverOptions);
+		}
+
+		// Если задан файл входов - классифицируем пакетом и выходим
+		if (!batchPath.empty()) {
+			return classifyBatchFile(batchPath, benchmarkMode);
+		}
+
 		// Если задан входной текст - классифицируем и выходим
 		if (!inputText.empty()) {
 			cout << "\nClassifying: \"" << inputText << "\"" << endl;
@@ -581,7 +1218,7 @@ int main(int argc, char* argv[])
 	// Загружаем конфигурацию или используем значения по умолчанию (если не дообучение)
 	if (!retrainMode) {
 		if (!configPath.empty()) {
-			if (!loadConfig(configPath, Receptors)) {
+			if (!loadConfigCached(configPath, DatasetCachePath, Receptors)) {
 				return 1;
 			}
 		} else {
@@ -615,8 +1252,28 @@ int main(int argc, char* argv[])
 	// Вывод информации о SIMD
 	cout << "SIMD: " << getSIMDInfo() << (UseSIMD ? "" : " (disabled via --no-simd)") << endl;
 
+	// Бюджет памяти кэшей нейронов: из командной строки или по лимиту контейнера
+	string cacheBudgetSource = "--cache-budget";
+	if (cacheBudgetMB >= 0.0) {
+		CacheBudgetBytes = (size_t)(cacheBudgetMB * 1024.0 * 1024.0);
+	} else {
+		size_t cgroupLimit = detectCgroupMemoryLimit();
+		CacheBudgetBytes = cgroupLimit / 4 * 3;
+		cacheBudgetSource = "cgroup limit";
+	}
+
+	// Одинаковые образы обучаются одним с весом: ошибка та же, перебор короче
+	if (DeduplicateImages) {
+		deduplicateDataset();
+	}
+
 	// Вычисляем производные значения после загрузки конфигурации
-	Images = const_words.size();
+	Images = g_dataset.size();
+	ImageWeights.clear();
+	if (g_dataset.hasWeights()) {
+		ImageWeights.resize(Images);
+		for (int img = 0; img < Images; img++) ImageWeights[img] = g_dataset.weight(img);
+	}
 	Inputs = Receptors + base_size;
 
 	// В режиме дообучения Neirons уже установлен из загруженной сети
@@ -626,53 +1283,44 @@ int main(int argc, char* argv[])
 
 	// Выделяем динамические массивы
 	NetInput.resize(Inputs);
-	vx.resize(Images);
-	for (int i = 0; i < Images; i++) {
-		vx[i].resize(Receptors);
-	}
+	g_receptorMatrix.reset(Receptors, Images, DatasetStorage, max_num);
 	vz.resize(Classes);
 	NetOutput.resize(Classes);
 
-	// Инициализируем массив нейронов
-	// В режиме дообучения нейроны уже инициализированы, но нужно расширить кэши под новые образы
-	if (retrainMode) {
-		// Расширяем кэши под новое количество образов
-		for (int n = 0; n < MAX_NEURONS; n++) {
-			nei[n].c.resize(Images);
-			nei[n].cached = false;  // Сбрасываем кэши, т.к. теперь другое количество образов
-		}
+	// Инициализируем массив нейронов и область их кэшей
+	// В режиме дообучения структура нейронов уже загружена: initNeurons() её не меняет,
+	// а только выделяет кэши под новое количество образов и сбрасывает флаги
+	if (!initNeurons()) {
+		cerr << "Error: Cannot reserve neuron caches (" << MAX_NEURONS << " x " << Images << " values)" << endl;
+		return 1;
+	}
+	if (g_activationCache.isBounded()) {
+		cout << "Neuron cache: " << (CacheBudgetBytes / 1024) << " KB budget (" << cacheBudgetSource
+			 << "), " << g_activationCache.slots() << " of " << MAX_NEURONS << " neurons resident, "
+			 << activationFormatName(ActivationStorage) << " storage" << endl;
 	} else {
-		initNeurons();
+		cout << "Neuron cache: unlimited, " << activationFormatName(ActivationStorage) << " storage" << endl;
 	}
+	cout << "Dataset: " << Receptors << " receptors x " << Images << " images, "
+		 << activationFormatName(DatasetStorage) << " (" << (g_receptorMatrix.bytes() / 1024) << " KB), "
+		 << g_dataset.words() << " words (" << (g_dataset.bytes() / 1024) << " KB)" << endl;
 
 	// Задаём базисные значения
 	for (int i = 0; i < base_size; i++)
 		NetInput[i + Receptors] = base[i];
 
-	// Генерируем образы из слов
+	// Заполняем матрицу входов кодами образов (пары слово/сдвиг набора)
+	vector<uint8_t> imageCodes(Receptors);
 	for (int index = 0; index < Images; index++)
 	{
-		memset(word_buf, 0, StringSize);
-		strcpy_s(word_buf, const_words[index].word.c_str());
-		cout << "img:" << const_words[index].word << endl;
-
-		for (int d = 0; d < Receptors; d++)
-		{
-			if (word_buf[d] == 0)
-			{
-				// Заполняем оставшиеся позиции пробелами
-				for (; d < Receptors; d++)
-					vx[index][d] = float((unsigned char)' ') / float(max_num);
-
-				break;
-			}
-			else
-			{
-				vx[index][d] = float((unsigned char)word_buf[d]) / float(max_num);
-			}
-		}
+		g_dataset.codes(index, imageCodes.data());
+		cout << "img:" << string(imageCodes.begin(), imageCodes.end()) << endl;
+		g_receptorMatrix.setImage(index, imageCodes.data());
 	}
 
+	// Векторы нейронов загруженной сети (в режиме дообучения)
+	updateNeuronCache();
+
 	int classIndex = 0;
 	// Отслеживаем ошибку для каждого класса
 	vector<float> class_er(Classes, big);
@@ -712,7 +1360,7 @@ int main(int argc, char* argv[])
 		vz.resize(Images);
 		for (int img = 0; img < Images; img++)
 		{
-			if (const_words[img].id == classIndex)
+			if (g_dataset.id(img) == classIndex)
 				vz[img] = 1.0;  // Образ принадлежит обучаемому классу
 			else
 				vz[img] = 0.0;  // Образ НЕ принадлежит классу
@@ -730,6 +1378,8 @@ int main(int argc, char* argv[])
 					LearningFunc func = getLearningFunc(funcName);
 					if (func != nullptr) {
 						float newError = func();
+						registerNewNeurons();
+						updateNeuronCache();
 						if (newError < class_er[classIndex]) {
 							class_er[classIndex] = newError;
 							NetOutput[classIndex] = Neirons - 1;
@@ -741,6 +1391,8 @@ int main(int argc, char* argv[])
 			} else {
 				// По умолчанию: используем triplet_random_parallel (rndrod4_parallel)
 				class_er[classIndex] = triplet_random_parallel();
+				registerNewNeurons();
+				updateNeuronCache();
 				NetOutput[classIndex] = Neirons - 1;
 			}
 		}
@@ -791,7 +1443,7 @@ int main(int argc, char* argv[])
 
 	// Сохраняем сеть если указан путь
 	if (!savePath.empty()) {
-		if (!saveNetwork(savePath)) {
+		if (!saveNetwork(savePath, modelFormat)) {
 			cerr << "Warning: Failed to save network to " << savePath << endl;
 		} else if (trainingInterrupted) {
 			cout << "\nNetwork state saved. To continue training, use:" << endl;
@@ -812,6 +1464,17 @@ int main(int argc, char* argv[])
 		cout << "  Neurons created: " << (Neirons - Inputs) << endl;
 		cout << "  Threads: " << NumThreads << (UseMultithreading ? " (multithreaded)" : " (single-threaded)") << endl;
 		cout << "  SIMD: " << getSIMDInfo() << (UseSIMD ? " (enabled)" : " (disabled)") << endl;
+		cout << "Memory:" << endl;
+		ActivationCache::Stats cacheStats = g_activationCache.stats();
+		unsigned long long cacheLookups = cacheStats.hits + cacheStats.misses;
+		cout << "  Neuron caches committed: " << g_activationCache.arena().committedRows() << " of "
+			 << g_activationCache.slots() << " slots (" << (g_activationCache.arena().committedBytes() / 1024) << " KB)" << endl;
+		cout << "  Cache hits: " << cacheStats.hits << ", misses: " << cacheStats.misses
+			 << ", evictions: " << cacheStats.evictions;
+		if (cacheLookups > 0) {
+			cout << " (hit rate " << (100.0 * cacheStats.hits / cacheLookups) << "%)";
+		}
+		cout << endl;
 		cout << "Timing:" << endl;
 		cout << "  Training time: " << trainingDuration.count() << " ms" << endl;
 		cout << "  Training iterations: " << trainingIterations << endl;
@@ -830,6 +1493,11 @@ int main(int argc, char* argv[])
 		return 0;
 	}
 
+	// Компилируем план инференса обученной сети для тестирования и интерактивного режима
+	if (!compileInferencePlan()) {
+		return 1;
+	}
+
 	// Режим тестирования: проверяем точность классификации
 	if (testMode) {
 		cout << "\n=== Running automated classification test ===" << endl;
@@ -837,26 +1505,29 @@ int main(int argc, char* argv[])
 		int failed = 0;
 		float threshold = 0.5f;  // Порог классификации
 
+		// Одинаковые образы сведены в один (deduplicateDataset): он
+		// учитывается столько раз, сколько образов исходного набора заменил
 		for (int img = 0; img < Images; img++) {
-			// Устанавливаем входы сети для текущего образа
-			for (int d = 0; d < Receptors; d++) {
-				NetInput[d] = vx[img][d];
-			}
-			clear_val_cache(nei, MAX_NEURONS);
+			const int count = (int)lround(g_dataset.weight(img));
+			const string repeats = (count > 1) ? " x" + to_string(count) : "";
+
+			// Вычисляем выходы сети для текущего образа
+			g_receptorMatrix.image(img, g_inferenceContext.input());
+			g_inferenceContext.evaluate();
 
 			// Находим класс с максимальным выходом
 			int predictedClass = -1;
 			float maxOutput = -big;
 			for (int c = 0; c < Classes; c++) {
-				float output = GetNeironVal(NetOutput[c]);
+				float output = g_inferenceContext.output(c);
 				if (output > maxOutput) {
 					maxOutput = output;
 					predictedClass = c;
 				}
 			}
 
-			int expectedClass = const_words[img].id;
-			float expectedOutput = GetNeironVal(NetOutput[expectedClass]);
+			int expectedClass = g_dataset.id(img);
+			float expectedOutput = g_inferenceContext.output(expectedClass);
 
 			// Тест проходит если:
 			// 1. Предсказанный класс совпадает с ожидаемым, ИЛИ
@@ -864,25 +1535,26 @@ int main(int argc, char* argv[])
 			bool testPassed = (predictedClass == expectedClass) || (expectedOutput >= threshold);
 
 			if (testPassed) {
-				passed++;
-				cout << "[PASS] Image " << img << " (\"" << const_words[img].word.substr(0, 10)
+				passed += count;
+				cout << "[PASS] Image " << img << repeats << " (\"" << g_dataset.text(img).substr(0, 10)
 					 << "...\"): expected class " << expectedClass
 					 << ", predicted " << predictedClass
 					 << " (output=" << expectedOutput << ")" << endl;
 			} else {
-				failed++;
-				cout << "[FAIL] Image " << img << " (\"" << const_words[img].word.substr(0, 10)
+				failed += count;
+				cout << "[FAIL] Image " << img << repeats << " (\"" << g_dataset.text(img).substr(0, 10)
 					 << "...\"): expected class " << expectedClass
 					 << ", predicted " << predictedClass
 					 << " (output=" << expectedOutput << ")" << endl;
 			}
 		}
 
+		const int total = passed + failed;
 		cout << "\n=== Test Summary ===" << endl;
-		cout << "Total images: " << Images << endl;
+		cout << "Total images: " << total << endl;
 		cout << "Passed: " << passed << endl;
 		cout << "Failed: " << failed << endl;
-		float accuracy = (float)passed / (float)Images * 100.0f;
+		float accuracy = (float)passed / (float)total * 100.0f;
 		cout << "Accuracy: " << accuracy << "%" << endl;
 
 		if (failed == 0) {
@@ -910,31 +1582,8 @@ int main(int argc, char* argv[])
 
 		if (cmp("Q") || cmp("q")) return 0;
 
-		// Устанавливаем входные значения
-		for (int d = 0; d < Receptors; d++)
-		{
-			if (word_buf[d] == 0)
-			{
-				NetInput[d] = float((unsigned char)' ') / float(max_num);
-			}
-			else
-			{
-				NetInput[d] = float((unsigned char)word_buf[d]) / float(max_num);
-			}
-		}
-
-		clear_val_cache(nei, MAX_NEURONS);
-
 		// Выводим состояние выходов нейросети
-		for (int out = 0; out < Classes; out++)
-		{
-			float z1 = GetNeironVal(NetOutput[out]) * 100.0f;
-			// Обработка некорректных значений
-			if (!std::isfinite(z1)) z1 = 0.0f;
-			if (z1 < 0.0f) z1 = 0.0f;
-			if (z1 > 100.0f) z1 = 100.0f;
-			cout << long(z1) << "%" << " - " << classes[out] << endl;
-		}
+		classifyInput(word_buf);
 
 	} while (true);
 }